@@ -185,6 +185,30 @@ SOURCE=..\..\src\tmbstr.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\src\intern.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\nodes.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\batch.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\arena.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\perfhash.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\textscan.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\src\utf8.c
 # End Source File
 # Begin Source File
@@ -281,6 +305,26 @@ SOURCE=..\..\src\tmbstr.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\src\intern.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\nodes.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\arena.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\perfhash.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\src\textscan.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\src\utf8.h
 # End Source File
 # Begin Source File
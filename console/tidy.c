@@ -14,6 +14,10 @@
 */
 
 #include "tidy.h"
+#include "buffio.h"
+
+#include <errno.h>
+#include <limits.h>
 
 static FILE* errout = NULL;  /* set to stderr */
 /* static FILE* txtout = NULL; */  /* set to stdout */
@@ -163,6 +167,11 @@ static const CmdOptDesc cmdopt_defs[] =  {
     { "-modify",
       "modify the original input files",
       "write-back: yes", CmdOptFileManip, "-m" },
+    { "-jobs <number>",
+      "tidy up to <number> files at a time, each in its own thread"
+      ". 0, or <number> missing, means one per processor. "
+      "Messages and output still come file by file, in order.",
+      NULL, CmdOptFileManip, "-j <number>" },
     { "-indent",
       "indent element content",
       "indent: auto", CmdOptProcDir, "-i" },
@@ -915,6 +924,115 @@ static void unknownOption( uint c )
     fprintf( errout, "HTML Tidy: unknown option: %c\n", (char)c );
 }
 
+/* With -jobs, each run of file names on the command line is tidied
+** as a batch, each file by its own document with tdoc's settings.
+** The files go to tidyProcessBatch() JOB_WINDOW at a time, to bound
+** the output held back while an earlier file is still being tidied.
+*/
+#define JOB_WINDOW 256
+
+typedef struct {
+    ctmbstr* files;
+    uint     count;
+    uint     size;
+} Jobs;
+
+static void addJob( Jobs* jobs, ctmbstr htmlfil )
+{
+    if ( jobs->count == jobs->size )
+    {
+        jobs->size = jobs->size ? 2 * jobs->size : 64;
+        jobs->files = (ctmbstr*) realloc( (void*) jobs->files,
+                                          jobs->size * sizeof(ctmbstr) );
+        if ( !jobs->files )
+            outOfMemory();
+    }
+    jobs->files[ jobs->count++ ] = htmlfil;
+}
+
+/* Called for each file of a batch, in order */
+static void TIDY_CALL jobDone( TidyBatchItem* item, uint ARG_UNUSED(ix),
+                               void* ARG_UNUSED(appData) )
+{
+    if ( item->messages->size > 0 )
+        fwrite( item->messages->bp, 1, item->messages->size, errout );
+    if ( item->output && item->output->size > 0 )
+        fwrite( item->output->bp, 1, item->output->size, stdout );
+    tidyBufFree( item->messages );
+    if ( item->output )
+        tidyBufFree( item->output );
+}
+
+static void runJobs( TidyDoc tdoc, Jobs* jobs, uint threads,
+                     uint* contentErrors, uint* contentWarnings,
+                     uint* accessWarnings )
+{
+    TidyBatchItem items[ JOB_WINDOW ];
+    TidyBuffer messages[ JOB_WINDOW ];
+    TidyBuffer output[ JOB_WINDOW ];
+    ctmbstr outfil = tidyOptGetValue( tdoc, TidyOutFile );
+    uint start, i, n;
+
+    for ( start = 0; start < jobs->count; start += n )
+    {
+        n = jobs->count - start;
+        if ( n > JOB_WINDOW )
+            n = JOB_WINDOW;
+
+        memset( items, 0, n * sizeof(TidyBatchItem) );
+        for ( i = 0; i < n; ++i )
+        {
+            TidyBatchItem* item = items + i;
+            item->file = jobs->files[ start + i ];
+            item->messages = messages + i;
+            tidyBufInit( item->messages );
+
+            /* Each file would overwrite the output file, so only
+            ** the last one is written.
+            */
+            if ( tidyOptGetBool(tdoc, TidyWriteBack) )
+                item->outFile = item->file;
+            else if ( outfil && start + i + 1 == jobs->count )
+                item->outFile = outfil;
+            else if ( !outfil )
+            {
+                item->output = output + i;
+                tidyBufInit( item->output );
+            }
+        }
+
+        tidyProcessBatch( tdoc, items, n, threads, jobDone, NULL );
+
+        for ( i = 0; i < n; ++i )
+        {
+            *contentErrors   += items[i].errorCount;
+            *contentWarnings += items[i].warningCount;
+            *accessWarnings  += items[i].accessWarningCount;
+        }
+    }
+    jobs->count = 0;
+}
+
+/* A thread count for -jobs is all digits; anything else, such as
+** 2019-report.html or -1, is left to be taken as a file or option.
+*/
+static Bool jobCount( ctmbstr arg, uint* threads )
+{
+    char* end = NULL;
+    unsigned long n;
+
+    if ( arg[0] < '0' || arg[0] > '9' )
+        return no;
+
+    errno = 0;
+    n = strtoul( arg, &end, 10 );
+    if ( *end != '\0' || errno == ERANGE || n > UINT_MAX )
+        return no;
+
+    *threads = (uint) n;
+    return yes;
+}
+
 int main( int argc, char** argv )
 {
     ctmbstr prog = argv[0];
@@ -926,6 +1044,10 @@ int main( int argc, char** argv )
     uint contentWarnings = 0;
     uint accessWarnings = 0;
 
+    Jobs jobs = { NULL, 0, 0 };
+    Bool useJobs = no;
+    uint threads = 0;
+
     errout = stderr;  /* initialize to stderr */
     status = 0;
     
@@ -1135,6 +1257,18 @@ int main( int argc, char** argv )
                     }
                 }
             }
+            else if ( strcasecmp(arg,  "jobs") == 0 ||
+                      strcasecmp(arg, "-jobs") == 0 ||
+                      strcasecmp(arg,     "j") == 0 )
+            {
+                useJobs = yes;
+                threads = 0;
+                if ( argc >= 3 && jobCount(argv[2], &threads) )
+                {
+                    --argc;
+                    ++argv;
+                }
+            }
             else if ( strcasecmp(arg,  "version") == 0 ||
                       strcasecmp(arg, "-version") == 0 ||
                       strcasecmp(arg,        "v") == 0 )
@@ -1239,6 +1373,21 @@ int main( int argc, char** argv )
             continue;
         }
 
+        if ( useJobs && argc > 1 )
+        {
+            /* Tidy the run of files once an option or the end follows */
+            addJob( &jobs, argv[1] );
+            if ( argc <= 2 || argv[2][0] == '-' )
+                runJobs( tdoc, &jobs, threads,
+                         &contentErrors, &contentWarnings, &accessWarnings );
+
+            --argc;
+            ++argv;
+            if ( argc <= 1 )
+                break;
+            continue;
+        }
+
         if ( argc > 1 )
         {
             htmlfil = argv[1];
@@ -1299,6 +1448,7 @@ int main( int argc, char** argv )
 
     /* called to free hash tables etc. */
     tidyRelease( tdoc );
+    free( (void*) jobs.files );
 
     /* return status can be used by scripts */
     if ( contentErrors > 0 )
@@ -575,6 +575,35 @@ typedef const tmbchar* ctmbstr; /* Ditto, but const */
 # define SUPPORT_POSIX_MAPPED_FILES 1
 #endif
 
+/* SUPPORT_DOC_ARENA makes each document take its small blocks of
+   memory from an arena, see src/arena.h, rather than asking the
+   allocator it was created with for every one. */
+#ifndef SUPPORT_DOC_ARENA
+# define SUPPORT_DOC_ARENA 1
+#endif
+
+/* SUPPORT_COMPACT_NODES keeps each document's nodes in arrays of
+   their own, linked by 32-bit indices rather than pointers, see
+   src/nodes.h.  A node then takes less than half the memory, for
+   some cost in speed, and a document must be under 4GB. */
+#ifndef SUPPORT_COMPACT_NODES
+# define SUPPORT_COMPACT_NODES 0
+#endif
+
+/* SUPPORT_BATCH_THREADS lets tidyProcessBatch() spread its work
+   over a pool of threads, using POSIX threads or, on Windows, the
+   Win32 API.  Define it to 0 to do the batch on the calling thread. */
+#ifndef SUPPORT_BATCH_THREADS
+# define SUPPORT_BATCH_THREADS 1
+#endif
+
+/* SUPPORT_SIMD_SCAN enables SSE2/AVX2 scanning of input text where
+   the compiler and target allow it.  Define it to 0 to always use
+   the portable byte loops. */
+#ifndef SUPPORT_SIMD_SCAN
+# define SUPPORT_SIMD_SCAN 1
+#endif
+
 /*
   bool is a reserved word in some but
   not all C++ compilers depending on age
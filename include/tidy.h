@@ -153,6 +153,20 @@ typedef struct _TidyBuffer TidyBuffer;
 ** memory usage is an issue then an allocator that 
 ** can reuse this memory is a good idea.
 **
+** Unless built with SUPPORT_DOC_ARENA set to 0, a
+** document asks its allocator for the blocks of 256
+** bytes or less in 64K pieces, which it reuses itself
+** and frees all together on tidyRelease().
+**
+** tidyMemoryUsed() and tidyMemoryPeak() tell how much
+** a document has allocated, and for what.
+**
+** The malloc(), realloc(), free() and panic replacements
+** below are shared by the whole process.  Set them before
+** creating any document, and not while documents are in use
+** on other threads.  An allocator given to several documents
+** used on different threads must itself be thread safe.
+**
 ** @{
 */
 
@@ -263,6 +277,12 @@ TIDY_EXPORT Bool TIDY_CALL tidySetPanicCall( TidyPanic fpanic );
 ** >0   -> 1 == TIDY WARNING, 2 == TIDY ERROR
 ** <0   -> SEVERE ERROR
 ** </pre>
+**
+** Tidy keeps no state outside its documents, other than the
+** memory hooks set before any document is created, so different
+** documents may be created, used and released on different threads
+** at once.  A single document must only be used by one thread at a
+** time.  tidyProcessBatch() runs many documents on a thread pool.
 ** 
 The following is a short example program.
 
@@ -322,6 +342,16 @@ TIDY_EXPORT TidyDoc TIDY_CALL     tidyCreate(void);
 TIDY_EXPORT TidyDoc TIDY_CALL     tidyCreateWithAllocator( TidyAllocator *allocator );
 TIDY_EXPORT void TIDY_CALL        tidyRelease( TidyDoc tdoc );
 
+/** Forget the document parsed last, ready for another.  Unlike
+**  tidyRelease() followed by tidyCreate(), this keeps the options
+**  and the buffers and tables already allocated, so that a loop
+**  reusing one TidyDoc soon allocates little for each document.
+**  Counts of errors and warnings start again from zero.
+**  Must not be called while a document is being parsed or saved.
+**  Returns 0, or -EINVAL if tdoc is invalid.
+*/
+TIDY_EXPORT int TIDY_CALL         tidyDocReset( TidyDoc tdoc );
+
 /** Let application store a chunk of data w/ each Tidy instance.
 **  Useful for callbacks.
 */
@@ -362,6 +392,17 @@ TIDY_EXPORT uint TIDY_CALL        tidyAccessWarningCount( TidyDoc tdoc );
 /** Number of Tidy configuration errors encountered. */
 TIDY_EXPORT uint TIDY_CALL        tidyConfigErrorCount( TidyDoc tdoc );
 
+/** Bytes of memory the document has in use for kind, or for
+**  everything with TidyMemTotal.  The TidyMemoryLimit option caps
+**  the total while parsing.
+*/
+TIDY_EXPORT size_t TIDY_CALL      tidyMemoryUsed( TidyDoc tdoc, TidyMemKind kind );
+
+/** Most bytes the document has had in use for kind since it last
+**  started parsing a document.
+*/
+TIDY_EXPORT size_t TIDY_CALL      tidyMemoryPeak( TidyDoc tdoc, TidyMemKind kind );
+
 /* Get/Set configuration options
 */
 /** Load an ASCII Tidy configuration file */
@@ -667,6 +708,38 @@ TIDY_EXPORT int TIDY_CALL         tidyParseBuffer( TidyDoc tdoc, TidyBuffer* buf
 /** Parse markup in given generic input source */
 TIDY_EXPORT int TIDY_CALL         tidyParseSource( TidyDoc tdoc, TidyInputSource* source);
 
+/** Parse markup delivered in pieces, e.g. as it arrives from the
+**  network.  Pass each chunk in turn, setting isFinal on the last one,
+**  which may be empty.  Each call parses as far as the input goes and
+**  keeps the parse's state in the document until the next one, so only
+**  input not yet read is held; no call ever waits for input.  The
+**  result is the same as tidyParseBuffer() on the whole of it, and the
+**  document is not to be used otherwise until the final call.  Another
+**  parse, tidyDocReset() or tidyRelease() drops one in progress.
+**  Returns 0 until then, and the parse status after.
+*/
+TIDY_EXPORT int TIDY_CALL         tidyParseChunk( TidyDoc tdoc, const byte* bytes,
+                                                  uint len, Bool isFinal );
+
+/** Callback for the tokens of a scanned document.  Type, name, id,
+**  attributes, position and value are read with the usual node
+**  functions, but the node is only valid during the call and has no
+**  parent, children or siblings.  Inferred tags have no attributes.
+**  Return true to go on scanning, false to stop.
+*/
+typedef Bool (TIDY_CALL *TidyTokenCallback)( TidyDoc tdoc, TidyNode tok );
+
+/** Scan rather than parse: once a token callback is given, the parse
+**  functions pass it each start tag, end tag, text, comment, doctype
+**  etc. as it is read, and build no document tree.  With inferTags,
+**  the html, head and body elements and omitted end tags are supplied
+**  as Tidy's parser would, e.g. </p> before a block or </li> before
+**  the next <li>.  Pass NULL to parse as usual again.
+*/
+TIDY_EXPORT Bool TIDY_CALL        tidySetTokenCallback( TidyDoc tdoc,
+                                                        TidyTokenCallback tokCallback,
+                                                        Bool inferTags );
+
 /** @} End Parse group */
 
 
@@ -714,6 +787,58 @@ TIDY_EXPORT int TIDY_CALL         tidySaveSink( TidyDoc tdoc, TidyOutputSink* si
 /** @} end Save group */
 
 
+/** @defgroup Batch Batch Processing
+**
+** Parse, clean and save many documents at once, on a pool of
+** threads.
+** @{
+*/
+
+/** One document in a batch.  Set file, or input if file is NULL.
+**  The markup is saved to outFile if that is set, else to output;
+**  messages are written to messages, encoded as config's error output
+**  would write them.  output and messages may be NULL to discard
+**  them.  The rest is filled in by tidyProcessBatch().
+*/
+typedef struct _TidyBatchItem
+{
+    ctmbstr     file;       /**< Input file name */
+    TidyBuffer* input;      /**< Input, if file is NULL */
+    ctmbstr     outFile;    /**< File to save the markup to */
+    TidyBuffer* output;     /**< Markup, if outFile is NULL */
+    TidyBuffer* messages;   /**< Messages */
+    void*       appData;    /**< Application data for the document */
+
+    int         status;     /**< As for tidyParseFile() etc. */
+    uint        errorCount;
+    uint        warningCount;
+    uint        accessWarningCount;
+} TidyBatchItem;
+
+/** Called with each item of a batch once it is done, in input order.
+**  Calls are made one at a time, but from any of the batch's threads.
+*/
+typedef void (TIDY_CALL *TidyBatchCallback)( TidyBatchItem* item, uint index,
+                                             void* appData );
+
+/** Tidy count items, each with a new document configured as config,
+**  on up to threads threads, or one per processor if threads is 0.
+**  Each document is parsed, cleaned, checked and saved as the tidy
+**  console tool does it.  Idle threads take work from busy ones.
+**  The documents use config's allocator, which must be thread safe,
+**  and config must not be changed until the call returns.  Returns
+**  the most severe of the items' statuses.  Afterwards
+**  tidyErrorSummary( config ) explains the problems of all the items.
+*/
+TIDY_EXPORT int TIDY_CALL         tidyProcessBatch( TidyDoc config,
+                                                    TidyBatchItem* items,
+                                                    uint count, uint threads,
+                                                    TidyBatchCallback callback,
+                                                    void* appData );
+
+/** @} end Batch group */
+
+
 /** @addtogroup Basic
 ** @{
 */
@@ -204,6 +204,7 @@ typedef enum
   TidySortAttributes,      /**< Sort attributes */
   TidyMergeSpans,       /**< Merge multiple SPANs */
   TidyAnchorAsName,    /**< Define anchors as name attributes */
+  TidyMemoryLimit,     /**< KB a document may use while parsing, 0 for any */
   N_TIDY_OPTIONS       /**< Must be last */
 } TidyOptionId;
 
@@ -290,6 +291,20 @@ typedef enum
 } TidyReportLevel;
 
 
+/** What a document's memory is used for, see tidyMemoryUsed()
+*/
+typedef enum
+{
+  TidyMemOther,         /**< Options, tables and anything else */
+  TidyMemLexer,         /**< Lexer text and inline stack */
+  TidyMemNodes,         /**< Document tree nodes */
+  TidyMemAttributes,    /**< Attributes and their values */
+  TidyMemPrint,         /**< Pretty printer buffers */
+  TidyMemMessages,      /**< Formatting messages */
+  TidyMemTotal          /**< All of the above */
+} TidyMemKind;
+
+
 /* Document tree traversal functions
 */
 
@@ -44,6 +44,7 @@
 #include "tags.h"
 #include "attrs.h"
 #include "tmbstr.h"
+#include "parser.h"
 
 
 /* 
@@ -369,16 +370,18 @@ static Bool EndsWithBytes( ctmbstr txt )
 
 static ctmbstr textFromOneNode( TidyDocImpl* doc, Node* node )
 {
-    uint i;
+    size_t i;
     uint x = 0;
     tmbstr txt = doc->access.text;
     
     if ( node )
     {
+        ctmbstr text = NodeText( doc->lexer, node );
+
         /* Copy contents of a text node */
-        for (i = node->start; i < node->end; ++i, ++x )
+        for (i = 0; i < NodeTextLen(node); ++i, ++x )
         {
-            txt[x] = doc->lexer->lexbuf[i];
+            txt[x] = text[i];
 
             /* Check buffer overflow */
             if ( x >= sizeof(doc->access.text)-1 )
@@ -411,20 +414,21 @@ static void getTextNode( TidyDocImpl* doc, Node* node )
     /* If the tag of the node is NULL, then grab the text within the node */
     if ( TY_(nodeIsText)(node) )
     {
-        uint i;
+        ctmbstr text = NodeText( doc->lexer, node );
+        size_t i;
 
         /* Retrieves each character found within the text node */
-        for (i = node->start; i < node->end; i++)
+        for (i = 0; i < NodeTextLen(node); i++)
         {
             /* The text must not exceed buffer */
             if ( doc->access.counter >= TEXTBUF_SIZE-1 )
                 return;
 
-            txtnod[ doc->access.counter++ ] = doc->lexer->lexbuf[i];
+            txtnod[ doc->access.counter++ ] = text[i];
         }
 
         /* Traverses through the contents within a container element */
-        for ( node = node->content; node != NULL; node = node->next )
+        for ( node = NodeContent(node); node != NULL; node = NodeNext(node) )
             getTextNode( doc, node );
     }   
 }
@@ -443,7 +447,7 @@ static tmbstr getTextNodeClear( TidyDocImpl* doc, Node* node )
     TidyClearMemory( doc->access.textNode, TEXTBUF_SIZE );
     doc->access.counter = 0;
 
-    getTextNode( doc, node->content );
+    getTextNode( doc, NodeContent(node) );
     return doc->access.textNode;
 }
 
@@ -523,7 +527,7 @@ static void CheckColorContrast( TidyDocImpl* doc, Node* node )
         AttVal* av;
 
         /* Check for 'BGCOLOR' first to compare with other color attributes */
-        for ( av = node->attributes; av; av = av->next )
+        for ( av = NodeAttrs(node); av; av = av->next )
         {            
             if ( attrIsBGCOLOR(av) )
             {
@@ -536,7 +540,7 @@ static void CheckColorContrast( TidyDocImpl* doc, Node* node )
            Search for COLOR attributes to compare with background color
            Must have valid colour contrast
         */
-        for ( av = node->attributes; gotBG && av != NULL; av = av->next )
+        for ( av = NodeAttrs(node); gotBG && av != NULL; av = av->next )
         {
             uint errcode = 0;
             if ( attrIsTEXT(av) )
@@ -690,7 +694,7 @@ static void CheckImage( TidyDocImpl* doc, Node* node )
     if (Level1_Enabled( doc ))
     {
         /* Checks all image attributes for invalid values within attributes */
-        for (av = node->attributes; av != NULL; av = av->next)
+        for (av = NodeAttrs(node); av != NULL; av = av->next)
         {
             /* 
                Checks for valid ALT attribute.
@@ -804,19 +808,19 @@ static void CheckImage( TidyDocImpl* doc, Node* node )
             the ANCHOR tags must be < 6 characters long, and must contain
             the letter 'd'.
         */
-        if ( nodeIsA(node->next) )
+        if ( nodeIsA(NodeNext(node)) )
         {
-            node = node->next;
+            node = NodeNext(node);
             
             /* 
                 Node following the anchor must be a text node
                 for dLINK to exist 
             */
 
-            if (node->content != NULL && (node->content)->tag == NULL)
+            if (NodeContent(node) != NULL && NodeTag(NodeContent(node)) == NULL)
             {
                 /* Number of characters found within the text node */
-                ctmbstr word = textFromOneNode( doc, node->content);
+                ctmbstr word = textFromOneNode( doc, NodeContent(node));
                     
                 if ((TY_(tmbstrcmp)(word,"d") == 0)||
                     (TY_(tmbstrcmp)(word,"D") == 0))
@@ -832,22 +836,22 @@ static void CheckImage( TidyDocImpl* doc, Node* node )
             whitespace and continues check for dLINK.
         */
         
-        if ( node->next && !node->next->tag )
+        if ( NodeNext(node) && !NodeTag(NodeNext(node)) )
         {
-            node = node->next;
+            node = NodeNext(node);
 
-            if ( nodeIsA(node->next) )
+            if ( nodeIsA(NodeNext(node)) )
             {
-                node = node->next;
+                node = NodeNext(node);
 
                 /* 
                     Node following the ANCHOR must be a text node
                     for dLINK to exist 
                 */
-                if (node->content != NULL && node->content->tag == NULL)
+                if (NodeContent(node) != NULL && NodeTag(NodeContent(node)) == NULL)
                 {
                     /* Number of characters found within the text node */
-                    ctmbstr word = textFromOneNode( doc, node->content );
+                    ctmbstr word = textFromOneNode( doc, NodeContent(node) );
 
                     if ((TY_(tmbstrcmp)(word, "d") == 0)||
                         (TY_(tmbstrcmp)(word, "D") == 0))
@@ -935,7 +939,7 @@ static void CheckApplet( TidyDocImpl* doc, Node* node )
     if (Level1_Enabled( doc ))
     {
         /* Checks for attributes within the APPLET element */
-        for (av = node->attributes; av != NULL; av = av->next)
+        for (av = NodeAttrs(node); av != NULL; av = av->next)
         {
             /*
                Checks for valid ALT attribute.
@@ -955,17 +959,17 @@ static void CheckApplet( TidyDocImpl* doc, Node* node )
         if (HasAlt == no)
         {
             /* Must have alternate text representation for that element */
-            if (node->content != NULL) 
+            if (NodeContent(node) != NULL) 
             {
                 ctmbstr word = NULL;
 
-                if ( node->content->tag == NULL )
-                    word = textFromOneNode( doc, node->content);
+                if ( NodeTag(NodeContent(node)) == NULL )
+                    word = textFromOneNode( doc, NodeContent(node));
 
-                if ( node->content->content != NULL &&
-                     node->content->content->tag == NULL )
+                if ( NodeContent(NodeContent(node)) != NULL &&
+                     NodeTag(NodeContent(NodeContent(node))) == NULL )
                 {
-                    word = textFromOneNode( doc, node->content->content);
+                    word = textFromOneNode( doc, NodeContent(NodeContent(node)));
                 }
                 
                 if ( word != NULL && !IsWhitespace(word) )
@@ -997,14 +1001,14 @@ static void CheckObject( TidyDocImpl* doc, Node* node )
 
     if (Level1_Enabled( doc ))
     {
-        if ( node->content != NULL)
+        if ( NodeContent(node) != NULL)
         {
-            if ( node->content->type != TextNode )
+            if ( NodeContent(node)->type != TextNode )
             {
-                Node* tnode = node->content;
+                Node* tnode = NodeContent(node);
                 AttVal* av;
 
-                for ( av=tnode->attributes; av; av = av->next )
+                for ( av=NodeAttrs(tnode); av; av = av->next )
                 {
                     if ( attrIsALT(av) )
                     {
@@ -1019,13 +1023,13 @@ static void CheckObject( TidyDocImpl* doc, Node* node )
             {
                 ctmbstr word = NULL;
 
-                if ( TY_(nodeIsText)(node->content) )
-                    word = textFromOneNode( doc, node->content );
+                if ( TY_(nodeIsText)(NodeContent(node)) )
+                    word = textFromOneNode( doc, NodeContent(node) );
 
                 if ( word == NULL &&
-                     TY_(nodeIsText)(node->content->content) )
+                     TY_(nodeIsText)(NodeContent(NodeContent(node))) )
                 {
-                    word = textFromOneNode( doc, node->content->content );
+                    word = textFromOneNode( doc, NodeContent(NodeContent(node)) );
                 }
                     
                 if ( word != NULL && !IsWhitespace(word) )
@@ -1047,22 +1051,22 @@ static void CheckObject( TidyDocImpl* doc, Node* node )
 * Ensures that stylesheets are used to control the presentation.
 ***************************************************************/
 
-static Bool CheckMissingStyleSheets( TidyDocImpl* doc, Node* node )
+static Bool CheckMissingStyleSheets( TidyDocImpl* ARG_UNUSED(doc), Node* node )
 {
     AttVal* av;
     Node* content;
     Bool sspresent = no;
 
-    for ( content = node->content;
+    for ( content = NodeContent(node);
           !sspresent && content != NULL;
-          content = content->next )
+          content = TY_(NextPreOrder)(content, node) )
     {
         sspresent = ( nodeIsLINK(content)  ||
                       nodeIsSTYLE(content) ||
                       nodeIsFONT(content)  ||
                       nodeIsBASEFONT(content) );
 
-        for ( av = content->attributes;
+        for ( av = NodeAttrs(content);
               !sspresent && av != NULL;
               av = av->next )
         {
@@ -1075,9 +1079,6 @@ static Bool CheckMissingStyleSheets( TidyDocImpl* doc, Node* node )
                 sspresent = AttrValueIs(av, "stylesheet");
             }
         }
-
-        if ( ! sspresent )
-            sspresent = CheckMissingStyleSheets( doc, content );
     }
     return sspresent;
 }
@@ -1102,7 +1103,7 @@ static void CheckFrame( TidyDocImpl* doc, Node* node )
     if (Level1_Enabled( doc ))
     {
         /* Checks for attributes within the FRAME element */
-        for (av = node->attributes; av != NULL; av = av->next)
+        for (av = NodeAttrs(node); av != NULL; av = av->next)
         {
             /* Checks if 'LONGDESC' value is valid only if present */
             if ( attrIsLONGDESC(av) )
@@ -1199,7 +1200,7 @@ static void CheckAnchorAccess( TidyDocImpl* doc, Node* node )
     Bool HasTriggeredLink = no;
 
     /* Checks for attributes within the ANCHOR element */
-    for ( av = node->attributes; av != NULL; av = av->next )
+    for ( av = NodeAttrs(node); av != NULL; av = av->next )
     {
         if (Level1_Enabled( doc ))
         {
@@ -1227,11 +1228,11 @@ static void CheckAnchorAccess( TidyDocImpl* doc, Node* node )
                         int errcode = IsSoundFile( av->value );
                         if ( errcode )
                         {
-                            if (node->next != NULL)
+                            if (NodeNext(node) != NULL)
                             {
-                                if (node->next->tag == NULL)
+                                if (NodeTag(NodeNext(node)) == NULL)
                                 {
-                                    ctmbstr word = textFromOneNode( doc, node->next);
+                                    ctmbstr word = textFromOneNode( doc, NodeNext(node));
                                 
                                     /* Must contain at least one letter in the text */
                                     if (IsWhitespace (word) == no)
@@ -1271,10 +1272,10 @@ static void CheckAnchorAccess( TidyDocImpl* doc, Node* node )
     
     if (Level2_Enabled( doc ))
     {
-        if ((node->content != NULL)&&
-            (node->content->tag == NULL))
+        if ((NodeContent(node) != NULL)&&
+            (NodeTag(NodeContent(node)) == NULL))
         {
-            ctmbstr word = textFromOneNode( doc, node->content);
+            ctmbstr word = textFromOneNode( doc, NodeContent(node));
 
             if ((word != NULL)&&
                 (IsWhitespace (word) == no))
@@ -1305,7 +1306,7 @@ static void CheckAnchorAccess( TidyDocImpl* doc, Node* node )
             }
         }
         
-        if (node->content == NULL)
+        if (NodeContent(node) == NULL)
         {
             TY_(ReportAccessWarning)( doc, node, LINK_TEXT_MISSING);
         }
@@ -1329,7 +1330,7 @@ static void CheckArea( TidyDocImpl* doc, Node* node )
     AttVal* av;
 
     /* Checks all attributes within the AREA element */
-    for (av = node->attributes; av != NULL; av = av->next)
+    for (av = NodeAttrs(node); av != NULL; av = av->next)
     {
         if (Level1_Enabled( doc ))
         {
@@ -1388,7 +1389,7 @@ static void CheckScriptAcc( TidyDocImpl* doc, Node* node )
     if (Level1_Enabled( doc ))
     {
         /* NOSCRIPT element must appear immediately following SCRIPT element */
-        if ( node->next == NULL || !nodeIsNOSCRIPT(node->next) )
+        if ( NodeNext(node) == NULL || !nodeIsNOSCRIPT(NodeNext(node)) )
         {
             TY_(ReportAccessError)( doc, node, SCRIPT_MISSING_NOSCRIPT);
         }
@@ -1410,15 +1411,15 @@ static void CheckRows( TidyDocImpl* doc, Node* node )
     
     doc->access.CheckedHeaders++;
 
-    for (; node != NULL; node = node->next )
+    for (; node != NULL; node = NodeNext(node) )
     {
         numTR++;
-        if ( nodeIsTH(node->content) )
+        if ( nodeIsTH(NodeContent(node)) )
         {
             doc->access.HasTH = yes;            
-            if ( TY_(nodeIsText)(node->content->content) )
+            if ( TY_(nodeIsText)(NodeContent(NodeContent(node))) )
             {
-                ctmbstr word = textFromOneNode( doc, node->content->content);
+                ctmbstr word = textFromOneNode( doc, NodeContent(NodeContent(node)));
                 if ( !IsWhitespace(word) )
                     numValidTH++;
             }
@@ -1452,17 +1453,17 @@ static void CheckColumns( TidyDocImpl* doc, Node* node )
     doc->access.CheckedHeaders++;
 
     /* Table must have row of headers if headers for columns don't exist */
-    if ( nodeIsTH(node->content) )
+    if ( nodeIsTH(NodeContent(node)) )
     {
         doc->access.HasTH = yes;
 
-        for ( tnode = node->content; tnode; tnode = tnode->next )
+        for ( tnode = NodeContent(node); tnode; tnode = NodeNext(tnode) )
         {
             if ( nodeIsTH(tnode) )
             {
-                if ( TY_(nodeIsText)(tnode->content) )
+                if ( TY_(nodeIsText)(NodeContent(tnode)) )
                 {
-                    ctmbstr word = textFromOneNode( doc, tnode->content);
+                    ctmbstr word = textFromOneNode( doc, NodeContent(tnode));
                     if ( !IsWhitespace(word) )
                         numTH++;
                 }
@@ -1499,7 +1500,7 @@ static void CheckTH( TidyDocImpl* doc, Node* node )
     if (Level3_Enabled( doc ))
     {
         /* Checks TH element for 'ABBR' attribute */
-        for (av = node->attributes; av != NULL; av = av->next)
+        for (av = NodeAttrs(node); av != NULL; av = av->next)
         {
             if ( attrIsABBR(av) )
             {
@@ -1527,7 +1528,7 @@ static void CheckTH( TidyDocImpl* doc, Node* node )
         }
 
         /* If the header is greater than 15 characters, an abbreviation is needed */
-        word = textFromOneNode( doc, node->content);
+        word = textFromOneNode( doc, NodeContent(node));
 
         if ((word != NULL)&&
             (IsWhitespace (word) == no))
@@ -1564,9 +1565,9 @@ static void CheckMultiHeaders( TidyDocImpl* doc, Node* node )
 
     if (Level1_Enabled( doc ))
     {
-        if (node->content != NULL)
+        if (NodeContent(node) != NULL)
         {
-            TNode = node->content;
+            TNode = NodeContent(node);
 
             /* 
                Checks for column of multiple headers found 
@@ -1576,9 +1577,9 @@ static void CheckMultiHeaders( TidyDocImpl* doc, Node* node )
             {
                 if ( nodeIsTR(TNode) )
                 {
-                    if (TNode->content != NULL)
+                    if (NodeContent(TNode) != NULL)
                     {
-                        temp = TNode->content;
+                        temp = NodeContent(TNode);
 
                         /* The number of TH elements found within TR element */
                         if (flag == 0)
@@ -1592,7 +1593,7 @@ static void CheckMultiHeaders( TidyDocImpl* doc, Node* node )
                                 if ( nodeIsTH(temp) )
                                 {
                                     AttVal* av;
-                                    for (av = temp->attributes; av != NULL; av = av->next)
+                                    for (av = NodeAttrs(temp); av != NULL; av = av->next)
                                     {
                                         if ( attrIsCOLSPAN(av)
                                              && (atoi(av->value) > 1) )
@@ -1604,7 +1605,7 @@ static void CheckMultiHeaders( TidyDocImpl* doc, Node* node )
                                     }
                                 }
 
-                                temp = temp->next;
+                                temp = NodeNext(temp);
                             }    
 
                             flag = 1;
@@ -1612,7 +1613,7 @@ static void CheckMultiHeaders( TidyDocImpl* doc, Node* node )
                     }
                 }
             
-                TNode = TNode->next;
+                TNode = NodeNext(TNode);
             }
 
             /* Displays HTML 4 Table Algorithm when multiple column of headers used */
@@ -1656,7 +1657,7 @@ static void CheckTable( TidyDocImpl* doc, Node* node )
     {
         AttVal* av;
         /* Table must have a 'SUMMARY' describing the purpose of the table */
-        for (av = node->attributes; av != NULL; av = av->next)
+        for (av = NodeAttrs(node); av != NULL; av = av->next)
         {
             if ( attrIsSUMMARY(av) )
             {
@@ -1685,7 +1686,7 @@ static void CheckTable( TidyDocImpl* doc, Node* node )
         }
 
         /* TABLE must have content. */
-        if (node->content == NULL)
+        if (NodeContent(node) == NULL)
         {
             TY_(ReportAccessError)( doc, node, DATA_TABLE_MISSING_HEADERS);
         
@@ -1702,11 +1703,11 @@ static void CheckTable( TidyDocImpl* doc, Node* node )
     if (Level2_Enabled( doc ))
     {
         /* Table must have a CAPTION describing the purpose of the table */
-        if ( nodeIsCAPTION(node->content) )
+        if ( nodeIsCAPTION(NodeContent(node)) )
         {
-            TNode = node->content;
+            TNode = NodeContent(node);
 
-            if (TNode->content && TNode->content->tag == NULL)
+            if (NodeContent(TNode) && NodeTag(NodeContent(TNode)) == NULL)
             {
                 word = getTextNodeClear( doc, TNode);
             }
@@ -1724,29 +1725,29 @@ static void CheckTable( TidyDocImpl* doc, Node* node )
     }
 
     
-    if (node->content != NULL)
+    if (NodeContent(node) != NULL)
     {
-        if ( nodeIsCAPTION(node->content) && nodeIsTR(node->content->next) )
+        if ( nodeIsCAPTION(NodeContent(node)) && nodeIsTR(NodeNext(NodeContent(node))) )
         {
-            CheckColumns( doc, node->content->next );
+            CheckColumns( doc, NodeNext(NodeContent(node)) );
         }
-        else if ( nodeIsTR(node->content) )
+        else if ( nodeIsTR(NodeContent(node)) )
         {
-            CheckColumns( doc, node->content );
+            CheckColumns( doc, NodeContent(node) );
         }
     }
     
     if ( ! doc->access.HasValidColumnHeaders )
     {
-        if (node->content != NULL)
+        if (NodeContent(node) != NULL)
         {
-            if ( nodeIsCAPTION(node->content) && nodeIsTR(node->content->next) )
+            if ( nodeIsCAPTION(NodeContent(node)) && nodeIsTR(NodeNext(NodeContent(node))) )
             {
-                CheckRows( doc, node->content->next);
+                CheckRows( doc, NodeNext(NodeContent(node)));
             }
-            else if ( nodeIsTR(node->content) )
+            else if ( nodeIsTR(NodeContent(node)) )
             {
-                CheckRows( doc, node->content);
+                CheckRows( doc, NodeContent(node));
             }
         }
     }
@@ -1763,9 +1764,9 @@ static void CheckTable( TidyDocImpl* doc, Node* node )
 
     if (Level2_Enabled( doc ))
     {
-        if (node->content != NULL)
+        if (NodeContent(node) != NULL)
         {
-            temp = node->content;
+            temp = NodeContent(node);
 
             while (temp != NULL)
             {
@@ -1774,7 +1775,7 @@ static void CheckTable( TidyDocImpl* doc, Node* node )
                     numTR++;
                 }
 
-                temp = temp->next;
+                temp = NodeNext(temp);
             }
 
             if (numTR == 1)
@@ -1834,34 +1835,37 @@ static void CheckASCII( TidyDocImpl* doc, Node* node )
     Bool IsAscii = no;
     int HasSkipOverLink = 0;
         
-    uint i, x;
+    size_t i, x, len;
     int newLines = -1;
     tmbchar compareLetter;
     int matchingCount = 0;
     AttVal* av;
     
-    if (Level1_Enabled( doc ) && node->content)
+    if (Level1_Enabled( doc ) && NodeContent(node))
     {
+        ctmbstr text = NodeText(doc->lexer, NodeContent(node));
+        len = NodeTextLen(NodeContent(node));
+
         /* 
            Checks the text within the PRE and XMP tags to see if ascii 
            art is present 
         */
-        for (i = node->content->start + 1; i < node->content->end; i++)
+        for (i = 1; i < len; i++)
         {
             matchingCount = 0;
 
             /* Counts the number of lines of text */
-            if (doc->lexer->lexbuf[i] == '\n')
+            if (text[i] == '\n')
             {
                 newLines++;
             }
             
-            compareLetter = doc->lexer->lexbuf[i];
+            compareLetter = text[i];
 
             /* Counts consecutive character matches */
-            for (x = i; x < i + 5; x++)
+            for (x = i; x < i + 5 && x < len; x++)
             {
-                if (doc->lexer->lexbuf[x] == compareLetter)
+                if (text[x] == compareLetter)
                 {
                     matchingCount++;
                 }
@@ -1891,12 +1895,12 @@ static void CheckASCII( TidyDocImpl* doc, Node* node )
         /* Checks for skip over link if ASCII art is present */
         if (IsAscii == yes)
         {
-            if (node->prev != NULL && node->prev->prev != NULL)
+            if (NodePrev(node) != NULL && NodePrev(NodePrev(node)) != NULL)
             {
-                temp1 = node->prev->prev;
+                temp1 = NodePrev(NodePrev(node));
 
                 /* Checks for 'HREF' attribute */
-                for (av = temp1->attributes; av != NULL; av = av->next)
+                for (av = NodeAttrs(temp1); av != NULL; av = av->next)
                 {
                     if ( attrIsHREF(av) && hasValue(av) )
                     {
@@ -1916,12 +1920,12 @@ static void CheckASCII( TidyDocImpl* doc, Node* node )
         */
         if (HasSkipOverLink == 1)
         {
-            if ( nodeIsA(node->next) )
+            if ( nodeIsA(NodeNext(node)) )
             {
-                temp2 = node->next;
+                temp2 = NodeNext(node);
                 
                 /* Checks for 'NAME' attribute */
-                for (av = temp2->attributes; av != NULL; av = av->next)
+                for (av = NodeAttrs(temp2); av != NULL; av = av->next)
                 {
                     if ( attrIsNAME(av) && hasValue(av) )
                     {
@@ -2019,7 +2023,7 @@ static void CheckInputLabel( TidyDocImpl* doc, Node* node )
         AttVal* av;
 
         /* Checks attributes within the INPUT element */
-        for (av = node->attributes; av != NULL; av = av->next)
+        for (av = NodeAttrs(node); av != NULL; av = av->next)
         {
             /* Must have valid 'ID' value */
             if ( attrIsID(av) && hasValue(av) )
@@ -2049,7 +2053,7 @@ static void CheckInputAttributes( TidyDocImpl* doc, Node* node )
     AttVal* av;
 
     /* Checks attributes within the INPUT element */
-    for (av = node->attributes; av != NULL; av = av->next)
+    for (av = NodeAttrs(node); av != NULL; av = av->next)
     {
         /* 'VALUE' must be found if the 'TYPE' is 'text' or 'checkbox' */
         if ( attrIsTYPE(av) && hasValue(av) )
@@ -2098,26 +2102,26 @@ static void CheckFrameSet( TidyDocImpl* doc, Node* node )
            TY_(ReportAccessError)( doc, node, NOFRAMES_INVALID_LINK);
            doc->badAccess &= ~BA_INVALID_LINK_NOFRAMES; /* emit only once */
         }
-        for ( temp = node->content; temp != NULL ; temp = temp->next )
+        for ( temp = NodeContent(node); temp != NULL ; temp = NodeNext(temp) )
         {
             if ( nodeIsNOFRAMES(temp) )
             {
                 HasNoFrames = yes;
 
-                if ( temp->content && nodeIsP(temp->content->content) )
+                if ( NodeContent(temp) && nodeIsP(NodeContent(NodeContent(temp))) )
                 {
-                    Node* para = temp->content->content;
-                    if ( TY_(nodeIsText)(para->content) )
+                    Node* para = NodeContent(NodeContent(temp));
+                    if ( TY_(nodeIsText)(NodeContent(para)) )
                     {
-                        ctmbstr word = textFromOneNode( doc, para->content );
+                        ctmbstr word = textFromOneNode( doc, NodeContent(para) );
                         if ( word && strstr(word, "browser") != NULL )
                             TY_(ReportAccessError)( doc, para, NOFRAMES_INVALID_CONTENT );
                     }
                 }
-                else if (temp->content == NULL)
+                else if (NodeContent(temp) == NULL)
                     TY_(ReportAccessError)( doc, temp, NOFRAMES_INVALID_NO_VALUE);
-                else if ( temp->content &&
-                          IsWhitespace(textFromOneNode(doc, temp->content)) )
+                else if ( NodeContent(temp) &&
+                          IsWhitespace(textFromOneNode(doc, NodeContent(temp))) )
                     TY_(ReportAccessError)( doc, temp, NOFRAMES_INVALID_NO_VALUE);
             }
         }
@@ -2152,9 +2156,9 @@ static void CheckHeaderNesting( TidyDocImpl* doc, Node* node )
            Text within header element cannot contain more than 20 words without
            a separate description
         */
-        if (node->content != NULL && node->content->tag == NULL)
+        if (NodeContent(node) != NULL && NodeTag(NodeContent(node)) == NULL)
         {
-            ctmbstr word = textFromOneNode( doc, node->content);
+            ctmbstr word = textFromOneNode( doc, NodeContent(node));
 
             for (i = 0; i < TY_(tmbstrlen)(word); i++)
             {
@@ -2178,7 +2182,7 @@ static void CheckHeaderNesting( TidyDocImpl* doc, Node* node )
             uint level = TY_(nodeHeaderLevel)( node );
             IsValidIncrease = yes;
 
-            for ( temp = node->next; temp != NULL; temp = temp->next )
+            for ( temp = NodeNext(node); temp != NULL; temp = NodeNext(temp) )
             {
                 uint nested = TY_(nodeHeaderLevel)( temp );
                 if ( nested >= level )
@@ -2214,37 +2218,37 @@ static void CheckParagraphHeader( TidyDocImpl* doc, Node* node )
     if (Level2_Enabled( doc ))
     {
         /* Cannot contain text formatting elements */
-        if (node->content != NULL)   
+        if (NodeContent(node) != NULL)   
         {                     
-            if (node->content->tag != NULL)
+            if (NodeTag(NodeContent(node)) != NULL)
             {
-                temp = node->content;
+                temp = NodeContent(node);
 
                 while (temp != NULL)
                 {
-                    if (temp->tag == NULL)
+                    if (NodeTag(temp) == NULL)
                     {
                         IsNotHeader = yes;
                         break;
                     }
                         
-                    temp = temp->next;
+                    temp = NodeNext(temp);
                 }
             }
 
             if ( !IsNotHeader )
             {
-                if ( nodeIsSTRONG(node->content) )
+                if ( nodeIsSTRONG(NodeContent(node)) )
                 {
                     TY_(ReportAccessWarning)( doc, node, POTENTIAL_HEADER_BOLD);
                 }
 
-                if ( nodeIsU(node->content) )
+                if ( nodeIsU(NodeContent(node)) )
                 {
                     TY_(ReportAccessWarning)( doc, node, POTENTIAL_HEADER_UNDERLINE);
                 }
 
-                if ( nodeIsEM(node->content) )
+                if ( nodeIsEM(NodeContent(node)) )
                 {
                     TY_(ReportAccessWarning)( doc, node, POTENTIAL_HEADER_ITALICS);
                 }
@@ -2313,9 +2317,9 @@ static void CheckBlink( TidyDocImpl* doc, Node* node )
     if (Level2_Enabled( doc ))
     {
         /* Checks to see if text is found within the BLINK element. */
-        if ( TY_(nodeIsText)(node->content) )
+        if ( TY_(nodeIsText)(NodeContent(node)) )
         {
-            ctmbstr word = textFromOneNode( doc, node->content );
+            ctmbstr word = textFromOneNode( doc, NodeContent(node) );
             if ( !IsWhitespace(word) )
             {
                 TY_(ReportAccessError)( doc, node, REMOVE_BLINK_MARQUEE );
@@ -2340,7 +2344,7 @@ static void CheckMarquee( TidyDocImpl* doc, Node* node )
         /* Checks to see if there is text in between the MARQUEE element */
         if ( TY_(nodeIsText)(node) )
         {
-            ctmbstr word = textFromOneNode( doc, node->content);
+            ctmbstr word = textFromOneNode( doc, NodeContent(node));
             if ( !IsWhitespace(word) )
             {
                 TY_(ReportAccessError)( doc, node, REMOVE_BLINK_MARQUEE );
@@ -2367,7 +2371,7 @@ static void CheckLink( TidyDocImpl* doc, Node* node )
     {
         AttVal* av;
         /* Check for valid 'REL' and 'TYPE' attribute */
-        for (av = node->attributes; av != NULL; av = av->next)
+        for (av = NodeAttrs(node); av != NULL; av = av->next)
         {
             if ( attrIsREL(av) && hasValue(av) )
             {
@@ -2615,7 +2619,6 @@ static void CheckDeprecated( TidyDocImpl* doc, Node* node )
 
 static void CheckScriptKeyboardAccessible( TidyDocImpl* doc, Node* node )
 {
-    Node* content;
     int HasOnMouseDown = 0;
     int HasOnMouseUp = 0;
     int HasOnClick = 0;
@@ -2627,7 +2630,7 @@ static void CheckScriptKeyboardAccessible( TidyDocImpl* doc, Node* node )
     {
         AttVal* av;
         /* Checks all elements for their attributes */
-        for (av = node->attributes; av != NULL; av = av->next)
+        for (av = NodeAttrs(node); av != NULL; av = av->next)
         {
             /* Must also have 'ONKEYDOWN' attribute with 'ONMOUSEDOWN' */
             if ( attrIsOnMOUSEDOWN(av) )
@@ -2680,11 +2683,6 @@ static void CheckScriptKeyboardAccessible( TidyDocImpl* doc, Node* node )
 
         if ( HasOnMouseMove == 1 )
             TY_(ReportAccessError)( doc, node, SCRIPT_NOT_KEYBOARD_ACCESSIBLE_ON_MOUSE_MOVE);
-
-        /* Recursively check all child nodes.
-         */
-        for ( content = node->content; content != NULL; content = content->next )
-            CheckScriptKeyboardAccessible( doc, content );
     }
 }
 
@@ -2699,83 +2697,84 @@ static void CheckScriptKeyboardAccessible( TidyDocImpl* doc, Node* node )
 **********************************************************/
 
 
-static Bool CheckMetaData( TidyDocImpl* doc, Node* node, Bool HasMetaData )
+static Bool CheckMetaData( TidyDocImpl* doc, Node* head )
 {
-    Bool HasHttpEquiv = no;
-    Bool HasContent = no;
-    Bool ContainsAttr = no;
+    Bool HasMetaData = no;
+    Node* node;
 
     if (Level2_Enabled( doc ))
     {
-        if ( nodeIsMETA(node) )
+        /* Check for MetaData */
+        for ( node = head; node; node = TY_(NextPreOrder)(node, head) )
         {
-            AttVal* av;
-            for (av = node->attributes; av != NULL; av = av->next)
+            Bool HasHttpEquiv = no;
+            Bool HasContent = no;
+            Bool ContainsAttr = no;
+
+            if ( nodeIsMETA(node) )
             {
-                if ( attrIsHTTP_EQUIV(av) && hasValue(av) )
+                AttVal* av;
+                for (av = NodeAttrs(node); av != NULL; av = av->next)
                 {
-                    ContainsAttr = yes;
-
-                    /* Must not have an auto-refresh */
-                    if (AttrValueIs(av, "refresh"))
+                    if ( attrIsHTTP_EQUIV(av) && hasValue(av) )
                     {
-                        HasHttpEquiv = yes;
-                        TY_(ReportAccessError)( doc, node, REMOVE_AUTO_REFRESH );
-                    }
-                }
+                        ContainsAttr = yes;
 
-                if ( attrIsCONTENT(av) && hasValue(av) )
-                {
-                    ContainsAttr = yes;
+                        /* Must not have an auto-refresh */
+                        if (AttrValueIs(av, "refresh"))
+                        {
+                            HasHttpEquiv = yes;
+                            TY_(ReportAccessError)( doc, node, REMOVE_AUTO_REFRESH );
+                        }
+                    }
 
-                    /* If the value is not an integer, then it must not be a URL */
-                    if ( TY_(tmbstrncmp)(av->value, "http:", 5) == 0)
+                    if ( attrIsCONTENT(av) && hasValue(av) )
                     {
-                        HasContent = yes;
-                        TY_(ReportAccessError)( doc, node, REMOVE_AUTO_REDIRECT);
+                        ContainsAttr = yes;
+
+                        /* If the value is not an integer, then it must not be a URL */
+                        if ( TY_(tmbstrncmp)(av->value, "http:", 5) == 0)
+                        {
+                            HasContent = yes;
+                            TY_(ReportAccessError)( doc, node, REMOVE_AUTO_REDIRECT);
+                        }
                     }
                 }
-            }
         
-            if ( HasContent || HasHttpEquiv )
+                if ( HasContent || HasHttpEquiv )
+                {
+                    HasMetaData = yes;
+                    TY_(ReportAccessError)( doc, node, METADATA_MISSING_REDIRECT_AUTOREFRESH);
+                }
+                else
+                {
+                    if ( ContainsAttr && !HasContent && !HasHttpEquiv )
+                        HasMetaData = yes;                    
+                }
+            }
+
+            if ( !HasMetaData && 
+                 nodeIsADDRESS(node) &&
+                 nodeIsA(NodeContent(node)) )
             {
                 HasMetaData = yes;
-                TY_(ReportAccessError)( doc, node, METADATA_MISSING_REDIRECT_AUTOREFRESH);
             }
-            else
+            
+            if ( !HasMetaData &&
+                 !nodeIsTITLE(node) &&
+                 TY_(nodeIsText)(NodeContent(node)) )
             {
-                if ( ContainsAttr && !HasContent && !HasHttpEquiv )
-                    HasMetaData = yes;                    
+                ctmbstr word = textFromOneNode( doc, NodeContent(node) );
+                if ( !IsWhitespace(word) )
+                    HasMetaData = yes;
             }
-        }
 
-        if ( !HasMetaData && 
-             nodeIsADDRESS(node) &&
-             nodeIsA(node->content) )
-        {
-            HasMetaData = yes;
-        }
-            
-        if ( !HasMetaData &&
-             !nodeIsTITLE(node) &&
-             TY_(nodeIsText)(node->content) )
-        {
-            ctmbstr word = textFromOneNode( doc, node->content );
-            if ( !IsWhitespace(word) )
-                HasMetaData = yes;
-        }
-
-        if( !HasMetaData && nodeIsLINK(node) )
-        {
-            AttVal* av = attrGetREL(node);
-            if( !AttrContains(av, "stylesheet") )
-                HasMetaData = yes;
-        }
-            
-        /* Check for MetaData */
-        for ( node = node->content; node; node = node->next )
-        {
-            HasMetaData = CheckMetaData( doc, node, HasMetaData );
+            if( !HasMetaData && nodeIsLINK(node) )
+            {
+                AttVal* av = attrGetREL(node);
+                if( !AttrContains(av, "stylesheet") )
+                    HasMetaData = yes;
+            }
         }
     }
     return HasMetaData;
@@ -2841,18 +2840,21 @@ static Bool urlMatch( ctmbstr url1, ctmbstr url2 )
   return ( TY_(tmbstrcmp)( url1, url2 ) == 0 );
 }
 
-static Bool FindLinkA( TidyDocImpl* doc, Node* node, ctmbstr url )
+static Bool FindLinkA( TidyDocImpl* ARG_UNUSED(doc), Node* root, ctmbstr url )
 {
   Bool found = no;
-  for ( node = node->content; !found && node; node = node->next )
+  Node* node = NodeContent(root);
+
+  while ( !found && node )
   {
     if ( nodeIsA(node) )
     {
       AttVal* href = attrGetHREF( node );
       found = ( hasValue(href) && urlMatch(url, href->value) );
+      node = TY_(NextPastContent)( node, root );
     }
     else
-        found = FindLinkA( doc, node, url );
+      node = TY_(NextPreOrder)( node, root );
   }
   return found;
 }
@@ -2865,7 +2867,7 @@ static void CheckMapLinks( TidyDocImpl* doc, Node* node )
         return;
 
     /* Stores the 'HREF' link of an AREA element within a MAP element */
-    for ( child = node->content; child != NULL; child = child->next )
+    for ( child = NodeContent(node); child != NULL; child = NodeNext(child) )
     {
         if ( nodeIsAREA(child) )
         {
@@ -2890,7 +2892,6 @@ static void CheckMapLinks( TidyDocImpl* doc, Node* node )
 
 static void CheckForStyleAttribute( TidyDocImpl* doc, Node* node )
 {
-    Node* content;
     if (Level1_Enabled( doc ))
     {
         /* Must not contain 'STYLE' attribute */
@@ -2900,11 +2901,6 @@ static void CheckForStyleAttribute( TidyDocImpl* doc, Node* node )
             TY_(ReportAccessWarning)( doc, node, STYLESHEETS_REQUIRE_TESTING_STYLE_ATTR );
         }
     }
-
-    /* Recursively check all child nodes.
-    */
-    for ( content = node->content; content != NULL; content = content->next )
-        CheckForStyleAttribute( doc, content );
 }
 
 
@@ -2924,11 +2920,6 @@ static void CheckForListElements( TidyDocImpl* doc, Node* node )
     {
         doc->access.OtherListElements++;
     }
-
-    for ( node = node->content; node != NULL; node = node->next )
-    {
-        CheckForListElements( doc, node );
-    }
 }
 
 
@@ -2960,7 +2951,7 @@ static void CheckListUsage( TidyDocImpl* doc, Node* node )
        ** b) was not added by Tidy parser
        ** IFF OL/UL node is implicit
        */
-       if ( !nodeIsLI(node->content) ) {
+       if ( !nodeIsLI(NodeContent(node)) ) {
             TY_(ReportAccessWarning)( doc, node, msgcode );
        } else if ( node->implicit ) {  /* if a tidy added node */
             TY_(ReportAccessWarning)( doc, node, LIST_USAGE_INVALID_LI );
@@ -2976,14 +2967,14 @@ static void CheckListUsage( TidyDocImpl* doc, Node* node )
         ** emit warnings LIST_USAGE_INVALID_UL or 
         ** warning LIST_USAGE_INVALID_OL tests 
         */
-        if ( node->parent == NULL ||
-             ( !nodeIsOL(node->parent) && !nodeIsUL(node->parent) ) )
+        if ( NodeParent(node) == NULL ||
+             ( !nodeIsOL(NodeParent(node)) && !nodeIsUL(NodeParent(node)) ) )
         {
             TY_(ReportAccessWarning)( doc, node, LIST_USAGE_INVALID_LI );
-        } else if ( node->implicit && node->parent &&
-                    ( nodeIsOL(node->parent) || nodeIsUL(node->parent) ) ) {
+        } else if ( node->implicit && NodeParent(node) &&
+                    ( nodeIsOL(NodeParent(node)) || nodeIsUL(NodeParent(node)) ) ) {
             /* if tidy added LI node, then */
-            msgcode = nodeIsUL(node->parent) ?
+            msgcode = nodeIsUL(NodeParent(node)) ?
                 LIST_USAGE_INVALID_UL : LIST_USAGE_INVALID_OL;
             TY_(ReportAccessWarning)( doc, node, msgcode );
         }
@@ -3039,8 +3030,6 @@ static void FreeAccessibilityChecks( TidyDocImpl* ARG_UNUSED(doc) )
 
 static void AccessibilityCheckNode( TidyDocImpl* doc, Node* node )
 {
-    Node* content;
-    
     /* Check BODY for color contrast */
     if ( nodeIsBODY(node) )
     {
@@ -3050,7 +3039,7 @@ static void AccessibilityCheckNode( TidyDocImpl* doc, Node* node )
     /* Checks document for MetaData */
     else if ( nodeIsHEAD(node) )
     {
-        if ( !CheckMetaData( doc, node, no ) )
+        if ( !CheckMetaData( doc, node ) )
           MetaDataPresent( doc, node );
     }
     
@@ -3236,13 +3225,20 @@ static void AccessibilityCheckNode( TidyDocImpl* doc, Node* node )
     {
         CheckListUsage( doc, node );
     }
+}
 
-    /* Recursively check all child nodes.
-    */
-    for ( content = node->content; content != NULL; content = content->next )
-    {
-        AccessibilityCheckNode( doc, content );
-    }
+/*
+  applies check to root and all of its content in document
+  order, walking the tree by its links rather than recursing
+*/
+typedef void (AccessCheck)( TidyDocImpl* doc, Node* node );
+
+static void CheckTree( TidyDocImpl* doc, Node* root, AccessCheck* check )
+{
+    Node* node;
+
+    for ( node = root; node; node = TY_(NextPreOrder)(node, root) )
+        (*check)( doc, node );
 }
 
 
@@ -3255,10 +3251,10 @@ void TY_(AccessibilityChecks)( TidyDocImpl* doc )
     TY_(AccessibilityHelloMessage)( doc );
 
     /* Checks all elements for script accessibility */
-    CheckScriptKeyboardAccessible( doc, &doc->root );
+    CheckTree( doc, &doc->root, CheckScriptKeyboardAccessible );
 
     /* Checks entire document for the use of 'STYLE' attribute */
-    CheckForStyleAttribute( doc, &doc->root );
+    CheckTree( doc, &doc->root, CheckForStyleAttribute );
 
     /* Checks for '!DOCTYPE' */
     CheckDocType( doc );
@@ -3272,7 +3268,7 @@ void TY_(AccessibilityChecks)( TidyDocImpl* doc )
     }
 
     /* Check to see if any list elements are found within the document */
-    CheckForListElements( doc, &doc->root );
+    CheckTree( doc, &doc->root, CheckForListElements );
 
     /* Checks for natural language change */
     /* Must contain more than 3 words of text in the document
@@ -3292,7 +3288,7 @@ void TY_(AccessibilityChecks)( TidyDocImpl* doc )
     /* Recursively apply all remaining checks to 
     ** each node in document.
     */
-    AccessibilityCheckNode( doc, &doc->root );
+    CheckTree( doc, &doc->root, AccessibilityCheckNode );
 
     /* Cleanup */
     FreeAccessibilityChecks( doc );
@@ -0,0 +1,281 @@
+/* arena.c -- per document memory arena
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+*/
+
+#include "arena.h"
+
+#define ARENA_BLOCK  (64 * 1024)
+
+typedef union _ArenaHeader ArenaHeader;
+
+/* An arena block; the blocks handed out follow it */
+typedef struct _ArenaBlock
+{
+    struct _ArenaBlock* next;
+    ArenaHeader         align;
+} ArenaBlock;
+
+/* A block from the document's allocator, on a list so it can be
+** freed with the arena.  hdr.is.sizeclass is 0.
+*/
+typedef struct _ArenaLarge
+{
+    struct _ArenaLarge* prev;
+    struct _ArenaLarge* next;
+    size_t              size;
+    ArenaHeader         hdr;
+} ArenaLarge;
+
+#define HeaderOf(mem)   ( ((ArenaHeader*) (mem)) - 1 )
+#define LargeOf(mem)    ( ((ArenaLarge*) (mem)) - 1 )
+
+static void* TIDY_CALL ArenaAlloc( TidyAllocator* base, size_t size );
+static void  TIDY_CALL ArenaFree( TidyAllocator* base, void* mem );
+
+static void Charge( TidyArena* arena, uint kind, size_t size )
+{
+    arena->used[kind] += size;
+    if ( arena->used[kind] > arena->peak[kind] )
+        arena->peak[kind] = arena->used[kind];
+
+    arena->used[TidyMemTotal] += size;
+    if ( arena->used[TidyMemTotal] > arena->peak[TidyMemTotal] )
+    {
+        arena->peak[TidyMemTotal] = arena->used[TidyMemTotal];
+        if ( arena->budget && arena->used[TidyMemTotal] > arena->budget )
+            arena->exceeded = yes;
+    }
+}
+
+static void Credit( TidyArena* arena, uint kind, size_t size )
+{
+    arena->used[kind] -= size;
+    arena->used[TidyMemTotal] -= size;
+}
+
+static void Link( TidyArena* arena, ArenaLarge* large )
+{
+#if SUPPORT_DOC_ARENA
+    large->prev = NULL;
+    large->next = arena->large;
+    if ( arena->large )
+        arena->large->prev = large;
+    arena->large = large;
+#endif
+}
+
+static void Unlink( TidyArena* arena, ArenaLarge* large )
+{
+#if SUPPORT_DOC_ARENA
+    if ( large->prev )
+        large->prev->next = large->next;
+    else
+        arena->large = large->next;
+    if ( large->next )
+        large->next->prev = large->prev;
+#endif
+}
+
+/* Puts large where it was in the list, after realloc moved it */
+static void Relink( TidyArena* arena, ArenaLarge* large )
+{
+#if SUPPORT_DOC_ARENA
+    if ( large->prev )
+        large->prev->next = large;
+    else
+        arena->large = large;
+    if ( large->next )
+        large->next->prev = large;
+#endif
+}
+
+static void* AllocLarge( TidyArena* arena, size_t size, uint kind )
+{
+    ArenaLarge* large = (ArenaLarge*) TidyAlloc( arena->allocator,
+                                                 sizeof(ArenaLarge) + size );
+    Link( arena, large );
+    large->size = size;
+    large->hdr.is.sizeclass = 0;
+    large->hdr.is.kind = kind;
+    Charge( arena, kind, size );
+    return large + 1;
+}
+
+#if SUPPORT_DOC_ARENA
+static void* AllocSmall( TidyArena* arena, size_t size, uint kind )
+{
+    size_t sizeclass, need;
+    ArenaHeader* hdr;
+
+    sizeclass = size ? (size + ARENA_ALIGN - 1) / ARENA_ALIGN : 1;
+    Charge( arena, kind, sizeclass * ARENA_ALIGN );
+    if ( arena->freed[sizeclass] )
+    {
+        void* mem = arena->freed[sizeclass];
+        arena->freed[sizeclass] = *(void**) mem;
+        HeaderOf(mem)->is.kind = kind;
+        return mem;
+    }
+
+    need = (sizeclass + 1) * ARENA_ALIGN;
+    if ( (size_t)(arena->limit - arena->next) < need )
+    {
+        ArenaBlock* block = (ArenaBlock*) TidyAlloc( arena->allocator,
+                                                     ARENA_BLOCK );
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->next = (byte*) (block + 1);
+        arena->limit = (byte*) block + ARENA_BLOCK;
+    }
+
+    hdr = (ArenaHeader*) arena->next;
+    hdr->is.sizeclass = (uint) sizeclass;
+    hdr->is.kind = kind;
+    arena->next += need;
+    return hdr + 1;
+}
+#endif
+
+static void* Alloc( TidyArena* arena, size_t size, uint kind )
+{
+#if SUPPORT_DOC_ARENA
+    if ( size <= ARENA_SMALL )
+        return AllocSmall( arena, size, kind );
+#endif
+    return AllocLarge( arena, size, kind );
+}
+
+static void* TIDY_CALL ArenaAlloc( TidyAllocator* base, size_t size )
+{
+    ArenaView* view = (ArenaView*) base;
+    return Alloc( view->arena, size, view->kind );
+}
+
+/* A block keeps the kind it was first allocated as */
+static void* TIDY_CALL ArenaRealloc( TidyAllocator* base, void* mem,
+                                     size_t newsize )
+{
+    TidyArena* arena = ((ArenaView*) base)->arena;
+    ArenaHeader* hdr;
+    void* p;
+
+    if ( mem == NULL )
+        return ArenaAlloc( base, newsize );
+
+    hdr = HeaderOf(mem);
+    if ( hdr->is.sizeclass == 0 )
+    {
+        ArenaLarge* large = LargeOf(mem);
+        uint kind = hdr->is.kind;
+
+        Credit( arena, kind, large->size );
+        large = (ArenaLarge*) TidyRealloc( arena->allocator, large,
+                                           sizeof(ArenaLarge) + newsize );
+        Relink( arena, large );
+        large->size = newsize;
+        Charge( arena, kind, newsize );
+        return large + 1;
+    }
+
+    if ( newsize <= hdr->is.sizeclass * ARENA_ALIGN )
+        return mem;
+
+    p = Alloc( arena, newsize, hdr->is.kind );
+    memcpy( p, mem, hdr->is.sizeclass * ARENA_ALIGN );
+    ArenaFree( base, mem );
+    return p;
+}
+
+static void TIDY_CALL ArenaFree( TidyAllocator* base, void* mem )
+{
+    TidyArena* arena = ((ArenaView*) base)->arena;
+    ArenaHeader* hdr;
+
+    if ( mem == NULL )
+        return;
+
+    hdr = HeaderOf(mem);
+    if ( hdr->is.sizeclass == 0 )
+    {
+        ArenaLarge* large = LargeOf(mem);
+        Credit( arena, hdr->is.kind, large->size );
+        Unlink( arena, large );
+        TidyFree( arena->allocator, large );
+    }
+    else
+    {
+        Credit( arena, hdr->is.kind, hdr->is.sizeclass * ARENA_ALIGN );
+        *(void**) mem = arena->freed[hdr->is.sizeclass];
+        arena->freed[hdr->is.sizeclass] = mem;
+    }
+}
+
+static void TIDY_CALL ArenaPanic( TidyAllocator* base, ctmbstr msg )
+{
+    TidyArena* arena = ((ArenaView*) base)->arena;
+    TidyPanic( arena->allocator, msg );
+}
+
+static const TidyAllocatorVtbl arenaVtbl = {
+    ArenaAlloc,
+    ArenaRealloc,
+    ArenaFree,
+    ArenaPanic
+};
+
+void TY_(InitArena)( TidyArena* arena, TidyAllocator* allocator )
+{
+    uint kind;
+
+    TidyClearMemory( arena, sizeof(*arena) );
+    for ( kind = 0; kind < TidyMemTotal; ++kind )
+    {
+        arena->views[kind].base.vtbl = &arenaVtbl;
+        arena->views[kind].arena = arena;
+        arena->views[kind].kind = (TidyMemKind) kind;
+    }
+    arena->allocator = allocator;
+}
+
+void TY_(FreeArena)( TidyArena* arena )
+{
+    while ( arena->large )
+    {
+        ArenaLarge* next = arena->large->next;
+        TidyFree( arena->allocator, arena->large );
+        arena->large = next;
+    }
+    while ( arena->blocks )
+    {
+        ArenaBlock* next = arena->blocks->next;
+        TidyFree( arena->allocator, arena->blocks );
+        arena->blocks = next;
+    }
+    TY_(InitArena)( arena, arena->allocator );
+}
+
+void TY_(ResetArenaPeak)( TidyArena* arena )
+{
+    uint kind;
+
+    for ( kind = 0; kind <= TidyMemTotal; ++kind )
+        arena->peak[kind] = arena->used[kind];
+}
+
+void TY_(SetArenaBudget)( TidyArena* arena, size_t budget )
+{
+    arena->budget = budget;
+    arena->exceeded = ( budget && arena->used[TidyMemTotal] > budget );
+}
+
+/*
+ * local variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * eval: (c-set-offset 'substatement-open 0)
+ * end:
+ */
@@ -0,0 +1,102 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+/* arena.h -- per document memory arena
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+  A document allocates many small blocks (nodes, attributes, their
+  names and values) and frees most of them only when the document
+  goes.  The arena is an allocator that takes small blocks from
+  large ones it gets from the document's allocator, keeping freed
+  ones on a list per size for reuse, and passes bigger requests on.
+  Everything it holds is freed at once by TY_(FreeArena)(), so a
+  document can be released without visiting its tree.
+
+  The arena also counts the bytes in the blocks it hands out,
+  charging each to the kind of the view it was allocated through.
+  Built with SUPPORT_DOC_ARENA set to 0, it only counts, passing
+  every request on and freeing nothing itself.
+
+*/
+
+#include "forward.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Requests up to ARENA_SMALL bytes come from arena blocks,
+** rounded up to a multiple of ARENA_ALIGN.
+*/
+#define ARENA_ALIGN  sizeof(union _ArenaHeader)
+#define ARENA_SMALL  256
+#define ARENA_CLASSES (ARENA_SMALL / ARENA_ALIGN)
+
+/* Stored just before each block handed out: its size class, or 0
+** for a block from the document's allocator, and what it's for.
+*/
+union _ArenaHeader
+{
+    struct
+    {
+        uint sizeclass;
+        uint kind;      /* TidyMemKind charged for it */
+    } is;
+    void*  ptr;
+    double d;           /* for alignment */
+};
+
+struct _ArenaBlock;
+struct _ArenaLarge;
+struct _TidyArena;
+
+/* The arena as an allocator charging its blocks to kind */
+typedef struct _ArenaView
+{
+    TidyAllocator       base;       /* must be first */
+    struct _TidyArena*  arena;
+    TidyMemKind         kind;
+} ArenaView;
+
+struct _TidyArena
+{
+    ArenaView           views[ TidyMemTotal ];
+    TidyAllocator*      allocator;  /* arena blocks come from here */
+
+    struct _ArenaBlock* blocks;     /* newest first */
+    byte*               next;       /* free space in blocks */
+    byte*               limit;
+    void*               freed[ ARENA_CLASSES + 1 ];  /* by size class */
+    struct _ArenaLarge* large;      /* passed on blocks in use */
+
+    /* bytes in use by kind, TidyMemTotal for all of them */
+    size_t              used[ TidyMemTotal + 1 ];
+    size_t              peak[ TidyMemTotal + 1 ];
+    size_t              budget;     /* 0 for no limit on the total */
+    Bool                exceeded;   /* set when the total passes it */
+};
+
+typedef struct _TidyArena TidyArena;
+
+/* The arena as an allocator charging to kind */
+#define ArenaAllocator(arena, kind)  (&(arena)->views[kind].base)
+
+/* Sets up arena to use allocator for its memory */
+void TY_(InitArena)( TidyArena* arena, TidyAllocator* allocator );
+
+/* Frees all memory allocated from arena, whether freed or not */
+void TY_(FreeArena)( TidyArena* arena );
+
+/* Starts the peaks again from what is in use */
+void TY_(ResetArenaPeak)( TidyArena* arena );
+
+/* Sets the most the arena may hand out before it is exceeded */
+void TY_(SetArenaBudget)( TidyArena* arena, size_t budget );
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __ARENA_H__ */
@@ -16,6 +16,7 @@
 #include "message.h"
 #include "tmbstr.h"
 #include "utf8.h"
+#include "perfhash.h"
 
 /*
  Bind attribute types to procedures to check values.
@@ -270,12 +271,12 @@ static uint AttributeVersions(Node* node, AttVal* attval)
     if (!attval || !attval->dict)
         return VERS_UNKNOWN;
 
-    if (!node || !node->tag || !node->tag->attrvers)
+    if (!node || !NodeTag(node) || !NodeTag(node)->attrvers)
         return attval->dict->versions;
 
-    for (i = 0; node->tag->attrvers[i].attribute; ++i)
-        if (node->tag->attrvers[i].attribute == attval->dict->id)
-            return node->tag->attrvers[i].versions;
+    for (i = 0; NodeTag(node)->attrvers[i].attribute; ++i)
+        if (NodeTag(node)->attrvers[i].attribute == attval->dict->id)
+            return NodeTag(node)->attrvers[i].versions;
 
     return attval->dict->versions & VERS_ALL
              ? VERS_UNKNOWN
@@ -289,12 +290,12 @@ uint TY_(NodeAttributeVersions)( Node* node, TidyAttrId id )
 {
     uint i;
 
-    if (!node || !node->tag || !node->tag->attrvers)
+    if (!node || !NodeTag(node) || !NodeTag(node)->attrvers)
         return VERS_UNKNOWN;
 
-    for (i = 0; node->tag->attrvers[i].attribute; ++i)
-        if (node->tag->attrvers[i].attribute == id)
-            return node->tag->attrvers[i].versions;
+    for (i = 0; NodeTag(node)->attrvers[i].attribute; ++i)
+        if (NodeTag(node)->attrvers[i].attribute == id)
+            return NodeTag(node)->attrvers[i].versions;
 
     return VERS_UNKNOWN;
 }
@@ -306,10 +307,10 @@ static Bool AttributeIsProprietary(Node* node, AttVal* attval)
     if (!node || !attval)
         return no;
 
-    if (!node->tag)
+    if (!NodeTag(node))
         return no;
 
-    if (!(node->tag->versions & VERS_ALL))
+    if (!(NodeTag(node)->versions & VERS_ALL))
         return no;
 
     if (AttributeVersions(node, attval) & VERS_ALL)
@@ -346,24 +347,74 @@ static const struct _colors colors[] =
     { NULL,      NULL      }
 };
 
+/* Caseless perfect hashes of colors[] by name and by code, see
+   perfhash.h.  Slot values are 1 + the colors[] index.  Debug builds
+   check them in InitAttrs() and print new arrays if colors[] has
+   changed. */
+static const unsigned short colorNameHashSeeds[] =
+{
+    3, 1, 1, 0, 2, 1, 1, 4, 6
+};
+static const unsigned short colorNameHashSlots[] =
+{
+    0, 4, 5, 9, 2, 13, 0, 16, 7, 10, 1, 0,
+    6, 8, 11, 12, 14, 0, 3, 0, 15
+};
+
+static const unsigned short colorCodeHashSeeds[] =
+{
+    2, 3, 2, 1, 1, 2, 1, 1, 6
+};
+static const unsigned short colorCodeHashSlots[] =
+{
+    7, 13, 0, 15, 2, 16, 9, 1, 4, 8, 11, 0,
+    6, 0, 0, 10, 0, 5, 12, 14, 3
+};
+
+static const PerfectHash colorNameHash =
+{
+    colorNameHashSeeds, sizeof(colorNameHashSeeds)/sizeof(colorNameHashSeeds[0]),
+    colorNameHashSlots, sizeof(colorNameHashSlots)/sizeof(colorNameHashSlots[0]),
+    yes
+};
+
+static const PerfectHash colorCodeHash =
+{
+    colorCodeHashSeeds, sizeof(colorCodeHashSeeds)/sizeof(colorCodeHashSeeds[0]),
+    colorCodeHashSlots, sizeof(colorCodeHashSlots)/sizeof(colorCodeHashSlots[0]),
+    yes
+};
+
+#define N_COLORS  ( sizeof(colors)/sizeof(colors[0]) )
+
+#ifdef _DEBUG
+static ctmbstr colorName( uint ix )
+{
+    return colors[ix - 1].name;
+}
+
+static ctmbstr colorCode( uint ix )
+{
+    return colors[ix - 1].hex;
+}
+#endif
+
 static ctmbstr GetColorCode(ctmbstr name)
 {
-    uint i;
+    uint ix = TY_(PerfectHashIndex)( &colorNameHash, name );
 
-    for (i = 0; colors[i].name; ++i)
-        if (TY_(tmbstrcasecmp)(name, colors[i].name) == 0)
-            return colors[i].hex;
+    if ( ix && TY_(tmbstrcasecmp)(name, colors[ix - 1].name) == 0 )
+        return colors[ix - 1].hex;
 
     return NULL;
 }
 
 static ctmbstr GetColorName(ctmbstr code)
 {
-    uint i;
+    uint ix = TY_(PerfectHashIndex)( &colorCodeHash, code );
 
-    for (i = 0; colors[i].name; ++i)
-        if (TY_(tmbstrcasecmp)(code, colors[i].hex) == 0)
-            return colors[i].name;
+    if ( ix && TY_(tmbstrcasecmp)(code, colors[ix - 1].hex) == 0 )
+        return colors[ix - 1].name;
 
     return NULL;
 }
@@ -515,104 +566,63 @@ static const struct _colors fancy_colors[] =
 };
 #endif
 
-#if ATTRIBUTE_HASH_LOOKUP
-static uint attrsHash(ctmbstr s)
-{
-    uint hashval;
-
-    for (hashval = 0; *s != '\0'; s++)
-        hashval = *s + 31*hashval;
-
-    return hashval % ATTRIBUTE_HASH_SIZE;
-}
+/* Perfect hash of attribute_defs, see perfhash.h.  Debug builds
+   check it in InitAttrs() and print new arrays if the table has
+   changed.  Unknown names miss in a single probe, so they need no
+   cache of their own. */
+static const unsigned short attrHashSeeds[] =
+{
+    1, 2, 2, 2, 1, 7, 0, 1, 1, 2, 4, 2,
+    2, 2, 3, 1, 2, 5, 1, 1, 0, 4, 3, 1,
+    2, 1, 2, 1, 5, 4, 1, 3, 0, 9, 5, 5,
+    0, 7, 6, 9, 2, 3, 3, 5, 7, 4, 2, 4,
+    1, 1, 8, 7, 1, 2, 4, 2, 6, 18, 1, 0,
+    2, 1, 1, 1, 9, 1, 10, 1, 4, 1, 3, 1,
+    1, 6, 2, 1, 5, 6, 5, 9, 7
+};
+static const unsigned short attrHashSlots[] =
+{
+    146, 34, 145, 133, 33, 18, 74, 156, 0, 111, 27, 0,
+    89, 42, 14, 140, 100, 0, 0, 0, 25, 48, 0, 84,
+    104, 68, 3, 50, 39, 93, 0, 0, 0, 117, 0, 53,
+    110, 70, 88, 0, 101, 115, 94, 62, 0, 0, 0, 151,
+    0, 51, 107, 87, 86, 160, 7, 36, 29, 0, 0, 131,
+    0, 99, 44, 0, 30, 81, 137, 149, 0, 13, 114, 119,
+    6, 129, 0, 83, 0, 31, 138, 8, 55, 37, 0, 52,
+    2, 75, 69, 141, 142, 90, 144, 153, 11, 85, 124, 40,
+    0, 0, 77, 135, 161, 82, 0, 147, 0, 97, 60, 78,
+    121, 112, 108, 132, 0, 0, 26, 118, 28, 0, 159, 0,
+    125, 46, 10, 63, 128, 1, 150, 116, 105, 57, 67, 61,
+    96, 12, 0, 4, 32, 73, 17, 72, 49, 22, 47, 109,
+    0, 15, 123, 127, 0, 136, 54, 76, 41, 106, 95, 9,
+    38, 102, 103, 21, 98, 143, 126, 0, 0, 0, 79, 0,
+    130, 20, 58, 16, 139, 0, 113, 148, 35, 152, 0, 71,
+    43, 155, 157, 91, 59, 45, 23, 66, 19, 154, 64, 134,
+    65, 158, 0, 80, 92, 24, 5, 120, 56, 122
+};
 
-static const Attribute *attrsInstall(TidyDocImpl* doc, TidyAttribImpl * attribs,
-                                const Attribute* old)
+static const PerfectHash attrHash =
 {
-    AttrHash *np;
-    uint hashval;
-
-    if (old)
-    {
-        np = (AttrHash *)TidyDocAlloc(doc, sizeof(*np));
-        np->attr = old;
-
-        hashval = attrsHash(old->name);
-        np->next = attribs->hashtab[hashval];
-        attribs->hashtab[hashval] = np;
-    }
-
-    return old;
-}
+    attrHashSeeds, sizeof(attrHashSeeds)/sizeof(attrHashSeeds[0]),
+    attrHashSlots, sizeof(attrHashSlots)/sizeof(attrHashSlots[0]),
+    no
+};
 
-static void attrsRemoveFromHash( TidyDocImpl* doc, TidyAttribImpl *attribs,
-                            ctmbstr s )
+#ifdef _DEBUG
+static ctmbstr attrDefName( uint ix )
 {
-    uint h = attrsHash(s);
-    AttrHash *p, *prev = NULL;
-    for (p = attribs->hashtab[h]; p && p->attr; p = p->next)
-    {
-        if (TY_(tmbstrcmp)(s, p->attr->name) == 0)
-        {
-            AttrHash* next = p->next;
-            if ( prev )
-                prev->next = next; 
-            else
-                attribs->hashtab[h] = next;
-            TidyDocFree(doc, p);
-            return;
-        }
-        prev = p;
-    }
-}
-
-static void attrsEmptyHash( TidyDocImpl* doc, TidyAttribImpl * attribs )
-{
-    AttrHash *dict, *next;
-    uint i;
-
-    for (i = 0; i < ATTRIBUTE_HASH_SIZE; ++i)
-    {
-        dict = attribs->hashtab[i];
-
-        while(dict)
-        {
-            next = dict->next;
-            TidyDocFree(doc, dict);
-            dict = next;
-        }
-
-        attribs->hashtab[i] = NULL;
-    }
+    return attribute_defs[ix].name;
 }
 #endif
 
-static const Attribute* attrsLookup(TidyDocImpl* doc,
+static const Attribute* attrsLookup(TidyDocImpl* ARG_UNUSED(doc),
                                TidyAttribImpl* ARG_UNUSED(attribs),
                                ctmbstr atnam)
 {
-    const Attribute *np;
-#if ATTRIBUTE_HASH_LOOKUP
-    const AttrHash *p;
-#endif
-
-    if (!atnam)
-        return NULL;
-
-#if ATTRIBUTE_HASH_LOOKUP
-    for (p = attribs->hashtab[attrsHash(atnam)]; p && p->attr; p = p->next)
-        if (TY_(tmbstrcmp)(atnam, p->attr->name) == 0)
-            return p->attr;
-
-    for (np = attribute_defs; np && np->name; ++np)
-        if (TY_(tmbstrcmp)(atnam, np->name) == 0)
-            return attrsInstall(doc, attribs, np);
-#else
-    for (np = attribute_defs; np && np->name; ++np)
-        if (TY_(tmbstrcmp)(atnam, np->name) == 0)
-            return np;
-#endif
+    uint ix = TY_(PerfectHashIndex)( &attrHash, atnam );
 
+    if ( ix && TY_(tmbstrcmp)(atnam, attribute_defs[ix].name) == 0 )
+        return attribute_defs + ix;
     return NULL;
 }
 
@@ -621,7 +631,7 @@ static const Attribute* attrsLookup(TidyDocImpl* doc,
 AttVal* TY_(AttrGetById)( Node* node, TidyAttrId id )
 {
    AttVal* av;
-   for ( av = node->attributes; av; av = av->next )
+   for ( av = NodeAttrs(node); av; av = av->next )
    {
      if ( AttrIsId(av, id) )
          return av;
@@ -637,10 +647,16 @@ const Attribute* TY_(FindAttribute)( TidyDocImpl* doc, AttVal *attval )
     return NULL;
 }
 
+ctmbstr TY_(KnownAttrName)( ctmbstr s )
+{
+    const Attribute* np = attrsLookup( NULL, NULL, s );
+    return np ? np->name : NULL;
+}
+
 AttVal* TY_(GetAttrByName)( Node *node, ctmbstr name )
 {
     AttVal *attr;
-    for (attr = node->attributes; attr != NULL; attr = attr->next)
+    for (attr = NodeAttrs(node); attr != NULL; attr = attr->next)
     {
         if (attr->attribute && TY_(tmbstrcmp)(attr->attribute, name) == 0)
             break;
@@ -653,7 +669,7 @@ AttVal* TY_(AddAttribute)( TidyDocImpl* doc,
 {
     AttVal *av = TY_(NewAttribute)(doc);
     av->delim = '"';
-    av->attribute = TY_(tmbstrdup)(doc->allocator, name);
+    av->attribute = InternAttrStr(doc, name);
 
     if (value)
         av->value = TY_(tmbstrdup)(doc->allocator, value);
@@ -662,7 +678,7 @@ AttVal* TY_(AddAttribute)( TidyDocImpl* doc,
 
     av->dict = attrsLookup(doc, &doc->attribs, name);
 
-    TY_(InsertAttributeAtEnd)(node, av);
+    TY_(InsertAttributeAtEnd)(doc, node, av);
     return av;
 }
 
@@ -672,6 +688,7 @@ AttVal* TY_(RepairAttrValue)(TidyDocImpl* doc, Node* node, ctmbstr name, ctmbstr
 
     if (old)
     {
+        old = TY_(OwnAttr)(doc, node, old);
         if (old->value)
             TidyDocFree(doc, old->value);
         if (value)
@@ -881,6 +898,15 @@ void TY_(InitAttrs)( TidyDocImpl* doc )
         const Attribute* dict = &attribute_defs[ ix ];
         assert( (uint) dict->id == ix );
       }
+      ix = TY_(CheckPerfectHash)( &attrHash, attrDefName,
+                                  N_TIDY_ATTRIBS, "attrHash" );
+      assert( ix );
+      ix = TY_(CheckPerfectHash)( &colorNameHash, colorName,
+                                  N_COLORS, "colorNameHash" );
+      assert( ix );
+      ix = TY_(CheckPerfectHash)( &colorCodeHash, colorCode,
+                                  N_COLORS, "colorCodeHash" );
+      assert( ix );
     }
 #endif
 }
@@ -893,9 +919,6 @@ static void FreeDeclaredAttributes( TidyDocImpl* doc )
     while ( NULL != (dict = attribs->declared_attr_list) )
     {
         attribs->declared_attr_list = dict->next;
-#if ATTRIBUTE_HASH_LOOKUP
-        attrsRemoveFromHash( doc, &doc->attribs, dict->name );
-#endif
         TidyDocFree( doc, dict->name );
         TidyDocFree( doc, dict );
     }
@@ -903,31 +926,63 @@ static void FreeDeclaredAttributes( TidyDocImpl* doc )
 
 void TY_(FreeAttrTable)( TidyDocImpl* doc )
 {
-#if ATTRIBUTE_HASH_LOOKUP
-    attrsEmptyHash( doc, &doc->attribs );
-#endif
     TY_(FreeAnchors)( doc );
     FreeDeclaredAttributes( doc );
 }
 
-void TY_(AppendToClassAttr)( TidyDocImpl* doc, AttVal *classattr, ctmbstr classname )
+/*
+  A run of appends to an attribute value keeps the length of the
+  value and the room allocated for it in the attribute, and grows
+  the room by doubling it, so the run costs time in proportion to
+  what it adds rather than to the value's length times the number
+  of appends.  The value is a plain string throughout.  The run
+  must be ended by TY_(FinishAttrValue)() before anything other
+  than an append changes the value.
+*/
+void TY_(AppendToAttrValue)( TidyDocImpl* doc, AttVal *av, ctmbstr str )
 {
-    uint len = TY_(tmbstrlen)(classattr->value) +
-        TY_(tmbstrlen)(classname) + 2;
-    tmbstr s = (tmbstr) TidyDocAlloc( doc, len );
-    s[0] = '\0';
-    if (classattr->value)
+    uint len = TY_(tmbstrlen)( str );
+
+    if ( av->size == 0 )
     {
-        TY_(tmbstrcpy)( s, classattr->value );
-        TY_(tmbstrcat)( s, " " );
+        av->length = TY_(tmbstrlen)( av->value );
+        av->size = av->length + 1;
     }
-    TY_(tmbstrcat)( s, classname );
+
+    if ( av->length + len + 1 > av->size )
+    {
+        uint size = 2 * av->size;
+        if ( size < av->length + len + 1 )
+            size = av->length + len + 1;
+        av->value = (tmbstr) TidyDocRealloc( doc, av->value, size );
+        av->size = size;
+    }
+
+    memcpy( av->value + av->length, str, len + 1 );
+    av->length += len;
+}
+
+void TY_(FinishAttrValue)( TidyDocImpl* ARG_UNUSED(doc), AttVal *av )
+{
+    av->length = 0;
+    av->size = 0;
+}
+
+/* append classname to the classes in classattr, during a run */
+static void AddToClassAttr( TidyDocImpl* doc, AttVal *classattr, ctmbstr classname )
+{
     if (classattr->value)
-        TidyDocFree( doc, classattr->value );
-    classattr->value = s;
+        TY_(AppendToAttrValue)( doc, classattr, " " );
+    TY_(AppendToAttrValue)( doc, classattr, classname );
 }
 
-/* concatenate styles */
+void TY_(AppendToClassAttr)( TidyDocImpl* doc, AttVal *classattr, ctmbstr classname )
+{
+    AddToClassAttr( doc, classattr, classname );
+    TY_(FinishAttrValue)( doc, classattr );
+}
+
+/* concatenate styles, during a run */
 static void AppendToStyleAttr( TidyDocImpl* doc, AttVal *styleattr, ctmbstr styleprop )
 {
     /*
@@ -935,39 +990,31 @@ static void AppendToStyleAttr( TidyDocImpl* doc, AttVal *styleattr, ctmbstr styl
     leading/trailing white-space very well
     see http://www.w3.org/TR/css-style-attr
     */
-    uint end = TY_(tmbstrlen)(styleattr->value);
+    uint end = styleattr->size ? styleattr->length
+                               : TY_(tmbstrlen)(styleattr->value);
 
     if (end >0 && styleattr->value[end - 1] == ';')
     {
         /* attribute ends with declaration seperator */
 
-        styleattr->value = (tmbstr) TidyDocRealloc(doc, styleattr->value,
-            end + TY_(tmbstrlen)(styleprop) + 2);
-
-        TY_(tmbstrcat)(styleattr->value, " ");
-        TY_(tmbstrcat)(styleattr->value, styleprop);
+        TY_(AppendToAttrValue)(doc, styleattr, " ");
+        TY_(AppendToAttrValue)(doc, styleattr, styleprop);
     }
     else if (end >0 && styleattr->value[end - 1] == '}')
     {
         /* attribute ends with rule set */
 
-        styleattr->value = (tmbstr) TidyDocRealloc(doc, styleattr->value,
-            end + TY_(tmbstrlen)(styleprop) + 6);
-
-        TY_(tmbstrcat)(styleattr->value, " { ");
-        TY_(tmbstrcat)(styleattr->value, styleprop);
-        TY_(tmbstrcat)(styleattr->value, " }");
+        TY_(AppendToAttrValue)(doc, styleattr, " { ");
+        TY_(AppendToAttrValue)(doc, styleattr, styleprop);
+        TY_(AppendToAttrValue)(doc, styleattr, " }");
     }
     else
     {
         /* attribute ends with property value */
 
-        styleattr->value = (tmbstr) TidyDocRealloc(doc, styleattr->value,
-            end + TY_(tmbstrlen)(styleprop) + 3);
-
         if (end > 0)
-            TY_(tmbstrcat)(styleattr->value, "; ");
-        TY_(tmbstrcat)(styleattr->value, styleprop);
+            TY_(AppendToAttrValue)(doc, styleattr, "; ");
+        TY_(AppendToAttrValue)(doc, styleattr, styleprop);
     }
 }
 
@@ -986,7 +1033,7 @@ static Bool AttrsHaveSameName( AttVal* av1, AttVal* av2)
     if (id1 != TidyAttr_UNKNOWN || id2 != TidyAttr_UNKNOWN)
         return no;
     if (av1->attribute && av2->attribute)
-        return TY_(tmbstrcmp)(av1->attribute, av2->attribute) == 0;
+        return av1->attribute == av2->attribute;
      return no;
 }
 
@@ -994,7 +1041,7 @@ void TY_(RepairDuplicateAttributes)( TidyDocImpl* doc, Node *node, Bool isXml )
 {
     AttVal *first;
 
-    for (first = node->attributes; first != NULL;)
+    for (first = NodeAttrs(node); first != NULL;)
     {
         AttVal *second;
         Bool firstRedefined = no;
@@ -1018,6 +1065,7 @@ void TY_(RepairDuplicateAttributes)( TidyDocImpl* doc, Node *node, Bool isXml )
 
             /* first and second attribute have same local name */
             /* now determine what to do with this duplicate... */
+            first = TY_(OwnAttr)(doc, node, first);
 
             if (!isXml
                 && attrIsCLASS(first) && cfgBool(doc, TidyJoinClasses)
@@ -1025,7 +1073,7 @@ void TY_(RepairDuplicateAttributes)( TidyDocImpl* doc, Node *node, Bool isXml )
             {
                 /* concatenate classes */
 
-                TY_(AppendToClassAttr)(doc, first, second->value);
+                AddToClassAttr(doc, first, second->value);
 
                 temp = second->next;
                 TY_(ReportAttrError)( doc, node, second, JOINING_ATTRIBUTE);
@@ -1060,6 +1108,7 @@ void TY_(RepairDuplicateAttributes)( TidyDocImpl* doc, Node *node, Bool isXml )
                 second = temp;
             }
         }
+        TY_(FinishAttrValue)( doc, first );
         if (!firstRedefined)
             first = first->next;
     }
@@ -1085,7 +1134,14 @@ const Attribute* TY_(CheckAttribute)( TidyDocImpl* doc, Node *node, AttVal *attv
         TY_(ConstrainVersion)(doc, AttributeVersions(node, attval));
         
         if (attribute->attrchk)
+        {
+            /* the check may give node its own copy of the list */
+            Bool first = ( attval == NodeAttrs(node) );
+
             attribute->attrchk( doc, node, attval );
+            if ( first )
+                attval = NodeAttrs(node);
+        }
     }
 
     if (AttributeIsProprietary(node, attval))
@@ -1140,13 +1196,14 @@ Bool TY_(attrIsEvent)( AttVal* attval )
             atid == TidyAttr_OnUNLOAD);
 }
 
-static void CheckLowerCaseAttrValue( TidyDocImpl* doc, Node *node, AttVal *attval)
+/* returns the attribute of node holding the value, see OwnAttr() */
+static AttVal* CheckLowerCaseAttrValue( TidyDocImpl* doc, Node *node, AttVal *attval)
 {
     tmbstr p;
     Bool hasUpper = no;
     
     if (!AttrHasValue(attval))
-        return;
+        return attval;
 
     p = attval->value;
     
@@ -1167,8 +1224,12 @@ static void CheckLowerCaseAttrValue( TidyDocImpl* doc, Node *node, AttVal *attva
             TY_(ReportAttrError)( doc, node, attval, ATTR_VALUE_NOT_LCASE);
   
         if ( lexer->isvoyager || cfgBool(doc, TidyLowerLiterals) )
+        {
+            attval = TY_(OwnAttr)(doc, node, attval);
             attval->value = TY_(tmbstrtolower)(attval->value);
+        }
     }
+    return attval;
 }
 
 /* methods for checking value of a specific attribute */
@@ -1199,7 +1260,11 @@ void TY_(CheckUrl)( TidyDocImpl* doc, Node *node, AttVal *attval)
         {
             ++backslash_count;
             if ( cfgBool(doc, TidyFixBackslash) && !isJavascript)
+            {
+                attval = TY_(OwnAttr)(doc, node, attval);
+                p = attval->value;
                 p[i] = '/';
+            }
         }
         else if ((c > 0x7e) || (c <= 0x20) || (strchr("<>", c)))
             ++escape_count;
@@ -1219,6 +1284,7 @@ void TY_(CheckUrl)( TidyDocImpl* doc, Node *node, AttVal *attval)
         }
         dest[pos] = 0;
 
+        attval = TY_(OwnAttr)(doc, node, attval);
         TidyDocFree(doc, attval->value);
         attval->value = dest;
     }
@@ -1348,7 +1414,7 @@ static void CheckAttrValidity( TidyDocImpl* doc, Node *node, AttVal *attval,
         return;
     }
 
-    CheckLowerCaseAttrValue( doc, node, attval );
+    attval = CheckLowerCaseAttrValue( doc, node, attval );
 
     if (!AttrValueIsAmong(attval, list))
         TY_(ReportAttrError)( doc, node, attval, BAD_ATTRIBUTE_VALUE);
@@ -1410,7 +1476,7 @@ void CheckBool( TidyDocImpl* doc, Node *node, AttVal *attval)
     if (!AttrHasValue(attval))
         return;
 
-    CheckLowerCaseAttrValue( doc, node, attval );
+    attval = CheckLowerCaseAttrValue( doc, node, attval );
 }
 
 void CheckAlign( TidyDocImpl* doc, Node *node, AttVal *attval)
@@ -1418,7 +1484,7 @@ void CheckAlign( TidyDocImpl* doc, Node *node, AttVal *attval)
     ctmbstr const values[] = {"left", "right", "center", "justify", NULL};
 
     /* IMG, OBJECT, APPLET and EMBED use align for vertical position */
-    if (node->tag && (node->tag->model & CM_IMG))
+    if (NodeTag(node) && (NodeTag(node)->model & CM_IMG))
     {
         CheckValign( doc, node, attval );
         return;
@@ -1430,7 +1496,7 @@ void CheckAlign( TidyDocImpl* doc, Node *node, AttVal *attval)
         return;
     }
 
-    CheckLowerCaseAttrValue( doc, node, attval);
+    attval = CheckLowerCaseAttrValue( doc, node, attval );
 
     /* currently CheckCaption(...) takes care of the remaining cases */
     if (nodeIsCAPTION(node))
@@ -1459,7 +1525,7 @@ void CheckValign( TidyDocImpl* doc, Node *node, AttVal *attval)
         return;
     }
 
-    CheckLowerCaseAttrValue( doc, node, attval );
+    attval = CheckLowerCaseAttrValue( doc, node, attval );
 
     if (AttrValueIsAmong(attval, values))
     {
@@ -1467,7 +1533,7 @@ void CheckValign( TidyDocImpl* doc, Node *node, AttVal *attval)
     }
     else if (AttrValueIsAmong(attval, values2))
     {
-        if (!(node->tag && (node->tag->model & CM_IMG)))
+        if (!(NodeTag(node) && (NodeTag(node)->model & CM_IMG)))
             TY_(ReportAttrError)( doc, node, attval, BAD_ATTRIBUTE_VALUE);
     }
     else if (AttrValueIsAmong(attval, valuesp))
@@ -1546,11 +1612,14 @@ void CheckClear( TidyDocImpl* doc, Node *node, AttVal *attval)
     {
         TY_(ReportAttrError)( doc, node, attval, MISSING_ATTR_VALUE);
         if (attval->value == NULL)
+        {
+            attval = TY_(OwnAttr)(doc, node, attval);
             attval->value = TY_(tmbstrdup)( doc->allocator, "none" );
+        }
         return;
     }
 
-    CheckLowerCaseAttrValue( doc, node, attval );
+    attval = CheckLowerCaseAttrValue( doc, node, attval );
         
     if (!AttrValueIsAmong(attval, values))
         TY_(ReportAttrError)( doc, node, attval, BAD_ATTRIBUTE_VALUE);
@@ -1600,20 +1669,19 @@ void CheckNumber( TidyDocImpl* doc, Node *node, AttVal *attval)
     }
 }
 
-/* check hexadecimal color value */
+#define IsHexDigit(c)  ( ((c) >= '0' && (c) <= '9') || \
+                         (((c) | 0x20) >= 'a' && ((c) | 0x20) <= 'f') )
+
+/* check hexadecimal color value: exactly six hex digits */
 static Bool IsValidColorCode(ctmbstr color)
 {
     uint i;
 
-    if (TY_(tmbstrlen)(color) != 6)
-        return no;
-
-    /* check if valid hex digits and letters */
     for (i = 0; i < 6; i++)
-        if (!TY_(IsDigit)(color[i]) && !strchr("abcdef", TY_(ToLower)(color[i])))
+        if (!IsHexDigit(color[i]))
             return no;
 
-    return yes;
+    return color[6] == '\0';
 }
 
 /* check color syntax and beautify value by option */
@@ -1642,6 +1710,7 @@ void CheckColor( TidyDocImpl* doc, Node *node, AttVal *attval)
 
         TY_(ReportAttrError)(doc, node, attval, BAD_ATTRIBUTE_VALUE_REPLACED);
 
+        attval = TY_(OwnAttr)(doc, node, attval);
         TidyDocFree(doc, attval->value);
         given = attval->value = s;
     }
@@ -1655,6 +1724,7 @@ void CheckColor( TidyDocImpl* doc, Node *node, AttVal *attval)
 
         if (newName)
         {
+            attval = TY_(OwnAttr)(doc, node, attval);
             TidyDocFree(doc, attval->value);
             given = attval->value = TY_(tmbstrdup)(doc->allocator, newName);
         }
@@ -1664,6 +1734,9 @@ void CheckColor( TidyDocImpl* doc, Node *node, AttVal *attval)
     if (!valid)
         valid = GetColorCode(given) != NULL;
 
+    if (valid)
+        attval = TY_(OwnAttr)(doc, node, attval);
+
     if (valid && given[0] == '#')
         attval->value = TY_(tmbstrtoupper)(attval->value);
     else if (valid)
@@ -1752,14 +1825,15 @@ void CheckType( TidyDocImpl* doc, Node *node, AttVal *attval)
 static
 AttVal *SortAttVal( AttVal* list, TidyAttrSortStrategy strat );
 
-void TY_(SortAttributes)(Node* node, TidyAttrSortStrategy strat)
+void TY_(SortAttributes)(TidyDocImpl* doc, Node* node, TidyAttrSortStrategy strat)
 {
     while (node)
     {
-        node->attributes = SortAttVal( node->attributes, strat );
-        if (node->content)
-            TY_(SortAttributes)(node->content, strat);
-        node = node->next;
+        TY_(OwnAttrs)(doc, node);
+        SetNodeAttrs(node, SortAttVal( NodeAttrs(node), strat ));
+        if (NodeContent(node))
+            TY_(SortAttributes)(doc, NodeContent(node), strat);
+        node = NodeNext(node);
     }
 }
 
@@ -43,25 +43,6 @@ struct _Anchor
 
 typedef struct _Anchor Anchor;
 
-#if !defined(ATTRIBUTE_HASH_LOOKUP)
-#define ATTRIBUTE_HASH_LOOKUP 1
-#endif
-
-#if ATTRIBUTE_HASH_LOOKUP
-enum
-{
-    ATTRIBUTE_HASH_SIZE=178u
-};
-
-struct _AttrHash
-{
-    Attribute const*  attr;
-    struct _AttrHash* next;
-};
-
-typedef struct _AttrHash AttrHash;
-#endif
-
 struct _TidyAttribImpl
 {
     /* anchor/node lookup */
@@ -69,10 +50,6 @@ struct _TidyAttribImpl
 
     /* Declared literal attributes */
     Attribute* declared_attr_list;
-
-#if ATTRIBUTE_HASH_LOOKUP
-    AttrHash*  hashtab[ATTRIBUTE_HASH_SIZE];
-#endif
 };
 
 typedef struct _TidyAttribImpl TidyAttribImpl;
@@ -86,6 +63,9 @@ const Attribute* TY_(CheckAttribute)( TidyDocImpl* doc, Node *node, AttVal *attv
 
 const Attribute* TY_(FindAttribute)( TidyDocImpl* doc, AttVal *attval );
 
+/* The name of the built-in attribute called s, NULL if none */
+ctmbstr TY_(KnownAttrName)( ctmbstr s );
+
 AttVal* TY_(GetAttrByName)( Node *node, ctmbstr name );
 
 AttVal* TY_(AddAttribute)( TidyDocImpl* doc,
@@ -132,13 +112,18 @@ void TY_(FreeAnchors)( TidyDocImpl* doc );
 void TY_(InitAttrs)( TidyDocImpl* doc );
 void TY_(FreeAttrTable)( TidyDocImpl* doc );
 
+/* appends to an attribute value, leaving room to append more */
+void TY_(AppendToAttrValue)( TidyDocImpl* doc, AttVal *av, ctmbstr str );
+/* ends a run of appends to an attribute value */
+void TY_(FinishAttrValue)( TidyDocImpl* doc, AttVal *av );
+
 void TY_(AppendToClassAttr)( TidyDocImpl* doc, AttVal *classattr, ctmbstr classname );
 /*
  the same attribute name can't be used
  more than once in each element
 */
 void TY_(RepairDuplicateAttributes)( TidyDocImpl* doc, Node* node, Bool isXml );
-void TY_(SortAttributes)(Node* node, TidyAttrSortStrategy strat);
+void TY_(SortAttributes)(TidyDocImpl* doc, Node* node, TidyAttrSortStrategy strat);
 
 Bool TY_(IsBoolAttribute)( AttVal* attval );
 Bool TY_(attrIsEvent)( AttVal* attval );
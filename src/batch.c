@@ -0,0 +1,377 @@
+/* batch.c -- tidy many documents on a pool of threads
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+  Each worker owns a queue, a range of the items, and takes the
+  lowest one left in it.  A worker whose queue is empty steals the
+  upper half of the first other queue that still has work, so the
+  threads stay busy however the work is spread.  Finished items are
+  handed to the callback strictly in input order, by whichever
+  thread finishes the item that lets the order move on.
+
+*/
+
+#include "tidy-int.h"
+#include "streamio.h"
+#include "buffio.h"
+
+#include <errno.h>
+
+#if SUPPORT_BATCH_THREADS && defined(_WIN32)
+
+#if _MSC_VER < 1300  /* less than msvc++ 7.0 */
+#pragma warning(disable:4115) /* named type definition in parentheses in windows headers */
+#endif
+#include <windows.h>
+#include <process.h>
+
+typedef CRITICAL_SECTION BatchLock;
+typedef HANDLE           BatchThread;
+
+#define InitLock(lock)   InitializeCriticalSection(lock)
+#define FreeLock(lock)   DeleteCriticalSection(lock)
+#define Lock(lock)       EnterCriticalSection(lock)
+#define Unlock(lock)     LeaveCriticalSection(lock)
+
+#elif SUPPORT_BATCH_THREADS
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_mutex_t  BatchLock;
+typedef pthread_t        BatchThread;
+
+#define InitLock(lock)   pthread_mutex_init(lock, NULL)
+#define FreeLock(lock)   pthread_mutex_destroy(lock)
+#define Lock(lock)       pthread_mutex_lock(lock)
+#define Unlock(lock)     pthread_mutex_unlock(lock)
+
+#else
+
+typedef int              BatchLock;
+
+#define InitLock(lock)   ((void) (lock))
+#define FreeLock(lock)   ((void) (lock))
+#define Lock(lock)       ((void) (lock))
+#define Unlock(lock)     ((void) (lock))
+
+#endif
+
+typedef struct _BatchQueue BatchQueue;
+typedef struct _Batch Batch;
+
+/* A worker's items still to do are [next, end) */
+struct _BatchQueue
+{
+    BatchLock   lock;
+    uint        next;
+    uint        end;
+    Batch*      batch;
+};
+
+struct _Batch
+{
+    TidyDoc            config;
+    TidyAllocator*     allocator;
+    TidyBatchItem*     items;
+    uint               count;
+    TidyBatchCallback  callback;
+    void*              appData;
+
+    BatchQueue*        queues;
+    uint               nQueues;
+
+    BatchLock          doneLock;  /* guards the fields below */
+    Bool*              done;
+    uint               delivered; /* items handed to the callback */
+    Bool               delivering;
+};
+
+static uint CountProcessors( void )
+{
+#if SUPPORT_BATCH_THREADS && defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+    return info.dwNumberOfProcessors;
+#elif SUPPORT_BATCH_THREADS && defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf( _SC_NPROCESSORS_ONLN );
+    return n > 0 ? (uint) n : 1;
+#else
+    return 1;
+#endif
+}
+
+/* Run one item through parse, clean and save, as the console tool
+** does for each file it is given, but into the item's buffers.
+*/
+static void ProcessItem( Batch* batch, TidyBatchItem* item )
+{
+    TidyDoc tdoc = tidyCreateWithAllocator( batch->allocator );
+    TidyDocImpl* doc = tidyDocToImpl( tdoc );
+    TidyDocImpl* config = tidyDocToImpl( batch->config );
+    StreamOut* errout = config->errout;
+    TidyBuffer discard;
+    int status = 0;
+
+    tidyBufInitWithAllocator( &discard, batch->allocator );
+    tidyOptCopyConfig( tdoc, batch->config );
+    tidySetAppData( tdoc, item->appData );
+
+    /* Messages are written as config's error output would write them */
+    TY_(ReleaseStreamOut)( doc, doc->errout );
+    doc->errout = TY_(BufferOutput)( doc, item->messages ? item->messages : &discard,
+                                     errout->encoding, errout->nl );
+
+    if ( item->file )
+    {
+        if ( tidyOptGetBool(tdoc, TidyEmacs) )
+            tidyOptSetValue( tdoc, TidyEmacsFile, item->file );
+        status = tidyParseFile( tdoc, item->file );
+    }
+    else
+        status = tidyParseBuffer( tdoc, item->input );
+
+    if ( status >= 0 )
+        status = tidyCleanAndRepair( tdoc );
+
+    if ( status >= 0 )
+        status = tidyRunDiagnostics( tdoc );
+
+    if ( status > 1 ) /* If errors, do we want to force output? */
+        status = ( tidyOptGetBool(tdoc, TidyForceOutput) ? status : -1 );
+
+    if ( status >= 0 && tidyOptGetBool(tdoc, TidyShowMarkup) )
+    {
+        if ( item->outFile )
+            status = tidySaveFile( tdoc, item->outFile );
+        else if ( item->output )
+            status = tidySaveBuffer( tdoc, item->output );
+    }
+
+    item->status = status;
+    item->errorCount = tidyErrorCount( tdoc );
+    item->warningCount = tidyWarningCount( tdoc );
+    item->accessWarningCount = tidyAccessWarningCount( tdoc );
+
+    /* So tidyErrorSummary( config ) covers every item */
+    Lock( &batch->doneLock );
+    config->badAccess |= doc->badAccess;
+    config->badLayout |= doc->badLayout;
+    config->badChars |= doc->badChars;
+    config->badForm |= doc->badForm;
+    Unlock( &batch->doneLock );
+
+    tidyRelease( tdoc );
+    tidyBufFree( &discard );
+}
+
+/* Next item from the worker's own queue, or stolen from another */
+static Bool TakeItem( BatchQueue* own, uint* ix )
+{
+    Batch* batch = own->batch;
+    uint i;
+
+    Lock( &own->lock );
+    if ( own->next < own->end )
+    {
+        *ix = own->next++;
+        Unlock( &own->lock );
+        return yes;
+    }
+    Unlock( &own->lock );
+
+    for ( i = 1; i < batch->nQueues; ++i )
+    {
+        BatchQueue* victim = batch->queues +
+            ( own - batch->queues + i ) % batch->nQueues;
+        uint mid, end;
+
+        Lock( &victim->lock );
+        end = victim->end;
+        mid = end - ( end - victim->next + 1 ) / 2;
+        if ( victim->next < end )
+            victim->end = mid;
+        Unlock( &victim->lock );
+
+        if ( mid < end )
+        {
+            /* keep the first stolen item, queue the rest */
+            Lock( &own->lock );
+            own->next = mid + 1;
+            own->end = end;
+            Unlock( &own->lock );
+            *ix = mid;
+            return yes;
+        }
+    }
+    return no;
+}
+
+/* Mark an item done and deliver all that are now in order.  If
+** another thread is delivering it picks this one up too.
+*/
+static void FinishItem( Batch* batch, uint ix )
+{
+    Lock( &batch->doneLock );
+    batch->done[ix] = yes;
+    if ( !batch->delivering )
+    {
+        batch->delivering = yes;
+        while ( batch->delivered < batch->count
+                && batch->done[batch->delivered] )
+        {
+            uint next = batch->delivered++;
+            Unlock( &batch->doneLock );
+            if ( batch->callback )
+                batch->callback( batch->items + next, next, batch->appData );
+            Lock( &batch->doneLock );
+        }
+        batch->delivering = no;
+    }
+    Unlock( &batch->doneLock );
+}
+
+static void RunWorker( BatchQueue* own )
+{
+    uint ix;
+
+    while ( TakeItem(own, &ix) )
+    {
+        ProcessItem( own->batch, own->batch->items + ix );
+        FinishItem( own->batch, ix );
+    }
+}
+
+#if SUPPORT_BATCH_THREADS && defined(_WIN32)
+
+static unsigned __stdcall WorkerThread( void* arg )
+{
+    RunWorker( (BatchQueue*) arg );
+    return 0;
+}
+
+static Bool StartThread( BatchThread* thread, BatchQueue* queue )
+{
+    *thread = (HANDLE) _beginthreadex( NULL, 0, WorkerThread, queue, 0, NULL );
+    return *thread != 0;
+}
+
+static void JoinThread( BatchThread thread )
+{
+    WaitForSingleObject( thread, INFINITE );
+    CloseHandle( thread );
+}
+
+#elif SUPPORT_BATCH_THREADS
+
+static void* WorkerThread( void* arg )
+{
+    RunWorker( (BatchQueue*) arg );
+    return NULL;
+}
+
+static Bool StartThread( BatchThread* thread, BatchQueue* queue )
+{
+    return pthread_create( thread, NULL, WorkerThread, queue ) == 0;
+}
+
+static void JoinThread( BatchThread thread )
+{
+    pthread_join( thread, NULL );
+}
+
+#endif
+
+int TIDY_CALL tidyProcessBatch( TidyDoc config, TidyBatchItem* items,
+                                uint count, uint threads,
+                                TidyBatchCallback callback, void* appData )
+{
+    TidyDocImpl* impl = tidyDocToImpl( config );
+    Batch batch;
+    uint i;
+    int status = 0;
+#if SUPPORT_BATCH_THREADS
+    BatchThread* workers;
+    uint started = 0;
+#endif
+
+    if ( impl == NULL || (items == NULL && count > 0) )
+        return -EINVAL;
+
+    if ( threads == 0 )
+        threads = CountProcessors();
+#if !SUPPORT_BATCH_THREADS
+    threads = 1;
+#endif
+    if ( threads > count )
+        threads = count ? count : 1;
+
+    TidyClearMemory( &batch, sizeof(batch) );
+    batch.config = config;
+    batch.allocator = impl->arena.allocator;
+    batch.items = items;
+    batch.count = count;
+    batch.callback = callback;
+    batch.appData = appData;
+    batch.nQueues = threads;
+    batch.queues = (BatchQueue*) TidyAlloc( batch.allocator, threads * sizeof(BatchQueue) );
+    batch.done = (Bool*) TidyAlloc( batch.allocator, (count + 1) * sizeof(Bool) );
+    TidyClearMemory( batch.done, (count + 1) * sizeof(Bool) );
+    InitLock( &batch.doneLock );
+
+    /* Worker i starts with the i-th of threads equal runs of items */
+    for ( i = 0; i < threads; ++i )
+    {
+        BatchQueue* queue = batch.queues + i;
+        InitLock( &queue->lock );
+        queue->next = (uint) ( (ulong) count * i / threads );
+        queue->end = (uint) ( (ulong) count * (i + 1) / threads );
+        queue->batch = &batch;
+    }
+
+#if SUPPORT_BATCH_THREADS
+    /* The calling thread is worker 0.  If a thread can't be
+    ** started the others steal its queue.
+    */
+    workers = (BatchThread*) TidyAlloc( batch.allocator, threads * sizeof(BatchThread) );
+    for ( i = 1; i < threads; ++i )
+    {
+        if ( StartThread(workers + started, batch.queues + i) )
+            ++started;
+    }
+#endif
+    RunWorker( batch.queues );
+#if SUPPORT_BATCH_THREADS
+    for ( i = 0; i < started; ++i )
+        JoinThread( workers[i] );
+    TidyFree( batch.allocator, workers );
+#endif
+
+    for ( i = 0; i < count; ++i )
+    {
+        if ( items[i].status < 0 )
+        {
+            if ( status >= 0 || items[i].status < status )
+                status = items[i].status;
+        }
+        else if ( status >= 0 && items[i].status > status )
+            status = items[i].status;
+    }
+
+    for ( i = 0; i < threads; ++i )
+        FreeLock( &batch.queues[i].lock );
+    FreeLock( &batch.doneLock );
+    TidyFree( batch.allocator, batch.queues );
+    TidyFree( batch.allocator, batch.done );
+    return status;
+}
+
+/*
+ * local variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * eval: (c-set-offset 'substatement-open 0)
+ * end:
+ */
@@ -61,15 +61,14 @@
 
 static Node* CleanNode( TidyDocImpl* doc, Node *node );
 
-static void RenameElem( TidyDocImpl* doc, Node* node, TidyTagId tid )
+static void RenameElem( TidyDocImpl* ARG_UNUSED(doc), Node* node, TidyTagId tid )
 {
     const Dict* dict = TY_(LookupTagDef)( tid );
-    TidyDocFree( doc, node->element );
-    node->element = TY_(tmbstrdup)( doc->allocator, dict->name );
-    node->tag = dict;
+    SetNodeElement(node, dict->name);
+    SetNodeTag(node, dict);
 }
 
-static void FreeStyleProps(TidyDocImpl* doc, StyleProp *props)
+void TY_(FreeStyleProps)(TidyDocImpl* doc, StyleProp *props)
 {
     StyleProp *next;
 
@@ -83,6 +82,18 @@ static void FreeStyleProps(TidyDocImpl* doc, StyleProp *props)
     }
 }
 
+/* Properties stand in for the value of a style attribute while
+** the document is cleaned, so they are charged to attributes.
+*/
+static StyleProp *NewStyleProp( TidyDocImpl* doc, ctmbstr name, ctmbstr value )
+{
+    TidyAllocator* allocator = TidyDocAllocator(doc, TidyMemAttributes);
+    StyleProp *prop = (StyleProp *)TidyAlloc(allocator, sizeof(StyleProp));
+    prop->name = TY_(tmbstrdup)(allocator, name);
+    prop->value = TY_(tmbstrdup)(allocator, value);
+    return prop;
+}
+
 static StyleProp *InsertProperty( TidyDocImpl* doc, StyleProp* props, ctmbstr name, ctmbstr value )
 {
     StyleProp *first, *prev, *prop;
@@ -105,9 +116,7 @@ static StyleProp *InsertProperty( TidyDocImpl* doc, StyleProp* props, ctmbstr na
         {
             /* insert before this */
 
-            prop = (StyleProp *)TidyDocAlloc(doc, sizeof(StyleProp));
-            prop->name = TY_(tmbstrdup)(doc->allocator, name);
-            prop->value = TY_(tmbstrdup)(doc->allocator, value);
+            prop = NewStyleProp(doc, name, value);
             prop->next = props;
 
             if (prev)
@@ -122,9 +131,7 @@ static StyleProp *InsertProperty( TidyDocImpl* doc, StyleProp* props, ctmbstr na
         props = props->next;
     }
 
-    prop = (StyleProp *)TidyDocAlloc(doc, sizeof(StyleProp));
-    prop->name = TY_(tmbstrdup)(doc->allocator, name);
-    prop->value = TY_(tmbstrdup)(doc->allocator, value);
+    prop = NewStyleProp(doc, name, value);
     prop->next = NULL;
 
     if (prev)
@@ -264,7 +271,7 @@ static tmbstr AddProperty( ctmbstr style, ctmbstr property )
     prop = CreateProps(doc, NULL, style);
     prop = CreateProps(doc, prop, property);
     line = CreatePropString(doc, prop);
-    FreeStyleProps(doc, prop);
+    TY_(FreeStyleProps)(doc, prop);
     return line;
 }
 */
@@ -274,15 +281,18 @@ void TY_(FreeStyles)( TidyDocImpl* doc )
     Lexer* lexer = doc->lexer;
     if ( lexer )
     {
-        TagStyle *style, *next;
-        for ( style = lexer->styles; style; style = next )
+        StyleTable* table = &lexer->styles;
+        uint i;
+        for ( i = 0; i < table->count; ++i )
         {
-            next = style->next;
+            TagStyle* style = table->styles + i;
             TidyDocFree( doc, style->tag );
             TidyDocFree( doc, style->tag_class );
             TidyDocFree( doc, style->properties );
-            TidyDocFree( doc, style );
         }
+        TidyDocFree( doc, table->styles );
+        TidyDocFree( doc, table->index );
+        TidyClearMemory( table, sizeof(StyleTable) );
     }
 }
 
@@ -297,24 +307,105 @@ static tmbstr GensymClass( TidyDocImpl* doc )
     return TY_(tmbstrdup)(doc->allocator, buf);
 }
 
+static uint HashStyle( ctmbstr tag, ctmbstr properties )
+{
+    uint h = 2166136261u;
+
+    if ( tag )
+    {
+        while ( *tag )
+        {
+            h ^= (byte) *tag++;
+            h *= 16777619u;
+        }
+    }
+    h *= 16777619u;  /* so "a" "bc" differs from "ab" "c" */
+    if ( properties )
+    {
+        while ( *properties )
+        {
+            h ^= (byte) *properties++;
+            h *= 16777619u;
+        }
+    }
+    return h;
+}
+
+/* Index of the slot for hash, either free or holding a style
+** with that hash and the same tag and properties
+*/
+static uint StyleSlot( StyleTable* table, uint hash,
+                       ctmbstr tag, ctmbstr properties )
+{
+    uint mask = table->indexSize - 1;
+    uint i;
+
+    for ( i = hash & mask; table->index[i]; i = (i + 1) & mask )
+    {
+        TagStyle* style = table->styles + table->index[i] - 1;
+        if ( style->hash == hash &&
+             TY_(tmbstrcmp)(style->tag, tag) == 0 &&
+             TY_(tmbstrcmp)(style->properties, properties) == 0 )
+            break;
+    }
+    return i;
+}
+
+static void GrowStyleIndex( TidyDocImpl* doc, StyleTable* table )
+{
+    uint i;
+
+    TidyDocFree( doc, table->index );
+    table->indexSize = table->indexSize ? 2 * table->indexSize : 64;
+    table->index = (uint*) TidyDocAlloc( doc, table->indexSize * sizeof(uint) );
+    TidyClearMemory( table->index, table->indexSize * sizeof(uint) );
+
+    for ( i = 0; i < table->count; ++i )
+    {
+        TagStyle* style = table->styles + i;
+        uint mask = table->indexSize - 1;
+        uint j;
+
+        for ( j = style->hash & mask; table->index[j]; j = (j + 1) & mask )
+            ;
+        table->index[j] = i + 1;
+    }
+}
+
+/* The class for tag with properties, made the first time they
+** are asked for.  Classes are numbered in that order.
+*/
 static ctmbstr FindStyle( TidyDocImpl* doc, ctmbstr tag, ctmbstr properties )
 {
-    Lexer* lexer = doc->lexer;
+    StyleTable* table = &doc->lexer->styles;
+    uint hash = HashStyle( tag, properties );
     TagStyle* style;
+    uint slot;
 
-    for (style = lexer->styles; style; style=style->next)
+    if ( table->indexSize > 0 )
     {
-        if (TY_(tmbstrcmp)(style->tag, tag) == 0 &&
-            TY_(tmbstrcmp)(style->properties, properties) == 0)
-            return style->tag_class;
+        slot = StyleSlot( table, hash, tag, properties );
+        if ( table->index[slot] )
+            return table->styles[ table->index[slot] - 1 ].tag_class;
     }
 
-    style = (TagStyle *)TidyDocAlloc( doc, sizeof(TagStyle) );
+    /* keep the index at most 3/4 full */
+    if ( 4 * (table->count + 1) > 3 * table->indexSize )
+        GrowStyleIndex( doc, table );
+    if ( table->count == table->length )
+    {
+        table->length = table->length ? 2 * table->length : 16;
+        table->styles = (TagStyle*) TidyDocRealloc( doc, table->styles,
+                                                    table->length * sizeof(TagStyle) );
+    }
+
+    style = table->styles + table->count++;
     style->tag = TY_(tmbstrdup)(doc->allocator, tag);
     style->tag_class = GensymClass( doc );
     style->properties = TY_(tmbstrdup)( doc->allocator, properties );
-    style->next = lexer->styles;
-    lexer->styles = style;
+    style->hash = hash;
+
+    table->index[ StyleSlot(table, hash, tag, properties) ] = table->count;
     return style->tag_class;
 }
 
@@ -330,7 +421,10 @@ static void AddClass( TidyDocImpl* doc, Node* node, ctmbstr classname )
      then append class name after a space.
     */
     if (classattr)
+    {
+        classattr = TY_(OwnAttr)( doc, node, classattr );
         TY_(AppendToClassAttr)( doc, classattr, classname );
+    }
     else /* create new class attribute */
         TY_(AddAttribute)( doc, node, "class", classname );
 }
@@ -339,7 +433,7 @@ void TY_(AddStyleAsClass)( TidyDocImpl* doc, Node *node, ctmbstr stylevalue )
 {
     ctmbstr classname;
 
-    classname = FindStyle( doc, node->element, stylevalue );
+    classname = FindStyle( doc, NodeElement(node), stylevalue );
     AddClass( doc, node, classname);
 }
 
@@ -367,7 +461,8 @@ static void Style2Rule( TidyDocImpl* doc, Node *node)
             return;
         }
 
-        classname = FindStyle( doc, node->element, styleattr->value );
+        styleattr = TY_(OwnAttr)( doc, node, styleattr );
+        classname = FindStyle( doc, NodeElement(node), styleattr->value );
         classattr = TY_(AttrGetById)(node, TidyAttr_CLASS);
 
         /*
@@ -381,9 +476,8 @@ static void Style2Rule( TidyDocImpl* doc, Node *node)
         }
         else /* reuse style attribute for class attribute */
         {
-            TidyDocFree(doc, styleattr->attribute);
             TidyDocFree(doc, styleattr->value);
-            styleattr->attribute = TY_(tmbstrdup)(doc->allocator, "class");
+            styleattr->attribute = InternAttrStr(doc, "class");
             styleattr->value = TY_(tmbstrdup)(doc->allocator, classname);
         }
     }
@@ -417,7 +511,9 @@ static void CleanBodyAttrs( TidyDocImpl* doc, Node* body )
     tmbstr bgcolor = NULL;
     tmbstr color   = NULL;
     AttVal* attr;
-    
+
+    TY_(OwnAttrs)( doc, body );
+
     if (NULL != (attr = TY_(AttrGetById)(body, TidyAttr_BACKGROUND)))
     {
         bgurl = attr->value;
@@ -511,29 +607,31 @@ static void CreateStyleElement( TidyDocImpl* doc )
 {
     Lexer* lexer = doc->lexer;
     Node *node, *head, *body;
-    TagStyle *style;
+    uint i;
     AttVal *av;
 
-    if ( lexer->styles == NULL && NiceBody(doc) )
+    if ( lexer->styles.count == 0 && NiceBody(doc) )
         return;
 
-    node = TY_(NewNode)( doc->allocator, lexer );
+    node = TY_(NewNode)( doc, lexer );
     node->type = StartTag;
     node->implicit = yes;
-    node->element = TY_(tmbstrdup)(doc->allocator, "style");
+    SetNodeElement(node, InternTagStr(doc, "style"));
     TY_(FindTag)( doc, node );
 
     /* insert type attribute */
     av = TY_(NewAttributeEx)( doc, "type", "text/css", '"' );
-    TY_(InsertAttributeAtStart)( node, av );
+    TY_(InsertAttributeAtStart)( doc, node, av );
 
     body = TY_(FindBody)( doc );
     lexer->txtstart = lexer->lexsize;
     if ( body )
         CleanBodyAttrs( doc, body );
 
-    for (style = lexer->styles; style; style = style->next)
+    /* newest first */
+    for ( i = lexer->styles.count; i > 0; --i )
     {
+        TagStyle* style = lexer->styles.styles + i - 1;
         TY_(AddCharToLexer)(lexer, ' ');
         TY_(AddStringLiteral)(lexer, style->tag);
         TY_(AddCharToLexer)(lexer, '.');
@@ -547,7 +645,7 @@ static void CreateStyleElement( TidyDocImpl* doc )
 
     lexer->txtend = lexer->lexsize;
 
-    TY_(InsertNodeAtEnd)( node, TY_(TextToken)(lexer) );
+    TY_(InsertNodeAtEnd)( node, TY_(TextToken)( doc ) );
 
     /*
      now insert style element into document head
@@ -565,18 +663,18 @@ void TY_(FixNodeLinks)(Node *node)
 {
     Node *child;
 
-    if (node->prev)
-        node->prev->next = node;
+    if (NodePrev(node))
+        SetNodeNext(NodePrev(node), node);
     else
-        node->parent->content = node;
+        SetNodeContent(NodeParent(node), node);
 
-    if (node->next)
-        node->next->prev = node;
+    if (NodeNext(node))
+        SetNodePrev(NodeNext(node), node);
     else
-        node->parent->last = node;
+        SetNodeLast(NodeParent(node), node);
 
-    for (child = node->content; child; child = child->next)
-        child->parent = node;
+    for (child = NodeContent(node); child; child = NodeNext(child))
+        SetNodeParent(child, node);
 }
 
 /*
@@ -587,14 +685,14 @@ static void StripOnlyChild(TidyDocImpl* doc, Node *node)
 {
     Node *child;
 
-    child = node->content;
-    node->content = child->content;
-    node->last = child->last;
-    child->content = NULL;
+    child = NodeContent(node);
+    SetNodeContent(node, NodeContent(child));
+    SetNodeLast(node, NodeLast(child));
+    SetNodeContent(child, NULL);
     TY_(FreeNode)(doc, child);
 
-    for (child = node->content; child; child = child->next)
-        child->parent = node;
+    for (child = NodeContent(node); child; child = NodeNext(child))
+        SetNodeParent(child, node);
 }
 
 /*
@@ -603,33 +701,34 @@ static void StripOnlyChild(TidyDocImpl* doc, Node *node)
 */
 static void DiscardContainer( TidyDocImpl* doc, Node *element, Node **pnode)
 {
-    if (element->content)
+    if (NodeContent(element))
     {
-        Node *node, *parent = element->parent;
+        Node *node, *parent = NodeParent(element);
 
-        element->last->next = element->next;
+        SetNodeNext(NodeLast(element), NodeNext(element));
 
-        if (element->next)
+        if (NodeNext(element))
         {
-            element->next->prev = element->last;
+            SetNodePrev(NodeNext(element), NodeLast(element));
         }
         else
-            parent->last = element->last;
+            SetNodeLast(parent, NodeLast(element));
 
-        if (element->prev)
+        if (NodePrev(element))
         {
-            element->content->prev = element->prev;
-            element->prev->next = element->content;
+            SetNodePrev(NodeContent(element), NodePrev(element));
+            SetNodeNext(NodePrev(element), NodeContent(element));
         }
         else
-            parent->content = element->content;
+            SetNodeContent(parent, NodeContent(element));
 
-        for (node = element->content; node; node = node->next)
-            node->parent = parent;
+        for (node = NodeContent(element); node; node = NodeNext(node))
+            SetNodeParent(node, parent);
 
-        *pnode = element->content;
+        *pnode = NodeContent(element);
 
-        element->next = element->content = NULL;
+        SetNodeNext(element, NULL);
+        SetNodeContent(element, NULL);
         TY_(FreeNode)(doc, element);
     }
     else
@@ -639,31 +738,116 @@ static void DiscardContainer( TidyDocImpl* doc, Node *element, Node **pnode)
 }
 
 /*
-  Create new string that consists of the
-  combined style properties in s1 and s2
+  While the document is cleaned, a style attribute that has had
+  properties merged into it keeps them as a sorted list in props,
+  and its value is NULL.  Merging more properties then adds to the
+  list rather than printing it and parsing it again each time, and
+  FinishAttrs() prints each list once when cleaning is over.  An
+  attribute nothing has been merged into keeps its value as it was.
+*/
+static Bool HasStyle( AttVal* av )
+{
+    return av && (av->props || av->value);
+}
+
+/* takes the properties of a style attribute, parsing its value */
+static StyleProp* TakeStyleProps( TidyDocImpl* doc, AttVal* av )
+{
+    StyleProp *props = av->props;
+
+    if ( props == NULL && av->value )
+        props = CreateProps( doc, NULL, av->value );
+
+    TidyDocFree( doc, av->value );
+    av->value = NULL;
+    av->props = NULL;
+    return props;
+}
+
+/* gives merged properties to a style attribute */
+static void GiveStyleProps( TidyDocImpl* doc, AttVal* av, StyleProp* props )
+{
+    if ( props )
+        av->props = props;
+    else
+        av->value = TY_(tmbstrdup)( doc->allocator, "" );
+}
+
+/* prints the properties of a style attribute as its value */
+static void FlushStyleProps( TidyDocImpl* doc, AttVal* av )
+{
+    if ( av->props )
+    {
+        av->value = CreatePropString( doc, av->props );
+        TY_(FreeStyleProps)( doc, av->props );
+        av->props = NULL;
+    }
+}
 
-  To merge property lists, we build a linked
-  list of property/values and insert properties
-  into the list in order, merging values for
-  the same property name.
+/* ends the clean passes' work on attribute values */
+static void FinishAttrs( TidyDocImpl* doc, Node* node )
+{
+    Node* parent = NodeParent(node);
+    AttVal *av;
+
+    for ( node = TY_(FirstLeaf)(node); node;
+          node = TY_(NextPostOrder)(node, parent) )
+    {
+        for (av = NodeAttrs(node); av; av = av->next)
+        {
+            FlushStyleProps( doc, av );
+            TY_(FinishAttrValue)( doc, av );
+        }
+    }
+}
+
+/*
+  Merge two sorted property lists, using up both.
+  Where both define a property, the value in props
+  is kept.
 */
-static tmbstr MergeProperties( TidyDocImpl* doc, ctmbstr s1, ctmbstr s2 )
+static StyleProp* MergeProps( TidyDocImpl* doc, StyleProp* props, StyleProp* more )
 {
-    tmbstr s;
-    StyleProp *prop;
+    StyleProp *first = NULL, **last = &first, *dup;
+    int cmp;
+
+    while (props && more)
+    {
+        cmp = TY_(tmbstrcmp)(props->name, more->name);
+
+        if (cmp <= 0)
+        {
+            *last = props;
+            last = &props->next;
+            props = props->next;
+        }
+        else
+        {
+            *last = more;
+            last = &more->next;
+            more = more->next;
+        }
+
+        if (cmp == 0)
+        {
+            /* this property is already defined, ignore new value */
+            dup = more;
+            more = more->next;
+            dup->next = NULL;
+            TY_(FreeStyleProps)(doc, dup);
+        }
+    }
 
-    prop = CreateProps(doc, NULL, s1);
-    prop = CreateProps(doc, prop, s2);
-    s = CreatePropString(doc, prop);
-    FreeStyleProps(doc, prop);
-    return s;
+    *last = props ? props : more;
+    return first;
 }
 
 /*
  Add style property to element, creating style
- attribute as needed and adding ; delimiter
+ attribute as needed.  While cleaning, the
+ merged properties are left as a list.
 */
-void TY_(AddStyleProperty)(TidyDocImpl* doc, Node *node, ctmbstr property )
+static AttVal* AddStyleProp( TidyDocImpl* doc, Node *node, ctmbstr property )
 {
     AttVal *av = TY_(AttrGetById)(node, TidyAttr_STYLE);
 
@@ -671,11 +855,11 @@ void TY_(AddStyleProperty)(TidyDocImpl* doc, Node *node, ctmbstr property )
 
     if ( av )
     {
-        if (av->value != NULL)
+        av = TY_(OwnAttr)( doc, node, av );
+        if ( HasStyle(av) )
         {
-            tmbstr s = MergeProperties( doc, av->value, property );
-            TidyDocFree( doc, av->value );
-            av->value = s;
+            StyleProp *props = TakeStyleProps( doc, av );
+            GiveStyleProps( doc, av, CreateProps(doc, props, property) );
         }
         else
         {
@@ -685,59 +869,63 @@ void TY_(AddStyleProperty)(TidyDocImpl* doc, Node *node, ctmbstr property )
     else /* else create new style attribute */
     {
         av = TY_(NewAttributeEx)( doc, "style", property, '"' );
-        TY_(InsertAttributeAtStart)( node, av );
+        TY_(InsertAttributeAtStart)( doc, node, av );
     }
+
+    return av;
 }
 
-static void MergeClasses(TidyDocImpl* doc, Node *node, Node *child)
+/*
+ Add style property to element, creating style
+ attribute as needed and adding ; delimiter
+*/
+void TY_(AddStyleProperty)(TidyDocImpl* doc, Node *node, ctmbstr property )
 {
-    AttVal *av;
-    tmbstr s1, s2, names;
+    FlushStyleProps( doc, AddStyleProp(doc, node, property) );
+}
 
-    for (s2 = NULL, av = child->attributes; av; av = av->next)
-    {
-        if (attrIsCLASS(av))
-        {
-            s2 = av->value;
-            break;
-        }
-    }
+/*
+  Merge the classes of child, which is about to be discarded,
+  into node.  As elements nest, the names pile up on the outer
+  one, so they are appended in a run that FinishAttrs() ends.
+*/
+static void MergeClasses(TidyDocImpl* doc, Node *node, Node *child)
+{
+    AttVal *av1, *av2;
 
-    for (s1 = NULL, av = node->attributes; av; av = av->next)
-    {
-        if (attrIsCLASS(av))
-        {
-            s1 = av->value;
-            break;
-        }
-    }
+    av2 = TY_(AttrGetById)(child, TidyAttr_CLASS);
+    av1 = TY_(AttrGetById)(node, TidyAttr_CLASS);
 
-    if (s1)
+    if (AttrHasValue(av1))
     {
-        if (s2)  /* merge class names from both */
+        if (AttrHasValue(av2))  /* merge class names from both */
         {
-            uint l1, l2;
-            l1 = TY_(tmbstrlen)(s1);
-            l2 = TY_(tmbstrlen)(s2);
-            names = (tmbstr) TidyDocAlloc(doc, l1 + l2 + 2);
-            TY_(tmbstrcpy)(names, s1);
-            names[l1] = ' ';
-            TY_(tmbstrcpy)(names+l1+1, s2);
-            TidyDocFree(doc, av->value);
-            av->value = names;
+            av1 = TY_(OwnAttr)( doc, node, av1 );
+            TY_(AppendToAttrValue)( doc, av1, " " );
+            TY_(AppendToAttrValue)( doc, av1, av2->value );
         }
     }
-    else if (s2)  /* copy class names from child */
+    else if (AttrHasValue(av2))  /* move class names of child */
     {
-        av = TY_(NewAttributeEx)( doc, "class", s2, '"' );
-        TY_(InsertAttributeAtStart)( node, av );
+        av2 = TY_(OwnAttr)( doc, child, av2 );
+        av1 = TY_(NewAttributeEx)( doc, "class", NULL, '"' );
+        av1->value = av2->value;
+        av1->length = av2->length;
+        av1->size = av2->size;
+        av2->value = NULL;
+        av2->length = av2->size = 0;
+        TY_(InsertAttributeAtStart)( doc, node, av1 );
     }
 }
 
+/*
+  Merge the style of child, which is about to be
+  discarded, into node.  The child's properties
+  are used up rather than copied.
+*/
 static void MergeStyles(TidyDocImpl* doc, Node *node, Node *child)
 {
-    AttVal *av;
-    tmbstr s1, s2, style;
+    AttVal *av1, *av2;
 
     /*
        the child may have a class attribute used
@@ -746,37 +934,31 @@ static void MergeStyles(TidyDocImpl* doc, Node *node, Node *child)
     */
     MergeClasses(doc, node, child);
 
-    for (s2 = NULL, av = child->attributes; av; av = av->next)
-    {
-        if (attrIsSTYLE(av))
-        {
-            s2 = av->value;
-            break;
-        }
-    }
+    av2 = TY_(AttrGetById)(child, TidyAttr_STYLE);
+    av1 = TY_(AttrGetById)(node, TidyAttr_STYLE);
 
-    for (s1 = NULL, av = node->attributes; av; av = av->next)
+    if ( HasStyle(av1) )
     {
-        if (attrIsSTYLE(av))
+        if ( HasStyle(av2) )  /* merge styles from both */
         {
-            s1 = av->value;
-            break;
-        }
-    }
+            StyleProp *props;
 
-    if (s1)
-    {
-        if (s2)  /* merge styles from both */
-        {
-            style = MergeProperties(doc, s1, s2);
-            TidyDocFree(doc, av->value);
-            av->value = style;
+            av1 = TY_(OwnAttr)( doc, node, av1 );
+            av2 = TY_(OwnAttr)( doc, child, av2 );
+            props = TakeStyleProps( doc, av1 );
+            props = MergeProps( doc, props, TakeStyleProps(doc, av2) );
+            GiveStyleProps( doc, av1, props );
         }
     }
-    else if (s2)  /* copy style of child */
+    else if ( HasStyle(av2) )  /* move style of child */
     {
-        av = TY_(NewAttributeEx)( doc, "style", s2, '"' );
-        TY_(InsertAttributeAtStart)( node, av );
+        av2 = TY_(OwnAttr)( doc, child, av2 );
+        av1 = TY_(NewAttributeEx)( doc, "style", NULL, '"' );
+        av1->value = av2->value;
+        av1->props = av2->props;
+        av2->value = NULL;
+        av2->props = NULL;
+        TY_(InsertAttributeAtStart)( doc, node, av1 );
     }
 }
 
@@ -834,7 +1016,7 @@ static void AddFontFace( TidyDocImpl* doc, Node *node, ctmbstr face )
 {
     tmbchar buf[256];
     TY_(tmbsnprintf)(buf, sizeof(buf), "font-family: %s", face );
-    TY_(AddStyleProperty)( doc, node, buf );
+    AddStyleProp( doc, node, buf );
 }
 
 static void AddFontSize( TidyDocImpl* doc, Node* node, ctmbstr size )
@@ -852,8 +1034,7 @@ static void AddFontSize( TidyDocImpl* doc, Node* node, ctmbstr size )
 
         if (value)
         {
-            TidyDocFree(doc, node->element);
-            node->element = TY_(tmbstrdup)(doc->allocator, value);
+            SetNodeElement(node, InternTagStr(doc, value));
             TY_(FindTag)(doc, node);
             return;
         }
@@ -865,7 +1046,7 @@ static void AddFontSize( TidyDocImpl* doc, Node* node, ctmbstr size )
     {
         tmbchar buf[64];
         TY_(tmbsnprintf)(buf, sizeof(buf), "font-size: %s", value);
-        TY_(AddStyleProperty)( doc, node, buf );
+        AddStyleProp( doc, node, buf );
     }
 }
 
@@ -873,7 +1054,7 @@ static void AddFontColor( TidyDocImpl* doc, Node *node, ctmbstr color)
 {
     tmbchar buf[128];
     TY_(tmbsnprintf)(buf, sizeof(buf), "color: %s", color);
-    TY_(AddStyleProperty)( doc, node, buf );
+    AddStyleProp( doc, node, buf );
 }
 
 /* force alignment value to lower case */
@@ -889,7 +1070,7 @@ static void AddAlign( TidyDocImpl* doc, Node *node, ctmbstr align )
             break;
     }
     buf[i] = '\0';
-    TY_(AddStyleProperty)( doc, node, buf );
+    AddStyleProp( doc, node, buf );
 }
 
 /*
@@ -922,15 +1103,16 @@ static void TextAlign( TidyDocImpl* doc, Node* node )
     AttVal *av, *prev;
 
     prev = NULL;
+    TY_(OwnAttrs)( doc, node );
 
-    for (av = node->attributes; av; av = av->next)
+    for (av = NodeAttrs(node); av; av = av->next)
     {
         if (attrIsALIGN(av))
         {
             if (prev)
                 prev->next = av->next;
             else
-                node->attributes = av->next;
+                SetNodeAttrs(node, av->next);
 
             if (av->value)
                 AddAlign( doc, node, av->value );
@@ -956,7 +1138,7 @@ static void TableBgColor( TidyDocImpl* doc, Node* node )
     {
         TY_(tmbsnprintf)(buf, sizeof(buf), "background-color: %s", attr->value );
         TY_(RemoveAttribute)( doc, node, attr );
-        TY_(AddStyleProperty)( doc, node, buf );
+        AddStyleProp( doc, node, buf );
     }
 }
 
@@ -976,14 +1158,14 @@ static Bool Dir2Div( TidyDocImpl* doc, Node *node, Node **ARG_UNUSED(pnode))
 
     if ( nodeIsDIR(node) || nodeIsUL(node) || nodeIsOL(node) )
     {
-        child = node->content;
+        child = NodeContent(node);
 
         if (child == NULL)
             return no;
 
         /* check child has no peers */
 
-        if (child->next)
+        if (NodeNext(child))
             return no;
 
         if ( !nodeIsLI(child) )
@@ -993,10 +1175,9 @@ static Bool Dir2Div( TidyDocImpl* doc, Node *node, Node **ARG_UNUSED(pnode))
             return no;
 
         /* coerce dir to div */
-        node->tag = TY_(LookupTagDef)( TidyTag_DIV );
-        TidyDocFree( doc, node->element );
-        node->element = TY_(tmbstrdup)(doc->allocator, "div");
-        TY_(AddStyleProperty)( doc, node, "margin-left: 2em" );
+        SetNodeTag(node, TY_(LookupTagDef)( TidyTag_DIV ));
+        SetNodeElement(node, NodeTag(node)->name);
+        AddStyleProp( doc, node, "margin-left: 2em" );
         StripOnlyChild( doc, node );
         return yes;
     }
@@ -1015,9 +1196,9 @@ static Bool Center2Div( TidyDocImpl* doc, Node *node, Node **pnode)
     {
         if ( cfgBool(doc, TidyDropFontTags) )
         {
-            if (node->content)
+            if (NodeContent(node))
             {
-                Node *last = node->last;
+                Node *last = NodeLast(node);
                 DiscardContainer( doc, node, pnode );
 
                 node = TY_(InferredTag)(doc, TidyTag_BR);
@@ -1025,8 +1206,8 @@ static Bool Center2Div( TidyDocImpl* doc, Node *node, Node **pnode)
             }
             else
             {
-                Node *prev = node->prev, *next = node->next,
-                     *parent = node->parent;
+                Node *prev = NodePrev(node), *next = NodeNext(node),
+                     *parent = NodeParent(node);
                 DiscardContainer( doc, node, pnode );
 
                 node = TY_(InferredTag)(doc, TidyTag_BR);
@@ -1042,7 +1223,7 @@ static Bool Center2Div( TidyDocImpl* doc, Node *node, Node **pnode)
         }
 
         RenameElem( doc, node, TidyTag_DIV );
-        TY_(AddStyleProperty)( doc, node, "text-align: center" );
+        AddStyleProp( doc, node, "text-align: center" );
         return yes;
     }
 
@@ -1066,7 +1247,8 @@ static Bool CopyAttrs( TidyDocImpl* doc, Node *node, Node *child)
 
     /* Move child attributes to node. Attributes in node
      can be overwritten or merged. */
-    for (av2 = child->attributes; av2; )
+    TY_(OwnAttrs)( doc, child );
+    for (av2 = NodeAttrs(child); av2; )
     {
         /* Dealt by MergeStyles. */
         if (attrIsSTYLE(av2) || attrIsCLASS(av2))
@@ -1084,7 +1266,7 @@ static Bool CopyAttrs( TidyDocImpl* doc, Node *node, Node *child)
         av1 = av2;
         av2 = av2->next;
         av1->next = NULL;
-        TY_(InsertAttributeAtEnd)( node, av1 );
+        TY_(InsertAttributeAtEnd)( doc, node, av1 );
     }
 
     return yes;
@@ -1113,10 +1295,10 @@ static Bool MergeNestedElements( TidyDocImpl* doc,
          || !TagIsId(node, Id) )
         return no;
 
-    child = node->content;
+    child = NodeContent(node);
 
     if ( child == NULL
-         || child->next != NULL
+         || NodeNext(child) != NULL
          || !TagIsId(child, Id) )
         return no;
 
@@ -1140,42 +1322,42 @@ static Bool NestedList( TidyDocImpl* doc, Node *node, Node **pnode )
 
     if ( nodeIsUL(node) || nodeIsOL(node) )
     {
-        child = node->content;
+        child = NodeContent(node);
 
         if (child == NULL)
             return no;
 
         /* check child has no peers */
 
-        if (child->next)
+        if (NodeNext(child))
             return no;
 
-        list = child->content;
+        list = NodeContent(child);
 
         if (!list)
             return no;
 
-        if (list->tag != node->tag)
+        if (NodeTag(list) != NodeTag(node))
             return no;
 
         /* check list has no peers */
-        if (list->next)
+        if (NodeNext(list))
             return no;
 
         *pnode = list;  /* Set node to resume iteration */
 
         /* move inner list node into position of outer node */
-        list->prev = node->prev;
-        list->next = node->next;
-        list->parent = node->parent;
+        SetNodePrev(list, NodePrev(node));
+        SetNodeNext(list, NodeNext(node));
+        SetNodeParent(list, NodeParent(node));
         TY_(FixNodeLinks)(list);
 
         /* get rid of outer ul and its li */
-        child->content = NULL;
+        SetNodeContent(child, NULL);
         TY_(FreeNode)( doc, child ); /* See test #427841. */
         child = NULL;
-        node->content = NULL;
-        node->next = NULL;
+        SetNodeContent(node, NULL);
+        SetNodeNext(node, NULL);
         TY_(FreeNode)( doc, node );
         node = NULL;
 
@@ -1185,22 +1367,22 @@ static Bool NestedList( TidyDocImpl* doc, Node *node, Node **pnode )
           recognizing nested lists and just uses indents
         */
 
-        if (list->prev)
+        if (NodePrev(list))
         {
-            if ( (nodeIsUL(list->prev) || nodeIsOL(list->prev))
-                 && list->prev->last )
+            if ( (nodeIsUL(NodePrev(list)) || nodeIsOL(NodePrev(list)))
+                 && NodeLast(NodePrev(list)) )
             {
                 node = list;
-                list = node->prev;
+                list = NodePrev(node);
 
-                child = list->last;  /* <li> */
+                child = NodeLast(list);  /* <li> */
 
-                list->next = node->next;
+                SetNodeNext(list, NodeNext(node));
                 TY_(FixNodeLinks)(list);
 
-                node->parent = child;
-                node->next = NULL;
-                node->prev = child->last;
+                SetNodeParent(node, child);
+                SetNodeNext(node, NULL);
+                SetNodePrev(node, NodeLast(child));
                 TY_(FixNodeLinks)(node);
                 CleanNode( doc, node );
             }
@@ -1293,25 +1475,25 @@ static Bool BlockStyle( TidyDocImpl* doc, Node *node, Node **ARG_UNUSED(pnode) )
         if ( !nodeIsCAPTION(node) )
             TextAlign( doc, node );
 
-        child = node->content;
+        child = NodeContent(node);
         if (child == NULL)
             return no;
 
         /* check child has no peers */
-        if (child->next)
+        if (NodeNext(child))
             return no;
 
         if ( FindCSSSpanEq(child, &CSSeq, no) )
         {
             MergeStyles( doc, node, child );
-            TY_(AddStyleProperty)( doc, node, CSSeq );
+            AddStyleProp( doc, node, CSSeq );
             StripOnlyChild( doc, node );
             return yes;
         }
         else if ( nodeIsFONT(child) )
         {
             MergeStyles( doc, node, child );
-            AddFontStyles( doc, node, child->attributes );
+            AddFontStyles( doc, node, NodeAttrs(child) );
             StripOnlyChild( doc, node );
             return yes;
         }
@@ -1334,27 +1516,27 @@ static Bool InlineStyle( TidyDocImpl* doc, Node *node, Node **ARG_UNUSED(pnode)
 
     if ( CanApplyInlineStyle(node) )
     {
-        child = node->content;
+        child = NodeContent(node);
 
         if (child == NULL)
             return no;
 
         /* check child has no peers */
 
-        if (child->next)
+        if (NodeNext(child))
             return no;
 
         if ( FindCSSSpanEq(child, &CSSeq, no) )
         {
             MergeStyles( doc, node, child );
-            TY_(AddStyleProperty)( doc, node, CSSeq );
+            AddStyleProp( doc, node, CSSeq );
             StripOnlyChild( doc, node );
             return yes;
         }
         else if ( nodeIsFONT(child) )
         {
             MergeStyles( doc, node, child );
-            AddFontStyles( doc, node, child->attributes );
+            AddFontStyles( doc, node, NodeAttrs(child) );
             StripOnlyChild( doc, node );
             return yes;
         }
@@ -1373,15 +1555,15 @@ static Bool InlineElementToCSS( TidyDocImpl* doc, Node* node,
 
     /* if node is the only child of parent element then leave alone
           Do so only if BlockStyle may be succesful. */
-    if ( node->parent->content == node && node->next == NULL &&
-         (CanApplyBlockStyle(node->parent)
-          || CanApplyInlineStyle(node->parent)) )
+    if ( NodeContent(NodeParent(node)) == node && NodeNext(node) == NULL &&
+         (CanApplyBlockStyle(NodeParent(node))
+          || CanApplyInlineStyle(NodeParent(node))) )
         return no;
 
     if ( FindCSSSpanEq(node, &CSSeq, yes) )
     {
         RenameElem( doc, node, TidyTag_SPAN );
-        TY_(AddStyleProperty)( doc, node, CSSeq );
+        AddStyleProp( doc, node, CSSeq );
         return yes;
     }
     return no;
@@ -1406,14 +1588,15 @@ static Bool Font2Span( TidyDocImpl* doc, Node *node, Node **pnode )
 
         /* if node is the only child of parent element then leave alone
           Do so only if BlockStyle may be succesful. */
-        if ( node->parent->content == node && node->next == NULL &&
-             CanApplyBlockStyle(node->parent) )
+        if ( NodeContent(NodeParent(node)) == node && NodeNext(node) == NULL &&
+             CanApplyBlockStyle(NodeParent(node)) )
             return no;
 
-        AddFontStyles( doc, node, node->attributes );
+        TY_(OwnAttrs)( doc, node );
+        AddFontStyles( doc, node, NodeAttrs(node) );
 
         /* extract style attribute and free the rest */
-        av = node->attributes;
+        av = NodeAttrs(node);
         style = NULL;
 
         while (av)
@@ -1432,7 +1615,7 @@ static Bool Font2Span( TidyDocImpl* doc, Node *node, Node **pnode )
             av = next;
         }
 
-        node->attributes = style;
+        SetNodeAttrs(node, style);
         RenameElem( doc, node, TidyTag_SPAN );
         return yes;
     }
@@ -1489,42 +1672,66 @@ Node* CleanNode( TidyDocImpl* doc, Node *node )
     return next;
 }
 
-/* Special case: if the current node is destroyed by
-** CleanNode() lower in the tree, this node and its parent
-** no longer exist.  So we must jump back up the CleanTree()
-** call stack until we have a valid node reference.
-*/
+/* the elements a walk is in, for when it can't go by parent links */
+typedef struct _NodeStack
+{
+    Node** nodes;
+    uint count;
+    uint size;
+} NodeStack;
 
-static Node* CleanTree( TidyDocImpl* doc, Node *node )
+static void PushNode( TidyDocImpl* doc, NodeStack* stack, Node* node )
 {
-    if (node->content)
+    if ( stack->count == stack->size )
     {
-        Node *child;
-        for (child = node->content; child != NULL; child = child->next)
-        {
-            child = CleanTree( doc, child );
-            if ( !child )
-                break;
-        }
+        stack->size = stack->size ? 2 * stack->size : 16;
+        stack->nodes = (Node**) TidyDocRealloc( doc, stack->nodes,
+                                                sizeof(Node*) * stack->size );
     }
-
-    return CleanNode( doc, node );
+    stack->nodes[ stack->count++ ] = node;
 }
 
-static void DefineStyleRules( TidyDocImpl* doc, Node *node )
+/*
+  Cleans node after its content, going on to the node CleanNode()
+  returns in its place.  Special case: if the current node is
+  destroyed by CleanNode() lower in the tree, it returns NULL or a
+  node moved elsewhere, and the rest of the content is left alone.
+  So the elements being cleaned are kept on a stack rather than
+  found from the parent links.
+*/
+static void CleanTree( TidyDocImpl* doc, Node *node )
 {
-    Node *child;
+    NodeStack stack = { NULL, 0, 0 };
 
-    if (node->content)
+    for (;;)
     {
-        for (child = node->content;
-                child != NULL; child = child->next)
+        while ( NodeContent(node) )
         {
-            DefineStyleRules( doc, child );
+            PushNode( doc, &stack, node );
+            node = NodeContent(node);
         }
+
+        node = CleanNode( doc, node );
+
+        while ( stack.count > 0 && !(node && NodeNext(node)) )
+            node = CleanNode( doc, stack.nodes[ --stack.count ] );
+
+        if ( stack.count == 0 )
+            break;
+
+        node = NodeNext(node);
     }
 
-    Style2Rule( doc, node );
+    TidyDocFree( doc, stack.nodes );
+}
+
+static void DefineStyleRules( TidyDocImpl* doc, Node *node )
+{
+    Node* parent = NodeParent(node);
+
+    for ( node = TY_(FirstLeaf)(node); node;
+          node = TY_(NextPostOrder)(node, parent) )
+        Style2Rule( doc, node );
 }
 
 void TY_(CleanDocument)( TidyDocImpl* doc )
@@ -1533,6 +1740,7 @@ void TY_(CleanDocument)( TidyDocImpl* doc )
     ** zap root element 
     */
     CleanTree( doc, &doc->root );
+    FinishAttrs( doc, &doc->root );
 
     if ( cfgBool(doc, TidyMakeClean) )
     {
@@ -1541,53 +1749,109 @@ void TY_(CleanDocument)( TidyDocImpl* doc )
     }
 }
 
-/* simplifies <b><b> ... </b> ...</b> etc. */
-void TY_(NestedEmphasis)( TidyDocImpl* doc, Node* node )
+/*
+  Passes that change the tree one node at a time are written as
+  rules, so that several can share a walk over it rather than each
+  making its own.  A walk in document order shows a rule an element
+  before its content, and the rule must leave the element in place.
+  A walk in post order shows it an element after its content, and
+  the rule may drop the element or replace it by its content, in
+  which case it returns yes and the element's later rules are
+  skipped.  Rules are run in the order they are listed.
+*/
+typedef struct _CleanWalk CleanWalk;
+typedef Bool (CleanRule)( TidyDocImpl* doc, Node* node, const CleanWalk* walk );
+
+struct _CleanWalk
 {
-    Node *next;
+    CleanRule* rules[3];    /* ended by NULL */
+    Bool wantName;          /* see FixAnchors() */
+    Bool wantId;
+    Bool wantXmlLang;       /* see FixLanguageInformation() */
+    Bool wantLang;
+};
 
-    while (node)
+static void WalkPreOrder( TidyDocImpl* doc, Node* node, const CleanWalk* walk )
+{
+    Node* parent = node ? NodeParent(node) : NULL;
+    CleanRule* const* rule;
+
+    for ( ; node; node = TY_(NextPreOrder)(node, parent) )
+    {
+        for ( rule = walk->rules; *rule; ++rule )
+            (*rule)( doc, node, walk );
+    }
+}
+
+static void WalkPostOrder( TidyDocImpl* doc, Node* node, const CleanWalk* walk )
+{
+    Node *parent, *next;
+    CleanRule* const* rule;
+
+    if ( node == NULL )
+        return;
+
+    parent = NodeParent(node);
+
+    for ( node = TY_(FirstLeaf)(node); node; node = next )
     {
-        next = node->next;
+        /* content has been seen, so a rule can't change next */
+        next = TY_(NextPostOrder)(node, parent);
 
-        if ( (nodeIsB(node) || nodeIsI(node))
-             && node->parent && node->parent->tag == node->tag)
+        for ( rule = walk->rules; *rule; ++rule )
         {
-            /* strip redundant inner element */
-            DiscardContainer( doc, node, &next );
-            node = next;
-            continue;
+            if ( (*rule)( doc, node, walk ) )
+                break;
         }
+    }
+}
 
-        if ( node->content )
-            TY_(NestedEmphasis)( doc, node->content );
+/*
+  strips redundant inner b and i elements.  Seen after its
+  content, the innermost of three nested ones goes first,
+  which leaves the same as going in document order.
+*/
+static Bool NestedEmphasisRule( TidyDocImpl* doc, Node* node,
+                                const CleanWalk* ARG_UNUSED(walk) )
+{
+    Node* next;
 
-        node = next;
+    if ( (nodeIsB(node) || nodeIsI(node))
+         && NodeParent(node) && NodeTag(NodeParent(node)) == NodeTag(node))
+    {
+        DiscardContainer( doc, node, &next );
+        return yes;
     }
+    return no;
 }
 
+/* simplifies <b><b> ... </b> ...</b> etc. */
+void TY_(NestedEmphasis)( TidyDocImpl* doc, Node* node )
+{
+    CleanWalk walk = { { NestedEmphasisRule } };
+    WalkPostOrder( doc, node, &walk );
+}
 
+static Bool EmFromIRule( TidyDocImpl* doc, Node* node,
+                         const CleanWalk* ARG_UNUSED(walk) )
+{
+    if ( nodeIsI(node) )
+        RenameElem( doc, node, TidyTag_EM );
+    else if ( nodeIsB(node) )
+        RenameElem( doc, node, TidyTag_STRONG );
+    return no;
+}
 
 /* replace i by em and b by strong */
 void TY_(EmFromI)( TidyDocImpl* doc, Node* node )
 {
-    while (node)
-    {
-        if ( nodeIsI(node) )
-            RenameElem( doc, node, TidyTag_EM );
-        else if ( nodeIsB(node) )
-            RenameElem( doc, node, TidyTag_STRONG );
-
-        if ( node->content )
-            TY_(EmFromI)( doc, node->content );
-
-        node = node->next;
-    }
+    CleanWalk walk = { { EmFromIRule } };
+    WalkPreOrder( doc, node, &walk );
 }
 
 static Bool HasOneChild(Node *node)
 {
-    return (node->content && node->content->next == NULL);
+    return (NodeContent(node) && NodeNext(NodeContent(node)) == NULL);
 }
 
 /*
@@ -1597,64 +1861,77 @@ static Bool HasOneChild(Node *node)
  li. This is recursively replaced by an
  implicit blockquote.
 */
-void TY_(List2BQ)( TidyDocImpl* doc, Node* node )
+static Bool List2BQRule( TidyDocImpl* doc, Node* node,
+                         const CleanWalk* ARG_UNUSED(walk) )
 {
-    while (node)
+    if ( NodeTag(node) && NodeTag(node)->parser == TY_(ParseList) &&
+         HasOneChild(node) && NodeContent(node)->implicit )
     {
-        if (node->content)
-            TY_(List2BQ)( doc, node->content );
-
-        if ( node->tag && node->tag->parser == TY_(ParseList) &&
-             HasOneChild(node) && node->content->implicit )
-        {
-            StripOnlyChild( doc, node );
-            RenameElem( doc, node, TidyTag_BLOCKQUOTE );
-            node->implicit = yes;
-        }
-
-        node = node->next;
+        StripOnlyChild( doc, node );
+        RenameElem( doc, node, TidyTag_BLOCKQUOTE );
+        node->implicit = yes;
     }
+    return no;
 }
 
+void TY_(List2BQ)( TidyDocImpl* doc, Node* node )
+{
+    CleanWalk walk = { { List2BQRule } };
+    WalkPostOrder( doc, node, &walk );
+}
 
 /*
  Replace implicit blockquote by div with an indent
  taking care to reduce nested blockquotes to a single
  div with the indent set to match the nesting depth
 */
-void TY_(BQ2Div)( TidyDocImpl* doc, Node *node )
+static Bool BQ2DivRule( TidyDocImpl* doc, Node* node,
+                        const CleanWalk* ARG_UNUSED(walk) )
 {
     tmbchar indent_buf[ 32 ];
     uint indent;
 
-    while (node)
+    if ( nodeIsBLOCKQUOTE(node) && node->implicit )
     {
-        if ( nodeIsBLOCKQUOTE(node) && node->implicit )
+        indent = 1;
+
+        while( HasOneChild(node) &&
+               nodeIsBLOCKQUOTE(NodeContent(node)) &&
+               node->implicit)
         {
-            indent = 1;
+            ++indent;
+            StripOnlyChild( doc, node );
+        }
 
-            while( HasOneChild(node) &&
-                   nodeIsBLOCKQUOTE(node->content) &&
-                   node->implicit)
-            {
-                ++indent;
-                StripOnlyChild( doc, node );
-            }
+        TY_(tmbsnprintf)(indent_buf, sizeof(indent_buf), "margin-left: %dem",
+                         2*indent);
 
-            if (node->content)
-                TY_(BQ2Div)( doc, node->content );
+        RenameElem( doc, node, TidyTag_DIV );
+        TY_(AddStyleProperty)(doc, node, indent_buf );
+    }
+    return no;
+}
 
-            TY_(tmbsnprintf)(indent_buf, sizeof(indent_buf), "margin-left: %dem",
-                             2*indent);
+void TY_(BQ2Div)( TidyDocImpl* doc, Node *node )
+{
+    CleanWalk walk = { { BQ2DivRule } };
+    WalkPreOrder( doc, node, &walk );
+}
 
-            RenameElem( doc, node, TidyTag_DIV );
-            TY_(AddStyleProperty)(doc, node, indent_buf );
-        }
-        else if (node->content)
-            TY_(BQ2Div)( doc, node->content );
+/*
+  NestedEmphasis() and List2BQ() look at different elements, as
+  do BQ2Div() and EmFromI(), so each pair shares a walk.  BQ2Div()
+  must see every blockquote made by List2BQ() before it, for the
+  nesting depth, so that makes two walks rather than four.
+*/
+void TY_(CleanEmphasisAndLists)( TidyDocImpl* doc, Bool logical )
+{
+    CleanWalk walk = { { NestedEmphasisRule, List2BQRule } };
+    WalkPostOrder( doc, &doc->root, &walk );
 
-        node = node->next;
-    }
+    walk.rules[0] = BQ2DivRule;
+    walk.rules[1] = logical ? EmFromIRule : NULL;
+    WalkPreOrder( doc, &doc->root, &walk );
 }
 
 
@@ -1662,7 +1939,7 @@ static Node* FindEnclosingCell( TidyDocImpl* ARG_UNUSED(doc), Node *node)
 {
     Node *check;
 
-    for ( check=node; check; check = check->parent )
+    for ( check=node; check; check = NodeParent(check) )
     {
       if ( nodeIsTD(check) )
         return check;
@@ -1670,14 +1947,18 @@ static Node* FindEnclosingCell( TidyDocImpl* ARG_UNUSED(doc), Node *node)
     return NULL;
 }
 
-/* node is <![if ...]> prune up to <![endif]> */
+/*
+  node is <![if ...]> prune up to <![endif]>, and so for the
+  sections nested in it, counted in depth rather than recursing
+*/
 static Node* PruneSection( TidyDocImpl* doc, Node *node )
 {
     Lexer* lexer = doc->lexer;
+    uint depth = 1;
 
-    for (;;)
+    while (node)
     {
-        ctmbstr lexbuf = lexer->lexbuf + node->start;
+        ctmbstr lexbuf = NodeText(lexer, node);
         if ( TY_(tmbstrncmp)(lexbuf, "if !supportEmptyParas", 21) == 0 )
         {
           Node* cell = FindEnclosingCell( doc, node );
@@ -1685,7 +1966,7 @@ static Node* PruneSection( TidyDocImpl* doc, Node *node )
           {
             /* Need to put &nbsp; into cell so it doesn't look weird
             */
-            Node* nbsp = TY_(NewLiteralTextNode)( lexer, "\240" );
+            Node* nbsp = TY_(NewLiteralTextNode)( doc, "\240" );
             assert( (byte)'\240' == (byte)160 );
             TY_(InsertNodeBeforeElement)( node, nbsp );
           }
@@ -1693,7 +1974,7 @@ static Node* PruneSection( TidyDocImpl* doc, Node *node )
 
         /* discard node and returns next, unless it is a text node */
         if ( node->type == TextNode )
-            node = node->next;
+            node = NodeNext(node);
         else
             node = TY_(DiscardElement)( doc, node );
 
@@ -1702,16 +1983,17 @@ static Node* PruneSection( TidyDocImpl* doc, Node *node )
         
         if (node->type == SectionTag)
         {
-            if (TY_(tmbstrncmp)(lexer->lexbuf + node->start, "if", 2) == 0)
+            if (TY_(tmbstrncmp)(NodeText(lexer, node), "if", 2) == 0)
             {
-                node = PruneSection( doc, node );
+                ++depth;
                 continue;
             }
 
-            if (TY_(tmbstrncmp)(lexer->lexbuf + node->start, "endif", 5) == 0)
+            if (TY_(tmbstrncmp)(NodeText(lexer, node), "endif", 5) == 0)
             {
                 node = TY_(DiscardElement)( doc, node );
-                break;
+                if (--depth == 0)
+                    break;
             }
         }
     }
@@ -1722,27 +2004,28 @@ static Node* PruneSection( TidyDocImpl* doc, Node *node )
 void TY_(DropSections)( TidyDocImpl* doc, Node* node )
 {
     Lexer* lexer = doc->lexer;
+    Node *parent = node ? NodeParent(node) : NULL, *up;
+
     while (node)
     {
         if (node->type == SectionTag)
         {
+            up = NodeParent(node);
+
             /* prune up to matching endif */
-            if ((TY_(tmbstrncmp)(lexer->lexbuf + node->start, "if", 2) == 0) &&
-                (TY_(tmbstrncmp)(lexer->lexbuf + node->start, "if !vml", 7) != 0)) /* #444394 - fix 13 Sep 01 */
-            {
+            if ((TY_(tmbstrncmp)(NodeText(lexer, node), "if", 2) == 0) &&
+                (TY_(tmbstrncmp)(NodeText(lexer, node), "if !vml", 7) != 0)) /* #444394 - fix 13 Sep 01 */
                 node = PruneSection( doc, node );
-                continue;
-            }
+            else /* discard others as well */
+                node = TY_(DiscardElement)( doc, node );
 
-            /* discard others as well */
-            node = TY_(DiscardElement)( doc, node );
+            /* at the end of up's content, go on after it */
+            if (node == NULL)
+                node = TY_(NextPastContent)( up, parent );
             continue;
         }
 
-        if (node->content)
-            TY_(DropSections)( doc, node->content );
-
-        node = node->next;
+        node = TY_(NextPreOrder)( node, parent );
     }
 }
 
@@ -1750,7 +2033,8 @@ static void PurgeWord2000Attributes( TidyDocImpl* doc, Node* node )
 {
     AttVal *attr, *next, *prev = NULL;
 
-    for ( attr = node->attributes; attr; attr = next )
+    TY_(OwnAttrs)( doc, node );
+    for ( attr = NodeAttrs(node); attr; attr = next )
     {
         next = attr->next;
 
@@ -1776,7 +2060,7 @@ static void PurgeWord2000Attributes( TidyDocImpl* doc, Node* node )
             if (prev)
                 prev->next = next;
             else
-                node->attributes = next;
+                SetNodeAttrs(node, next);
 
             TY_(FreeAttribute)( doc, attr );
         }
@@ -1785,26 +2069,22 @@ static void PurgeWord2000Attributes( TidyDocImpl* doc, Node* node )
     }
 }
 
-/* Word2000 uses span excessively, so we strip span out */
+/*
+  Word2000 uses span excessively, so we strip span out,
+  splicing its content, already cleaned, in its place
+*/
 static Node* StripSpan( TidyDocImpl* doc, Node* span )
 {
     Node *node, *prev = NULL, *content;
 
-    /*
-     deal with span elements that have content
-     by splicing the content in place of the span
-     after having processed it
-    */
-
-    TY_(CleanWord2000)( doc, span->content );
-    content = span->content;
+    content = NodeContent(span);
 
-    if (span->prev)
-        prev = span->prev;
+    if (NodePrev(span))
+        prev = NodePrev(span);
     else if (content)
     {
         node = content;
-        content = content->next;
+        content = NodeNext(content);
         TY_(RemoveNode)(node);
         TY_(InsertNodeBeforeElement)(span, node);
         prev = node;
@@ -1813,51 +2093,52 @@ static Node* StripSpan( TidyDocImpl* doc, Node* span )
     while (content)
     {
         node = content;
-        content = content->next;
+        content = NodeNext(content);
         TY_(RemoveNode)(node);
         TY_(InsertNodeAfterElement)(prev, node);
         prev = node;
     }
 
-    if (span->next == NULL)
-        span->parent->last = prev;
+    if (NodeNext(span) == NULL)
+        SetNodeLast(NodeParent(span), prev);
 
-    node = span->next;
-    span->content = NULL;
+    node = NodeNext(span);
+    SetNodeContent(span, NULL);
     TY_(DiscardElement)( doc, span );
     return node;
 }
 
-/* map non-breaking spaces to regular spaces */
 void TY_(NormalizeSpaces)(Lexer *lexer, Node *node)
 {
-    while ( node )
-    {
-        if ( node->content )
-            TY_(NormalizeSpaces)( lexer, node->content );
+    Node* parent = node ? NodeParent(node) : NULL;
 
+    /* only text is changed, and it has no content to see first */
+    for ( ; node; node = TY_(NextPreOrder)(node, parent) )
+    {
         if (TY_(nodeIsText)(node))
         {
-            uint i, c;
-            tmbstr p = lexer->lexbuf + node->start;
+            size_t i, len = NodeTextLen(node);
+            uint c;
+            tmbstr text, p;
+
+            TY_(OwnNodeText)( lexer, node, no );
+            text = p = TY_(LexTextAt)( lexer, node->start );
 
-            for (i = node->start; i < node->end; ++i)
+            for (i = 0; i < len; ++i)
             {
-                c = (byte) lexer->lexbuf[i];
+                c = (byte) text[i];
 
                 /* look for UTF-8 multibyte character */
                 if ( c > 0x7F )
-                    i += TY_(GetUTF8)( lexer->lexbuf + i, &c );
+                    i += TY_(GetUTF8)( text + i, &c );
 
                 if ( c == 160 )
                     c = ' ';
 
                 p = TY_(PutUTF8)(p, c);
             }
-            node->end = p - lexer->lexbuf;
+            node->end = node->start + (p - text);
         }
-
-        node = node->next;
     }
 }
 
@@ -1883,24 +2164,24 @@ static Bool NoMargins(Node *node)
 /* does element have a single space as its content? */
 static Bool SingleSpace( Lexer* lexer, Node* node )
 {
-    if ( node->content )
+    if ( NodeContent(node) )
     {
-        node = node->content;
+        node = NodeContent(node);
 
-        if ( node->next != NULL )
+        if ( NodeNext(node) != NULL )
             return no;
 
         if ( node->type != TextNode )
             return no;
 
-        if ( (node->end - node->start) == 1 &&
-             lexer->lexbuf[node->start] == ' ' )
+        if ( NodeTextLen(node) == 1 &&
+             NodeText(lexer, node)[0] == ' ' )
             return yes;
 
-        if ( (node->end - node->start) == 2 )
+        if ( NodeTextLen(node) == 2 )
         {
             uint c = 0;
-            TY_(GetUTF8)( lexer->lexbuf + node->start, &c );
+            TY_(GetUTF8)( NodeText(lexer, node), &c );
             if ( c == 160 )
                 return yes;
         }
@@ -1910,194 +2191,314 @@ static Bool SingleSpace( Lexer* lexer, Node* node )
 }
 
 /*
- This is a major clean up to strip out all the extra stuff you get
- when you save as web page from Word 2000. It doesn't yet know what
- to do with VML tags, but these will appear as errors unless you
- declare them as new tags, such as o:p which needs to be declared
- as inline.
+  CleanWord2000() works through a list of siblings at a time, and
+  cleans an element's content as a list of its own at the points
+  marked below, before going on with the element.  So as not to
+  recurse for nested content, each list has a frame on a stack,
+  which keeps where it is to go on from when its child is done.
 */
-void TY_(CleanWord2000)( TidyDocImpl* doc, Node *node)
+typedef enum
+{
+    Word2000Next,           /* at node, in the list */
+    Word2000Pre,            /* node's content cleaned for pre */
+    Word2000MorePre,        /* looking for more p's for pre */
+    Word2000PreSpan,        /* span's content cleaned for pre */
+    Word2000Element,        /* node is not a pre */
+    Word2000Span,           /* span's content cleaned */
+    Word2000ListItem,       /* node's content cleaned as li */
+    Word2000Code,           /* span's content cleaned as code */
+    Word2000Attrs,          /* node to be purged */
+    Word2000Content         /* node's content cleaned */
+} Word2000State;
+
+typedef struct _Word2000Frame
+{
+    Word2000State state;
+    Node* node;
+    Node* list;     /* used to a list from a sequence of bulletted p's */
+    Node* pre;
+    Node* span;
+    Node* next;
+    Node* br;
+} Word2000Frame;
+
+/*
+  goes on with the list in frame, returning the first of a list
+  to be cleaned before the frame goes on, or NULL when it is done
+*/
+static Node* CleanWord2000List( TidyDocImpl* doc, Word2000Frame* frame )
 {
-    /* used to a list from a sequence of bulletted p's */
     Lexer* lexer = doc->lexer;
-    Node* list = NULL;
+    Node* node;
 
-    while ( node )
+    for (;;)
     {
-        /* get rid of Word's xmlns attributes */
-        if ( nodeIsHTML(node) )
+        node = frame->node;
+
+        switch ( frame->state )
         {
-            /* check that it's a Word 2000 document */
-            if ( !TY_(GetAttrByName)(node, "xmlns:o") &&
-                 !cfgBool(doc, TidyMakeBare) )
-                return;
+        case Word2000Next:
+            if ( !node )
+                return NULL;
 
-            TY_(FreeAttrs)( doc, node );
-        }
+            /* get rid of Word's xmlns attributes */
+            if ( nodeIsHTML(node) )
+            {
+                /* check that it's a Word 2000 document */
+                if ( !TY_(GetAttrByName)(node, "xmlns:o") &&
+                     !cfgBool(doc, TidyMakeBare) )
+                    return NULL;
 
-        /* fix up preformatted sections by looking for a
-        ** sequence of paragraphs with zero top/bottom margin
-        */
-        if ( nodeIsP(node) )
-        {
-            if (NoMargins(node))
+                TY_(FreeAttrs)( doc, node );
+            }
+
+            /* fix up preformatted sections by looking for a
+            ** sequence of paragraphs with zero top/bottom margin
+            */
+            frame->state = Word2000Element;
+            if ( nodeIsP(node) && NoMargins(node) )
             {
-                Node *pre, *next;
                 TY_(CoerceNode)(doc, node, TidyTag_PRE, no, yes);
 
                 PurgeWord2000Attributes( doc, node );
 
-                if (node->content)
-                    TY_(CleanWord2000)( doc, node->content );
-
-                pre = node;
-                node = node->next;
-
-                /* continue to strip p's */
+                frame->state = Word2000Pre;
+                if (NodeContent(node))
+                    return NodeContent(node);
+            }
+            break;
 
-                while ( nodeIsP(node) && NoMargins(node) )
-                {
-                    next = node->next;
-                    TY_(RemoveNode)(node);
-                    TY_(InsertNodeAtEnd)(pre, TY_(NewLineNode)(lexer));
-                    TY_(InsertNodeAtEnd)(pre, node);
-                    StripSpan( doc, node );
-                    node = next;
-                }
+        case Word2000Pre:
+            frame->pre = node;
+            frame->node = NodeNext(node);
+            frame->state = Word2000MorePre;
+            break;
 
-                if (node == NULL)
-                    break;
+        case Word2000MorePre:
+            /* continue to strip p's */
+            if ( nodeIsP(node) && NoMargins(node) )
+            {
+                frame->next = NodeNext(node);
+                TY_(RemoveNode)(node);
+                TY_(InsertNodeAtEnd)(frame->pre, TY_(NewLineNode)( doc ));
+                TY_(InsertNodeAtEnd)(frame->pre, node);
+                frame->span = node;
+                frame->state = Word2000PreSpan;
+                if (NodeContent(node))
+                    return NodeContent(node);
+                break;
             }
-        }
 
-        if (node->tag && (node->tag->model & CM_BLOCK)
-            && SingleSpace(lexer, node))
-        {
-            node = StripSpan( doc, node );
-            continue;
-        }
-        /* discard Word's style verbiage */
-        if ( nodeIsSTYLE(node) || nodeIsMETA(node) ||
-             node->type == CommentTag )
-        {
-            node = TY_(DiscardElement)( doc, node );
-            continue;
-        }
+            if (node == NULL)
+                return NULL;
 
-        /* strip out all span and font tags Word scatters so liberally! */
-        if ( nodeIsSPAN(node) || nodeIsFONT(node) )
-        {
-            node = StripSpan( doc, node );
-            continue;
-        }
+            frame->state = Word2000Element;
+            break;
 
-        if ( nodeIsLINK(node) )
-        {
-            AttVal *attr = TY_(AttrGetById)(node, TidyAttr_REL);
+        case Word2000PreSpan:
+            StripSpan( doc, frame->span );
+            frame->node = frame->next;
+            frame->state = Word2000MorePre;
+            break;
+
+        case Word2000Element:
+            frame->state = Word2000Next;
 
-            if (AttrValueIs(attr, "File-List"))
+            if (NodeTag(node) && (NodeTag(node)->model & CM_BLOCK)
+                && SingleSpace(lexer, node))
             {
-                node = TY_(DiscardElement)( doc, node );
-                continue;
+                frame->span = node;
+                frame->state = Word2000Span;
+                if (NodeContent(node))
+                    return NodeContent(node);
+                break;
+            }
+            /* discard Word's style verbiage */
+            if ( nodeIsSTYLE(node) || nodeIsMETA(node) ||
+                 node->type == CommentTag )
+            {
+                frame->node = TY_(DiscardElement)( doc, node );
+                break;
             }
-        }
-
-        /* discards <o:p> which encodes the paragraph mark */
-        if ( node->tag && TY_(tmbstrcmp)(node->tag->name,"o:p")==0)
-        {
-            Node* next;
-            DiscardContainer( doc, node, &next );
-            node = next;
-            continue;
-        }
-
-        /* discard empty paragraphs */
-
-        if ( node->content == NULL && nodeIsP(node) )
-        {
-            /*  Use the existing function to ensure consistency */
-            Node *next = TY_(TrimEmptyElement)( doc, node );
-            node = next;
-            continue;
-        }
 
-        if ( nodeIsP(node) )
-        {
-            AttVal *attr, *atrStyle;
-            
-            attr = TY_(AttrGetById)(node, TidyAttr_CLASS);
-            atrStyle = TY_(AttrGetById)(node, TidyAttr_STYLE);
-            /*
-               (JES) Sometimes Word marks a list item with the following hokie syntax
-               <p class="MsoNormal" style="...;mso-list:l1 level1 lfo1;
-                translate these into <li>
-            */
-            /* map sequence of <p class="MsoListBullet"> to <ul>...</ul> */
-            /* map <p class="MsoListNumber"> to <ol>...</ol> */
-            if ( AttrValueIs(attr, "MsoListBullet") ||
-                 AttrValueIs(attr, "MsoListNumber") ||
-                 AttrContains(atrStyle, "mso-list:") )
+            /* strip out all span and font tags Word scatters so liberally! */
+            if ( nodeIsSPAN(node) || nodeIsFONT(node) )
             {
-                TidyTagId listType = TidyTag_UL;
-                if (AttrValueIs(attr, "MsoListNumber"))
-                    listType = TidyTag_OL;
+                frame->span = node;
+                frame->state = Word2000Span;
+                if (NodeContent(node))
+                    return NodeContent(node);
+                break;
+            }
 
-                TY_(CoerceNode)(doc, node, TidyTag_LI, no, yes);
+            if ( nodeIsLINK(node) )
+            {
+                AttVal *attr = TY_(AttrGetById)(node, TidyAttr_REL);
 
-                if ( !list || TagId(list) != listType )
+                if (AttrValueIs(attr, "File-List"))
                 {
-                    const Dict* tag = TY_(LookupTagDef)( listType );
-                    list = TY_(InferredTag)(doc, tag->id);
-                    TY_(InsertNodeBeforeElement)(node, list);
+                    frame->node = TY_(DiscardElement)( doc, node );
+                    break;
                 }
+            }
 
-                PurgeWord2000Attributes( doc, node );
+            /* discards <o:p> which encodes the paragraph mark */
+            if ( NodeTag(node) && TY_(tmbstrcmp)(NodeTag(node)->name,"o:p")==0)
+            {
+                DiscardContainer( doc, node, &frame->node );
+                break;
+            }
 
-                if ( node->content )
-                    TY_(CleanWord2000)( doc, node->content );
+            /* discard empty paragraphs */
 
-                /* remove node and append to contents of list */
-                TY_(RemoveNode)(node);
-                TY_(InsertNodeAtEnd)(list, node);
-                node = list;
+            if ( NodeContent(node) == NULL && nodeIsP(node) )
+            {
+                /*  Use the existing function to ensure consistency */
+                frame->node = TY_(TrimEmptyElement)( doc, node );
+                break;
             }
-            /* map sequence of <p class="Code"> to <pre>...</pre> */
-            else if (AttrValueIs(attr, "Code"))
+
+            frame->state = Word2000Attrs;
+
+            if ( nodeIsP(node) )
             {
-                Node *br = TY_(NewLineNode)(lexer);
-                TY_(NormalizeSpaces)(lexer, node->content);
+                AttVal *attr, *atrStyle;
+                Node* list = frame->list;
 
-                if ( !list || TagId(list) != TidyTag_PRE )
+                attr = TY_(AttrGetById)(node, TidyAttr_CLASS);
+                atrStyle = TY_(AttrGetById)(node, TidyAttr_STYLE);
+                /*
+                   (JES) Sometimes Word marks a list item with the following hokie syntax
+                   <p class="MsoNormal" style="...;mso-list:l1 level1 lfo1;
+                    translate these into <li>
+                */
+                /* map sequence of <p class="MsoListBullet"> to <ul>...</ul> */
+                /* map <p class="MsoListNumber"> to <ol>...</ol> */
+                if ( AttrValueIs(attr, "MsoListBullet") ||
+                     AttrValueIs(attr, "MsoListNumber") ||
+                     AttrContains(atrStyle, "mso-list:") )
                 {
-                    list = TY_(InferredTag)(doc, TidyTag_PRE);
-                    TY_(InsertNodeBeforeElement)(node, list);
+                    TidyTagId listType = TidyTag_UL;
+                    if (AttrValueIs(attr, "MsoListNumber"))
+                        listType = TidyTag_OL;
+
+                    TY_(CoerceNode)(doc, node, TidyTag_LI, no, yes);
+
+                    if ( !list || TagId(list) != listType )
+                    {
+                        const Dict* tag = TY_(LookupTagDef)( listType );
+                        frame->list = TY_(InferredTag)(doc, tag->id);
+                        TY_(InsertNodeBeforeElement)(node, frame->list);
+                    }
+
+                    PurgeWord2000Attributes( doc, node );
+
+                    frame->state = Word2000ListItem;
+                    if ( NodeContent(node) )
+                        return NodeContent(node);
                 }
+                /* map sequence of <p class="Code"> to <pre>...</pre> */
+                else if (AttrValueIs(attr, "Code"))
+                {
+                    frame->br = TY_(NewLineNode)( doc );
+                    TY_(NormalizeSpaces)(lexer, NodeContent(node));
 
-                /* remove node and append to contents of list */
-                TY_(RemoveNode)(node);
-                TY_(InsertNodeAtEnd)(list, node);
-                StripSpan( doc, node );
-                TY_(InsertNodeAtEnd)(list, br);
-                node = list->next;
+                    if ( !list || TagId(list) != TidyTag_PRE )
+                    {
+                        frame->list = TY_(InferredTag)(doc, TidyTag_PRE);
+                        TY_(InsertNodeBeforeElement)(node, frame->list);
+                    }
+
+                    /* remove node and append to contents of list */
+                    TY_(RemoveNode)(node);
+                    TY_(InsertNodeAtEnd)(frame->list, node);
+                    frame->span = node;
+                    frame->state = Word2000Code;
+                    if ( NodeContent(node) )
+                        return NodeContent(node);
+                }
+                else
+                    frame->list = NULL;
             }
             else
-                list = NULL;
-        }
-        else
-            list = NULL;
+                frame->list = NULL;
+            break;
 
-        if (!node)
-            return;
+        case Word2000Span:
+            frame->node = StripSpan( doc, frame->span );
+            frame->state = Word2000Next;
+            break;
 
-        /* strip out style and class attributes */
-        if (TY_(nodeIsElement)(node))
-            PurgeWord2000Attributes( doc, node );
+        case Word2000ListItem:
+            /* remove node and append to contents of list */
+            TY_(RemoveNode)(node);
+            TY_(InsertNodeAtEnd)(frame->list, node);
+            frame->node = frame->list;
+            frame->state = Word2000Attrs;
+            break;
+
+        case Word2000Code:
+            StripSpan( doc, frame->span );
+            TY_(InsertNodeAtEnd)(frame->list, frame->br);
+            frame->node = NodeNext(frame->list);
+            frame->state = Word2000Attrs;
+            break;
+
+        case Word2000Attrs:
+            if (!node)
+                return NULL;
 
-        if (node->content)
-            TY_(CleanWord2000)( doc, node->content );
+            /* strip out style and class attributes */
+            if (TY_(nodeIsElement)(node))
+                PurgeWord2000Attributes( doc, node );
+
+            frame->state = Word2000Content;
+            if (NodeContent(node))
+                return NodeContent(node);
+            break;
 
-        node = node->next;
+        case Word2000Content:
+            frame->node = NodeNext(node);
+            frame->state = Word2000Next;
+            break;
+        }
+    }
+}
+
+/*
+ This is a major clean up to strip out all the extra stuff you get
+ when you save as web page from Word 2000. It doesn't yet know what
+ to do with VML tags, but these will appear as errors unless you
+ declare them as new tags, such as o:p which needs to be declared
+ as inline.
+*/
+void TY_(CleanWord2000)( TidyDocImpl* doc, Node *node)
+{
+    Word2000Frame* frames = NULL;
+    uint nframes = 0, size = 0;
+
+    while ( node || nframes > 0 )
+    {
+        if ( node )
+        {
+            if ( nframes == size )
+            {
+                size = size ? 2 * size : 16;
+                frames = (Word2000Frame*) TidyDocRealloc( doc, frames,
+                                            sizeof(Word2000Frame) * size );
+            }
+            TidyClearMemory( &frames[nframes], sizeof(Word2000Frame) );
+            frames[nframes].node = node;
+            frames[nframes].state = Word2000Next;
+            ++nframes;
+        }
+
+        node = CleanWord2000List( doc, &frames[nframes - 1] );
+        if ( !node )
+            --nframes;
     }
+
+    TidyDocFree( doc, frames );
 }
 
 Bool TY_(IsWord2000)( TidyDocImpl* doc )
@@ -2114,7 +2515,7 @@ Bool TY_(IsWord2000)( TidyDocImpl* doc )
 
     if (head)
     {
-        for (node = head->content; node; node = node->next)
+        for (node = NodeContent(head); node; node = NodeNext(node))
         {
             if ( !nodeIsMETA(node) )
                 continue;
@@ -2142,7 +2543,7 @@ void TY_(BumpObject)( TidyDocImpl* doc, Node *html )
     if (!html)
         return;
 
-    for ( node = html->content; node != NULL; node = node->next )
+    for ( node = NodeContent(html); node != NULL; node = NodeNext(node) )
     {
         if ( nodeIsHEAD(node) )
             head = node;
@@ -2153,16 +2554,16 @@ void TY_(BumpObject)( TidyDocImpl* doc, Node *html )
 
     if ( head != NULL && body != NULL )
     {
-        for (node = head->content; node != NULL; node = next)
+        for (node = NodeContent(head); node != NULL; node = next)
         {
-            next = node->next;
+            next = NodeNext(node);
 
             if ( nodeIsOBJECT(node) )
             {
                 Node *child;
                 Bool bump = no;
 
-                for (child = node->content; child != NULL; child = child->next)
+                for (child = NodeContent(node); child != NULL; child = NodeNext(child))
                 {
                     /* bump to body unless content is param */
                     if ( (TY_(nodeIsText)(child) && !TY_(IsBlank)(doc->lexer, node))
@@ -2244,7 +2645,7 @@ void TY_(VerifyHTTPEquiv)(TidyDocImpl* doc, Node *head)
         return;
 
     /* Find any <meta http-equiv='Content-Type' content='...' /> */
-    for (pNode = head->content; NULL != pNode; pNode = pNode->next)
+    for (pNode = NodeContent(head); NULL != pNode; pNode = NodeNext(pNode))
     {
         AttVal* httpEquiv = TY_(AttrGetById)(pNode, TidyAttr_HTTP_EQUIV);
         AttVal* metaContent = TY_(AttrGetById)(pNode, TidyAttr_CONTENT);
@@ -2292,12 +2693,13 @@ void TY_(VerifyHTTPEquiv)(TidyDocImpl* doc, Node *head)
             TY_(tmbstrcpy)(prop->name, "charset=");
             TY_(tmbstrcpy)(prop->name+8, enc);
             s = CreatePropString( doc, pFirstProp );
+            metaContent = TY_(OwnAttr)( doc, pNode, metaContent );
             TidyDocFree( doc, metaContent->value );
             metaContent->value = s;
             break;
         }
         /* #718127, prevent memory leakage */
-        FreeStyleProps(doc, pFirstProp);
+        TY_(FreeStyleProps)(doc, pFirstProp);
         pFirstProp = NULL;
         pLastProp = NULL;
     }
@@ -2305,71 +2707,59 @@ void TY_(VerifyHTTPEquiv)(TidyDocImpl* doc, Node *head)
 
 void TY_(DropComments)(TidyDocImpl* doc, Node* node)
 {
-    Node* next;
+    Node *parent = node ? NodeParent(node) : NULL, *next;
 
     while (node)
     {
-        next = node->next;
-
         if (node->type == CommentTag)
         {
+            next = TY_(NextPastContent)(node, parent);
             TY_(RemoveNode)(node);
             TY_(FreeNode)(doc, node);
             node = next;
             continue;
         }
 
-        if (node->content)
-            TY_(DropComments)(doc, node->content);
-
-        node = next;
+        node = TY_(NextPreOrder)(node, parent);
     }
 }
 
 void TY_(DropFontElements)(TidyDocImpl* doc, Node* node, Node **ARG_UNUSED(pnode))
 {
-    Node* next;
+    Node *parent = node ? NodeParent(node) : NULL, *next, *after;
 
     while (node)
     {
-        next = node->next;
-
         if (nodeIsFONT(node))
         {
+            /* the font's content, if any, is seen in its place */
+            after = TY_(NextPastContent)(node, parent);
             DiscardContainer(doc, node, &next);
-            node = next;
+            node = next ? next : after;
             continue;
         }
 
-        if (node->content)
-            TY_(DropFontElements)(doc, node->content, &next);
-
-        node = next;
+        node = TY_(NextPreOrder)(node, parent);
     }
 }
 
 void TY_(WbrToSpace)(TidyDocImpl* doc, Node* node)
 {
-    Node* next;
+    Node *parent = node ? NodeParent(node) : NULL, *next;
 
     while (node)
     {
-        next = node->next;
+        next = TY_(NextPreOrder)(node, parent);
 
         if (nodeIsWBR(node))
         {
             Node* text;
-            text = TY_(NewLiteralTextNode)(doc->lexer, " ");
+            text = TY_(NewLiteralTextNode)( doc, " ");
             TY_(InsertNodeAfterElement)(node, text);
             TY_(RemoveNode)(node);
             TY_(FreeNode)(doc, node);
-            node = next;
-            continue;
         }
 
-        if (node->content)
-            TY_(WbrToSpace)(doc, node->content);
-
         node = next;
    }
 }
@@ -2411,24 +2801,26 @@ void TY_(WbrToSpace)(TidyDocImpl* doc, Node* node)
 */
 void TY_(DowngradeTypography)(TidyDocImpl* doc, Node* node)
 {
-    Node* next;
+    Node* parent = node ? NodeParent(node) : NULL;
     Lexer* lexer = doc->lexer;
 
-    while (node)
+    for ( ; node; node = TY_(NextPreOrder)(node, parent))
     {
-        next = node->next;
-
         if (TY_(nodeIsText)(node))
         {
-            uint i, c;
-            tmbstr p = lexer->lexbuf + node->start;
+            size_t i, len = NodeTextLen(node);
+            uint c;
+            tmbstr text, p;
 
-            for (i = node->start; i < node->end; ++i)
+            TY_(OwnNodeText)( lexer, node, no );
+            text = p = TY_(LexTextAt)( lexer, node->start );
+
+            for (i = 0; i < len; ++i)
             {
-                c = (unsigned char) lexer->lexbuf[i];
+                c = (unsigned char) text[i];
 
                 if (c > 0x7F)
-                    i += TY_(GetUTF8)(lexer->lexbuf + i, &c);
+                    i += TY_(GetUTF8)(text + i, &c);
 
                 if (c >= 0x2013 && c <= 0x201E)
                 {
@@ -2454,53 +2846,36 @@ void TY_(DowngradeTypography)(TidyDocImpl* doc, Node* node)
                 p = TY_(PutUTF8)(p, c);
             }
 
-            node->end = p - lexer->lexbuf;
+            node->end = node->start + (p - text);
         }
-
-        if (node->content)
-            TY_(DowngradeTypography)(doc, node->content);
-
-        node = next;
     }
 }
 
 void TY_(ReplacePreformattedSpaces)(TidyDocImpl* doc, Node* node)
 {
-    Node* next;
+    Node* parent = node ? NodeParent(node) : NULL;
 
     while (node)
     {
-        next = node->next;
-
-        if (node->tag && node->tag->parser == TY_(ParsePre))
+        if (NodeTag(node) && NodeTag(node)->parser == TY_(ParsePre))
         {
-            TY_(NormalizeSpaces)(doc->lexer, node->content);
-            node = next;
+            TY_(NormalizeSpaces)(doc->lexer, NodeContent(node));
+            node = TY_(NextPastContent)(node, parent);
             continue;
         }
 
-        if (node->content)
-            TY_(ReplacePreformattedSpaces)(doc, node->content);
-
-        node = next;
+        node = TY_(NextPreOrder)(node, parent);
     }
 }
 
-void TY_(ConvertCDATANodes)(TidyDocImpl* doc, Node* node)
+void TY_(ConvertCDATANodes)(TidyDocImpl* ARG_UNUSED(doc), Node* node)
 {
-    Node* next;
+    Node* parent = node ? NodeParent(node) : NULL;
 
-    while (node)
+    for ( ; node; node = TY_(NextPreOrder)(node, parent))
     {
-        next = node->next;
-
         if (node->type == CDATATag)
             node->type = TextNode;
-
-        if (node->content)
-            TY_(ConvertCDATANodes)(doc, node->content);
-
-        node = next;
     }
 }
 
@@ -2511,55 +2886,64 @@ void TY_(ConvertCDATANodes)(TidyDocImpl* doc, Node* node)
   'xml:lang' and 'lang' are desired, for XHTML 1.1 only 'xml:lang'
   is desired and for HTML 4.01 only 'lang' is desired.
 */
-void TY_(FixLanguageInformation)(TidyDocImpl* doc, Node* node, Bool wantXmlLang, Bool wantLang)
+static Bool FixLanguageRule( TidyDocImpl* doc, Node* node, const CleanWalk* walk )
 {
-    Node* next;
+    Bool wantXmlLang = walk->wantXmlLang;
+    Bool wantLang = walk->wantLang;
 
-    while (node)
-    {
-        next = node->next;
+    /* todo: report modifications made here to the report system */
 
-        /* todo: report modifications made here to the report system */
+    if (TY_(nodeIsElement)(node))
+    {
+        AttVal* lang = TY_(AttrGetById)(node, TidyAttr_LANG);
+        AttVal* xmlLang = TY_(AttrGetById)(node, TidyAttr_XML_LANG);
 
-        if (TY_(nodeIsElement)(node))
+        if (lang || xmlLang)
         {
-            AttVal* lang = TY_(AttrGetById)(node, TidyAttr_LANG);
-            AttVal* xmlLang = TY_(AttrGetById)(node, TidyAttr_XML_LANG);
-
-            if (lang && xmlLang)
-            {
-                /*
-                  todo: check whether both attributes are in sync,
-                  here or elsewhere, where elsewhere is probably
-                  preferable.
-                  AD - March 2005: not mandatory according the standards.
-                */
-            }
-            else if (lang && wantXmlLang)
-            {
-                if (TY_(NodeAttributeVersions)( node, TidyAttr_XML_LANG )
-                    & doc->lexer->versionEmitted)
-                    TY_(RepairAttrValue)(doc, node, "xml:lang", lang->value);
-            }
-            else if (xmlLang && wantLang)
-            {
-                if (TY_(NodeAttributeVersions)( node, TidyAttr_LANG )
-                    & doc->lexer->versionEmitted)
-                    TY_(RepairAttrValue)(doc, node, "lang", xmlLang->value);
-            }
-
-            if (lang && !wantLang)
-                TY_(RemoveAttribute)(doc, node, lang);
-            
-            if (xmlLang && !wantXmlLang)
-                TY_(RemoveAttribute)(doc, node, xmlLang);
+            /* take node's own copy of both before changing either */
+            TY_(OwnAttrs)(doc, node);
+            lang = TY_(AttrGetById)(node, TidyAttr_LANG);
+            xmlLang = TY_(AttrGetById)(node, TidyAttr_XML_LANG);
         }
 
-        if (node->content)
-            TY_(FixLanguageInformation)(doc, node->content, wantXmlLang, wantLang);
+        if (lang && xmlLang)
+        {
+            /*
+              todo: check whether both attributes are in sync,
+              here or elsewhere, where elsewhere is probably
+              preferable.
+              AD - March 2005: not mandatory according the standards.
+            */
+        }
+        else if (lang && wantXmlLang)
+        {
+            if (TY_(NodeAttributeVersions)( node, TidyAttr_XML_LANG )
+                & doc->lexer->versionEmitted)
+                TY_(RepairAttrValue)(doc, node, "xml:lang", lang->value);
+        }
+        else if (xmlLang && wantLang)
+        {
+            if (TY_(NodeAttributeVersions)( node, TidyAttr_LANG )
+                & doc->lexer->versionEmitted)
+                TY_(RepairAttrValue)(doc, node, "lang", xmlLang->value);
+        }
 
-        node = next;
+        if (lang && !wantLang)
+            TY_(RemoveAttribute)(doc, node, lang);
+        
+        if (xmlLang && !wantXmlLang)
+            TY_(RemoveAttribute)(doc, node, xmlLang);
     }
+    return no;
+}
+
+void TY_(FixLanguageInformation)(TidyDocImpl* doc, Node* node, Bool wantXmlLang, Bool wantLang)
+{
+    CleanWalk walk = { { FixLanguageRule } };
+
+    walk.wantXmlLang = wantXmlLang;
+    walk.wantLang = wantLang;
+    WalkPreOrder( doc, node, &walk );
 }
 
 /*
@@ -2589,79 +2973,109 @@ void TY_(FixXhtmlNamespace)(TidyDocImpl* doc, Bool wantXmlns)
 /*
   ...
 */
-void TY_(FixAnchors)(TidyDocImpl* doc, Node *node, Bool wantName, Bool wantId)
+static Bool FixAnchorsRule( TidyDocImpl* doc, Node* node, const CleanWalk* walk )
 {
-    Node* next;
+    Bool wantName = walk->wantName;
+    Bool wantId = walk->wantId;
 
-    while (node)
+    if (TY_(IsAnchorElement)(doc, node))
     {
-        next = node->next;
+        AttVal *name, *id;
+        Bool hadName, hadId;
+        Bool IdEmitted = no;
+        Bool NameEmitted = no;
 
-        if (TY_(IsAnchorElement)(doc, node))
+        name = TY_(AttrGetById)(node, TidyAttr_NAME);
+        id = TY_(AttrGetById)(node, TidyAttr_ID);
+
+        if (name || id)
         {
-            AttVal *name = TY_(AttrGetById)(node, TidyAttr_NAME);
-            AttVal *id = TY_(AttrGetById)(node, TidyAttr_ID);
-            Bool hadName = name!=NULL;
-            Bool hadId = id!=NULL;
-            Bool IdEmitted = no;
-            Bool NameEmitted = no;
+            /* take node's own copy of both before changing either */
+            TY_(OwnAttrs)(doc, node);
+            name = TY_(AttrGetById)(node, TidyAttr_NAME);
+            id = TY_(AttrGetById)(node, TidyAttr_ID);
+        }
 
-            /* todo: how are empty name/id attributes handled? */
+        hadName = name!=NULL;
+        hadId = id!=NULL;
 
-            if (name && id)
-            {
-                Bool NameHasValue = AttrHasValue(name);
-                Bool IdHasValue = AttrHasValue(id);
-                if ( (NameHasValue != IdHasValue) ||
-                     (NameHasValue && IdHasValue &&
-                     TY_(tmbstrcmp)(name->value, id->value) != 0 ) )
-                    TY_(ReportAttrError)( doc, node, name, ID_NAME_MISMATCH);
-            }
-            else if (name && wantId)
-            {
-                if (TY_(NodeAttributeVersions)( node, TidyAttr_ID )
-                    & doc->lexer->versionEmitted)
-                {
-                    if (TY_(IsValidHTMLID)(name->value))
-                    {
-                        TY_(RepairAttrValue)(doc, node, "id", name->value);
-                        IdEmitted = yes;
-                    }
-                    else
-                        TY_(ReportAttrError)(doc, node, name, INVALID_XML_ID);
-                 }
-            }
-            else if (id && wantName)
+        /* todo: how are empty name/id attributes handled? */
+
+        if (name && id)
+        {
+            Bool NameHasValue = AttrHasValue(name);
+            Bool IdHasValue = AttrHasValue(id);
+            if ( (NameHasValue != IdHasValue) ||
+                 (NameHasValue && IdHasValue &&
+                 TY_(tmbstrcmp)(name->value, id->value) != 0 ) )
+                TY_(ReportAttrError)( doc, node, name, ID_NAME_MISMATCH);
+        }
+        else if (name && wantId)
+        {
+            if (TY_(NodeAttributeVersions)( node, TidyAttr_ID )
+                & doc->lexer->versionEmitted)
             {
-                if (TY_(NodeAttributeVersions)( node, TidyAttr_NAME )
-                    & doc->lexer->versionEmitted)
+                if (TY_(IsValidHTMLID)(name->value))
                 {
-                    /* todo: do not assume id is valid */
-                    TY_(RepairAttrValue)(doc, node, "name", id->value);
-                    NameEmitted = yes;
+                    TY_(RepairAttrValue)(doc, node, "id", name->value);
+                    IdEmitted = yes;
                 }
+                else
+                    TY_(ReportAttrError)(doc, node, name, INVALID_XML_ID);
+             }
+        }
+        else if (id && wantName)
+        {
+            if (TY_(NodeAttributeVersions)( node, TidyAttr_NAME )
+                & doc->lexer->versionEmitted)
+            {
+                /* todo: do not assume id is valid */
+                TY_(RepairAttrValue)(doc, node, "name", id->value);
+                NameEmitted = yes;
             }
+        }
 
-            if (id && !wantId
-                /* make sure that Name has been emitted if requested */
-                && (hadName || !wantName || NameEmitted) )
-                TY_(RemoveAttribute)(doc, node, id);
+        if (id && !wantId
+            /* make sure that Name has been emitted if requested */
+            && (hadName || !wantName || NameEmitted) )
+            TY_(RemoveAttribute)(doc, node, id);
 
-            if (name && !wantName
-                /* make sure that Id has been emitted if requested */
-                && (hadId || !wantId || IdEmitted) )
-                TY_(RemoveAttribute)(doc, node, name);
+        if (name && !wantName
+            /* make sure that Id has been emitted if requested */
+            && (hadId || !wantId || IdEmitted) )
+            TY_(RemoveAttribute)(doc, node, name);
 
-            if (TY_(AttrGetById)(node, TidyAttr_NAME) == NULL &&
-                TY_(AttrGetById)(node, TidyAttr_ID) == NULL)
-                TY_(RemoveAnchorByNode)(doc, node);
-        }
+        if (TY_(AttrGetById)(node, TidyAttr_NAME) == NULL &&
+            TY_(AttrGetById)(node, TidyAttr_ID) == NULL)
+            TY_(RemoveAnchorByNode)(doc, node);
+    }
+    return no;
+}
 
-        if (node->content)
-            TY_(FixAnchors)(doc, node->content, wantName, wantId);
+void TY_(FixAnchors)(TidyDocImpl* doc, Node *node, Bool wantName, Bool wantId)
+{
+    CleanWalk walk = { { FixAnchorsRule } };
 
-        node = next;
-    }
+    walk.wantName = wantName;
+    walk.wantId = wantId;
+    WalkPreOrder( doc, node, &walk );
+}
+
+/*
+  FixAnchors() and FixLanguageInformation() change different
+  attributes, and only the first reports, so they share a walk.
+*/
+void TY_(FixAnchorsAndLanguage)( TidyDocImpl* doc, Node* node,
+                                  Bool wantName, Bool wantId,
+                                  Bool wantXmlLang, Bool wantLang )
+{
+    CleanWalk walk = { { FixAnchorsRule, FixLanguageRule } };
+
+    walk.wantName = wantName;
+    walk.wantId = wantId;
+    walk.wantXmlLang = wantXmlLang;
+    walk.wantLang = wantLang;
+    WalkPreOrder( doc, node, &walk );
 }
 
 /*
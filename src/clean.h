@@ -16,6 +16,7 @@
 void TY_(FixNodeLinks)(Node *node);
 
 void TY_(FreeStyles)( TidyDocImpl* doc );
+void TY_(FreeStyleProps)( TidyDocImpl* doc, StyleProp *props );
 
 /* Add class="foo" to node
 */
@@ -46,6 +47,10 @@ void TY_(List2BQ)( TidyDocImpl* doc, Node* node );
 */
 void TY_(BQ2Div)( TidyDocImpl* doc, Node* node );
 
+/* NestedEmphasis, List2BQ, BQ2Div and, if logical, EmFromI
+   over the document, in two walks */
+void TY_(CleanEmphasisAndLists)( TidyDocImpl* doc, Bool logical );
+
 
 void TY_(DropSections)( TidyDocImpl* doc, Node* node );
 
@@ -83,5 +88,10 @@ void TY_(FixAnchors)(TidyDocImpl* doc, Node *node, Bool wantName, Bool wantId);
 void TY_(FixXhtmlNamespace)(TidyDocImpl* doc, Bool wantXmlns);
 void TY_(FixLanguageInformation)(TidyDocImpl* doc, Node* node, Bool wantXmlLang, Bool wantLang);
 
+/* FixAnchors and FixLanguageInformation in one walk */
+void TY_(FixAnchorsAndLanguage)( TidyDocImpl* doc, Node* node,
+                                  Bool wantName, Bool wantId,
+                                  Bool wantXmlLang, Bool wantLang );
+
 
 #endif /* __CLEAN_H__ */
@@ -305,19 +305,137 @@ static const entity entities[] =
 };
 
 
-/* Pure static implementation.  Trades off lookup speed
-** for faster setup time (well, none actually).
-** Optimization of comparing 1st character buys enough
-** speed that hash doesn't improve things without > 500
-** items in list.
+#define N_ENTITIES  ( sizeof(entities)/sizeof(entities[0]) - 1 )
+
+/* Indexes of entities[] sorted by name (as by strcmp) and by code.
+** The names form a trie implicitly: the names starting with a given
+** prefix are a range of entityByName, narrowed char by char.  Debug
+** builds check both in InitEntities() and print new arrays if the
+** table has changed.
 */
+static const unsigned short entityByName[] =
+{
+    43, 38, 39, 37, 102, 42, 40, 41, 103, 44, 123, 248,
+    105, 53, 46, 47, 45, 106, 108, 48, 104, 50, 51, 49,
+    110, 52, 111, 112, 113, 54, 114, 225, 56, 57, 55, 125,
+    116, 61, 58, 59, 122, 117, 157, 124, 118, 227, 119, 67,
+    120, 109, 63, 64, 62, 121, 65, 115, 66, 229, 107, 70,
+    71, 25, 75, 69, 164, 126, 1, 192, 191, 2, 74, 200,
+    72, 73, 246, 127, 11, 154, 194, 76, 29, 7, 148, 230,
+    222, 199, 14, 170, 195, 9, 174, 247, 168, 21, 129, 224,
+    92, 78, 79, 77, 179, 233, 232, 130, 202, 132, 85, 80,
+    252, 178, 101, 176, 34, 33, 35, 159, 128, 204, 4, 175,
+    169, 223, 155, 82, 83, 6, 81, 161, 190, 196, 134, 36,
+    181, 84, 135, 171, 136, 218, 16, 165, 214, 244, 203, 216,
+    187, 220, 237, 250, 241, 3, 20, 240, 26, 28, 186, 137,
+    180, 5, 239, 201, 183, 17, 182, 207, 86, 138, 88, 89,
+    226, 87, 158, 150, 140, 210, 193, 15, 31, 93, 90, 211,
+    91, 27, 177, 249, 212, 147, 141, 153, 22, 8, 156, 184,
+    189, 149, 0, 173, 188, 219, 32, 167, 215, 245, 162, 19,
+    217, 142, 238, 251, 242, 243, 228, 213, 12, 18, 144, 143,
+    198, 221, 205, 208, 185, 206, 30, 23, 24, 209, 68, 145,
+    197, 133, 151, 234, 99, 231, 60, 163, 172, 95, 166, 96,
+    94, 13, 152, 146, 97, 160, 139, 98, 10, 100, 131, 236,
+    235
+};
+
+static const unsigned short entityByCode[] =
+{
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+    12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
+    24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35,
+    36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+    48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59,
+    60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71,
+    72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83,
+    84, 85, 86, 87, 88, 89, 90, 91, 92, 93, 94, 95,
+    96, 97, 98, 99, 100, 225, 226, 227, 228, 229, 101, 230,
+    231, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111, 112,
+    113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124,
+    125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135, 136,
+    137, 138, 139, 140, 141, 142, 143, 144, 145, 146, 147, 148,
+    149, 150, 151, 152, 153, 232, 233, 234, 235, 236, 237, 238,
+    239, 240, 241, 242, 243, 244, 245, 246, 247, 248, 154, 155,
+    249, 156, 157, 250, 251, 158, 159, 252, 161, 160, 162, 163,
+    164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+    176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187,
+    188, 189, 190, 191, 192, 193, 194, 195, 196, 197, 198, 199,
+    200, 201, 202, 203, 204, 205, 206, 207, 208, 209, 210, 211,
+    212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+    224
+};
+
+#define ByName(ix)  ( entities[ entityByName[ix] ].name )
+
+void TY_(EntityMatchInit)( EntityMatch* match )
+{
+    match->lo = 0;
+    match->hi = N_ENTITIES;
+    match->len = 0;
+}
+
+Bool TY_(EntityMatchStep)( EntityMatch* match, uint c )
+{
+    uint lo = match->lo, hi = match->hi, k = match->len, mid;
+
+    /* names in range share their first k chars, so are sorted by
+       the next one; names of length k come first, with '\0' */
+    if ( c > 0 && c < 128 )
+    {
+        uint b = hi;
+        while ( lo < b )
+        {
+            mid = lo + (b - lo) / 2;
+            if ( (byte) ByName(mid)[k] < c )
+                lo = mid + 1;
+            else
+                b = mid;
+        }
+        b = lo;
+        while ( b < hi )
+        {
+            mid = b + (hi - b) / 2;
+            if ( (byte) ByName(mid)[k] == c )
+                b = mid + 1;
+            else
+                hi = mid;
+        }
+    }
+    else
+        lo = hi;
+
+    match->lo = lo;
+    match->hi = hi;
+    match->len = k + 1;
+    return ( lo < hi );
+}
+
+Bool TY_(EntityMatchInfo)( const EntityMatch* match, Bool isXml,
+                           uint* code, uint* versions )
+{
+    if ( match->lo < match->hi && ByName(match->lo)[match->len] == '\0' )
+    {
+        const entity* np = &entities[ entityByName[match->lo] ];
+        *code = np->code;
+        *versions = np->versions;
+        return yes;
+    }
+
+    *code = 0;
+    *versions = ( isXml ? VERS_XML : VERS_PROPRIETARY );
+    return no;
+}
+
 static const entity* entitiesLookup( ctmbstr s )
 {
-    tmbchar ch = (tmbchar)( s ? *s : 0 );
-    const entity *np;
-    for ( np = entities; ch && np && np->name; ++np )
-        if ( ch == *np->name && TY_(tmbstrcmp)(s, np->name) == 0 )
-            return np;
+    EntityMatch match;
+
+    TY_(EntityMatchInit)( &match );
+    while ( s && *s && TY_(EntityMatchStep)(&match, (byte) *s) )
+        ++s;
+    if ( s && *s == '\0' && match.lo < match.hi
+         && ByName(match.lo)[match.len] == '\0' )
+        return &entities[ entityByName[match.lo] ];
     return NULL;
 }
 
@@ -394,19 +512,77 @@ Bool TY_(EntityInfo)( ctmbstr name, Bool isXml, uint* code, uint* versions )
 
 ctmbstr TY_(EntityName)( uint ch, uint versions )
 {
-    ctmbstr entnam = NULL;
-    const entity *ep;
+    uint lo = 0, hi = N_ENTITIES, mid;
 
-    for ( ep = entities; ep->name != NULL; ++ep )
+    while ( lo < hi )
     {
+        const entity* ep;
+        mid = lo + (hi - lo) / 2;
+        ep = &entities[ entityByCode[mid] ];
         if ( ep->code == ch )
-        {
-            if ( ep->versions & versions )
-                entnam = ep->name;
-            break; /* Found code. Stop search. */
-        }
+            return ( ep->versions & versions ) ? ep->name : NULL;
+        if ( ep->code < ch )
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    return entnam;
+    return NULL;
+}
+
+#if defined(_DEBUG)
+static int CompareByName( const void* a, const void* b )
+{
+    return TY_(tmbstrcmp)( entities[*(const unsigned short*)a].name,
+                           entities[*(const unsigned short*)b].name );
+}
+
+static int CompareByCode( const void* a, const void* b )
+{
+    uint ca = entities[*(const unsigned short*)a].code;
+    uint cb = entities[*(const unsigned short*)b].code;
+    return ca < cb ? -1 : ca > cb;
+}
+
+/* Checks index is entities[] sorted by cmp, and if not prints one
+   that is to stderr. */
+static Bool CheckEntityIndex( const unsigned short* index, uint count,
+                              ctmbstr what,
+                              int (*cmp)(const void*, const void*) )
+{
+    unsigned short sorted[ N_ENTITIES ];
+    uint i;
+
+    for ( i = 0; i < N_ENTITIES; ++i )
+        sorted[i] = (unsigned short) i;
+    qsort( sorted, N_ENTITIES, sizeof(sorted[0]), cmp );
+
+    for ( i = 0; i < N_ENTITIES; ++i )
+        if ( count != N_ENTITIES || index[i] != sorted[i] )
+            break;
+    if ( i == N_ENTITIES )
+        return yes;
+
+    fprintf( stderr, "%s is out of date, use:\n", what );
+    fprintf( stderr, "static const unsigned short %s[] =\n{", what );
+    for ( i = 0; i < N_ENTITIES; ++i )
+        fprintf( stderr, "%s%u%s", i % 12 ? " " : "\n    ", sorted[i],
+                 i + 1 < N_ENTITIES ? "," : "\n" );
+    fprintf( stderr, "};\n" );
+    return no;
+}
+#endif
+
+void TY_(InitEntities)( void )
+{
+#if defined(_DEBUG)
+    Bool ok = CheckEntityIndex( entityByName,
+                                sizeof(entityByName)/sizeof(entityByName[0]),
+                                "entityByName", CompareByName );
+    ok = CheckEntityIndex( entityByCode,
+                           sizeof(entityByCode)/sizeof(entityByCode[0]),
+                           "entityByCode", CompareByCode ) && ok;
+    assert( ok );
+#endif
 }
 
 /*
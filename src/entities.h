@@ -21,4 +21,27 @@
 ctmbstr TY_(EntityName)( uint charCode, uint versions );
 Bool    TY_(EntityInfo)( ctmbstr name, Bool isXml, uint* code, uint* versions );
 
+/* Matching of an entity name as it is read, one char at a time.
+** Tracks the entities whose names start with the chars so far.
+*/
+typedef struct _EntityMatch
+{
+    uint lo, hi;    /* range of matching names, by name order */
+    uint len;       /* chars fed */
+} EntityMatch;
+
+void    TY_(EntityMatchInit)( EntityMatch* match );
+
+/* Feeds the next char of the name.  Returns no once no entity
+** name starts with the chars fed.
+*/
+Bool    TY_(EntityMatchStep)( EntityMatch* match, uint c );
+
+/* Like EntityInfo() for the name fed so far */
+Bool    TY_(EntityMatchInfo)( const EntityMatch* match, Bool isXml,
+                              uint* code, uint* versions );
+
+/* The tables are constant.  Debug builds check their indexes here */
+void    TY_(InitEntities)( void );
+
 #endif /* __ENTITIES_H__ */
@@ -52,9 +52,23 @@ static void TIDY_CALL filesrc_ungetByte( void* sourceData, byte bv )
   tidyBufPutByte( &fin->unget, bv );
 }
 
+static const byte* filesrc_getBlock( TidyInputSource* source, byte* buf,
+                                     uint maxlen, uint* len )
+{
+  FileSource* fin = (FileSource*) source->sourceData;
+  uint n = 0;
+  while ( n < maxlen && fin->unget.size > 0 )
+    buf[n++] = (byte) tidyBufPopByte( &fin->unget );
+  if ( n < maxlen )
+    n += (uint) fread( buf + n, 1, maxlen - n, fin->fp );
+  *len = n;
+  return n > 0 ? buf : NULL;
+}
+
 #if SUPPORT_POSIX_MAPPED_FILES
 #define initFileSource initStdIOFileSource
 #define freeFileSource freeStdIOFileSource
+#define fileSourceBlockFunc stdIOFileSourceBlockFunc
 #endif
 int TY_(initFileSource)( TidyAllocator *allocator, TidyInputSource* inp, FILE* fp )
 {
@@ -84,6 +98,34 @@ void TY_(freeFileSource)( TidyInputSource* inp, Bool closeIt )
     TidyFree( fin->unget.allocator, fin );
 }
 
+TidyGetBlockFunc TY_(fileSourceBlockFunc)( TidyInputSource* ARG_UNUSED(inp) )
+{
+    return filesrc_getBlock;
+}
+
+#if !SUPPORT_POSIX_MAPPED_FILES
+/* Files are never mapped here */
+const byte* TY_(fileSourceMapping)( TidyInputSource* ARG_UNUSED(inp), size_t* size )
+{
+    *size = 0;
+    return NULL;
+}
+
+void* TY_(keepFileSourceMapping)( TidyInputSource* ARG_UNUSED(inp) )
+{
+    return NULL;
+}
+
+void TY_(freeMappedFile)( void* ARG_UNUSED(mapping) )
+{
+}
+
+Bool TY_(isMappedFile)( void* ARG_UNUSED(mapping), ctmbstr ARG_UNUSED(filnam) )
+{
+    return no;
+}
+#endif
+
 void TIDY_CALL TY_(filesink_putByte)( void* sinkData, byte bv )
 {
   FILE* fout = (FILE*) sinkData;
@@ -20,18 +20,48 @@
 extern "C" {
 #endif
 
+/** Block read callback: returns a pointer to the next run of raw input
+**  bytes and sets *len to its length, or returns NULL at end of input.
+**  The bytes are either copied into buf (at most maxlen of them) or
+**  point straight into memory owned by the source.  They stay valid
+**  until the next call.
+*/
+typedef const byte* (*TidyGetBlockFunc)( TidyInputSource* source, byte* buf,
+                                         uint maxlen, uint* len );
+
 /** Allocate and initialize file input source */
 int TY_(initFileSource)( TidyAllocator *allocator, TidyInputSource* source, FILE* fp );
 
 /** Free file input source */
 void TY_(freeFileSource)( TidyInputSource* source, Bool closeIt );
 
+/** Block reader for a file input source */
+TidyGetBlockFunc TY_(fileSourceBlockFunc)( TidyInputSource* source );
+
+/** Memory mapped file input only: returns the whole mapping and sets
+**  *size to its length, or returns NULL for any other source */
+const byte* TY_(fileSourceMapping)( TidyInputSource* source, size_t* size );
+
+/** Memory mapped file input only: leaves the mapping in place when
+**  the source is freed and returns a handle for it, or returns NULL
+**  for any other source.  Release it with TY_(freeMappedFile)() */
+void* TY_(keepFileSourceMapping)( TidyInputSource* source );
+
+/** Unmap a mapping kept by TY_(keepFileSourceMapping)() */
+void TY_(freeMappedFile)( void* mapping );
+
+/** Is filnam the file behind a kept mapping? */
+Bool TY_(isMappedFile)( void* mapping, ctmbstr filnam );
+
 #if SUPPORT_POSIX_MAPPED_FILES
 /** Allocate and initialize file input source using Standard C I/O */
 int TY_(initStdIOFileSource)( TidyAllocator *allocator, TidyInputSource* source, FILE* fp );
 
 /** Free file input source using Standard C I/O */
 void TY_(freeStdIOFileSource)( TidyInputSource* source, Bool closeIt );
+
+/** Block reader for a file input source using Standard C I/O */
+TidyGetBlockFunc TY_(stdIOFileSourceBlockFunc)( TidyInputSource* source );
 #endif
 
 /** Initialize file output sink */
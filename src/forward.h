@@ -56,6 +56,12 @@ typedef struct _IStack IStack;
 struct _Lexer;
 typedef struct _Lexer Lexer;
 
+struct _ParseFrame;
+typedef struct _ParseFrame ParseFrame;
+
+struct _ScanState;
+typedef struct _ScanState ScanState;
+
 extern TidyAllocator TY_(g_default_allocator);
 
 /** Wrappers for easy memory allocation using an allocator */
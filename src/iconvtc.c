@@ -33,7 +33,6 @@ void IconvUninitInputTranscoder(void)
 int IconvGetChar(byte firstByte, StreamIn * in, uint * bytesRead)
 {
     iconv_t cd;
-    TidyInputSource * source;
     char inbuf[TC_INBUFSIZE] = { 0 };
     char outbuf[TC_OUTBUFSIZE] = { 0 };
     size_t inbufsize = 0;
@@ -44,7 +43,6 @@ int IconvGetChar(byte firstByte, StreamIn * in, uint * bytesRead)
     assert( in->iconvptr != 0 );
 
     cd = (iconv_t)in->iconvptr;
-    source = &in->source;
 
     inbuf[inbufsize++] = (char)firstByte;
     
@@ -82,7 +80,7 @@ int IconvGetChar(byte firstByte, StreamIn * in, uint * bytesRead)
         assert( iconv_errno == EINVAL ); /* incomplete sequence       */
 
         /* we need more bytes */
-        nextByte = source->getByte(source->sourceData);
+        nextByte = TY_(ReadRawByte)(in);
 
         if (nextByte == EndOfStream)
         {
@@ -0,0 +1,214 @@
+/* intern.c -- element and attribute names shared by a document
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+*/
+
+#include "tidy-int.h"
+#include "intern.h"
+#include "tmbstr.h"
+
+static uint HashName( ctmbstr s, uint len )
+{
+    uint h = 2166136261u;
+
+    while ( len-- > 0 )
+    {
+        h ^= (byte) *s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void FreeTable( TidyDocImpl* doc, NameTable* table,
+                       ctmbstr (*known)(ctmbstr) )
+{
+    uint i;
+
+    for ( i = 0; i < table->size; ++i )
+    {
+        ctmbstr name = table->entries[i].name;
+        if ( name && known(name) != name )
+            TidyDocFree( doc, (tmbstr) name );
+    }
+    TidyDocFree( doc, table->entries );
+    TidyClearMemory( table, sizeof(*table) );
+}
+
+static NameEntry* FreeEntry( NameTable* table, uint hash )
+{
+    uint i;
+
+    for ( i = hash & (table->size - 1);
+          table->entries[i].name;
+          i = (i + 1) & (table->size - 1) )
+        ;
+    return table->entries + i;
+}
+
+/* The entry for the len bytes at s, or the free one where they'd go */
+static NameEntry* FindEntry( NameTable* table, ctmbstr s, uint len, uint hash )
+{
+    NameEntry* entry;
+    uint i;
+
+    for ( i = hash & (table->size - 1);
+          (entry = table->entries + i)->name != NULL;
+          i = (i + 1) & (table->size - 1) )
+    {
+        if ( entry->hash == hash && entry->len == len &&
+             memcmp(entry->name, s, len) == 0 )
+            break;
+    }
+    return entry;
+}
+
+static void NewEntries( TidyDocImpl* doc, NameTable* table, uint size )
+{
+    table->size = size;
+    table->entries = (NameEntry*) TidyDocAlloc( doc, size * sizeof(NameEntry) );
+    TidyClearMemory( table->entries, size * sizeof(NameEntry) );
+}
+
+static void GrowTable( TidyDocImpl* doc, NameTable* table )
+{
+    NameTable old = *table;
+    uint i;
+
+    NewEntries( doc, table, old.size ? 2 * old.size : 64 );
+
+    for ( i = 0; i < old.size; ++i )
+    {
+        if ( old.entries[i].name )
+            *FreeEntry( table, old.entries[i].hash ) = old.entries[i];
+    }
+    TidyDocFree( doc, old.entries );
+}
+
+static ctmbstr Intern( TidyDocImpl* doc, NameTable* table,
+                       ctmbstr (*known)(ctmbstr), ctmbstr s, uint len )
+{
+    uint h;
+    ctmbstr name;
+    tmbstr copy;
+    NameEntry* entry;
+
+    if ( s == NULL )
+        return NULL;
+
+    h = HashName( s, len );
+    if ( table->size > 0 &&
+         (entry = FindEntry(table, s, len, h))->name != NULL )
+        return entry->name;
+
+    /* first time in this document */
+    if ( 2 * (table->count + 1) > table->size )
+        GrowTable( doc, table );
+
+    copy = TY_(tmbstrndup)( doc->allocator, s, len );
+    name = known( copy );
+    if ( name )
+        TidyDocFree( doc, copy );
+    else
+        name = copy;
+
+    entry = FreeEntry( table, h );
+    entry->name = name;
+    entry->hash = h;
+    entry->len = len;
+    ++table->count;
+    return name;
+}
+
+ctmbstr TY_(InternTagName)( TidyDocImpl* doc, ctmbstr s, uint len )
+{
+    return Intern( doc, &doc->tagNames, TY_(KnownTagName), s, len );
+}
+
+ctmbstr TY_(InternAttrName)( TidyDocImpl* doc, ctmbstr s, uint len )
+{
+    return Intern( doc, &doc->attrNames, TY_(KnownAttrName), s, len );
+}
+
+void TY_(FreeNames)( TidyDocImpl* doc )
+{
+    FreeTable( doc, &doc->tagNames, TY_(KnownTagName) );
+    FreeTable( doc, &doc->attrNames, TY_(KnownAttrName) );
+}
+
+/* Takes name into table if it's one of those in old */
+static void KeepName( NameTable* table, NameTable* old, ctmbstr name )
+{
+    uint len = TY_(tmbstrlen)( name );
+    uint h = HashName( name, len );
+    NameEntry* entry = FindEntry( table, name, len, h );
+
+    if ( entry->name == NULL )
+    {
+        *entry = *FindEntry( old, name, len, h );
+        if ( entry->name )
+            ++table->count;
+    }
+}
+
+/*
+  A scan builds no tree, so once a token has been passed on its
+  names are only needed while its element is still open.  When
+  enough names have been interned since last time, a table is
+  rebuilt with just those of the open elements, so that a stream of
+  ever new names takes no more memory than the nesting of elements.
+*/
+static void TrimTable( TidyDocImpl* doc, NameTable* table,
+                       ctmbstr (*known)(ctmbstr), Bool attrs,
+                       Node* const* open, uint nopen )
+{
+    NameTable old = *table;
+    uint i;
+
+    if ( old.count < 2 * old.kept + 512 )
+        return;
+
+    NewEntries( doc, table, old.size );
+    table->count = 0;
+
+    for ( i = 0; i < nopen; ++i )
+    {
+        AttVal* av;
+
+        if ( !attrs && NodeElement(open[i]) )
+            KeepName( table, &old, NodeElement(open[i]) );
+        for ( av = NodeAttrs(open[i]); attrs && av; av = av->next )
+        {
+            if ( av->attribute )
+                KeepName( table, &old, av->attribute );
+        }
+    }
+
+    /* free the copies of the names not kept */
+    for ( i = 0; i < old.size; ++i )
+    {
+        NameEntry* entry = old.entries + i;
+
+        if ( entry->name && known(entry->name) != entry->name &&
+             FindEntry(table, entry->name, entry->len, entry->hash)->name == NULL )
+            TidyDocFree( doc, (tmbstr) entry->name );
+    }
+    TidyDocFree( doc, old.entries );
+    table->kept = table->count;
+}
+
+void TY_(TrimNames)( TidyDocImpl* doc, Node* const* open, uint nopen )
+{
+    TrimTable( doc, &doc->tagNames, TY_(KnownTagName), no, open, nopen );
+    TrimTable( doc, &doc->attrNames, TY_(KnownAttrName), yes, open, nopen );
+}
+
+/*
+ * local variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * eval: (c-set-offset 'substatement-open 0)
+ * end:
+ */
@@ -0,0 +1,62 @@
+#ifndef __INTERN_H__
+#define __INTERN_H__
+
+/* intern.h -- element and attribute names shared by a document
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+  Node element names and attribute names are interned: each distinct
+  name is held once, so two names are equal if and only if they are
+  the same pointer.  The names of built-in tags and attributes are
+  the strings in their Dict or Attribute; any other name is copied
+  once for the document.  Nodes don't own their names, and must not
+  change or free them.
+
+  Interned names last until the document's tree is freed, except
+  in a scan, which keeps just those of the open elements.
+
+*/
+
+#include "forward.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct _NameEntry
+{
+    ctmbstr name;       /* NULL if free */
+    uint    hash;
+    uint    len;
+} NameEntry;
+
+struct _NameTable
+{
+    NameEntry* entries; /* open addressing */
+    uint       count;
+    uint       size;    /* a power of 2 */
+    uint       kept;    /* count after the last TrimNames() */
+};
+
+typedef struct _NameTable NameTable;
+
+/* The element name or attribute name of the len bytes at s */
+ctmbstr TY_(InternTagName)( TidyDocImpl* doc, ctmbstr s, uint len );
+ctmbstr TY_(InternAttrName)( TidyDocImpl* doc, ctmbstr s, uint len );
+
+#define InternTagStr(doc, s)  TY_(InternTagName)( doc, s, TY_(tmbstrlen)(s) )
+#define InternAttrStr(doc, s) TY_(InternAttrName)( doc, s, TY_(tmbstrlen)(s) )
+
+/* Forgets all names, freeing the copies */
+void TY_(FreeNames)( TidyDocImpl* doc );
+
+/* Forgets all names but those of the nopen nodes at open and their
+   attributes, once enough have been interned since last time */
+void TY_(TrimNames)( TidyDocImpl* doc, Node* const* open, uint nopen );
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __INTERN_H__ */
@@ -17,6 +17,23 @@
 #include "streamio.h"
 #include "tmbstr.h"
 
+/* duplicate one attribute, not the ones after it */
+static AttVal *DupAttr( TidyDocImpl* doc, AttVal *attr )
+{
+    AttVal *newattr = TY_(NewAttribute)(doc);
+
+    *newattr = *attr;
+    newattr->shared = 0;
+    newattr->length = newattr->size = 0;
+    newattr->next = NULL;
+    newattr->value = TY_(tmbstrdup)(TidyDocAllocator(doc, TidyMemAttributes),
+                                    attr->value);
+    newattr->dict = TY_(FindAttribute)(doc, newattr);
+    newattr->asp = attr->asp ? TY_(CloneNode)(doc, attr->asp) : NULL;
+    newattr->php = attr->php ? TY_(CloneNode)(doc, attr->php) : NULL;
+    return newattr;
+}
+
 /* duplicate attributes */
 AttVal *TY_(DupAttrs)( TidyDocImpl* doc, AttVal *attrs)
 {
@@ -25,33 +42,68 @@ AttVal *TY_(DupAttrs)( TidyDocImpl* doc, AttVal *attrs)
     if (attrs == NULL)
         return attrs;
 
-    newattrs = TY_(NewAttribute)(doc);
-    *newattrs = *attrs;
+    newattrs = DupAttr( doc, attrs );
     newattrs->next = TY_(DupAttrs)( doc, attrs->next );
-    newattrs->attribute = TY_(tmbstrdup)(doc->allocator, attrs->attribute);
-    newattrs->value = TY_(tmbstrdup)(doc->allocator, attrs->value);
-    newattrs->dict = TY_(FindAttribute)(doc, newattrs);
-    newattrs->asp = attrs->asp ? TY_(CloneNode)(doc, attrs->asp) : NULL;
-    newattrs->php = attrs->php ? TY_(CloneNode)(doc, attrs->php) : NULL;
     return newattrs;
 }
 
+/*
+  Inline stack entries and the inferred nodes made from them share
+  one list of attributes, counted on its first attribute.  Every
+  function that changes a list of attributes first calls OwnAttrs()
+  or OwnAttr() for the node holding it.
+*/
+AttVal *TY_(ShareAttrs)( AttVal *attrs )
+{
+    if (attrs)
+        ++(attrs->shared);
+    return attrs;
+}
+
+/*
+  give node a list of attributes it alone holds.  The node keeps the
+  attributes it has but the first, which stays with the other holders
+  along with copies of the rest, so that callers walking the list of
+  node are not left holding attributes of another list.
+*/
+void TY_(OwnAttrs)( TidyDocImpl* doc, Node *node )
+{
+    AttVal *attrs = NodeAttrs(node);
+
+    if (attrs && attrs->shared)
+    {
+        --(attrs->shared);
+        SetNodeAttrs(node, DupAttr( doc, attrs ));
+        NodeAttrs(node)->next = attrs->next;
+        attrs->next = TY_(DupAttrs)( doc, attrs->next );
+    }
+}
+
+/* as OwnAttrs(), returning the attribute of node that stands for attr */
+AttVal *TY_(OwnAttr)( TidyDocImpl* doc, Node *node, AttVal *attr )
+{
+    Bool first = ( attr == NodeAttrs(node) );
+
+    TY_(OwnAttrs)( doc, node );
+    return first ? NodeAttrs(node) : attr;
+}
+
 static Bool IsNodePushable( Node *node )
 {
-    if (node->tag == NULL)
+    if (NodeTag(node) == NULL)
         return no;
 
-    if (!(node->tag->model & CM_INLINE))
+    if (!(NodeTag(node)->model & CM_INLINE))
         return no;
 
-    if (node->tag->model & CM_OBJECT)
+    if (NodeTag(node)->model & CM_OBJECT)
         return no;
 
     return yes;
 }
 
 /*
-  push a copy of an inline node onto stack
+  push an inline node onto stack, sharing its attributes
   but don't push if implicit or OBJECT or APPLET
   (implicit tags are ones generated from the istack)
 
@@ -87,15 +139,15 @@ void TY_(PushInline)( TidyDocImpl* doc, Node *node )
             lexer->istacklength = 6;   /* this is perhaps excessive */
 
         lexer->istacklength = lexer->istacklength * 2;
-        lexer->istack = (IStack *)TidyDocRealloc(doc, lexer->istack,
+        lexer->istack = (IStack *)TidyRealloc(lexer->allocator, lexer->istack,
                             sizeof(IStack)*(lexer->istacklength));
     }
 
     istack = &(lexer->istack[lexer->istacksize]);
-    istack->tag = node->tag;
+    istack->tag = NodeTag(node);
 
-    istack->element = TY_(tmbstrdup)(doc->allocator, node->element);
-    istack->attributes = TY_(DupAttrs)( doc, node->attributes );
+    istack->element = NodeElement(node);
+    istack->attributes = TY_(ShareAttrs)( NodeAttrs(node) );
     ++(lexer->istacksize);
 }
 
@@ -108,13 +160,18 @@ static void PopIStack( TidyDocImpl* doc )
     --(lexer->istacksize);
     istack = &(lexer->istack[lexer->istacksize]);
 
+    if (istack->attributes && istack->attributes->shared)
+    {
+        --(istack->attributes->shared);
+        istack->attributes = NULL;
+    }
+
     while (istack->attributes)
     {
         av = istack->attributes;
         istack->attributes = av->next;
         TY_(FreeAttribute)( doc, av );
     }
-    TidyDocFree(doc, istack->element);
 }
 
 static void PopIStackUntil( TidyDocImpl* doc, TidyTagId tid )
@@ -166,7 +223,7 @@ Bool TY_(IsPushed)( TidyDocImpl* doc, Node *node )
 
     for (i = lexer->istacksize - 1; i >= 0; --i)
     {
-        if (lexer->istack[i].tag == node->tag)
+        if (lexer->istack[i].tag == NodeTag(node))
             return yes;
     }
 
@@ -184,7 +241,7 @@ Bool TY_(IsPushedLast)( TidyDocImpl* doc, Node *element, Node *node )
         return no;
 
     if (lexer->istacksize > 0) {
-        if (lexer->istack[lexer->istacksize - 1].tag == node->tag) {
+        if (lexer->istack[lexer->istacksize - 1].tag == NodeTag(node)) {
             return yes;
         }
     }
@@ -259,7 +316,7 @@ Node *TY_(InsertedToken)( TidyDocImpl* doc )
         lexer->columns = doc->docIn->curcol;
     }
 
-    node = TY_(NewNode)(doc->allocator, lexer);
+    node = TY_(NewNode)( doc, lexer );
     node->type = StartTag;
     node->implicit = yes;
     node->start = lexer->txtstart;
@@ -272,9 +329,9 @@ Node *TY_(InsertedToken)( TidyDocImpl* doc )
         fprintf( stderr, "0-size istack!\n" );
 #endif
 
-    node->element = TY_(tmbstrdup)(doc->allocator, istack->element);
-    node->tag = istack->tag;
-    node->attributes = TY_(DupAttrs)( doc, istack->attributes );
+    SetNodeElement(node, istack->element);
+    SetNodeTag(node, istack->tag);
+    SetNodeAttrs(node, TY_(ShareAttrs)( istack->attributes ));
 
     /* advance lexer to next item on the stack */
     n = (uint)(lexer->insert - &(lexer->istack[0]));
@@ -300,8 +357,8 @@ Bool TY_(SwitchInline)( TidyDocImpl* doc, Node* element, Node* node )
 {
     Lexer* lexer = doc->lexer;
     if ( lexer
-         && element && element->tag
-         && node && node->tag
+         && element && NodeTag(element)
+         && node && NodeTag(node)
          && TY_(IsPushed)( doc, element )
          && TY_(IsPushed)( doc, node ) 
          && ((lexer->istacksize - lexer->istackbase) >= 2) )
@@ -310,14 +367,14 @@ Bool TY_(SwitchInline)( TidyDocImpl* doc, Node* element, Node* node )
         int i;
         for (i = (lexer->istacksize - lexer->istackbase - 1); i >= 0; --i)
         {
-            if (lexer->istack[i].tag == element->tag) {
+            if (lexer->istack[i].tag == NodeTag(element)) {
                 /* found the element tag - phew */
                 IStack *istack1 = &lexer->istack[i];
                 IStack *istack2 = NULL;
                 --i; /* back one more, and continue */
                 for ( ; i >= 0; --i)
                 {
-                    if (lexer->istack[i].tag == node->tag)
+                    if (lexer->istack[i].tag == NodeTag(node))
                     {
                         /* found the element tag - phew */
                         istack2 = &lexer->istack[i];
@@ -348,11 +405,11 @@ Bool TY_(InlineDup1)( TidyDocImpl* doc, Node* node, Node* element )
     Lexer* lexer = doc->lexer;
     int n, i;
     if ( element
-         && (element->tag != NULL)
+         && (NodeTag(element) != NULL)
          && ((n = lexer->istacksize - lexer->istackbase) > 0) )
     {
         for ( i = n - 1; i >=0; --i ) {
-            if (lexer->istack[i].tag == element->tag) {
+            if (lexer->istack[i].tag == NodeTag(element)) {
                 /* found our element tag - insert it */
                 lexer->insert = &(lexer->istack[i]);
                 lexer->inode = node;
@@ -51,7 +51,7 @@
 /* swallows closing '>' */
 static AttVal *ParseAttrs( TidyDocImpl* doc, Bool *isempty );
 
-static tmbstr ParseAttribute( TidyDocImpl* doc, Bool* isempty, 
+static ctmbstr ParseAttribute( TidyDocImpl* doc, Bool* isempty, 
                              Node **asp, Node **php );
 
 static tmbstr ParseValue( TidyDocImpl* doc, ctmbstr name, Bool foldCase,
@@ -61,9 +61,40 @@ static Node *ParseDocTypeDecl(TidyDocImpl* doc);
 
 static void AddAttrToList( AttVal** list, AttVal* av );
 
-/* used to classify characters for lexical purposes */
+static void GrowLexer( Lexer *lexer, size_t needed );
+
+/* used to classify characters for lexical purposes.  The table is
+** fixed at compile time so documents on different threads can share it.
+*/
+#define LX_WS  white
+#define LX_NL  (newline|white)
+#define LX_NM  namechar
+#define LX_DG  (digit|digithex|namechar)
+#define LX_LC  (lowercase|letter|namechar)
+#define LX_LH  (LX_LC|digithex)
+#define LX_UC  (uppercase|letter|namechar)
+#define LX_UH  (LX_UC|digithex)
+
 #define MAP(c) ((unsigned)c < 128 ? lexmap[(unsigned)c] : 0)
-static uint lexmap[128];
+static const uint lexmap[128] =
+{
+    0,     0,     0,     0,     0,     0,     0,     0,     /* 00-07 */
+    0,     LX_WS, LX_NL, 0,     LX_NL, LX_NL, 0,     0,     /* 08-0f */
+    0,     0,     0,     0,     0,     0,     0,     0,     /* 10-17 */
+    0,     0,     0,     0,     0,     0,     0,     0,     /* 18-1f */
+    LX_WS, 0,     0,     0,     0,     0,     0,     0,     /* 20-27 */
+    0,     0,     0,     0,     0,     LX_NM, LX_NM, 0,     /* 28-2f */
+    LX_DG, LX_DG, LX_DG, LX_DG, LX_DG, LX_DG, LX_DG, LX_DG, /* 30-37 */
+    LX_DG, LX_DG, LX_NM, 0,     0,     0,     0,     0,     /* 38-3f */
+    0,     LX_UH, LX_UH, LX_UH, LX_UH, LX_UH, LX_UH, LX_UC, /* 40-47 */
+    LX_UC, LX_UC, LX_UC, LX_UC, LX_UC, LX_UC, LX_UC, LX_UC, /* 48-4f */
+    LX_UC, LX_UC, LX_UC, LX_UC, LX_UC, LX_UC, LX_UC, LX_UC, /* 50-57 */
+    LX_UC, LX_UC, LX_UC, 0,     0,     0,     0,     LX_NM, /* 58-5f */
+    0,     LX_LH, LX_LH, LX_LH, LX_LH, LX_LH, LX_LH, LX_LC, /* 60-67 */
+    LX_LC, LX_LC, LX_LC, LX_LC, LX_LC, LX_LC, LX_LC, LX_LC, /* 68-6f */
+    LX_LC, LX_LC, LX_LC, LX_LC, LX_LC, LX_LC, LX_LC, LX_LC, /* 70-77 */
+    LX_LC, LX_LC, LX_LC, 0,     0,     0,     0,     0      /* 78-7f */
+};
 
 #define IsValidXMLAttrName(name) TY_(IsValidXMLID)(name)
 #define IsValidXMLElemName(name) TY_(IsValidXMLID)(name)
@@ -632,7 +663,7 @@ char FoldCase( TidyDocImpl* doc, tmbchar c, Bool tocaps )
  this is useful when trailing quotemark
  is missing on an attribute
 */
-static tmbchar LastChar( tmbstr str )
+static tmbchar LastChar( ctmbstr str )
 {
     if ( str && *str )
     {
@@ -651,22 +682,30 @@ static tmbchar LastChar( tmbstr str )
     #define StartEndTag 4
 */
 
+static void InitLexer( TidyDocImpl* doc, Lexer* lexer )
+{
+    lexer->allocator = TidyDocAllocator( doc, TidyMemLexer );
+    lexer->lines = 1;
+    lexer->columns = 1;
+    lexer->state = LEX_CONTENT;
+
+    lexer->versions = (VERS_ALL|VERS_PROPRIETARY);
+    lexer->doctype = VERS_UNKNOWN;
+    lexer->root = &doc->root;
+}
+
 Lexer* TY_(NewLexer)( TidyDocImpl* doc )
 {
-    Lexer* lexer = (Lexer*) TidyDocAlloc( doc, sizeof(Lexer) );
+    Lexer* lexer = (Lexer*) TidyAlloc( TidyDocAllocator(doc, TidyMemLexer),
+                                       sizeof(Lexer) );
 
     if ( lexer != NULL )
     {
         TidyClearMemory( lexer, sizeof(Lexer) );
+        InitLexer( doc, lexer );
 
-        lexer->allocator = doc->allocator;
-        lexer->lines = 1;
-        lexer->columns = 1;
-        lexer->state = LEX_CONTENT;
-
-        lexer->versions = (VERS_ALL|VERS_PROPRIETARY);
-        lexer->doctype = VERS_UNKNOWN;
-        lexer->root = &doc->root;
+        /* so text can always be read at lexsize */
+        GrowLexer( lexer, 0 );
     }
     return lexer;
 }
@@ -677,67 +716,250 @@ static Bool EndOfInput( TidyDocImpl* doc )
     return ( !doc->docIn->pushed && TY_(IsEOF)(doc->docIn) );
 }
 
+/* Frees what the lexer holds for the current document */
+static void FreeLexerState( TidyDocImpl* doc, Lexer* lexer )
+{
+    TY_(FreeStyles)( doc );
+
+    /* See GetToken() */
+    if ( lexer->pushed || lexer->itoken )
+    {
+        if (lexer->pushed)
+            TY_(FreeNode)( doc, lexer->itoken );
+        TY_(FreeNode)( doc, lexer->token );
+    }
+
+    while ( lexer->istacksize > 0 )
+        TY_(PopInline)( doc, NULL );
+
+    TY_(ResetAncestors)( doc );
+
+    if ( lexer->mapping )
+        TY_(freeMappedFile)( lexer->mapping );
+}
+
 void TY_(FreeLexer)( TidyDocImpl* doc )
 {
     Lexer *lexer = doc->lexer;
     if ( lexer )
     {
-        TY_(FreeStyles)( doc );
-
-        /* See GetToken() */
-        if ( lexer->pushed || lexer->itoken )
-        {
-            if (lexer->pushed)
-                TY_(FreeNode)( doc, lexer->itoken );
-            TY_(FreeNode)( doc, lexer->token );
-        }
-
-        while ( lexer->istacksize > 0 )
-            TY_(PopInline)( doc, NULL );
+        FreeLexerState( doc, lexer );
 
         TidyDocFree( doc, lexer->istack );
-        TidyDocFree( doc, lexer->lexbuf );
+        TidyDocFree( doc, lexer->frames );
+        TidyDocFree( doc, lexer->chain );
+        while ( lexer->nsegs > 0 )
+            TidyDocFree( doc, lexer->segs[--lexer->nsegs].buf );
+        TidyDocFree( doc, lexer->segs );
         TidyDocFree( doc, lexer );
         doc->lexer = NULL;
     }
 }
 
+/* Readies the lexer for another document, keeping the
+** text store's last segment and the inline and parser stacks.
+*/
+void TY_(ResetLexer)( TidyDocImpl* doc )
+{
+    Lexer *lexer = doc->lexer;
+    Lexer keep;
+
+    FreeLexerState( doc, lexer );
+    TY_(ClearLexerText)( lexer );
+
+    keep = *lexer;
+    TidyClearMemory( lexer, sizeof(Lexer) );
+    InitLexer( doc, lexer );
+
+    lexer->segs = keep.segs;
+    lexer->nsegs = keep.nsegs;
+    lexer->segslength = keep.segslength;
+    lexer->lexbuf = keep.lexbuf;
+    lexer->lexlength = keep.lexlength;
+    lexer->istack = keep.istack;
+    lexer->istacklength = keep.istacklength;
+    lexer->frames = keep.frames;
+    lexer->frameslength = keep.frameslength;
+    lexer->chain = keep.chain;
+    lexer->chainlength = keep.chainlength;
+}
+
 /* Lexer uses bigger memory chunks than pprint as
 ** it must hold the entire input document. not just
-** the last line or three.
+** the last line or three.  Segments double in size
+** up to LEXSEG_MAX, beyond which only the text moved
+** to a new one is copied, so there is no point.
 */
-static void AddByte( Lexer *lexer, tmbchar ch )
+#define LEXSEG_MIN  8192
+#define LEXSEG_MAX  (1024 * 1024)
+
+static void GrowLexer( Lexer *lexer, size_t needed )
 {
-    if ( lexer->lexsize + 2 >= lexer->lexlength )
+    if ( lexer->lexsize + needed + 1 >= lexer->lexlength )
     {
-        tmbstr buf = NULL;
-        uint allocAmt = lexer->lexlength;
-        while ( lexer->lexsize + 2 >= allocAmt )
+        size_t base, keep, allocAmt = lexer->lexlength - lexer->lexbase;
+        tmbstr buf;
+
+        /* text from txtstart on may still grow so moves with it */
+        base = lexer->txtstart;
+        if ( base > lexer->lexsize )
+            base = lexer->lexsize;
+        if ( base < lexer->lexbase )
+            base = lexer->lexbase;
+        keep = lexer->lexsize - base;
+
+        if ( allocAmt == 0 )
+            allocAmt = LEXSEG_MIN;
+        else if ( allocAmt < LEXSEG_MAX )
+            allocAmt *= 2;
+        while ( keep + needed + 1 >= allocAmt )
+            allocAmt *= 2;
+
+        if ( lexer->nsegs > 0 && base == lexer->lexbase )
         {
-            if ( allocAmt == 0 )
-                allocAmt = 8192;
-            else
-                allocAmt *= 2;
+            /* nothing else in the last segment, so replace it */
+            buf = (tmbstr) TidyRealloc( lexer->allocator, lexer->lexbuf,
+                                        allocAmt );
+            lexer->segs[ lexer->nsegs - 1 ].buf = buf;
         }
-        buf = (tmbstr) TidyRealloc( lexer->allocator, lexer->lexbuf, allocAmt );
-        if ( buf )
+        else
         {
-          TidyClearMemory( buf + lexer->lexlength, 
-                           allocAmt - lexer->lexlength );
-          lexer->lexbuf = buf;
-          lexer->lexlength = allocAmt;
+            buf = (tmbstr) TidyAlloc( lexer->allocator, allocAmt );
+            if ( keep > 0 )
+                memcpy( buf, LexBuf(lexer, base), keep );
+
+            if ( lexer->nsegs == lexer->segslength )
+            {
+                lexer->segslength = lexer->segslength ? 2 * lexer->segslength : 16;
+                lexer->segs = (LexSegment*) TidyRealloc( lexer->allocator, lexer->segs,
+                                       lexer->segslength * sizeof(LexSegment) );
+            }
+            lexer->segs[ lexer->nsegs ].buf = buf;
+            lexer->segs[ lexer->nsegs ].base = base;
+            ++lexer->nsegs;
         }
+
+        lexer->lexbuf = buf;
+        lexer->lexbase = base;
+        lexer->lexlength = base + allocAmt;
+        *LexBuf( lexer, lexer->lexsize ) = '\0';
+    }
+}
+
+tmbstr TY_(LexTextAt)( Lexer* lexer, size_t ix )
+{
+    uint lo = 0, hi, mid;
+
+    if ( ix >= lexer->lexbase )
+        return LexBuf( lexer, ix );
+
+    /* the last segment before lexbuf starting at or before ix */
+    hi = lexer->nsegs - 1;
+    while ( hi - lo > 1 )
+    {
+        mid = (lo + hi) / 2;
+        if ( lexer->segs[mid].base <= ix )
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lexer->segs[lo].buf + (ix - lexer->segs[lo].base);
+}
+
+void TY_(ClearLexerText)( Lexer* lexer )
+{
+    uint i;
+
+    for ( i = 0; i + 1 < lexer->nsegs; ++i )
+        TidyFree( lexer->allocator, lexer->segs[i].buf );
+    lexer->segs[0].buf = lexer->lexbuf;
+    lexer->segs[0].base = 0;
+    lexer->nsegs = 1;
+
+    lexer->lexlength -= lexer->lexbase;
+    lexer->lexbase = 0;
+    lexer->lexsize = lexer->txtstart = lexer->txtend = 0;
+    lexer->mapheld = 0;
+    lexer->lexbuf[0] = '\0';
+}
+
+static void AddByte( Lexer *lexer, tmbchar ch )
+{
+    GrowLexer( lexer, 1 );
+    *LexBuf( lexer, lexer->lexsize++ ) = ch;
+    *LexBuf( lexer, lexer->lexsize )   = '\0';  /* debug */
+}
+
+static void AddBytes( Lexer *lexer, ctmbstr str, size_t len )
+{
+    GrowLexer( lexer, len );
+    memcpy( LexBuf(lexer, lexer->lexsize), str, len );
+    lexer->lexsize += len;
+    *LexBuf( lexer, lexer->lexsize ) = '\0';  /* debug */
+}
+
+/* how many of the current token's bytes are only in the mapping.
+   They are only ever trimmed once the token is complete. */
+static size_t HeldBytes( Lexer *lexer )
+{
+    size_t len = lexer->lexsize - lexer->txtstart;
+    return ( lexer->mapheld < len ? lexer->mapheld : len );
+}
+
+/* copy the bytes held in the mapping into the room left for them,
+   trimmed ones too as callers may peek at the byte after a token */
+static void UnholdText( Lexer *lexer )
+{
+    if ( lexer->mapheld > 0 )
+        memcpy( LexBuf(lexer, lexer->txtstart), lexer->mapheldpos,
+                lexer->mapheld );
+    lexer->mapheld = 0;
+}
+
+/* the current token's last byte, which may be held in the mapping */
+static tmbchar LastLexByte( Lexer *lexer )
+{
+    size_t pos = lexer->lexsize - 1;
+
+    if ( pos >= lexer->txtstart && pos - lexer->txtstart < lexer->mapheld )
+        return (tmbchar) lexer->mapheldpos[ pos - lexer->txtstart ];
+    return *LexBuf( lexer, pos );
+}
+
+/*
+  Add a run of text read straight from the input window.  If the
+  token began at mappos in a memory mapped input, the run lies
+  just after it there and the token's bytes so far match the
+  mapping, the run is only held (see Lexer.mapheld): room for it
+  is made in lexbuf, but it isn't copied.
+*/
+static void AddTextRun( Lexer *lexer, const byte* mappos,
+                        ctmbstr run, size_t len )
+{
+    size_t held = HeldBytes( lexer );
+    size_t sofar = lexer->lexsize - lexer->txtstart;
+
+    if ( mappos != NULL && (const byte*) run == mappos + sofar &&
+         memcmp(mappos + held, LexBuf(lexer, lexer->txtstart + held),
+                sofar - held) == 0 )
+    {
+        GrowLexer( lexer, len );
+        lexer->mapheldpos = mappos;
+        lexer->mapheld = sofar + len;
+        lexer->lexsize += len;
+        *LexBuf( lexer, lexer->lexsize ) = '\0';  /* debug */
+        return;
     }
 
-    lexer->lexbuf[ lexer->lexsize++ ] = ch;
-    lexer->lexbuf[ lexer->lexsize ]   = '\0';  /* debug */
+    UnholdText( lexer );
+    AddBytes( lexer, run, len );
 }
 
 static void ChangeChar( Lexer *lexer, tmbchar c )
 {
     if ( lexer->lexsize > 0 )
     {
-        lexer->lexbuf[ lexer->lexsize-1 ] = c;
+        *LexBuf( lexer, lexer->lexsize-1 ) = c;
     }
 }
 
@@ -825,7 +1047,7 @@ static void ParseEntity( TidyDocImpl* doc, GetTokenMode mode )
         TY_(IsDigit),
         IsDigitHex
     };
-    uint start;
+    size_t start;
     ENTState entState = ENT_default;
     uint charRead = 0;
     Bool semicolon = no, found = no;
@@ -833,9 +1055,11 @@ static void ParseEntity( TidyDocImpl* doc, GetTokenMode mode )
     Bool preserveEntities = cfgBool( doc, TidyPreserveEntities );
     uint c, ch, startcol, entver = 0;
     Lexer* lexer = doc->lexer;
+    EntityMatch match;
 
     start = lexer->lexsize - 1;  /* to start at "&" */
     startcol = doc->docIn->curcol - 1;
+    TY_(EntityMatchInit)( &match );
 
     while ( (c = TY_(ReadChar)(doc->docIn)) != EndOfStream )
     {
@@ -871,6 +1095,8 @@ static void ParseEntity( TidyDocImpl* doc, GetTokenMode mode )
 
         if ( entFn[entState](c) )
         {
+            if ( entState == ENT_default )
+                TY_(EntityMatchStep)( &match, c );
             TY_(AddCharToLexer)( lexer, c );
             continue;
         }
@@ -881,21 +1107,25 @@ static void ParseEntity( TidyDocImpl* doc, GetTokenMode mode )
     }
 
     /* make sure entity is NULL terminated */
-    lexer->lexbuf[lexer->lexsize] = '\0';
+    *LexBuf(lexer, lexer->lexsize) = '\0';
 
     /* Should contrain version to XML/XHTML if &apos; 
     ** is encountered.  But this is not possible with
     ** Tidy's content model bit mask.
     */
-    if ( TY_(tmbstrcmp)(lexer->lexbuf+start, "&apos") == 0
+    if ( TY_(tmbstrcmp)(LexBuf(lexer, start), "&apos") == 0
          && !cfgBool(doc, TidyXmlOut)
          && !lexer->isvoyager
          && !cfgBool(doc, TidyXhtmlOut) )
-        TY_(ReportEntityError)( doc, APOS_UNDEFINED, lexer->lexbuf+start, 39 );
+        TY_(ReportEntityError)( doc, APOS_UNDEFINED, LexBuf(lexer, start), 39 );
 
-    /* Lookup entity code and version
+    /* Lookup entity code and version, named ones having been
+    ** matched as they were read
     */
-    found = TY_(EntityInfo)( lexer->lexbuf+start, isXml, &ch, &entver );
+    if ( entState == ENT_default )
+        found = TY_(EntityMatchInfo)( &match, isXml, &ch, &entver );
+    else
+        found = TY_(EntityInfo)( LexBuf(lexer, start), isXml, &ch, &entver );
 
     /* deal with unrecognized or invalid entities */
     /* #433012 - fix by Randy Waki 17 Feb 01 */
@@ -925,7 +1155,7 @@ static void ParseEntity( TidyDocImpl* doc, GetTokenMode mode )
                 
                 if ( c != ';' )  /* issue warning if not terminated by ';' */
                     TY_(ReportEntityError)( doc, MISSING_SEMICOLON_NCR,
-                                            lexer->lexbuf+start, c );
+                                            LexBuf(lexer, start), c );
  
                 TY_(ReportEncodingError)(doc, INVALID_NCR, ch, replaceMode == DISCARDED_CHAR);
                 
@@ -946,14 +1176,14 @@ static void ParseEntity( TidyDocImpl* doc, GetTokenMode mode )
             }
             else
                 TY_(ReportEntityError)( doc, UNKNOWN_ENTITY,
-                                        lexer->lexbuf+start, ch );
+                                        LexBuf(lexer, start), ch );
 
             if (semicolon)
                 TY_(AddCharToLexer)( lexer, ';' );
         }
         else /* naked & */
             TY_(ReportEntityError)( doc, UNESCAPED_AMPERSAND,
-                                    lexer->lexbuf+start, ch );
+                                    LexBuf(lexer, start), ch );
     }
     else
     {
@@ -962,7 +1192,7 @@ static void ParseEntity( TidyDocImpl* doc, GetTokenMode mode )
             /* set error position just before offending chararcter */
             SetLexerLocus( doc, lexer );
             lexer->columns = startcol;
-            TY_(ReportEntityError)( doc, MISSING_SEMICOLON, lexer->lexbuf+start, c );
+            TY_(ReportEntityError)( doc, MISSING_SEMICOLON, LexBuf(lexer, start), c );
         }
 
         if (preserveEntities)
@@ -986,12 +1216,12 @@ static void ParseEntity( TidyDocImpl* doc, GetTokenMode mode )
 static tmbchar ParseTagName( TidyDocImpl* doc )
 {
     Lexer *lexer = doc->lexer;
-    uint c = lexer->lexbuf[ lexer->txtstart ];
+    uint c = *LexBuf(lexer, lexer->txtstart);
     Bool xml = cfgBool(doc, TidyXmlTags);
 
     /* fold case of first character in buffer */
     if (!xml && TY_(IsUpper)(c))
-        lexer->lexbuf[lexer->txtstart] = (tmbchar) TY_(ToLower)(c);
+        *LexBuf(lexer, lexer->txtstart) = (tmbchar) TY_(ToLower)(c);
 
     while ((c = TY_(ReadChar)(doc->docIn)) != EndOfStream)
     {
@@ -1025,10 +1255,15 @@ static tmbchar ParseTagName( TidyDocImpl* doc )
 */
 
 
-Node *TY_(NewNode)(TidyAllocator* allocator, Lexer *lexer)
+Node *TY_(NewNode)(TidyDocImpl* doc, Lexer *lexer)
 {
-    Node* node = (Node*) TidyAlloc( allocator, sizeof(Node) );
+#if SUPPORT_COMPACT_NODES
+    Node* node = TY_(AllocNode)( doc );
+#else
+    Node* node = (Node*) TidyAlloc( TidyDocAllocator(doc, TidyMemNodes),
+                                    sizeof(Node) );
     TidyClearMemory( node, sizeof(Node) );
+#endif
     if ( lexer )
     {
         node->line = lexer->lines;
@@ -1042,20 +1277,20 @@ Node *TY_(NewNode)(TidyAllocator* allocator, Lexer *lexer)
 Node *TY_(CloneNode)( TidyDocImpl* doc, Node *element )
 {
     Lexer* lexer = doc->lexer;
-    Node *node = TY_(NewNode)( lexer->allocator, lexer );
+    Node *node = TY_(NewNode)( doc, lexer );
 
     node->start = lexer->lexsize;
     node->end   = lexer->lexsize;
 
     if ( element )
     {
-        node->parent     = element->parent;
+        SetNodeParent(node, NodeParent(element));
         node->type       = element->type;
         node->closed     = element->closed;
         node->implicit   = element->implicit;
-        node->tag        = element->tag;
-        node->element    = TY_(tmbstrdup)( doc->allocator, element->element );
-        node->attributes = TY_(DupAttrs)( doc, element->attributes );
+        SetNodeTag(node, NodeTag(element));
+        SetNodeElement(node, NodeElement(element));
+        SetNodeAttrs(node, TY_(ShareAttrs)( NodeAttrs(element) ));
     }
     return node;
 }
@@ -1063,9 +1298,17 @@ Node *TY_(CloneNode)( TidyDocImpl* doc, Node *element )
 /* free node's attributes */
 void TY_(FreeAttrs)( TidyDocImpl* doc, Node *node )
 {
-    while ( node->attributes )
+    /* a shared list lives on with its other holders */
+    if ( NodeAttrs(node) && NodeAttrs(node)->shared )
     {
-        AttVal *av = node->attributes;
+        --(NodeAttrs(node)->shared);
+        SetNodeAttrs(node, NULL);
+        return;
+    }
+
+    while ( NodeAttrs(node) )
+    {
+        AttVal *av = NodeAttrs(node);
 
         if ( av->attribute )
         {
@@ -1076,7 +1319,7 @@ void TY_(FreeAttrs)( TidyDocImpl* doc, Node *node )
             }
         }
 
-        node->attributes = av->next;
+        SetNodeAttrs(node, av->next);
         TY_(FreeAttribute)( doc, av );
     }
 }
@@ -1086,7 +1329,7 @@ void TY_(FreeAttribute)( TidyDocImpl* doc, AttVal *av )
 {
     TY_(FreeNode)( doc, av->asp );
     TY_(FreeNode)( doc, av->php );
-    TidyDocFree( doc, av->attribute );
+    TY_(FreeStyleProps)( doc, av->props );
     TidyDocFree( doc, av->value );
     TidyDocFree( doc, av );
 }
@@ -1097,14 +1340,14 @@ void TY_(DetachAttribute)( Node *node, AttVal *attr )
 {
     AttVal *av, *prev = NULL;
 
-    for ( av = node->attributes; av; av = av->next )
+    for ( av = NodeAttrs(node); av; av = av->next )
     {
         if ( av == attr )
         {
             if ( prev )
                 prev->next = attr->next;
             else
-                node->attributes = attr->next;
+                SetNodeAttrs(node, attr->next);
             break;
         }
         prev = av;
@@ -1115,6 +1358,7 @@ void TY_(DetachAttribute)( Node *node, AttVal *attr )
 */
 void TY_(RemoveAttribute)( TidyDocImpl* doc, Node *node, AttVal *attr )
 {
+    attr = TY_(OwnAttr)( doc, node, attr );
     TY_(DetachAttribute)( node, attr );
     TY_(FreeAttribute)( doc, attr );
 }
@@ -1126,21 +1370,37 @@ void TY_(RemoveAttribute)( TidyDocImpl* doc, Node *node, AttVal *attr )
  */
 void TY_(FreeNode)( TidyDocImpl* doc, Node *node )
 {
+    Node *next, *last;
+
     while ( node )
     {
-        Node* next = node->next;
+        next = NodeNext(node);
+
+        /* the content goes before the rest, rather than by recursion */
+        if ( NodeContent(node) )
+        {
+            for ( last = NodeContent(node); NodeNext(last); last = NodeNext(last) )
+                /**/;
+            SetNodeNext(last, next);
+            next = NodeContent(node);
+        }
+
+        if ( node->counted )
+            TY_(ResetAncestors)( doc );
 
         TY_(FreeAttrs)( doc, node );
-        TY_(FreeNode)( doc, node->content );
-        TidyDocFree( doc, node->element );
 #ifdef TIDY_STORE_ORIGINAL_TEXT
         if (node->otext)
             TidyDocFree(doc, node->otext);
 #endif
         if (RootNode != node->type)
+#if SUPPORT_COMPACT_NODES
+            TY_(ReleaseNode)( doc, node );
+#else
             TidyDocFree( doc, node );
+#endif
         else
-            node->content = NULL;
+            SetNodeContent(node, NULL);
 
         node = next;
     }
@@ -1193,18 +1453,146 @@ void StoreOriginalTextInToken(TidyDocImpl* doc, Node* node, uint count)
 }
 #endif
 
-Node* TY_(TextToken)( Lexer *lexer )
+Node* TY_(TextToken)( TidyDocImpl* doc )
 {
-    Node *node = TY_(NewNode)( lexer->allocator, lexer );
+    Lexer* lexer = doc->lexer;
+    Node *node = TY_(NewNode)( doc, lexer );
     node->start = lexer->txtstart;
     node->end = lexer->txtend;
     return node;
 }
 
+/*
+  Whether the current text token can span onto the mapped input
+  at mappos, where it began: it must be the same byte for byte.
+  Bytes held in the mapping by AddTextRun() are known to be, so
+  only the rest are compared.
+
+  Empty tokens, left when a lone space before an end tag is
+  trimmed, stay in lexbuf: the parser takes one as white space
+  by the byte at its start, which is the trimmed space there
+  but the next markup in the mapping.
+*/
+static Bool TextOnMapping( TidyDocImpl* doc, const byte* mappos )
+{
+    Lexer* lexer = doc->lexer;
+    StreamIn* in = doc->docIn;
+    size_t len = lexer->txtend - lexer->txtstart;
+    size_t held;
+
+    if ( mappos == NULL || len == 0 || lexer->lexsize != lexer->txtend )
+        return no;
+
+    /* Some callers peek at the byte at node->end, so
+       the text mustn't run up to the end of the mapping. */
+    if ( len >= in->mapsize - (size_t)(mappos - in->mapbase) )
+        return no;
+
+#if SUPPORT_COMPACT_NODES
+    /* a span must fit in the 32 bits of node->end */
+    if ( (size_t)(mappos - in->mapbase) + len >= NODE_SPAN_LIMIT )
+        return no;
+#endif
+
+    held = HeldBytes( lexer );
+    if ( memcmp(mappos + held, LexBuf(lexer, lexer->txtstart + held),
+                len - held) != 0 )
+        return no;
+
+    if ( lexer->mapping == NULL )
+    {
+        lexer->mapping = TY_(keepFileSourceMapping)( &in->source );
+        if ( lexer->mapping == NULL )
+            return no;
+        lexer->mapbuf = in->mapbase;
+    }
+    return yes;
+}
+
+/*
+  Text token for element content.  If the text is on the mapping
+  the token spans onto it and the text is dropped from lexbuf
+  again, otherwise any bytes held in the mapping are copied in.
+*/
+static Node* ContentTextToken( TidyDocImpl* doc, const byte* mappos )
+{
+    Lexer* lexer = doc->lexer;
+    Node* node;
+
+    if ( !TextOnMapping(doc, mappos) )
+    {
+        UnholdText( lexer );
+        return TY_(TextToken)( doc );
+    }
+
+    node = TY_(TextToken)( doc );
+    node->mapped = yes;
+    node->start = mappos - doc->docIn->mapbase;
+    node->end = node->start + (lexer->txtend - lexer->txtstart);
+    lexer->mapheld = 0;
+    lexer->lexsize = lexer->txtend = lexer->txtstart;
+    *LexBuf(lexer, lexer->lexsize) = '\0';
+    return node;
+}
+
+void TY_(OwnNodeText)( Lexer* lexer, Node* node, Bool toEnd )
+{
+    size_t len;
+
+    if ( node == NULL )
+        return;
+
+    /* text at the end of the last segment can grow where it is */
+    if ( !node->mapped && (!toEnd || (node->end == lexer->lexsize &&
+                                      node->start >= lexer->lexbase)) )
+    {
+        if ( toEnd )
+            lexer->txtstart = node->start;
+        return;
+    }
+
+    /* room first, as growing may move the last segment */
+    lexer->txtstart = lexer->lexsize;
+    len = node->end - node->start;
+    GrowLexer( lexer, len );
+    AddBytes( lexer, NodeText(lexer, node), len );
+    node->mapped = no;
+    node->start = lexer->lexsize - len;
+    node->end = lexer->lexsize;
+}
+
+static void OwnTreeText( Lexer* lexer, Node* node )
+{
+    Node* parent = NodeParent(node);
+
+    for ( ; node; node = TY_(NextPreOrder)(node, parent) )
+        TY_(OwnNodeText)( lexer, node, no );
+}
+
+void TY_(UnmapText)( TidyDocImpl* doc )
+{
+    Lexer* lexer = doc->lexer;
+
+    if ( lexer == NULL || lexer->mapping == NULL )
+        return;
+
+    OwnTreeText( lexer, &doc->root );
+    if ( lexer->pushed || lexer->itoken )
+    {
+        TY_(OwnNodeText)( lexer, lexer->token, no );
+        TY_(OwnNodeText)( lexer, lexer->itoken, no );
+    }
+
+    TY_(freeMappedFile)( lexer->mapping );
+    lexer->mapping = NULL;
+    lexer->mapbuf = NULL;
+}
+
 /* used for creating preformatted text from Word2000 */
-Node *TY_(NewLineNode)( Lexer *lexer )
+Node *TY_(NewLineNode)( TidyDocImpl* doc )
 {
-    Node *node = TY_(NewNode)( lexer->allocator, lexer );
+    Lexer* lexer = doc->lexer;
+    Node *node = TY_(NewNode)( doc, lexer );
     node->start = lexer->lexsize;
     TY_(AddCharToLexer)( lexer, (uint)'\n' );
     node->end = lexer->lexsize;
@@ -1212,9 +1600,10 @@ Node *TY_(NewLineNode)( Lexer *lexer )
 }
 
 /* used for adding a &nbsp; for Word2000 */
-Node* TY_(NewLiteralTextNode)( Lexer *lexer, ctmbstr txt )
+Node* TY_(NewLiteralTextNode)( TidyDocImpl* doc, ctmbstr txt )
 {
-    Node *node = TY_(NewNode)( lexer->allocator, lexer );
+    Lexer* lexer = doc->lexer;
+    Node *node = TY_(NewNode)( doc, lexer );
     node->start = lexer->lexsize;
     AddStringToLexer( lexer, txt );
     node->end = lexer->lexsize;
@@ -1224,11 +1613,10 @@ Node* TY_(NewLiteralTextNode)( Lexer *lexer, ctmbstr txt )
 static Node* TagToken( TidyDocImpl* doc, NodeType type )
 {
     Lexer* lexer = doc->lexer;
-    Node* node = TY_(NewNode)( lexer->allocator, lexer );
+    Node* node = TY_(NewNode)( doc, lexer );
     node->type = type;
-    node->element = TY_(tmbstrndup)( doc->allocator,
-                                     lexer->lexbuf + lexer->txtstart,
-                                     lexer->txtend - lexer->txtstart );
+    SetNodeElement(node, TY_(InternTagName)( doc, LexBuf(lexer, lexer->txtstart),
+                                             (uint)(lexer->txtend - lexer->txtstart) ));
     node->start = lexer->txtstart;
     node->end = lexer->txtstart;
 
@@ -1241,10 +1629,11 @@ static Node* TagToken( TidyDocImpl* doc, NodeType type )
 static Node* NewToken(TidyDocImpl* doc, NodeType type)
 {
     Lexer* lexer = doc->lexer;
-    Node* node = TY_(NewNode)(lexer->allocator, lexer);
+    Node* node = TY_(NewNode)( doc, lexer );
     node->type = type;
     node->start = lexer->txtstart;
     node->end = lexer->txtend;
+    assert( node->start <= node->end );
 #ifdef TIDY_STORE_ORIGINAL_TEXT
     StoreOriginalTextInToken(doc, node, 0);
 #endif
@@ -1283,9 +1672,9 @@ void AddStringLiteralLen( Lexer* lexer, ctmbstr str, int len )
 Node *TY_(FindDocType)( TidyDocImpl* doc )
 {
     Node* node;
-    for ( node = (doc ? doc->root.content : NULL);
+    for ( node = (doc ? NodeContent(&doc->root) : NULL);
           node && node->type != DocTypeTag; 
-          node = node->next )
+          node = NodeNext(node) )
         /**/;
     return node;
 }
@@ -1293,9 +1682,9 @@ Node *TY_(FindDocType)( TidyDocImpl* doc )
 /* find parent container element */
 Node* TY_(FindContainer)( Node* node )
 {
-    for ( node = (node ? node->parent : NULL);
+    for ( node = (node ? NodeParent(node) : NULL);
           node && TY_(nodeHasCM)(node, CM_INLINE);
-          node = node->parent )
+          node = NodeParent(node) )
         /**/;
 
     return node;
@@ -1306,9 +1695,9 @@ Node* TY_(FindContainer)( Node* node )
 Node *TY_(FindHTML)( TidyDocImpl* doc )
 {
     Node *node;
-    for ( node = (doc ? doc->root.content : NULL);
+    for ( node = (doc ? NodeContent(&doc->root) : NULL);
           node && !nodeIsHTML(node); 
-          node = node->next )
+          node = NodeNext(node) )
         /**/;
 
     return node;
@@ -1318,9 +1707,9 @@ Node *TY_(FindHTML)( TidyDocImpl* doc )
 Node *TY_(FindXmlDecl)(TidyDocImpl* doc)
 {
     Node *node;
-    for ( node = (doc ? doc->root.content : NULL);
+    for ( node = (doc ? NodeContent(&doc->root) : NULL);
           node && !(node->type == XmlDecl);
-          node = node->next )
+          node = NodeNext(node) )
         /**/;
 
     return node;
@@ -1333,9 +1722,9 @@ Node *TY_(FindHEAD)( TidyDocImpl* doc )
 
     if ( node )
     {
-        for ( node = node->content;
+        for ( node = NodeContent(node);
               node && !nodeIsHEAD(node); 
-              node = node->next )
+              node = NodeNext(node) )
             /**/;
     }
 
@@ -1347,38 +1736,38 @@ Node *TY_(FindTITLE)(TidyDocImpl* doc)
     Node *node = TY_(FindHEAD)(doc);
 
     if (node)
-        for (node = node->content;
+        for (node = NodeContent(node);
              node && !nodeIsTITLE(node);
-             node = node->next) {}
+             node = NodeNext(node)) {}
 
     return node;
 }
 
 Node *TY_(FindBody)( TidyDocImpl* doc )
 {
-    Node *node = ( doc ? doc->root.content : NULL );
+    Node *node = ( doc ? NodeContent(&doc->root) : NULL );
 
     while ( node && !nodeIsHTML(node) )
-        node = node->next;
+        node = NodeNext(node);
 
     if (node == NULL)
         return NULL;
 
-    node = node->content;
+    node = NodeContent(node);
     while ( node && !nodeIsBODY(node) && !nodeIsFRAMESET(node) )
-        node = node->next;
+        node = NodeNext(node);
 
     if ( node && nodeIsFRAMESET(node) )
     {
-        node = node->content;
+        node = NodeContent(node);
         while ( node && !nodeIsNOFRAMES(node) )
-            node = node->next;
+            node = NodeNext(node);
 
         if ( node )
         {
-            node = node->content;
+            node = NodeContent(node);
             while ( node && !nodeIsBODY(node) )
-                node = node->next;
+                node = NodeNext(node);
         }
     }
 
@@ -1402,7 +1791,7 @@ Bool TY_(AddGenerator)( TidyDocImpl* doc )
         TY_(tmbsnprintf)(buf, sizeof(buf), "HTML Tidy (vers %s), see www.w3.org", tidyReleaseDate());
 #endif
 
-        for ( node = head->content; node; node = node->next )
+        for ( node = NodeContent(head); node; node = NodeNext(node) )
         {
             if ( nodeIsMETA(node) )
             {
@@ -1418,6 +1807,7 @@ Bool TY_(AddGenerator)( TidyDocImpl* doc )
                         /* update the existing content to reflect the */
                         /* actual version of Tidy currently being used */
                         
+                        attval = TY_(OwnAttr)(doc, node, attval);
                         TidyDocFree(doc, attval->value);
                         attval->value = TY_(tmbstrdup)(doc->allocator, buf);
                         return no;
@@ -1458,6 +1848,7 @@ static uint FindGivenVersion( TidyDocImpl* doc, Node* doctype )
     }
 
     /* todo: add a warning if case does not match? */
+    fpi = TY_(OwnAttr)(doc, doctype, fpi);
     TidyDocFree(doc, fpi->value);
     fpi->value = TY_(tmbstrdup)(doc->allocator, GetFPIFromVers(vers));
 
@@ -1527,12 +1918,22 @@ static Node* NewDocTypeNode( TidyDocImpl* doc )
     if ( !html )
         return NULL;
 
-    doctype = TY_(NewNode)( doc->allocator, NULL );
+    doctype = TY_(NewNode)( doc, NULL );
     doctype->type = DocTypeTag;
     TY_(InsertNodeBeforeElement)(html, doctype);
     return doctype;
 }
 
+/* interned names can't be changed in place */
+static void LowerDocTypeName( TidyDocImpl* doc, Node* doctype )
+{
+    tmbstr name = TY_(tmbstrdup)( doc->allocator, NodeElement(doctype) );
+
+    if ( name )
+        SetNodeElement(doctype, InternTagStr( doc, TY_(tmbstrtolower)(name) ));
+    TidyDocFree( doc, name );
+}
+
 Bool TY_(SetXHTMLDocType)( TidyDocImpl* doc )
 {
     Lexer *lexer = doc->lexer;
@@ -1556,11 +1957,11 @@ Bool TY_(SetXHTMLDocType)( TidyDocImpl* doc )
     if (!doctype)
     {
         doctype = NewDocTypeNode(doc);
-        doctype->element = TY_(tmbstrdup)(doc->allocator, "html");
+        SetNodeElement(doctype, InternTagStr(doc, "html"));
     }
     else
     {
-        doctype->element = TY_(tmbstrtolower)(doctype->element);
+        LowerDocTypeName(doc, doctype);
     }
 
     switch(dtmode)
@@ -1694,12 +2095,12 @@ Bool TY_(FixDocType)( TidyDocImpl* doc )
 
     if (doctype)
     {
-        doctype->element = TY_(tmbstrtolower)(doctype->element);
+        LowerDocTypeName(doc, doctype);
     }
     else
     {
         doctype = NewDocTypeNode(doc);
-        doctype->element = TY_(tmbstrdup)(doc->allocator, "html");
+        SetNodeElement(doctype, InternTagStr(doc, "html"));
     }
 
     TY_(RepairAttrValue)(doc, doctype, "PUBLIC", GetFPIFromVers(guessed));
@@ -1719,18 +2120,18 @@ Bool TY_(FixXmlDecl)( TidyDocImpl* doc )
     Lexer*lexer = doc->lexer;
     Node* root = &doc->root;
 
-    if ( root->content && root->content->type == XmlDecl )
+    if ( NodeContent(root) && NodeContent(root)->type == XmlDecl )
     {
-        xml = root->content;
+        xml = NodeContent(root);
     }
     else
     {
-        xml = TY_(NewNode)(lexer->allocator, lexer);
+        xml = TY_(NewNode)( doc, lexer );
         xml->type = XmlDecl;
-        if ( root->content )
-            TY_(InsertNodeBeforeElement)(root->content, xml);
+        if ( NodeContent(root) )
+            TY_(InsertNodeBeforeElement)(NodeContent(root), xml);
         else
-            root->content = xml;
+            SetNodeContent(root, xml);
     }
 
     version = TY_(GetAttrByName)(xml, "version");
@@ -1757,15 +2158,15 @@ Bool TY_(FixXmlDecl)( TidyDocImpl* doc )
 Node* TY_(InferredTag)(TidyDocImpl* doc, TidyTagId id)
 {
     Lexer *lexer = doc->lexer;
-    Node *node = TY_(NewNode)( lexer->allocator, lexer );
+    Node *node = TY_(NewNode)( doc, lexer );
     const Dict* dict = TY_(LookupTagDef)(id);
 
     assert( dict != NULL );
 
     node->type = StartTag;
     node->implicit = yes;
-    node->element = TY_(tmbstrdup)(doc->allocator, dict->name);
-    node->tag = dict;
+    SetNodeElement(node, dict->name);
+    SetNodeTag(node, dict);
     node->start = lexer->txtstart;
     node->end = lexer->txtend;
 
@@ -1778,10 +2179,10 @@ static Bool ExpectsContent(Node *node)
         return no;
 
     /* unknown element? */
-    if (node->tag == NULL)
+    if (NodeTag(node) == NULL)
         return yes;
 
-    if (node->tag->model & CM_EMPTY)
+    if (NodeTag(node)->model & CM_EMPTY)
         return no;
 
     return yes;
@@ -1803,10 +2204,10 @@ typedef enum
 static Node *GetCDATA( TidyDocImpl* doc, Node *container )
 {
     Lexer* lexer = doc->lexer;
-    uint start = 0;
+    size_t start = 0;
     int nested = 0;
     CDATAState state = CDATA_INTERMEDIATE;
-    uint i;
+    size_t i;
     Bool isEmpty = yes;
     Bool matches = no;
     uint c;
@@ -1901,8 +2302,8 @@ static Node *GetCDATA( TidyDocImpl* doc, Node *container )
             if (TY_(IsLetter)(c))
                 continue;
 
-            matches = TY_(tmbstrncasecmp)(container->element, lexer->lexbuf + start,
-                                          TY_(tmbstrlen)(container->element)) == 0;
+            matches = TY_(tmbstrncasecmp)(NodeElement(container), LexBuf(lexer, start),
+                                          TY_(tmbstrlen)(NodeElement(container))) == 0;
             if (matches)
                 nested++;
 
@@ -1914,15 +2315,15 @@ static Node *GetCDATA( TidyDocImpl* doc, Node *container )
             if (TY_(IsLetter)(c))
                 continue;
 
-            matches = TY_(tmbstrncasecmp)(container->element, lexer->lexbuf + start,
-                                          TY_(tmbstrlen)(container->element)) == 0;
+            matches = TY_(tmbstrncasecmp)(NodeElement(container), LexBuf(lexer, start),
+                                          TY_(tmbstrlen)(NodeElement(container))) == 0;
 
             if (isEmpty && !matches)
             {
                 /* ReportError(doc, container, NULL, MISSING_ENDTAG_FOR); */
 
                 for (i = lexer->lexsize - 1; i >= start; --i)
-                    TY_(UngetChar)((uint)lexer->lexbuf[i], doc->docIn);
+                    TY_(UngetChar)((uint)*LexBuf(lexer, i), doc->docIn);
                 TY_(UngetChar)('/', doc->docIn);
                 TY_(UngetChar)('<', doc->docIn);
                 break;
@@ -1931,13 +2332,13 @@ static Node *GetCDATA( TidyDocImpl* doc, Node *container )
             if (matches && nested-- <= 0)
             {
                 for (i = lexer->lexsize - 1; i >= start; --i)
-                    TY_(UngetChar)((uint)lexer->lexbuf[i], doc->docIn);
+                    TY_(UngetChar)((uint)*LexBuf(lexer, i), doc->docIn);
                 TY_(UngetChar)('/', doc->docIn);
                 TY_(UngetChar)('<', doc->docIn);
                 lexer->lexsize -= (lexer->lexsize - start) + 2;
                 break;
             }
-            else if (lexer->lexbuf[start - 2] != '\\')
+            else if (*LexBuf(lexer, start - 2) != '\\')
             {
                 /* if the end tag is not already escaped using backslash */
                 SetLexerLocus( doc, lexer );
@@ -1948,9 +2349,9 @@ static Node *GetCDATA( TidyDocImpl* doc, Node *container )
                 if (TY_(IsJavaScript)(container))
                 {
                     for (i = lexer->lexsize; i > start-1; --i)
-                        lexer->lexbuf[i] = lexer->lexbuf[i-1];
+                        *LexBuf(lexer, i) = *LexBuf(lexer, i-1);
 
-                    lexer->lexbuf[start-1] = '\\';
+                    *LexBuf(lexer, start-1) = '\\';
                     lexer->lexsize++;
                 }
             }
@@ -1972,7 +2373,7 @@ static Node *GetCDATA( TidyDocImpl* doc, Node *container )
     else
         return NULL;
 #else
-    return TY_(TextToken)(lexer);
+    return TY_(TextToken)( doc );
 #endif
 }
 
@@ -1985,7 +2386,7 @@ void TY_(UngetToken)( TidyDocImpl* doc )
 #define CondReturnTextNode(doc, skip) \
             if (lexer->txtend > lexer->txtstart) \
             { \
-                lexer->token = TY_(TextToken)(lexer); \
+                lexer->token = ContentTextToken(doc, mappos); \
                 StoreOriginalTextInToken(doc, lexer->token, skip); \
                 return lexer->token; \
             }
@@ -1993,7 +2394,7 @@ void TY_(UngetToken)( TidyDocImpl* doc )
 #define CondReturnTextNode(doc, skip) \
             if (lexer->txtend > lexer->txtstart) \
             { \
-                lexer->token = TY_(TextToken)(lexer); \
+                lexer->token = ContentTextToken(doc, mappos); \
                 return lexer->token; \
             }
 #endif
@@ -2006,11 +2407,25 @@ void TY_(UngetToken)( TidyDocImpl* doc )
   IgnoreMarkup   -- for CDATA elements such as script, style
 */
 static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode );
+static Node* GetPartialToken( TidyDocImpl* doc, GetTokenMode mode );
+
+static Node* ReadToken( TidyDocImpl* doc, GetTokenMode mode )
+{
+    if (mode == CdataContent)
+    {
+        assert( doc->lexer->parent != NULL );
+        return GetCDATA(doc, doc->lexer->parent);
+    }
+
+    return GetTokenFromStream( doc, mode );
+}
 
 Node* TY_(GetToken)( TidyDocImpl* doc, GetTokenMode mode )
 {
     Lexer* lexer = doc->lexer;
 
+    lexer->suspended = no;
+
     if (lexer->pushed || lexer->itoken)
     {
         /* Deal with previously returned duplicate inline token */
@@ -2041,13 +2456,106 @@ Node* TY_(GetToken)( TidyDocImpl* doc, GetTokenMode mode )
     if (lexer->insert || lexer->inode)
         return lexer->token = TY_(InsertedToken)( doc );
 
-    if (mode == CdataContent)
+    /* past the memory limit, end the document here */
+    if ( doc->arena.exceeded )
+        return NULL;
+
+    if ( doc->docIn->partial )
+        return GetPartialToken( doc, mode );
+
+    return ReadToken( doc, mode );
+}
+
+/* What reading a token may change, see GetPartialToken() */
+typedef struct _LexerMark
+{
+    uint lines;
+    uint columns;
+    Bool waswhite;
+    Bool insertspace;
+    Bool isvoyager;
+    uint versions;
+    uint doctype;
+    size_t txtstart;
+    size_t txtend;
+    size_t lexsize;
+    LexerState state;
+    Node* token;
+    uint badAccess;
+    uint badLayout;
+    uint badChars;
+    uint badForm;
+} LexerMark;
+
+/*
+  Reads a token from input given to tidyParseChunk() so far.  If it
+  runs out first, the token may not be complete, so the lexer and
+  the input go back to where it started, and GetToken() returns NULL
+  with lexer->suspended set.  The messages about the token are only
+  given once it has been read to its end.
+*/
+static Node* GetPartialToken( TidyDocImpl* doc, GetTokenMode mode )
+{
+    Lexer* lexer = doc->lexer;
+    StreamIn* in = doc->docIn;
+    LexerMark mark;
+    Node* node;
+
+    mark.lines = lexer->lines;
+    mark.columns = lexer->columns;
+    mark.waswhite = lexer->waswhite;
+    mark.insertspace = lexer->insertspace;
+    mark.isvoyager = lexer->isvoyager;
+    mark.versions = lexer->versions;
+    mark.doctype = lexer->doctype;
+    mark.txtstart = lexer->txtstart;
+    mark.txtend = lexer->txtend;
+    mark.lexsize = lexer->lexsize;
+    mark.state = lexer->state;
+    mark.token = lexer->token;
+    mark.badAccess = doc->badAccess;
+    mark.badLayout = doc->badLayout;
+    mark.badChars = doc->badChars;
+    mark.badForm = doc->badForm;
+
+    TY_(MarkStreamIn)( in );
+    TY_(HoldMessages)( doc );
+    node = ReadToken( doc, mode );
+
+    if ( !in->starved )
     {
-        assert( lexer->parent != NULL );
-        return GetCDATA(doc, lexer->parent);
+        TY_(ReleaseMessages)( doc, yes );
+        return node;
     }
 
-    return GetTokenFromStream( doc, mode );
+    TY_(ReleaseMessages)( doc, no );
+    if ( node )
+        TY_(FreeNode)( doc, node );
+
+    lexer->lines = mark.lines;
+    lexer->columns = mark.columns;
+    lexer->waswhite = mark.waswhite;
+    lexer->insertspace = mark.insertspace;
+    lexer->isvoyager = mark.isvoyager;
+    lexer->versions = mark.versions;
+    lexer->doctype = mark.doctype;
+    lexer->state = mark.state;
+    lexer->token = mark.token;
+    doc->badAccess = mark.badAccess;
+    doc->badLayout = mark.badLayout;
+    doc->badChars = mark.badChars;
+    doc->badForm = mark.badForm;
+
+    /* text from txtstart on may have moved to a new segment */
+    lexer->txtstart = MAX( mark.txtstart, lexer->lexbase );
+    lexer->txtend = MAX( mark.txtend, lexer->lexbase );
+    lexer->lexsize = MAX( mark.lexsize, lexer->lexbase );
+    lexer->mapheld = 0;
+    *LexBuf( lexer, lexer->lexsize ) = '\0';
+
+    TY_(ResetStreamIn)( in );
+    lexer->suspended = yes;
+    return NULL;
 }
 
 static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
@@ -2056,6 +2564,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
     uint c, badcomment = 0;
     Bool isempty = no;
     AttVal *attributes = NULL;
+    const byte* mappos = NULL;
 
     /* Lexer->token must be set on return. Nullify it for safety. */
     lexer->token = NULL;
@@ -2064,6 +2573,11 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
     lexer->waswhite = no;
 
     lexer->txtstart = lexer->txtend = lexer->lexsize;
+    lexer->mapheld = 0;
+
+    /* where any text token would start in mapped input */
+    if ( lexer->state == LEX_CONTENT )
+        mappos = TY_(MappedInputPos)( doc->docIn );
 
     while ((c = TY_(ReadChar)(doc->docIn)) != EndOfStream)
     {
@@ -2132,6 +2646,18 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
                     mode = MixedContent;
 
                 lexer->waswhite = no;
+
+                /* copy any following run of plain text in one go */
+                {
+                    ctmbstr run = NULL;
+                    uint len = TY_(ReadTextRun)( doc->docIn, &run,
+                                                mode == Preformatted );
+                    if ( len > 0 )
+                    {
+                        AddTextRun( lexer, mappos, run, len );
+                        lexer->waswhite = ( run[len-1] == ' ' );
+                    }
+                }
                 continue;
 
             case LEX_GT:  /* < */
@@ -2153,19 +2679,19 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
                         lexer->txtend = lexer->lexsize;
                         TY_(UngetChar)(c, doc->docIn);
                         lexer->state = LEX_ENDTAG;
-                        lexer->lexbuf[lexer->lexsize] = '\0';  /* debug */
+                        *LexBuf(lexer, lexer->lexsize) = '\0';  /* debug */
                         doc->docIn->curcol -= 2;
 
                         /* if some text before the </ return it now */
                         if (lexer->txtend > lexer->txtstart)
                         {
                             /* trim space character before end tag */
-                            if (mode == IgnoreWhitespace && lexer->lexbuf[lexer->lexsize - 1] == ' ')
+                            if (mode == IgnoreWhitespace && LastLexByte(lexer) == ' ')
                             {
                                 lexer->lexsize -= 1;
                                 lexer->txtend = lexer->lexsize;
                             }
-                            lexer->token = TY_(TextToken)(lexer);
+                            lexer->token = ContentTextToken(doc, mappos);
 #ifdef TIDY_STORE_ORIGINAL_TEXT
                             StoreOriginalTextInToken(doc, lexer->token, 3);
 #endif
@@ -2298,7 +2824,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
                     }
 
                     lexer->lexsize -= 2;
-                    lexer->lexbuf[lexer->lexsize] = '\0';
+                    *LexBuf(lexer, lexer->lexsize) = '\0';
                     lexer->state = LEX_CONTENT;
                     continue;
                 }
@@ -2419,7 +2945,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
                 if (isempty)
                     lexer->token->type = StartEndTag;
 
-                lexer->token->attributes = attributes;
+                SetNodeAttrs(lexer->token, attributes);
                 lexer->lexsize = lexer->txtend = lexer->txtstart;
 
                 /* swallow newline following start tag */
@@ -2441,14 +2967,14 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
                     lexer->waswhite = no;
 
                 lexer->state = LEX_CONTENT;
-                if (lexer->token->tag == NULL)
+                if (NodeTag(lexer->token) == NULL)
                     TY_(ReportFatal)( doc, NULL, lexer->token, UNKNOWN_ELEMENT );
                 else if ( !cfgBool(doc, TidyXmlTags) )
                 {
                     Node* curr = lexer->token;
-                    TY_(ConstrainVersion)( doc, curr->tag->versions );
+                    TY_(ConstrainVersion)( doc, NodeTag(curr)->versions );
                     
-                    if ( curr->tag->versions & VERS_PROPRIETARY )
+                    if ( NodeTag(curr)->versions & VERS_PROPRIETARY )
                     {
                         if ( !cfgBool(doc, TidyMakeClean) ||
                              ( !nodeIsNOBR(curr) && !nodeIsWBR(curr) ) )
@@ -2494,7 +3020,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
                     /* do not store closing -- in lexbuf */
                     lexer->lexsize -= 2;
                     lexer->txtend = lexer->lexsize;
-                    lexer->lexbuf[lexer->lexsize] = '\0';
+                    *LexBuf(lexer, lexer->lexsize) = '\0';
                     lexer->state = LEX_CONTENT;
                     lexer->waswhite = no;
                     lexer->token = CommentToken(doc);
@@ -2521,7 +3047,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
                 badcomment++;
 
                 if ( cfgBool(doc, TidyFixComments) )
-                    lexer->lexbuf[lexer->lexsize - 2] = '=';
+                    *LexBuf(lexer, lexer->lexsize - 2) = '=';
 
                 /* if '-' then look for '>' to end the comment */
                 if (c == '-')
@@ -2531,7 +3057,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
                 }
 
                 /* otherwise continue to look for --> */
-                lexer->lexbuf[lexer->lexsize - 1] = '=';
+                *LexBuf(lexer, lexer->lexsize - 1) = '=';
 
                 /* http://tidy.sf.net/bug/1266647 */
                 TY_(AddCharToLexer)(lexer, c);
@@ -2546,7 +3072,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
                 lexer->token = ParseDocTypeDecl(doc);
 
                 lexer->txtend = lexer->lexsize;
-                lexer->lexbuf[lexer->lexsize] = '\0';
+                *LexBuf(lexer, lexer->lexsize) = '\0';
                 lexer->state = LEX_CONTENT;
                 lexer->waswhite = no;
 
@@ -2560,7 +3086,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
 
                 if  (lexer->lexsize - lexer->txtstart == 3)
                 {
-                    if (TY_(tmbstrncmp)(lexer->lexbuf + lexer->txtstart, "php", 3) == 0)
+                    if (TY_(tmbstrncmp)(LexBuf(lexer, lexer->txtstart), "php", 3) == 0)
                     {
                         lexer->state = LEX_PHP;
                         continue;
@@ -2569,8 +3095,8 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
 
                 if  (lexer->lexsize - lexer->txtstart == 4)
                 {
-                    if (TY_(tmbstrncmp)(lexer->lexbuf + lexer->txtstart, "xml", 3) == 0 &&
-                        TY_(IsWhite)(lexer->lexbuf[lexer->txtstart + 3]))
+                    if (TY_(tmbstrncmp)(LexBuf(lexer, lexer->txtstart), "xml", 3) == 0 &&
+                        TY_(IsWhite)(*LexBuf(lexer, lexer->txtstart + 3)))
                     {
                         lexer->state = LEX_XMLDECL;
                         attributes = NULL;
@@ -2602,34 +3128,35 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
 
                 lexer->lexsize -= 1;
 
-                if (lexer->lexsize)
+                if (lexer->lexsize > lexer->txtstart)
                 {
                     uint i;
                     Bool closed;
 
-                    for (i = 0; i < lexer->lexsize - lexer->txtstart &&
-                        !TY_(IsWhite)(lexer->lexbuf[i + lexer->txtstart]); ++i)
-                        /**/;
-
-                    closed = lexer->lexbuf[lexer->lexsize - 1] == '?';
+                    closed = *LexBuf(lexer, lexer->lexsize - 1) == '?';
 
                     if (closed)
                         lexer->lexsize -= 1;
 
+                    /* the target, measured after the '?' is dropped
+                       so that txtstart stays at or before lexsize */
+                    for (i = 0; i < lexer->lexsize - lexer->txtstart &&
+                        !TY_(IsWhite)(*LexBuf(lexer, i + lexer->txtstart)); ++i)
+                        /**/;
+
                     lexer->txtstart += i;
                     lexer->txtend = lexer->lexsize;
-                    lexer->lexbuf[lexer->lexsize] = '\0';
+                    *LexBuf(lexer, lexer->lexsize) = '\0';
 
                     lexer->token = PIToken(doc);
                     lexer->token->closed = closed;
-                    lexer->token->element = TY_(tmbstrndup)(doc->allocator,
-                                                            lexer->lexbuf +
-                                                            lexer->txtstart - i, i);
+                    SetNodeElement(lexer->token, TY_(InternTagName)(doc,
+                                                LexBuf(lexer, lexer->txtstart - i), i));
                 }
                 else
                 {
                     lexer->txtend = lexer->lexsize;
-                    lexer->lexbuf[lexer->lexsize] = '\0';
+                    *LexBuf(lexer, lexer->lexsize) = '\0';
                     lexer->token = PIToken(doc);
                 }
 
@@ -2653,7 +3180,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
 
                 lexer->lexsize -= 1;
                 lexer->txtend = lexer->lexsize;
-                lexer->lexbuf[lexer->lexsize] = '\0';
+                *LexBuf(lexer, lexer->lexsize) = '\0';
                 lexer->state = LEX_CONTENT;
                 lexer->waswhite = no;
                 return lexer->token = AspToken(doc);
@@ -2674,7 +3201,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
 
                 lexer->lexsize -= 1;
                 lexer->txtend = lexer->lexsize;
-                lexer->lexbuf[lexer->lexsize] = '\0';
+                *LexBuf(lexer, lexer->lexsize) = '\0';
                 lexer->state = LEX_CONTENT;
                 lexer->waswhite = no;
                 return lexer->token = JsteToken(doc);
@@ -2694,7 +3221,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
 
                 lexer->lexsize -= 1;
                 lexer->txtend = lexer->lexsize;
-                lexer->lexbuf[lexer->lexsize] = '\0';
+                *LexBuf(lexer, lexer->lexsize) = '\0';
                 lexer->state = LEX_CONTENT;
                 lexer->waswhite = no;
                 return lexer->token = PhpToken(doc);
@@ -2707,7 +3234,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
                 /* get pseudo-attribute */
                 if (c != '?')
                 {
-                    tmbstr name;
+                    ctmbstr name;
                     Node *asp, *php;
                     AttVal *av = NULL;
                     int pdelim = 0;
@@ -2722,11 +3249,11 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
                         /* fix for http://tidy.sf.net/bug/788031 */
                         lexer->lexsize -= 1;
                         lexer->txtend = lexer->txtstart;
-                        lexer->lexbuf[lexer->txtend] = '\0';
+                        *LexBuf(lexer, lexer->txtend) = '\0';
                         lexer->state = LEX_CONTENT;
                         lexer->waswhite = no;
                         lexer->token = XmlDeclToken(doc);
-                        lexer->token->attributes = attributes;
+                        SetNodeAttrs(lexer->token, attributes);
                         return lexer->token;
                     }
 
@@ -2750,18 +3277,18 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
                 }
                 lexer->lexsize -= 1;
                 lexer->txtend = lexer->txtstart;
-                lexer->lexbuf[lexer->txtend] = '\0';
+                *LexBuf(lexer, lexer->txtend) = '\0';
                 lexer->state = LEX_CONTENT;
                 lexer->waswhite = no;
                 lexer->token = XmlDeclToken(doc);
-                lexer->token->attributes = attributes;
+                SetNodeAttrs(lexer->token, attributes);
                 return lexer->token;
 
             case LEX_SECTION: /* seen "<![" so look for "]>" */
                 if (c == '[')
                 {
                     if (lexer->lexsize == (lexer->txtstart + 6) &&
-                        TY_(tmbstrncmp)(lexer->lexbuf+lexer->txtstart, "CDATA[", 6) == 0)
+                        TY_(tmbstrncmp)(LexBuf(lexer, lexer->txtstart), "CDATA[", 6) == 0)
                     {
                         lexer->state = LEX_CDATA;
                         lexer->lexsize -= 6;
@@ -2783,7 +3310,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
 
                 lexer->lexsize -= 1;
                 lexer->txtend = lexer->lexsize;
-                lexer->lexbuf[lexer->lexsize] = '\0';
+                *LexBuf(lexer, lexer->lexsize) = '\0';
                 lexer->state = LEX_CONTENT;
                 lexer->waswhite = no;
                 return lexer->token = SectionToken(doc);
@@ -2813,7 +3340,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
 
                 lexer->lexsize -= 1;
                 lexer->txtend = lexer->lexsize;
-                lexer->lexbuf[lexer->lexsize] = '\0';
+                *LexBuf(lexer, lexer->lexsize) = '\0';
                 lexer->state = LEX_CONTENT;
                 lexer->waswhite = no;
                 return lexer->token = CDATAToken(doc);
@@ -2828,12 +3355,12 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
         {
             TY_(UngetChar)(c, doc->docIn);
 
-            if (lexer->lexbuf[lexer->lexsize - 1] == ' ')
+            if (LastLexByte(lexer) == ' ')
             {
                 lexer->lexsize -= 1;
                 lexer->txtend = lexer->lexsize;
             }
-            lexer->token = TY_(TextToken)(lexer);
+            lexer->token = ContentTextToken(doc, mappos);
 #ifdef TIDY_STORE_ORIGINAL_TEXT
             StoreOriginalTextInToken(doc, lexer->token, 0); /* ? */
 #endif
@@ -2846,7 +3373,7 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
             TY_(ReportError)(doc, NULL, NULL, MALFORMED_COMMENT );
 
         lexer->txtend = lexer->lexsize;
-        lexer->lexbuf[lexer->lexsize] = '\0';
+        *LexBuf(lexer, lexer->lexsize) = '\0';
         lexer->state = LEX_CONTENT;
         lexer->waswhite = no;
         return lexer->token = CommentToken(doc);
@@ -2855,26 +3382,6 @@ static Node* GetTokenFromStream( TidyDocImpl* doc, GetTokenMode mode )
     return NULL;
 }
 
-static void MapStr( ctmbstr str, uint code )
-{
-    while ( *str )
-    {
-        uint i = (byte) *str++;
-        lexmap[i] |= code;
-    }
-}
-
-void TY_(InitMap)(void)
-{
-    MapStr("\r\n\f", newline|white);
-    MapStr(" \t", white);
-    MapStr("-.:_", namechar);
-    MapStr("0123456789", digit|digithex|namechar);
-    MapStr("abcdefghijklmnopqrstuvwxyz", lowercase|letter|namechar);
-    MapStr("ABCDEFGHIJKLMNOPQRSTUVWXYZ", uppercase|letter|namechar);
-    MapStr("abcdefABCDEF", digithex);
-}
-
 /*
  parser for ASP within start tags
 
@@ -2976,12 +3483,12 @@ static Node *ParsePhp( TidyDocImpl* doc )
 }   
 
 /* consumes the '>' terminating start tags */
-static tmbstr  ParseAttribute( TidyDocImpl* doc, Bool *isempty,
+static ctmbstr ParseAttribute( TidyDocImpl* doc, Bool *isempty,
                               Node **asp, Node **php)
 {
     Lexer* lexer = doc->lexer;
-    int start, len = 0;
-    tmbstr attr = NULL;
+    size_t start, len = 0;
+    ctmbstr attr = NULL;
     uint c, lastc;
 
     *asp = NULL;  /* clear asp pointer */
@@ -3099,8 +3606,8 @@ static tmbstr  ParseAttribute( TidyDocImpl* doc, Bool *isempty,
 
     /* handle attribute names with multibyte chars */
     len = lexer->lexsize - start;
-    attr = (len > 0 ? TY_(tmbstrndup)(doc->allocator,
-                                      lexer->lexbuf+start, len) : NULL);
+    attr = (len > 0 ? TY_(InternAttrName)(doc, LexBuf(lexer, start),
+                                          (uint)len) : NULL);
     lexer->lexsize = start;
     return attr;
 }
@@ -3208,7 +3715,7 @@ static tmbstr ParseValue( TidyDocImpl* doc, ctmbstr name,
                           Bool foldCase, Bool *isempty, int *pdelim)
 {
     Lexer* lexer = doc->lexer;
-    int len = 0, start;
+    size_t len = 0, start;
     Bool seen_gt = no;
     Bool munge = yes;
     uint c, lastc, delim, quotewarning;
@@ -3280,8 +3787,8 @@ static tmbstr ParseValue( TidyDocImpl* doc, ctmbstr name,
         *pdelim = ParseServerInstruction( doc );
         len = lexer->lexsize - start;
         lexer->lexsize = start;
-        return (len > 0 ? TY_(tmbstrndup)(doc->allocator,
-                                          lexer->lexbuf+start, len) : NULL);
+        return (len > 0 ? TY_(tmbstrndup)(TidyDocAllocator(doc, TidyMemAttributes),
+                                          LexBuf(lexer, start), (uint)len) : NULL);
     }
     else
         TY_(UngetChar)(c, doc->docIn);
@@ -3387,7 +3894,7 @@ static tmbstr ParseValue( TidyDocImpl* doc, ctmbstr name,
         {
             TY_(AddCharToLexer)(lexer, c);
             ParseEntity( doc, IgnoreWhitespace );
-            if (lexer->lexbuf[lexer->lexsize - 1] == '\n' && munge)
+            if (*LexBuf(lexer, lexer->lexsize - 1) == '\n' && munge)
                 ChangeChar(lexer, ' ');
             continue;
         }
@@ -3451,8 +3958,8 @@ static tmbstr ParseValue( TidyDocImpl* doc, ctmbstr name,
            Microsoft Office.
         */
         if ( !TY_(IsScript)(doc, name) &&
-             !(TY_(IsUrl)(doc, name) && TY_(tmbstrncmp)(lexer->lexbuf+start, "javascript:", 11) == 0) &&
-             !(TY_(tmbstrncmp)(lexer->lexbuf+start, "<xml ", 5) == 0)
+             !(TY_(IsUrl)(doc, name) && TY_(tmbstrncmp)(LexBuf(lexer, start), "javascript:", 11) == 0) &&
+             !(TY_(tmbstrncmp)(LexBuf(lexer, start), "<xml ", 5) == 0)
            )
             TY_(ReportFatal)( doc, NULL, NULL, SUSPECTED_MISSING_QUOTE ); 
     }
@@ -3473,17 +3980,18 @@ static tmbstr ParseValue( TidyDocImpl* doc, ctmbstr name,
             TY_(tmbstrcasecmp)(name, "value") &&
             TY_(tmbstrcasecmp)(name, "prompt"))
         {
-            while (TY_(IsWhite)(lexer->lexbuf[start+len-1]))
+            while (len > 0 && TY_(IsWhite)(*LexBuf(lexer, start+len-1)))
                 --len;
 
-            while (TY_(IsWhite)(lexer->lexbuf[start]) && start < len)
+            while (len > 0 && TY_(IsWhite)(*LexBuf(lexer, start)))
             {
                 ++start;
                 --len;
             }
         }
 
-        value = TY_(tmbstrndup)(doc->allocator, lexer->lexbuf + start, len);
+        value = TY_(tmbstrndup)(TidyDocAllocator(doc, TidyMemAttributes),
+                                LexBuf(lexer, start), (uint)len);
     }
     else
         value = NULL;
@@ -3520,7 +4028,8 @@ static Bool IsValidAttrName( ctmbstr attr )
 /* create a new attribute */
 AttVal *TY_(NewAttribute)( TidyDocImpl* doc )
 {
-    AttVal *av = (AttVal*) TidyDocAlloc( doc, sizeof(AttVal) );
+    AttVal *av = (AttVal*) TidyAlloc( TidyDocAllocator(doc, TidyMemAttributes),
+                                      sizeof(AttVal) );
     TidyClearMemory( av, sizeof(AttVal) );
     return av;
 }
@@ -3530,8 +4039,8 @@ AttVal* TY_(NewAttributeEx)( TidyDocImpl* doc, ctmbstr name, ctmbstr value,
                              int delim )
 {
     AttVal *av = TY_(NewAttribute)(doc);
-    av->attribute = TY_(tmbstrdup)(doc->allocator, name);
-    av->value = TY_(tmbstrdup)(doc->allocator, value);
+    av->attribute = InternAttrStr(doc, name);
+    av->value = TY_(tmbstrdup)(TidyDocAllocator(doc, TidyMemAttributes), value);
     av->delim = delim;
     av->dict = TY_(FindAttribute)( doc, av );
     return av;
@@ -3550,15 +4059,21 @@ static void AddAttrToList( AttVal** list, AttVal* av )
   }
 }
 
-void TY_(InsertAttributeAtEnd)( Node *node, AttVal *av )
+void TY_(InsertAttributeAtEnd)( TidyDocImpl* doc, Node *node, AttVal *av )
 {
-    AddAttrToList(&node->attributes, av);
+    AttVal* list;
+
+    TY_(OwnAttrs)( doc, node );
+    list = NodeAttrs(node);
+    AddAttrToList(&list, av);
+    SetNodeAttrs(node, list);
 }
 
-void TY_(InsertAttributeAtStart)( Node *node, AttVal *av )
+void TY_(InsertAttributeAtStart)( TidyDocImpl* doc, Node *node, AttVal *av )
 {
-    av->next = node->attributes;
-    node->attributes = av;
+    TY_(OwnAttrs)( doc, node );
+    av->next = NodeAttrs(node);
+    SetNodeAttrs(node, av);
 }
 
 /* swallows closing '>' */
@@ -3575,7 +4090,7 @@ static AttVal* ParseAttrs( TidyDocImpl* doc, Bool *isempty )
 
     while ( !EndOfInput(doc) )
     {
-        tmbstr attribute = ParseAttribute( doc, isempty, &asp, &php );
+        ctmbstr attribute = ParseAttribute( doc, isempty, &asp, &php );
 
         if (attribute == NULL)
         {
@@ -3648,13 +4163,13 @@ static AttVal* ParseAttrs( TidyDocImpl* doc, Bool *isempty )
 static Node *ParseDocTypeDecl(TidyDocImpl* doc)
 {
     Lexer *lexer = doc->lexer;
-    int start = lexer->lexsize;
+    size_t start = lexer->lexsize;
     ParseDocTypeDeclState state = DT_DOCTYPENAME;
     uint c;
     uint delim = 0;
     Bool hasfpi = yes;
 
-    Node* node = TY_(NewNode)(lexer->allocator, lexer);
+    Node* node = TY_(NewNode)( doc, lexer );
     node->type = DocTypeTag;
     node->start = lexer->txtstart;
     node->end = lexer->txtend;
@@ -3722,7 +4237,7 @@ static Node *ParseDocTypeDecl(TidyDocImpl* doc)
                 if (si)
                     TY_(CheckUrl)(doc, node, si);
 
-                if (!node->element || !IsValidXMLElemName(node->element))
+                if (!NodeElement(node) || !IsValidXMLElemName(NodeElement(node)))
                 {
                     TY_(ReportError)(doc, NULL, NULL, MALFORMED_DOCTYPE);
                     TY_(FreeNode)(doc, node);
@@ -3742,9 +4257,8 @@ static Node *ParseDocTypeDecl(TidyDocImpl* doc)
             /* read document type name */
             if (TY_(IsWhite)(c) || c == '>' || c == '[')
             {
-                node->element = TY_(tmbstrndup)(doc->allocator,
-                                                lexer->lexbuf + start,
-                                                lexer->lexsize - start - 1);
+                SetNodeElement(node, TY_(InternTagName)(doc, LexBuf(lexer, start),
+                                                        (uint)(lexer->lexsize - start - 1)));
                 if (c == '>' || c == '[')
                 {
                     --(lexer->lexsize);
@@ -3760,8 +4274,8 @@ static Node *ParseDocTypeDecl(TidyDocImpl* doc)
             if (TY_(IsWhite)(c) || c == '>')
             {
                 char *attname = TY_(tmbstrndup)(doc->allocator,
-                                                lexer->lexbuf + start,
-                                                lexer->lexsize - start - 1);
+                                                LexBuf(lexer, start),
+                                                (uint)(lexer->lexsize - start - 1));
                 hasfpi = !(TY_(tmbstrcasecmp)(attname, "SYSTEM") == 0);
 
                 TidyDocFree(doc, attname);
@@ -3783,8 +4297,8 @@ static Node *ParseDocTypeDecl(TidyDocImpl* doc)
             if (c == delim)
             {
                 char *value = TY_(tmbstrndup)(doc->allocator,
-                                              lexer->lexbuf + start,
-                                              lexer->lexsize - start - 1);
+                                              LexBuf(lexer, start),
+                                              (uint)(lexer->lexsize - start - 1));
                 AttVal* att = TY_(AddAttribute)(doc, node, hasfpi ? "PUBLIC" : "SYSTEM", value);
                 TidyDocFree(doc, value);
                 att->delim = delim;
@@ -3801,7 +4315,7 @@ static Node *ParseDocTypeDecl(TidyDocImpl* doc)
                 Node* subset;
                 lexer->txtstart = start;
                 lexer->txtend = lexer->lexsize - 1;
-                subset = TY_(TextToken)(lexer);
+                subset = TY_(TextToken)( doc );
                 TY_(InsertNodeAtEnd)(node, subset);
                 state = DT_INTERMEDIATE;
             }
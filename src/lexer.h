@@ -42,6 +42,7 @@ extern "C" {
 #endif
 
 #include "forward.h"
+#include "nodes.h"
 
 /* lexer character types
 */
@@ -219,7 +220,7 @@ typedef enum
 /* all proprietary types */
 #define VERS_PROPRIETARY   (VERS_NETSCAPE|VERS_MICROSOFT|VERS_SUN)
 
-/* Linked list of class names and styles
+/* Class names and styles, see FindStyle() in clean.c
 */
 struct _Style;
 typedef struct _Style TagStyle;
@@ -229,9 +230,21 @@ struct _Style
     tmbstr tag;
     tmbstr tag_class;
     tmbstr properties;
-    TagStyle *next;
+    uint   hash;        /* of tag and properties */
 };
 
+/* The styles in the order they were made, with an open addressing
+** index on tag and properties.
+*/
+typedef struct _StyleTable
+{
+    TagStyle* styles;
+    uint      count;
+    uint      length;   /* allocated */
+    uint*     index;    /* 1 + position in styles, or 0 if free */
+    uint      indexSize; /* a power of 2 */
+} StyleTable;
+
 
 /* Linked list of style properties
 */
@@ -258,8 +271,12 @@ struct _AttVal
     Node*             asp;
     Node*             php;
     int               delim;
-    tmbstr            attribute;
+    ctmbstr           attribute;      /* interned, see intern.h */
     tmbstr            value;
+    uint              shared;         /* other holders of list, see istack.c */
+    uint              length;         /* of value while appended to, */
+    uint              size;           /* and room for it, see attrs.c */
+    StyleProp*        props;          /* style value while cleaning, see clean.c */
 };
 
 
@@ -283,15 +300,73 @@ struct _IStack
 {
     IStack*     next;
     const Dict* tag;        /* tag's dictionary definition */
-    tmbstr      element;    /* name (NULL for text nodes) */
+    ctmbstr     element;    /* name (NULL for text nodes) */
     AttVal*     attributes;
 };
 
 
 /* HTML/XHTML/XML Element, Comment, PI, DOCTYPE, XML Decl,
 ** etc. etc.
+**
+** The tree links, attributes, tag, element and was are read and set
+** with the macros below, as SUPPORT_COMPACT_NODES makes them indices.
 */
 
+#if SUPPORT_COMPACT_NODES
+
+/* Held in per document arrays, see nodes.h */
+struct _Node
+{
+    uint        parent;         /* tree structure */
+    uint        prev;
+    uint        next;
+    uint        content;
+    uint        last;
+
+    uint        attributes;
+    uint        kind;           /* tag, element and was */
+
+    uint        start;          /* start of span onto text array */
+    uint        end;            /* end of span onto text array */
+
+    uint        line;           /* current line of document */
+    uint        column;         /* current column of document */
+
+    unsigned    type      : 4;  /* NodeType: TextNode, StartTag etc. */
+    unsigned    closed    : 1;  /* true if closed by explicit end tag */
+    unsigned    implicit  : 1;  /* true if inferred */
+    unsigned    linebreak : 1;  /* true if followed by a line break */
+    unsigned    mapped    : 1;  /* span is onto the mapped input file */
+    unsigned    counted   : 1;  /* on lexer->chain */
+    unsigned    slot      : NODE_SLOT_BITS;  /* place in its chunk */
+
+#ifdef TIDY_STORE_ORIGINAL_TEXT
+    tmbstr      otext;
+#endif
+};
+
+#define NodeParent(node)        TY_(NodeParent)(node)
+#define NodePrev(node)          TY_(NodePrev)(node)
+#define NodeNext(node)          TY_(NodeNext)(node)
+#define NodeContent(node)       TY_(NodeContent)(node)
+#define NodeLast(node)          TY_(NodeLast)(node)
+#define NodeAttrs(node)         TY_(NodeAttrs)(node)
+#define NodeTag(node)           TY_(NodeTag)(node)
+#define NodeElement(node)       TY_(NodeElement)(node)
+#define NodeWas(node)           TY_(NodeWas)(node)
+
+#define SetNodeParent(node, v)  TY_(SetNodeParent)(node, v)
+#define SetNodePrev(node, v)    TY_(SetNodePrev)(node, v)
+#define SetNodeNext(node, v)    TY_(SetNodeNext)(node, v)
+#define SetNodeContent(node, v) TY_(SetNodeContent)(node, v)
+#define SetNodeLast(node, v)    TY_(SetNodeLast)(node, v)
+#define SetNodeAttrs(node, v)   TY_(SetNodeAttrs)(node, v)
+#define SetNodeTag(node, v)     TY_(SetNodeTag)(node, v)
+#define SetNodeElement(node, v) TY_(SetNodeElement)(node, v)
+#define SetNodeWas(node, v)     TY_(SetNodeWas)(node, v)
+
+#else
+
 struct _Node
 {
     Node*       parent;         /* tree structure */
@@ -304,31 +379,63 @@ struct _Node
     const Dict* was;            /* old tag when it was changed */
     const Dict* tag;            /* tag's dictionary definition */
 
-    tmbstr      element;        /* name (NULL for text nodes) */
+    ctmbstr     element;        /* name (NULL for text nodes) */
 
-    uint        start;          /* start of span onto text array */
-    uint        end;            /* end of span onto text array */
-    NodeType    type;           /* TextNode, StartTag, EndTag etc. */
+    size_t      start;          /* start of span onto text array */
+    size_t      end;            /* end of span onto text array */
 
     uint        line;           /* current line of document */
     uint        column;         /* current column of document */
 
-    Bool        closed;         /* true if closed by explicit end tag */
-    Bool        implicit;       /* true if inferred */
-    Bool        linebreak;      /* true if followed by a line break */
+    /* packed in one word, as there is one Node per tag or text */
+    unsigned    type      : 4;  /* NodeType: TextNode, StartTag etc. */
+    unsigned    closed    : 1;  /* true if closed by explicit end tag */
+    unsigned    implicit  : 1;  /* true if inferred */
+    unsigned    linebreak : 1;  /* true if followed by a line break */
+    unsigned    mapped    : 1;  /* span is onto the mapped input file */
+    unsigned    counted   : 1;  /* on lexer->chain */
 
 #ifdef TIDY_STORE_ORIGINAL_TEXT
     tmbstr      otext;
 #endif
 };
 
+#define NodeParent(node)        ((node)->parent)
+#define NodePrev(node)          ((node)->prev)
+#define NodeNext(node)          ((node)->next)
+#define NodeContent(node)       ((node)->content)
+#define NodeLast(node)          ((node)->last)
+#define NodeAttrs(node)         ((node)->attributes)
+#define NodeTag(node)           ((node)->tag)
+#define NodeElement(node)       ((node)->element)
+#define NodeWas(node)           ((node)->was)
+
+#define SetNodeParent(node, v)  ((node)->parent = (v))
+#define SetNodePrev(node, v)    ((node)->prev = (v))
+#define SetNodeNext(node, v)    ((node)->next = (v))
+#define SetNodeContent(node, v) ((node)->content = (v))
+#define SetNodeLast(node, v)    ((node)->last = (v))
+#define SetNodeAttrs(node, v)   ((node)->attributes = (v))
+#define SetNodeTag(node, v)     ((node)->tag = (v))
+#define SetNodeElement(node, v) ((node)->element = (v))
+#define SetNodeWas(node, v)     ((node)->was = (v))
+
+#endif /* SUPPORT_COMPACT_NODES */
+
 
 /*
   The following are private to the lexer
-  Use NewLexer() to create a lexer, and
-  FreeLexer() to free it.
+  Use NewLexer() to create a lexer, ResetLexer()
+  to reuse it, and FreeLexer() to free it.
 */
 
+/* A segment of the lexer's text store */
+typedef struct _LexSegment
+{
+    tmbstr buf;
+    size_t base;            /* offset of buf[0] */
+} LexSegment;
+
 struct _Lexer
 {
 #if 0  /* Move to TidyDocImpl */
@@ -355,8 +462,8 @@ struct _Lexer
     uint doctype;           /* version as given by doctype (if any) */
     uint versionEmitted;    /* version of doctype emitted */
     Bool bad_doctype;       /* e.g. if html or PUBLIC is missing */
-    uint txtstart;          /* start of current node */
-    uint txtend;            /* end of current node */
+    size_t txtstart;        /* start of current node */
+    size_t txtend;          /* end of current node */
     LexerState state;       /* state of lexer's finite state machine */
 
     Node* token;            /* last token returned by GetToken() */
@@ -368,17 +475,48 @@ struct _Lexer
     Bool seenEndHtml;       /* true if a </html> tag has been encountered */
 
     /*
-      Lexer character buffer
+      Lexer character store
 
-      Parse tree nodes span onto this buffer
+      Parse tree nodes span onto this store
       which contains the concatenated text
       contents of all of the elements.
 
+      It is kept in segments which are never
+      moved or resized, so adding text copies
+      none already stored.  When the last one
+      fills, the text from txtstart on, which
+      may still grow, moves to a new segment
+      that takes over its offsets.  So the text
+      of any node is all in one segment.
+
       lexsize must be reset for each file.
     */
-    tmbstr lexbuf;          /* MB character buffer */
-    uint lexlength;         /* allocated */
-    uint lexsize;           /* used */
+    LexSegment* segs;       /* in order of offset */
+    uint nsegs;             /* used */
+    uint segslength;        /* allocated */
+    tmbstr lexbuf;          /* MB character buffer: the last segment */
+    size_t lexbase;         /* offset of lexbuf[0] */
+    size_t lexlength;       /* offset of the end of lexbuf */
+    size_t lexsize;         /* used */
+
+    /*
+      Text nodes whose text is byte for byte the same
+      as in a memory mapped input file span onto the
+      mapping instead (see Node.mapped), which is then
+      kept until the lexer is freed.
+    */
+    void* mapping;          /* handle for the kept mapping */
+    const byte* mapbuf;     /* mapped input file */
+
+    /*
+      While such a text token is read, its first
+      mapheld bytes from txtstart on may be held
+      only in the mapping: lexbuf has room for
+      them but they are copied in only if the
+      token doesn't end up on the mapping.
+    */
+    const byte* mapheldpos; /* where the held bytes are */
+    size_t mapheld;         /* how many */
 
     /* Inline stack for compatibility with Mosaic */
     Node* inode;            /* for deferring text node */
@@ -388,15 +526,47 @@ struct _Lexer
     uint istacksize;        /* used */
     uint istackbase;        /* start of frame */
 
-    TagStyle *styles;          /* used for cleaning up presentation markup */
+    /* Elements whose content is being parsed, see ParseFrame */
+    ParseFrame* frames;
+    uint frameslength;      /* allocated */
+    uint nframes;           /* used */
+    ScanState* scan;        /* or being scanned, see ScanDocument() */
+
+    /* GetToken() returned NULL as the input given to tidyParseChunk()
+       ran out, not at the end of the document.  The parsers then
+       return, keeping their frames, to carry on with more input. */
+    Bool suspended;
 
-    TidyAllocator* allocator; /* allocator */
+    /* Elements from the root down to the last one asked about,
+       counted by tag, see DescendantOf() */
+    Node** chain;
+    uint chainlength;       /* allocated */
+    uint nchain;            /* used */
+    uint ancestors[N_TIDY_TAGS];
+    uint preancestors;      /* elements parsed by ParsePre */
+
+    StyleTable styles;      /* used for cleaning up presentation markup */
+
+    TidyAllocator* allocator; /* allocator for text */
 
 #if 0
     TidyDocImpl* doc;       /* Pointer back to doc for error reporting */
 #endif 
 };
 
+/* Text at offset ix of the current token, which is in the last
+   segment as it starts at or after txtstart */
+#define LexBuf( lexer, ix ) ( (lexer)->lexbuf + ((ix) - (lexer)->lexbase) )
+
+/* Text of node, from node->start on */
+#define NodeText( lexer, node ) \
+    ( (node)->mapped ? (ctmbstr) (lexer)->mapbuf + (node)->start \
+                     : (ctmbstr) TY_(LexTextAt)( lexer, (node)->start ) )
+
+/* Length of the text of node, 0 for none */
+#define NodeTextLen( node ) \
+    ( (node)->end > (node)->start ? (size_t) ((node)->end - (node)->start) : 0 )
+
 
 /* Lexer Functions
 */
@@ -424,15 +594,22 @@ uint TY_(ToUpper)(uint c);
 
 Lexer* TY_(NewLexer)( TidyDocImpl* doc );
 void TY_(FreeLexer)( TidyDocImpl* doc );
+void TY_(ResetLexer)( TidyDocImpl* doc );
 
 /* store character c as UTF-8 encoded byte stream */
 void TY_(AddCharToLexer)( Lexer *lexer, uint c );
 
+/* text at offset ix of the lexer's store */
+tmbstr TY_(LexTextAt)( Lexer* lexer, size_t ix );
+
+/* drop all text, keeping the last segment for reuse */
+void TY_(ClearLexerText)( Lexer* lexer );
+
 /*
   Used for elements and text nodes
   element name is NULL for text nodes
-  start and end are offsets into lexbuf
-  which contains the textual content of
+  start and end are offsets into the lexer's
+  text store which contains the textual content of
   all elements in the parse tree.
 
   parent and content allow traversal
@@ -441,7 +618,7 @@ void TY_(AddCharToLexer)( Lexer *lexer, uint c );
   list of AttVal nodes which hold the
   strings for attribute/value pairs.
 */
-Node* TY_(NewNode)( TidyAllocator* allocator, Lexer* lexer );
+Node* TY_(NewNode)( TidyDocImpl* doc, Lexer* lexer );
 
 
 /* used to clone heading nodes when split by an <HR> */
@@ -467,13 +644,24 @@ void TY_(RemoveAttribute)( TidyDocImpl* doc, Node *node, AttVal *attr );
  */
 void TY_(FreeNode)( TidyDocImpl* doc, Node *node );
 
-Node* TY_(TextToken)( Lexer *lexer );
+Node* TY_(TextToken)( TidyDocImpl* doc );
+
+/*
+  copy a node's mapped text into lexbuf so it can be changed.
+  With toEnd text already in lexbuf is copied too unless it
+  ends at lexsize in the last segment, so more can be added
+  with AddCharToLexer()
+*/
+void TY_(OwnNodeText)( Lexer* lexer, Node* node, Bool toEnd );
+
+/* copy all mapped text into lexbuf and release the mapping */
+void TY_(UnmapText)( TidyDocImpl* doc );
 
 /* used for creating preformatted text from Word2000 */
-Node* TY_(NewLineNode)( Lexer *lexer );
+Node* TY_(NewLineNode)( TidyDocImpl* doc );
 
 /* used for adding a &nbsp; for Word2000 */
-Node* TY_(NewLiteralTextNode)(Lexer *lexer, ctmbstr txt );
+Node* TY_(NewLiteralTextNode)( TidyDocImpl* doc, ctmbstr txt );
 
 void TY_(AddStringLiteral)( Lexer* lexer, ctmbstr str );
 /* void AddStringLiteralLen( Lexer* lexer, ctmbstr str, int len ); */
@@ -531,8 +719,6 @@ typedef enum
 
 Node* TY_(GetToken)( TidyDocImpl* doc, GetTokenMode mode );
 
-void TY_(InitMap)(void);
-
 
 /* create a new attribute */
 AttVal* TY_(NewAttribute)( TidyDocImpl* doc );
@@ -542,10 +728,10 @@ AttVal* TY_(NewAttributeEx)( TidyDocImpl* doc, ctmbstr name, ctmbstr value,
                              int delim );
 
 /* insert attribute at the end of attribute list of a node */
-void TY_(InsertAttributeAtEnd)( Node *node, AttVal *av );
+void TY_(InsertAttributeAtEnd)( TidyDocImpl* doc, Node *node, AttVal *av );
 
 /* insert attribute at the start of attribute list of a node */
-void TY_(InsertAttributeAtStart)( Node *node, AttVal *av );
+void TY_(InsertAttributeAtStart)( TidyDocImpl* doc, Node *node, AttVal *av );
 
 /*************************************
   In-line Stack functions
@@ -555,8 +741,17 @@ void TY_(InsertAttributeAtStart)( Node *node, AttVal *av );
 /* duplicate attributes */
 AttVal* TY_(DupAttrs)( TidyDocImpl* doc, AttVal* attrs );
 
+/* add a holder to a list of attributes, which must then not change */
+AttVal* TY_(ShareAttrs)( AttVal* attrs );
+
+/* copy node's attributes if they are shared, before changing them */
+void TY_(OwnAttrs)( TidyDocImpl* doc, Node* node );
+
+/* as OwnAttrs(), returning node's own attribute in place of attr */
+AttVal* TY_(OwnAttr)( TidyDocImpl* doc, Node* node, AttVal* attr );
+
 /*
-  push a copy of an inline node onto stack
+  push an inline node onto stack, sharing its attributes
   but don't push if implicit or OBJECT or APPLET
   (implicit tags are ones generated from the istack)
 
@@ -857,6 +857,12 @@ static const TidyOptionDoc option_docs[] =
    "If set to \"no\", any existing name attribute is removed "
    "if an id attribute exists or has been added. "
   },
+  {TidyMemoryLimit,
+   "This option specifies the most memory, in kilobytes, that Tidy may use "
+   "for a document while parsing it. Past this limit Tidy stops reading the "
+   "document and fails with an error, so no output is written. "
+   "If set to 0, there is no limit. "
+  },
   {N_TIDY_OPTIONS,
    NULL
   }
@@ -974,27 +980,66 @@ static void messagePos( TidyDocImpl* doc, TidyReportLevel level,
 __attribute__((format(printf, 5, 0)))
 #endif
 ;
+/* A message held back by HoldMessages(), followed by its text */
+typedef struct _HeldMessage
+{
+    TidyReportLevel level;
+    int line;
+    int col;
+    uint len;
+} HeldMessage;
+
+static void PutMessage( TidyDocImpl* doc, TidyReportLevel level,
+                        int line, int col, ctmbstr messageBuf );
+
 static void messagePos( TidyDocImpl* doc, TidyReportLevel level,
                         int line, int col, ctmbstr msg, va_list args )
 {
     enum { sizeMessageBuf=2048 };
-    char *messageBuf = TidyDocAlloc(doc,sizeMessageBuf);
-    Bool go = UpdateCount( doc, level );
+    char *messageBuf = TidyAlloc(TidyDocAllocator(doc, TidyMemMessages), sizeMessageBuf);
+    Bool go;
 
+    if ( doc->holdMessages )
+    {
+        HeldMessage held;
+        TY_(tmbvsnprintf)(messageBuf, sizeMessageBuf, msg, args);
+        held.level = level;
+        held.line = line;
+        held.col = col;
+        held.len = TY_(tmbstrlen)( messageBuf ) + 1;
+        tidyBufAppend( &doc->heldMessages, &held, sizeof(held) );
+        tidyBufAppend( &doc->heldMessages, messageBuf, held.len );
+        TidyDocFree(doc, messageBuf);
+        return;
+    }
+
+    go = UpdateCount( doc, level );
     if ( go )
     {
         TY_(tmbvsnprintf)(messageBuf, sizeMessageBuf, msg, args);
-        if ( doc->mssgFilt )
-        {
-            TidyDoc tdoc = tidyImplToDoc( doc );
-            go = doc->mssgFilt( tdoc, level, line, col, messageBuf );
-        }
+        PutMessage( doc, level, line, col, messageBuf );
+    }
+    TidyDocFree(doc, messageBuf);
+}
+
+/* Passes a message counted by UpdateCount() to the filter, if any,
+** and writes it out unless the filter says not to.
+*/
+static void PutMessage( TidyDocImpl* doc, TidyReportLevel level,
+                        int line, int col, ctmbstr messageBuf )
+{
+    Bool go = yes;
+
+    if ( doc->mssgFilt )
+    {
+        TidyDoc tdoc = tidyImplToDoc( doc );
+        go = doc->mssgFilt( tdoc, level, line, col, messageBuf );
     }
 
     if ( go )
     {
         enum { sizeBuf=1024 };
-        char *buf = TidyDocAlloc(doc,sizeBuf);
+        char *buf = TidyAlloc(TidyDocAllocator(doc, TidyMemMessages), sizeBuf);
         const char *cp;
         if ( line > 0 && col > 0 )
         {
@@ -1012,7 +1057,36 @@ static void messagePos( TidyDocImpl* doc, TidyReportLevel level,
         TY_(WriteChar)( '\n', doc->errout );
         TidyDocFree(doc, buf);
     }
-    TidyDocFree(doc, messageBuf);
+}
+
+/* Messages are kept back, uncounted, until ReleaseMessages().  See
+** GetToken(), which may read a token again with more input.
+*/
+void TY_(HoldMessages)( TidyDocImpl* doc )
+{
+    doc->holdMessages = yes;
+}
+
+/* Counts and writes out the messages held, in order, if emit is
+** set, or else forgets them.
+*/
+void TY_(ReleaseMessages)( TidyDocImpl* doc, Bool emit )
+{
+    TidyBuffer* buf = &doc->heldMessages;
+    uint pos = 0;
+
+    doc->holdMessages = no;
+    while ( emit && pos < buf->size )
+    {
+        HeldMessage held;
+        memcpy( &held, buf->bp + pos, sizeof(held) );
+        pos += sizeof(held);
+        if ( UpdateCount(doc, held.level) )
+            PutMessage( doc, held.level, held.line, held.col,
+                        (ctmbstr) buf->bp + pos );
+        pos += held.len;
+    }
+    tidyBufClear( buf );
 }
 
 /* Reports error at current Lexer line/column. */ 
@@ -1090,7 +1164,7 @@ void tidy_out( TidyDocImpl* doc, ctmbstr msg, ... )
     {
         ctmbstr cp;
         enum { sizeBuf=2048 };
-        char *buf = TidyDocAlloc(doc,sizeBuf);
+        char *buf = TidyAlloc(TidyDocAllocator(doc, TidyMemMessages), sizeBuf);
 
         va_list args;
         va_start( args, msg );
@@ -1124,23 +1198,30 @@ void TY_(FileError)( TidyDocImpl* doc, ctmbstr file, TidyReportLevel level )
     message( doc, level, "Can't open \"%s\"\n", file );
 }
 
+void TY_(ReportMemoryLimit)( TidyDocImpl* doc, ulong limit )
+{
+    messageLexer( doc, TidyError,
+                  "document needs more than memory-limit %luK, "
+                  "the rest is ignored", limit );
+}
+
 static char* TagToString(Node* tag, char* buf, size_t count)
 {
     *buf = 0;
     if (tag)
     {
         if (TY_(nodeIsElement)(tag))
-            TY_(tmbsnprintf)(buf, count, "<%s>", tag->element);
+            TY_(tmbsnprintf)(buf, count, "<%s>", NodeElement(tag));
         else if (tag->type == EndTag)
-            TY_(tmbsnprintf)(buf, count, "</%s>", tag->element);
+            TY_(tmbsnprintf)(buf, count, "</%s>", NodeElement(tag));
         else if (tag->type == DocTypeTag)
             TY_(tmbsnprintf)(buf, count, "<!DOCTYPE>");
         else if (tag->type == TextNode)
             TY_(tmbsnprintf)(buf, count, "plain text");
         else if (tag->type == XmlDecl)
             TY_(tmbsnprintf)(buf, count, "XML declaration");
-        else if (tag->element)
-            TY_(tmbsnprintf)(buf, count, "%s", tag->element);
+        else if (NodeElement(tag))
+            TY_(tmbsnprintf)(buf, count, "%s", NodeElement(tag));
     }
     return buf + TY_(tmbstrlen)(buf);
 }
@@ -1411,7 +1492,7 @@ void TY_(ReportWarning)(TidyDocImpl* doc, Node *element, Node *node, uint code)
         messageNode(doc, TidyWarning, rpt, fmt, nodedesc);
         break;
     case COERCE_TO_ENDTAG_WARN:
-        messageNode(doc, TidyWarning, rpt, fmt, node->element, node->element);
+        messageNode(doc, TidyWarning, rpt, fmt, NodeElement(node), NodeElement(node));
         break;
     }
 }
@@ -1458,7 +1539,7 @@ void TY_(ReportError)(TidyDocImpl* doc, Node *element, Node *node, uint code)
     case UNEXPECTED_ENDTAG:
     case TOO_MANY_ELEMENTS:
     case INSERTING_TAG:
-        messageNode(doc, TidyWarning, node, fmt, node->element);
+        messageNode(doc, TidyWarning, node, fmt, NodeElement(node));
         break;
 
     case USING_BR_INPLACE_OF:
@@ -1485,15 +1566,15 @@ void TY_(ReportError)(TidyDocImpl* doc, Node *element, Node *node, uint code)
 
     case COERCE_TO_ENDTAG:
     case NON_MATCHING_ENDTAG:
-        messageNode(doc, TidyWarning, rpt, fmt, node->element, node->element);
+        messageNode(doc, TidyWarning, rpt, fmt, NodeElement(node), NodeElement(node));
         break;
 
     case UNEXPECTED_ENDTAG_IN:
     case TOO_MANY_ELEMENTS_IN:
-        messageNode(doc, TidyWarning, node, fmt, node->element, element->element);
+        messageNode(doc, TidyWarning, node, fmt, NodeElement(node), NodeElement(element));
         if (cfgBool( doc, TidyShowWarnings ))
             messageNode(doc, TidyInfo, node, GetFormatFromCode(PREVIOUS_LOCATION),
-                        element->element);
+                        NodeElement(element));
         break;
 
     case ENCODING_IO_CONFLICT:
@@ -1512,11 +1593,11 @@ void TY_(ReportError)(TidyDocImpl* doc, Node *element, Node *node, uint code)
 
 
     case MISSING_ENDTAG_FOR:
-        messageNode(doc, TidyWarning, rpt, fmt, element->element);
+        messageNode(doc, TidyWarning, rpt, fmt, NodeElement(element));
         break;
 
     case MISSING_ENDTAG_BEFORE:
-        messageNode(doc, TidyWarning, rpt, fmt, element->element, nodedesc);
+        messageNode(doc, TidyWarning, rpt, fmt, NodeElement(element), nodedesc);
         break;
 
     case DISCARDING_UNEXPECTED:
@@ -1525,10 +1606,10 @@ void TY_(ReportError)(TidyDocImpl* doc, Node *element, Node *node, uint code)
         break;
 
     case TAG_NOT_ALLOWED_IN:
-        messageNode(doc, TidyWarning, node, fmt, nodedesc, element->element);
+        messageNode(doc, TidyWarning, node, fmt, nodedesc, NodeElement(element));
         if (cfgBool( doc, TidyShowWarnings ))
             messageNode(doc, TidyInfo, element,
-                        GetFormatFromCode(PREVIOUS_LOCATION), element->element);
+                        GetFormatFromCode(PREVIOUS_LOCATION), NodeElement(element));
         break;
 
     case REPLACING_UNEX_ELEMENT:
@@ -1557,11 +1638,11 @@ void TY_(ReportFatal)( TidyDocImpl* doc, Node *element, Node *node, uint code)
         break;
 
     case UNEXPECTED_ENDTAG_IN:
-        messageNode(doc, TidyError, node, fmt, node->element, element->element);
+        messageNode(doc, TidyError, node, fmt, NodeElement(node), NodeElement(element));
         break;
 
     case UNEXPECTED_ENDTAG:  /* generated by XML docs */
-        messageNode(doc, TidyError, node, fmt, node->element);
+        messageNode(doc, TidyError, node, fmt, NodeElement(node));
         break;
     }
 }
@@ -29,6 +29,9 @@ typedef struct
     TidyAllocator *allocator;
     const byte *base;
     size_t pos, size;
+    dev_t dev;
+    ino_t ino;
+    Bool kept;
 } MappedFileSource;
 
 static int TIDY_CALL mapped_getByte( void* sourceData )
@@ -49,6 +52,28 @@ static void TIDY_CALL mapped_ungetByte( void* sourceData, byte ARG_UNUSED(bv) )
     fin->pos--;
 }
 
+/* The mapping is handed out directly, in blocks small enough
+   to keep lengths within a uint */
+#define MAPPED_BLOCK_MAX ((size_t)1 << 30)
+
+static const byte* mapped_getBlock( TidyInputSource* source, byte* ARG_UNUSED(buf),
+                                    uint ARG_UNUSED(maxlen), uint* len )
+{
+    MappedFileSource* fin = (MappedFileSource*) source->sourceData;
+    const byte* block = fin->base + fin->pos;
+    size_t avail = fin->size - fin->pos;
+    if ( avail == 0 )
+    {
+        *len = 0;
+        return NULL;
+    }
+    if ( avail > MAPPED_BLOCK_MAX )
+        avail = MAPPED_BLOCK_MAX;
+    fin->pos += avail;
+    *len = (uint) avail;
+    return block;
+}
+
 int TY_(initFileSource)( TidyAllocator *allocator, TidyInputSource* inp, FILE* fp )
 {
     MappedFileSource* fin;
@@ -72,6 +97,9 @@ int TY_(initFileSource)( TidyAllocator *allocator, TidyInputSource* inp, FILE* f
 
     fin->pos = 0;
     fin->allocator = allocator;
+    fin->dev = sbuf.st_dev;
+    fin->ino = sbuf.st_ino;
+    fin->kept = no;
     fclose(fp);
 
     inp->getByte    = mapped_getByte;
@@ -87,13 +115,57 @@ void TY_(freeFileSource)( TidyInputSource* inp, Bool closeIt )
     if ( inp->getByte == mapped_getByte )
     {
         MappedFileSource* fin = (MappedFileSource*) inp->sourceData;
-        munmap( (void*)fin->base, fin->size );
-        TidyFree( fin->allocator, fin );
+        if ( !fin->kept )
+            TY_(freeMappedFile)( fin );
     }
     else
         TY_(freeStdIOFileSource)( inp, closeIt );
 }
 
+TidyGetBlockFunc TY_(fileSourceBlockFunc)( TidyInputSource* inp )
+{
+    if ( inp->getByte == mapped_getByte )
+        return mapped_getBlock;
+    return TY_(stdIOFileSourceBlockFunc)( inp );
+}
+
+const byte* TY_(fileSourceMapping)( TidyInputSource* inp, size_t* size )
+{
+    MappedFileSource* fin;
+    *size = 0;
+    if ( inp->getByte != mapped_getByte )
+        return NULL;
+    fin = (MappedFileSource*) inp->sourceData;
+    *size = fin->size;
+    return fin->base;
+}
+
+/* The source data itself serves as the handle */
+void* TY_(keepFileSourceMapping)( TidyInputSource* inp )
+{
+    MappedFileSource* fin;
+    if ( inp->getByte != mapped_getByte )
+        return NULL;
+    fin = (MappedFileSource*) inp->sourceData;
+    fin->kept = yes;
+    return fin;
+}
+
+void TY_(freeMappedFile)( void* mapping )
+{
+    MappedFileSource* fin = (MappedFileSource*) mapping;
+    munmap( (void*)fin->base, fin->size );
+    TidyFree( fin->allocator, fin );
+}
+
+Bool TY_(isMappedFile)( void* mapping, ctmbstr filnam )
+{
+    MappedFileSource* fin = (MappedFileSource*) mapping;
+    struct stat sbuf;
+    return ( stat(filnam, &sbuf) == 0
+             && sbuf.st_dev == fin->dev && sbuf.st_ino == fin->ino );
+}
+
 #endif
 
 
@@ -45,6 +45,10 @@ void TY_(GeneralInfo)( TidyDocImpl* doc );
 /* void TY_(UnknownOption)( TidyDocImpl* doc, char c ); */
 /* void TY_(UnknownFile)( TidyDocImpl* doc, ctmbstr program, ctmbstr file ); */
 void TY_(FileError)( TidyDocImpl* doc, ctmbstr file, TidyReportLevel level );
+void TY_(ReportMemoryLimit)( TidyDocImpl* doc, ulong limit );
+
+void TY_(HoldMessages)( TidyDocImpl* doc );
+void TY_(ReleaseMessages)( TidyDocImpl* doc, Bool emit );
 
 void TY_(ErrorSummary)( TidyDocImpl* doc );
 
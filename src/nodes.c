@@ -0,0 +1,413 @@
+/* nodes.c -- compact per document node storage
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+*/
+
+#include "tidy-int.h"
+#include "nodes.h"
+
+#if SUPPORT_COMPACT_NODES
+
+#include <stddef.h>
+
+#define ROOT_INDEX  1
+
+typedef struct _NodeChunk
+{
+    NodeTable*  table;
+    uint        base;       /* index of nodes[0] */
+    Node        nodes[ NODE_CHUNK ];
+} NodeChunk;
+
+#define ChunkOf(node) ( (NodeChunk*) ((byte*) ((node) - (node)->slot) - \
+                                      offsetof(NodeChunk, nodes)) )
+
+/* The root is the first member of its TidyDocImpl */
+static NodeTable* TableOf( const Node* node )
+{
+    if ( node->type == RootNode )
+        return &((TidyDocImpl*) node)->nodes;
+    return ChunkOf( node )->table;
+}
+
+static uint IndexOf( const Node* node )
+{
+    if ( node == NULL )
+        return 0;
+    if ( node->type == RootNode )
+        return ROOT_INDEX;
+    return ChunkOf( node )->base + node->slot;
+}
+
+static Node* NodeAt( const NodeTable* table, uint index )
+{
+    if ( index == ROOT_INDEX )
+        return table->root;
+    return table->chunks[ index >> NODE_SLOT_BITS ]->nodes +
+           ( index & (NODE_CHUNK - 1) );
+}
+
+/* The node at index, as a link of node */
+static Node* LinkOf( const Node* node, uint index )
+{
+    return index ? NodeAt( TableOf(node), index ) : NULL;
+}
+
+void TY_(InitNodeTable)( TidyDocImpl* doc )
+{
+    NodeTable* table = &doc->nodes;
+
+    TidyClearMemory( table, sizeof(*table) );
+    table->allocator = TidyDocAllocator( doc, TidyMemNodes );
+    table->root = &doc->root;
+}
+
+void TY_(FreeNodeTable)( TidyDocImpl* doc )
+{
+    NodeTable* table = &doc->nodes;
+    uint i;
+
+    for ( i = 0; i < table->nchunks; ++i )
+        TidyFree( table->allocator, table->chunks[i] );
+    TidyFree( table->allocator, table->chunks );
+    TidyFree( table->allocator, table->kinds );
+    TidyFree( table->allocator, table->buckets );
+    TidyFree( table->allocator, table->lists );
+    TY_(InitNodeTable)( doc );
+}
+
+static void AddChunk( NodeTable* table )
+{
+    NodeChunk* chunk = (NodeChunk*) TidyAlloc( table->allocator,
+                                               sizeof(NodeChunk) );
+
+    if ( table->nchunks == table->chunkRoom )
+    {
+        table->chunkRoom = table->chunkRoom ? 2 * table->chunkRoom : 16;
+        table->chunks = (NodeChunk**) TidyRealloc( table->allocator,
+                            table->chunks, table->chunkRoom * sizeof(NodeChunk*) );
+    }
+
+    chunk->table = table;
+    chunk->base = table->nchunks * NODE_CHUNK;
+    table->chunks[ table->nchunks++ ] = chunk;
+
+    /* 0 is no node and 1 the root */
+    if ( chunk->base == 0 )
+        table->used = ROOT_INDEX + 1;
+}
+
+Node* TY_(AllocNode)( TidyDocImpl* doc )
+{
+    NodeTable* table = &doc->nodes;
+    Node* node;
+    uint index;
+
+    if ( table->freed )
+    {
+        index = table->freed;
+        table->freed = NodeAt( table, index )->next;
+    }
+    else
+    {
+        if ( table->used == table->nchunks * NODE_CHUNK )
+            AddChunk( table );
+        index = table->used++;
+    }
+
+    node = NodeAt( table, index );
+    TidyClearMemory( node, sizeof(Node) );
+    node->slot = index & (NODE_CHUNK - 1);
+    return node;
+}
+
+/*
+  Kinds.  Each combination of tag, element and was in use is held
+  once, with a count of the nodes using it, and is forgotten when
+  the last of them goes, as a scan frees the names of elements
+  that have been closed.
+*/
+
+static uint HashKind( const Dict* tag, ctmbstr element, const Dict* was )
+{
+    size_t h = (size_t) tag ^ ((size_t) element * 31) ^ ((size_t) was * 7);
+    return (uint) ( h ^ (h >> 9) ^ (h >> 21) );
+}
+
+static void Rehash( NodeTable* table, uint nbuckets )
+{
+    uint k, h;
+
+    TidyFree( table->allocator, table->buckets );
+    table->buckets = (uint*) TidyAlloc( table->allocator,
+                                        nbuckets * sizeof(uint) );
+    TidyClearMemory( table->buckets, nbuckets * sizeof(uint) );
+    table->nbuckets = nbuckets;
+
+    for ( k = 1; k < table->nkinds; ++k )
+    {
+        NodeKind* kind = table->kinds + k;
+
+        if ( kind->refs == 0 )
+            continue;
+        h = HashKind( kind->tag, kind->element, kind->was ) & (nbuckets - 1);
+        kind->hnext = table->buckets[h];
+        table->buckets[h] = k;
+    }
+}
+
+/* The kind of tag, element and was, made if new, with no refs */
+static uint FindKind( NodeTable* table, const Dict* tag, ctmbstr element,
+                      const Dict* was )
+{
+    NodeKind* kind;
+    uint h, k;
+
+    if ( tag == NULL && element == NULL && was == NULL )
+        return 0;
+
+    if ( table->nkinds >= table->nbuckets )
+        Rehash( table, table->nbuckets ? 2 * table->nbuckets : 64 );
+
+    h = HashKind( tag, element, was ) & (table->nbuckets - 1);
+    for ( k = table->buckets[h]; k; k = kind->hnext )
+    {
+        kind = table->kinds + k;
+        if ( kind->tag == tag && kind->element == element && kind->was == was )
+            return k;
+    }
+
+    if ( table->freeKind )
+    {
+        k = table->freeKind;
+        table->freeKind = table->kinds[k].hnext;
+    }
+    else
+    {
+        if ( table->nkinds == 0 )
+            table->nkinds = 1;      /* kinds[0] is never looked at */
+        if ( table->nkinds >= table->kindRoom )
+        {
+            table->kindRoom = table->kindRoom ? 2 * table->kindRoom : 64;
+            table->kinds = (NodeKind*) TidyRealloc( table->allocator,
+                               table->kinds, table->kindRoom * sizeof(NodeKind) );
+        }
+        k = table->nkinds++;
+    }
+
+    kind = table->kinds + k;
+    kind->tag = tag;
+    kind->element = element;
+    kind->was = was;
+    kind->refs = 0;
+    kind->hnext = table->buckets[h];
+    table->buckets[h] = k;
+    return k;
+}
+
+static void DropKind( NodeTable* table, uint k )
+{
+    NodeKind* kind;
+    uint* link;
+
+    if ( k == 0 )
+        return;
+    kind = table->kinds + k;
+    if ( --(kind->refs) > 0 )
+        return;
+
+    link = table->buckets +
+           ( HashKind(kind->tag, kind->element, kind->was) & (table->nbuckets - 1) );
+    while ( *link != k )
+        link = &table->kinds[ *link ].hnext;
+    *link = kind->hnext;
+
+    kind->hnext = table->freeKind;
+    table->freeKind = k;
+}
+
+static void SetKind( Node* node, const Dict* tag, ctmbstr element,
+                     const Dict* was )
+{
+    NodeTable* table = TableOf( node );
+    uint k = FindKind( table, tag, element, was );
+
+    if ( k )
+        ++(table->kinds[k].refs);
+    DropKind( table, node->kind );
+    node->kind = k;
+}
+
+static const NodeKind* KindOf( const Node* node )
+{
+    static const NodeKind none = { NULL, NULL, NULL, 0, 0 };
+    return node->kind ? TableOf(node)->kinds + node->kind : &none;
+}
+
+void TY_(ReleaseNode)( TidyDocImpl* doc, Node* node )
+{
+    NodeTable* table = &doc->nodes;
+
+    TY_(SetNodeAttrs)( node, NULL );
+    DropKind( table, node->kind );
+    node->kind = 0;
+
+    node->next = table->freed;
+    table->freed = IndexOf( node );
+}
+
+Node* TY_(NodeParent)( const Node* node )
+{
+    return LinkOf( node, node->parent );
+}
+
+Node* TY_(NodePrev)( const Node* node )
+{
+    return LinkOf( node, node->prev );
+}
+
+Node* TY_(NodeNext)( const Node* node )
+{
+    return LinkOf( node, node->next );
+}
+
+Node* TY_(NodeContent)( const Node* node )
+{
+    return LinkOf( node, node->content );
+}
+
+Node* TY_(NodeLast)( const Node* node )
+{
+    return LinkOf( node, node->last );
+}
+
+AttVal* TY_(NodeAttrs)( const Node* node )
+{
+    if ( node->attributes == 0 )
+        return NULL;
+    return TableOf( node )->lists[ node->attributes ].attrs;
+}
+
+const Dict* TY_(NodeTag)( const Node* node )
+{
+    return KindOf( node )->tag;
+}
+
+ctmbstr TY_(NodeElement)( const Node* node )
+{
+    return KindOf( node )->element;
+}
+
+const Dict* TY_(NodeWas)( const Node* node )
+{
+    return KindOf( node )->was;
+}
+
+Node* TY_(SetNodeParent)( Node* node, Node* parent )
+{
+    node->parent = IndexOf( parent );
+    return parent;
+}
+
+Node* TY_(SetNodePrev)( Node* node, Node* prev )
+{
+    node->prev = IndexOf( prev );
+    return prev;
+}
+
+Node* TY_(SetNodeNext)( Node* node, Node* next )
+{
+    node->next = IndexOf( next );
+    return next;
+}
+
+Node* TY_(SetNodeContent)( Node* node, Node* content )
+{
+    node->content = IndexOf( content );
+    return content;
+}
+
+Node* TY_(SetNodeLast)( Node* node, Node* last )
+{
+    node->last = IndexOf( last );
+    return last;
+}
+
+AttVal* TY_(SetNodeAttrs)( Node* node, AttVal* attrs )
+{
+    NodeTable* table;
+    uint i = node->attributes;
+
+    if ( i == 0 && attrs == NULL )
+        return NULL;
+
+    table = TableOf( node );
+    if ( attrs == NULL )
+    {
+        table->lists[i].nextFree = table->freeList;
+        table->freeList = i;
+        node->attributes = 0;
+        return NULL;
+    }
+
+    if ( i == 0 )
+    {
+        if ( table->freeList )
+        {
+            i = table->freeList;
+            table->freeList = table->lists[i].nextFree;
+        }
+        else
+        {
+            if ( table->nlists == 0 )
+                table->nlists = 1;  /* lists[0] is never looked at */
+            if ( table->nlists >= table->listRoom )
+            {
+                table->listRoom = table->listRoom ? 2 * table->listRoom : 64;
+                table->lists = (NodeAttrList*) TidyRealloc( table->allocator,
+                                   table->lists,
+                                   table->listRoom * sizeof(NodeAttrList) );
+            }
+            i = table->nlists++;
+        }
+        node->attributes = i;
+    }
+    table->lists[i].attrs = attrs;
+    return attrs;
+}
+
+/* FindKind() may move the kinds, so these copy what they keep */
+
+const Dict* TY_(SetNodeTag)( Node* node, const Dict* tag )
+{
+    const NodeKind* kind = KindOf( node );
+    SetKind( node, tag, kind->element, kind->was );
+    return tag;
+}
+
+ctmbstr TY_(SetNodeElement)( Node* node, ctmbstr element )
+{
+    const NodeKind* kind = KindOf( node );
+    SetKind( node, kind->tag, element, kind->was );
+    return element;
+}
+
+const Dict* TY_(SetNodeWas)( Node* node, const Dict* was )
+{
+    const NodeKind* kind = KindOf( node );
+    SetKind( node, kind->tag, kind->element, was );
+    return was;
+}
+
+#endif /* SUPPORT_COMPACT_NODES */
+
+/*
+ * local variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * eval: (c-set-offset 'substatement-open 0)
+ * end:
+ */
@@ -0,0 +1,121 @@
+#ifndef __NODES_H__
+#define __NODES_H__
+
+/* nodes.h -- compact per document node storage
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+  Built with SUPPORT_COMPACT_NODES, a document keeps its nodes in
+  chunks of NODE_CHUNK nodes, which never move, so that a Node* (and
+  so a TidyNode) is good for as long as the node lives.  A node
+  refers to the nodes around it by index rather than by pointer, 0
+  being none and 1 the document's root.  Its tag, element and was
+  are one index into a table of the combinations in use, and its
+  attributes an index into a table of lists.  On a 64-bit platform
+  a node then takes 48 bytes, where a Node of pointers takes 104
+  and 8 more for its arena header.
+
+  Each node holds its place in its chunk and each chunk the index
+  of its first node, which with the root being the only RootNode and
+  the first member of TidyDocImpl maps a node to its index and its
+  table.  Use the
+  macros in lexer.h, which are field accesses without the switch.
+
+*/
+
+#include "forward.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define NODE_SLOT_BITS  8
+#define NODE_CHUNK      (1u << NODE_SLOT_BITS)
+
+#if SUPPORT_COMPACT_NODES
+
+/* Spans are 32-bit, so no document may have more text than this */
+#define NODE_SPAN_LIMIT 0xF0000000u
+
+/* A tag, element and was used by refs nodes */
+typedef struct _NodeKind
+{
+    const Dict* tag;
+    ctmbstr     element;
+    const Dict* was;
+    uint        refs;
+    uint        hnext;      /* in its hash chain, or the free list */
+} NodeKind;
+
+/* A list of attributes, or the next free one */
+typedef union _NodeAttrList
+{
+    AttVal*     attrs;
+    uint        nextFree;
+} NodeAttrList;
+
+struct _NodeChunk;
+
+typedef struct _NodeTable
+{
+    TidyAllocator*      allocator;
+    Node*               root;       /* index 1 */
+
+    struct _NodeChunk** chunks;
+    uint                nchunks;
+    uint                chunkRoom;
+    uint                used;       /* indices handed out so far */
+    uint                freed;      /* first free node, linked by next */
+
+    NodeKind*           kinds;      /* kinds[0] is none of them */
+    uint                nkinds;
+    uint                kindRoom;
+    uint                freeKind;
+    uint*               buckets;    /* chains of kinds by hash */
+    uint                nbuckets;   /* a power of 2 */
+
+    NodeAttrList*       lists;      /* lists[0] is unused */
+    uint                nlists;
+    uint                listRoom;
+    uint                freeList;
+} NodeTable;
+
+/* Sets up the table of doc, empty */
+void  TY_(InitNodeTable)( TidyDocImpl* doc );
+
+/* Frees the table of doc and any nodes left in it */
+void  TY_(FreeNodeTable)( TidyDocImpl* doc );
+
+/* A cleared node of doc, and giving one back */
+Node* TY_(AllocNode)( TidyDocImpl* doc );
+void  TY_(ReleaseNode)( TidyDocImpl* doc, Node* node );
+
+Node* TY_(NodeParent)( const Node* node );
+Node* TY_(NodePrev)( const Node* node );
+Node* TY_(NodeNext)( const Node* node );
+Node* TY_(NodeContent)( const Node* node );
+Node* TY_(NodeLast)( const Node* node );
+AttVal* TY_(NodeAttrs)( const Node* node );
+const Dict* TY_(NodeTag)( const Node* node );
+ctmbstr TY_(NodeElement)( const Node* node );
+const Dict* TY_(NodeWas)( const Node* node );
+
+/* These return what they set */
+Node* TY_(SetNodeParent)( Node* node, Node* parent );
+Node* TY_(SetNodePrev)( Node* node, Node* prev );
+Node* TY_(SetNodeNext)( Node* node, Node* next );
+Node* TY_(SetNodeContent)( Node* node, Node* content );
+Node* TY_(SetNodeLast)( Node* node, Node* last );
+AttVal* TY_(SetNodeAttrs)( Node* node, AttVal* attrs );
+const Dict* TY_(SetNodeTag)( Node* node, const Dict* tag );
+ctmbstr TY_(SetNodeElement)( Node* node, ctmbstr element );
+const Dict* TY_(SetNodeWas)( Node* node, const Dict* was );
+
+#endif /* SUPPORT_COMPACT_NODES */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __NODES_H__ */
@@ -26,32 +26,50 @@
 Bool TY_(CheckNodeIntegrity)(Node *node)
 {
 #ifndef NO_NODE_INTEGRITY_CHECK
-    Node *child;
+    Node *top = node;
 
-    if (node->prev)
+    /* walks the parent links as they are checked, not the C stack */
+    for (;;)
     {
-        if (node->prev->next != node)
-            return no;
-    }
+        if (NodePrev(node))
+        {
+            if (NodeNext(NodePrev(node)) != node)
+                return no;
+        }
 
-    if (node->next)
-    {
-        if (node->next == node || node->next->prev != node)
-            return no;
-    }
+        if (NodeNext(node))
+        {
+            if (NodeNext(node) == node || NodePrev(NodeNext(node)) != node)
+                return no;
+        }
 
-    if (node->parent)
-    {
-        if (node->prev == NULL && node->parent->content != node)
-            return no;
+        if (NodeParent(node))
+        {
+            if (NodePrev(node) == NULL && NodeContent(NodeParent(node)) != node)
+                return no;
 
-        if (node->next == NULL && node->parent->last != node)
-            return no;
-    }
+            if (NodeNext(node) == NULL && NodeLast(NodeParent(node)) != node)
+                return no;
+        }
+
+        if (NodeContent(node))
+        {
+            if (NodeParent(NodeContent(node)) != node)
+                return no;
+            node = NodeContent(node);
+            continue;
+        }
+
+        while (node != top && NodeNext(node) == NULL)
+            node = NodeParent(node);
+
+        if (node == top)
+            break;
 
-    for (child = node->content; child; child = child->next)
-        if ( child->parent != node || !TY_(CheckNodeIntegrity)(child) )
+        if (NodeParent(NodeNext(node)) != NodeParent(node))
             return no;
+        node = NodeNext(node);
+    }
 
 #endif
     return yes;
@@ -65,9 +83,9 @@ Bool TY_(CheckNodeIntegrity)(Node *node)
 */
 Bool TY_(IsNewNode)(Node *node)
 {
-    if (node && node->tag)
+    if (node && NodeTag(node))
     {
-        return (node->tag->model & CM_NEW);
+        return (NodeTag(node)->model & CM_NEW);
     }
     return yes;
 }
@@ -84,36 +102,39 @@ void TY_(CoerceNode)(TidyDocImpl* doc, Node *node, TidyTagId tid, Bool obsolete,
     else
         TY_(ReportNotice)(doc, node, tmp, REPLACING_ELEMENT);
 
-    TidyDocFree(doc, tmp->element);
-    TidyDocFree(doc, tmp);
+    TY_(FreeNode)(doc, tmp);
+
+    if (node->counted)
+        TY_(ResetAncestors)(doc);
 
-    node->was = node->tag;
-    node->tag = tag;
+    SetNodeWas(node, NodeTag(node));
+    SetNodeTag(node, tag);
     node->type = StartTag;
     node->implicit = yes;
-    TidyDocFree(doc, node->element);
-    node->element = TY_(tmbstrdup)(doc->allocator, tag->name);
+    SetNodeElement(node, tag->name);
 }
 
 /* extract a node and its children from a markup tree */
 Node *TY_(RemoveNode)(Node *node)
 {
-    if (node->prev)
-        node->prev->next = node->next;
+    if (NodePrev(node))
+        SetNodeNext(NodePrev(node), NodeNext(node));
 
-    if (node->next)
-        node->next->prev = node->prev;
+    if (NodeNext(node))
+        SetNodePrev(NodeNext(node), NodePrev(node));
 
-    if (node->parent)
+    if (NodeParent(node))
     {
-        if (node->parent->content == node)
-            node->parent->content = node->next;
+        if (NodeContent(NodeParent(node)) == node)
+            SetNodeContent(NodeParent(node), NodeNext(node));
 
-        if (node->parent->last == node)
-            node->parent->last = node->prev;
+        if (NodeLast(NodeParent(node)) == node)
+            SetNodeLast(NodeParent(node), NodePrev(node));
     }
 
-    node->parent = node->prev = node->next = NULL;
+    SetNodeParent(node, NULL);
+    SetNodePrev(node, NULL);
+    SetNodeNext(node, NULL);
     return node;
 }
 
@@ -124,7 +145,7 @@ Node *TY_(DiscardElement)( TidyDocImpl* doc, Node *element )
 
     if (element)
     {
-        next = element->next;
+        next = NodeNext(element);
         TY_(RemoveNode)(element);
         TY_(FreeNode)( doc, element);
     }
@@ -138,16 +159,16 @@ Node *TY_(DiscardElement)( TidyDocImpl* doc, Node *element )
 */
 void TY_(InsertNodeAtStart)(Node *element, Node *node)
 {
-    node->parent = element;
+    SetNodeParent(node, element);
 
-    if (element->content == NULL)
-        element->last = node;
+    if (NodeContent(element) == NULL)
+        SetNodeLast(element, node);
     else
-        element->content->prev = node;
+        SetNodePrev(NodeContent(element), node);
 
-    node->next = element->content;
-    node->prev = NULL;
-    element->content = node;
+    SetNodeNext(node, NodeContent(element));
+    SetNodePrev(node, NULL);
+    SetNodeContent(element, node);
 }
 
 /*
@@ -156,45 +177,48 @@ void TY_(InsertNodeAtStart)(Node *element, Node *node)
 */
 void TY_(InsertNodeAtEnd)(Node *element, Node *node)
 {
-    node->parent = element;
-    node->prev = element->last;
+    SetNodeParent(node, element);
+    SetNodePrev(node, NodeLast(element));
 
-    if (element->last != NULL)
-        element->last->next = node;
+    if (NodeLast(element) != NULL)
+        SetNodeNext(NodeLast(element), node);
     else
-        element->content = node;
+        SetNodeContent(element, node);
 
-    element->last = node;
+    SetNodeLast(element, node);
 }
 
 /*
  insert "node" into markup tree in place of "element"
  which is moved to become the child of the node
 */
-static void InsertNodeAsParent(Node *element, Node *node)
+static void InsertNodeAsParent(TidyDocImpl* doc, Node *element, Node *node)
 {
-    node->content = element;
-    node->last = element;
-    node->parent = element->parent;
-    element->parent = node;
+    if (element->counted)
+        TY_(ResetAncestors)(doc);
 
-    if (node->parent->content == element)
-        node->parent->content = node;
+    SetNodeContent(node, element);
+    SetNodeLast(node, element);
+    SetNodeParent(node, NodeParent(element));
+    SetNodeParent(element, node);
 
-    if (node->parent->last == element)
-        node->parent->last = node;
+    if (NodeContent(NodeParent(node)) == element)
+        SetNodeContent(NodeParent(node), node);
 
-    node->prev = element->prev;
-    element->prev = NULL;
+    if (NodeLast(NodeParent(node)) == element)
+        SetNodeLast(NodeParent(node), node);
 
-    if (node->prev)
-        node->prev->next = node;
+    SetNodePrev(node, NodePrev(element));
+    SetNodePrev(element, NULL);
 
-    node->next = element->next;
-    element->next = NULL;
+    if (NodePrev(node))
+        SetNodeNext(NodePrev(node), node);
 
-    if (node->next)
-        node->next->prev = node;
+    SetNodeNext(node, NodeNext(element));
+    SetNodeNext(element, NULL);
+
+    if (NodeNext(node))
+        SetNodePrev(NodeNext(node), node);
 }
 
 /* insert "node" into markup tree before "element" */
@@ -202,17 +226,17 @@ void TY_(InsertNodeBeforeElement)(Node *element, Node *node)
 {
     Node *parent;
 
-    parent = element->parent;
-    node->parent = parent;
-    node->next = element;
-    node->prev = element->prev;
-    element->prev = node;
+    parent = NodeParent(element);
+    SetNodeParent(node, parent);
+    SetNodeNext(node, element);
+    SetNodePrev(node, NodePrev(element));
+    SetNodePrev(element, node);
 
-    if (node->prev)
-        node->prev->next = node;
+    if (NodePrev(node))
+        SetNodeNext(NodePrev(node), node);
 
-    if (parent->content == element)
-        parent->content = node;
+    if (NodeContent(parent) == element)
+        SetNodeContent(parent, node);
 }
 
 /* insert "node" into markup tree after "element" */
@@ -220,22 +244,22 @@ void TY_(InsertNodeAfterElement)(Node *element, Node *node)
 {
     Node *parent;
 
-    parent = element->parent;
-    node->parent = parent;
+    parent = NodeParent(element);
+    SetNodeParent(node, parent);
 
     /* AQ - 13 Jan 2000 fix for parent == NULL */
-    if (parent != NULL && parent->last == element)
-        parent->last = node;
+    if (parent != NULL && NodeLast(parent) == element)
+        SetNodeLast(parent, node);
     else
     {
-        node->next = element->next;
+        SetNodeNext(node, NodeNext(element));
         /* AQ - 13 Jan 2000 fix for node->next == NULL */
-        if (node->next != NULL)
-            node->next->prev = node;
+        if (NodeNext(node) != NULL)
+            SetNodePrev(NodeNext(node), node);
     }
 
-    element->next = node;
-    node->prev = element;
+    SetNodeNext(element, node);
+    SetNodePrev(node, element);
 }
 
 static Bool CanPrune( TidyDocImpl* doc, Node *element )
@@ -243,25 +267,25 @@ static Bool CanPrune( TidyDocImpl* doc, Node *element )
     if ( TY_(nodeIsText)(element) )
         return yes;
 
-    if ( element->content )
+    if ( NodeContent(element) )
         return no;
 
-    if ( element->tag == NULL )
+    if ( NodeTag(element) == NULL )
         return no;
 
-    if ( element->tag->model & CM_BLOCK && element->attributes != NULL )
+    if ( NodeTag(element)->model & CM_BLOCK && NodeAttrs(element) != NULL )
         return no;
 
-    if ( nodeIsA(element) && element->attributes != NULL )
+    if ( nodeIsA(element) && NodeAttrs(element) != NULL )
         return no;
 
     if ( nodeIsP(element) && !cfgBool(doc, TidyDropEmptyParas) )
         return no;
 
-    if ( element->tag->model & CM_ROW )
+    if ( NodeTag(element)->model & CM_ROW )
         return no;
 
-    if ( element->tag->model & CM_EMPTY )
+    if ( NodeTag(element)->model & CM_EMPTY )
         return no;
 
     if ( nodeIsAPPLET(element) )
@@ -293,7 +317,7 @@ static Bool CanPrune( TidyDocImpl* doc, Node *element )
         return no;
 
     /* fix for bug 723772, don't trim new-...-tags */
-    if (element->tag->id == TidyTag_UNKNOWN)
+    if (NodeTag(element)->id == TidyTag_UNKNOWN)
         return no;
 
     if (nodeIsBODY(element))
@@ -315,32 +339,75 @@ Node *TY_(TrimEmptyElement)( TidyDocImpl* doc, Node *element )
 
         return TY_(DiscardElement)(doc, element);
     }
-    return element->next;
+    return NodeNext(element);
 }
 
-Node* TY_(DropEmptyElements)(TidyDocImpl* doc, Node* node)
+/*
+ The passes over the parsed tree below walk it through the
+ parent links rather than by recursion, like the parsers, so
+ they take no more stack for deeply nested documents.  Each
+ covers node, its following siblings and all of their content;
+ parent is node's parent, where the walk stops.
+*/
+
+/* the node after node, content before next siblings */
+Node* TY_(NextPreOrder)( Node *node, Node *parent )
 {
-    Node* next;
+    if ( NodeContent(node) )
+        return NodeContent(node);
 
-    while (node)
+    return TY_(NextPastContent)( node, parent );
+}
+
+/* the node after node, skipping its content */
+Node* TY_(NextPastContent)( Node *node, Node *parent )
+{
+    for ( ; node != parent; node = NodeParent(node) )
     {
-        next = node->next;
+        if ( NodeNext(node) )
+            return NodeNext(node);
+    }
+    return NULL;
+}
+
+Node* TY_(FirstLeaf)( Node *node )
+{
+    while ( NodeContent(node) )
+        node = NodeContent(node);
+    return node;
+}
+
+/* the node after node, content before the element it is in */
+Node* TY_(NextPostOrder)( Node *node, Node *parent )
+{
+    if ( NodeNext(node) )
+        return TY_(FirstLeaf)( NodeNext(node) );
+
+    node = NodeParent(node);
+    return ( node != parent ) ? node : NULL;
+}
+
+Node* TY_(DropEmptyElements)(TidyDocImpl* doc, Node* node)
+{
+    Node *parent, *next;
+
+    if (node == NULL)
+        return NULL;
 
-        if (node->content)
-            TY_(DropEmptyElements)(doc, node->content);
+    parent = NodeParent(node);
+
+    for (node = TY_(FirstLeaf)(node); node; node = next)
+    {
+        next = TY_(NextPostOrder)(node, parent);
 
         if (!TY_(nodeIsElement)(node) &&
             !(TY_(nodeIsText)(node) && !(node->start < node->end)))
-        {
-            node = next;
             continue;
-        }
 
-        next = TY_(TrimEmptyElement)(doc, node);
-        node = next;
+        TY_(TrimEmptyElement)(doc, node);
     }
 
-    return node;
+    return NULL;
 }
 
 /* 
@@ -372,7 +439,7 @@ static void TrimTrailingSpace( TidyDocImpl* doc, Node *element, Node *last )
     {
         if (last->end > last->start)
         {
-            c = (byte) lexer->lexbuf[ last->end - 1 ];
+            c = (byte) NodeText(lexer, last)[ NodeTextLen(last) - 1 ];
 
             if (   c == ' '
 #ifdef COMMENT_NBSP_FIX
@@ -383,8 +450,8 @@ static void TrimTrailingSpace( TidyDocImpl* doc, Node *element, Node *last )
 #ifdef COMMENT_NBSP_FIX
                 /* take care with <td>&nbsp;</td> */
                 if ( c == 160 && 
-                     ( element->tag == doc->tags.tag_td || 
-                       element->tag == doc->tags.tag_th )
+                     ( NodeTag(element) == doc->tags.tag_td || 
+                       NodeTag(element) == doc->tags.tag_th )
                    )
                 {
                     if (last->end > last->start + 1)
@@ -394,8 +461,8 @@ static void TrimTrailingSpace( TidyDocImpl* doc, Node *element, Node *last )
 #endif
                 {
                     last->end -= 1;
-                    if ( (element->tag->model & CM_INLINE) &&
-                         !(element->tag->model & CM_FIELD) )
+                    if ( (NodeTag(element)->model & CM_INLINE) &&
+                         !(NodeTag(element)->model & CM_FIELD) )
                         lexer->insertspace = yes;
                 }
             }
@@ -406,7 +473,7 @@ static void TrimTrailingSpace( TidyDocImpl* doc, Node *element, Node *last )
 #if 0
 static Node *EscapeTag(Lexer *lexer, Node *element)
 {
-    Node *node = NewNode(lexer->allocator, lexer);
+    Node *node = NewNode(lexer->nodeAllocator, lexer);
 
     node->start = lexer->lexsize;
     AddByte(lexer, '<');
@@ -422,10 +489,10 @@ static Node *EscapeTag(Lexer *lexer, Node *element)
     }
     else if (element->type == DocTypeTag)
     {
-        uint i;
+        size_t i;
         AddStringLiteral( lexer, "!DOCTYPE " );
         for (i = element->start; i < element->end; ++i)
-            AddByte(lexer, lexer->lexbuf[i]);
+            AddByte(lexer, *TY_(LexTextAt)(lexer, i));
     }
 
     if (element->type == StartEndTag)
@@ -445,7 +512,7 @@ Bool TY_(IsBlank)(Lexer *lexer, Node *node)
     if ( isBlank )
         isBlank = ( node->end == node->start ||       /* Zero length */
                     ( node->end == node->start+1      /* or one blank. */
-                      && lexer->lexbuf[node->start] == ' ' ) );
+                      && NodeText(lexer, node)[0] == ' ' ) );
     return isBlank;
 }
 
@@ -465,27 +532,30 @@ static void TrimInitialSpace( TidyDocImpl* doc, Node *element, Node *text )
     Node *prev, *node;
 
     if ( TY_(nodeIsText)(text) && 
-         lexer->lexbuf[text->start] == ' ' && 
-         text->start < text->end )
+         text->start < text->end &&
+         NodeText(lexer, text)[0] == ' ' )
     {
-        if ( (element->tag->model & CM_INLINE) &&
-             !(element->tag->model & CM_FIELD) )
+        if ( (NodeTag(element)->model & CM_INLINE) &&
+             !(NodeTag(element)->model & CM_FIELD) )
         {
-            prev = element->prev;
+            prev = NodePrev(element);
 
+            /* The bytes after prev and at element->start may be
+               other text by now, e.g. when mapped text has been
+               dropped, or in another segment, so add the space. */
             if (TY_(nodeIsText)(prev))
             {
-                if (prev->end == 0 || lexer->lexbuf[prev->end - 1] != ' ')
-                    lexer->lexbuf[(prev->end)++] = ' ';
-
-                ++(element->start);
+                if (prev->end == prev->start ||
+                    NodeText(lexer, prev)[NodeTextLen(prev) - 1] != ' ')
+                {
+                    TY_(OwnNodeText)(lexer, prev, yes);
+                    TY_(AddCharToLexer)(lexer, ' ');
+                    prev->end = lexer->lexsize;
+                }
             }
             else /* create new node */
             {
-                node = TY_(NewNode)(lexer->allocator, lexer);
-                node->start = (element->start)++;
-                node->end = element->start;
-                lexer->lexbuf[node->start] = ' ';
+                node = TY_(NewLiteralTextNode)( doc, " ");
                 TY_(InsertNodeBeforeElement)(element ,node);
             }
         }
@@ -495,20 +565,123 @@ static void TrimInitialSpace( TidyDocImpl* doc, Node *element, Node *text )
     }
 }
 
-static Bool IsPreDescendant(Node* node)
+/*
+  Whether an element is inside a form, a pre or a table is asked
+  as the parser moves from element to element, and by the passes
+  over the tree that follow.  The elements from the root down to
+  the last one asked about are kept on lexer->chain and counted by
+  tag, so moving to a child, a sibling or back up takes no walk up
+  the tree, which would make deeply nested documents quadratic.
+  Freeing a counted element forgets the chain, and so must
+  anything that moves one.
+*/
+static void CountAncestor( Lexer* lexer, Node* node, int n )
+{
+    node->counted = (n > 0);
+    if ( NodeTag(node) )
+    {
+        lexer->ancestors[ NodeTag(node)->id ] += n;
+        if ( NodeTag(node)->parser == TY_(ParsePre) )
+            lexer->preancestors += n;
+    }
+}
+
+void TY_(ResetAncestors)( TidyDocImpl* doc )
+{
+    Lexer* lexer = doc->lexer;
+
+    while ( lexer && lexer->nchain > 0 )
+        CountAncestor( lexer, lexer->chain[--lexer->nchain], -1 );
+}
+
+/* count node and the elements it is in */
+static void CountAncestors( TidyDocImpl* doc, Node* node )
 {
-    Node *parent = node->parent;
+    Lexer* lexer = doc->lexer;
+    Node* parent = node ? NodeParent(node) : NULL;
+    Node* top;
+    uint n;
 
-    while (parent)
+    /* back up to node or its parent */
+    while ( lexer->nchain > 0 )
     {
-        if (parent->tag && parent->tag->parser == TY_(ParsePre))
-            return yes;
+        top = lexer->chain[ lexer->nchain - 1 ];
+        if ( top == node || top == parent )
+            break;
+        CountAncestor( lexer, top, -1 );
+        --(lexer->nchain);
+    }
+
+    n = lexer->nchain;
+    if ( n > 0 && NodeParent(lexer->chain[n - 1]) == (n > 1 ? lexer->chain[n - 2] : NULL) )
+    {
+        if ( lexer->chain[n - 1] == node )
+            return;
+
+        if ( lexer->chain[n - 1] == parent )
+        {
+            if ( n == lexer->chainlength )
+            {
+                lexer->chainlength = 2 * lexer->chainlength;
+                lexer->chain = (Node**) TidyRealloc( lexer->allocator, lexer->chain,
+                                          sizeof(Node*) * lexer->chainlength );
+            }
+            lexer->chain[ lexer->nchain++ ] = node;
+            CountAncestor( lexer, node, 1 );
+            return;
+        }
+    }
+
+    /* the tree has changed under the chain, or node is elsewhere */
+    TY_(ResetAncestors)( doc );
+
+    for ( n = 0, top = node; top; top = NodeParent(top) )
+        ++n;
+
+    if ( n > lexer->chainlength )
+    {
+        lexer->chainlength = n > 16 ? n : 16;
+        lexer->chain = (Node**) TidyRealloc( lexer->allocator, lexer->chain,
+                                  sizeof(Node*) * lexer->chainlength );
+    }
 
-        parent = parent->parent;
+    lexer->nchain = n;
+    for ( top = node; top; top = NodeParent(top) )
+    {
+        lexer->chain[--n] = top;
+        CountAncestor( lexer, top, 1 );
     }
+}
+
+#if defined(_DEBUG)
+/* the walk up the tree that the counts stand in for */
+static Bool WalkDescendantOf( Node* node, TidyTagId tid, Bool pre )
+{
+    Node *parent;
 
+    for ( parent = NodeParent(node); parent; parent = NodeParent(parent) )
+    {
+        if ( NodeTag(parent) == NULL )
+            continue;
+        if ( pre ? NodeTag(parent)->parser == TY_(ParsePre)
+                 : NodeTag(parent)->id == tid )
+            return yes;
+    }
     return no;
 }
+#endif
+
+static Bool IsPreDescendant( TidyDocImpl* doc, Node* node )
+{
+    Bool result;
+
+    CountAncestors( doc, NodeParent(node) );
+    result = ( doc->lexer->preancestors > 0 );
+#if defined(_DEBUG)
+    assert( result == WalkDescendantOf(node, TidyTag_UNKNOWN, yes) );
+#endif
+    return result;
+}
 
 static Bool CleanTrailingWhitespace(TidyDocImpl* doc, Node* node)
 {
@@ -517,23 +690,23 @@ static Bool CleanTrailingWhitespace(TidyDocImpl* doc, Node* node)
     if (!TY_(nodeIsText)(node))
         return no;
 
-    if (node->parent->type == DocTypeTag)
+    if (NodeParent(node)->type == DocTypeTag)
         return no;
 
-    if (IsPreDescendant(node))
+    if (IsPreDescendant(doc, node))
         return no;
 
-    if (node->parent->tag && node->parent->tag->parser == TY_(ParseScript))
+    if (NodeTag(NodeParent(node)) && NodeTag(NodeParent(node))->parser == TY_(ParseScript))
         return no;
 
-    next = node->next;
+    next = NodeNext(node);
 
     /* <p>... </p> */
-    if (!next && !TY_(nodeHasCM)(node->parent, CM_INLINE))
+    if (!next && !TY_(nodeHasCM)(NodeParent(node), CM_INLINE))
         return yes;
 
     /* <div><small>... </small><h3>...</h3></div> */
-    if (!next && node->parent->next && !TY_(nodeHasCM)(node->parent->next, CM_INLINE))
+    if (!next && NodeNext(NodeParent(node)) && !TY_(nodeHasCM)(NodeNext(NodeParent(node)), CM_INLINE))
         return yes;
 
     if (!next)
@@ -555,41 +728,41 @@ static Bool CleanTrailingWhitespace(TidyDocImpl* doc, Node* node)
 
     /* evil adjacent text nodes, Tidy should not generate these :-( */
     if (TY_(nodeIsText)(next) && next->start < next->end
-        && TY_(IsWhite)(doc->lexer->lexbuf[next->start]))
+        && TY_(IsWhite)(NodeText(doc->lexer, next)[0]))
         return yes;
 
     return no;
 }
 
-static Bool CleanLeadingWhitespace(TidyDocImpl* ARG_UNUSED(doc), Node* node)
+static Bool CleanLeadingWhitespace(TidyDocImpl* doc, Node* node)
 {
     if (!TY_(nodeIsText)(node))
         return no;
 
-    if (node->parent->type == DocTypeTag)
+    if (NodeParent(node)->type == DocTypeTag)
         return no;
 
-    if (IsPreDescendant(node))
+    if (IsPreDescendant(doc, node))
         return no;
 
-    if (node->parent->tag && node->parent->tag->parser == TY_(ParseScript))
+    if (NodeTag(NodeParent(node)) && NodeTag(NodeParent(node))->parser == TY_(ParseScript))
         return no;
 
     /* <p>...<br> <em>...</em>...</p> */
-    if (nodeIsBR(node->prev))
+    if (nodeIsBR(NodePrev(node)))
         return yes;
 
     /* <p> ...</p> */
-    if (node->prev == NULL && !TY_(nodeHasCM)(node->parent, CM_INLINE))
+    if (NodePrev(node) == NULL && !TY_(nodeHasCM)(NodeParent(node), CM_INLINE))
         return yes;
 
     /* <h4>...</h4> <em>...</em> */
-    if (node->prev && !TY_(nodeHasCM)(node->prev, CM_INLINE) &&
-        TY_(nodeIsElement)(node->prev))
+    if (NodePrev(node) && !TY_(nodeHasCM)(NodePrev(node), CM_INLINE) &&
+        TY_(nodeIsElement)(NodePrev(node)))
         return yes;
 
     /* <p><span> ...</span></p> */
-    if (!node->prev && !node->parent->prev && !TY_(nodeHasCM)(node->parent->parent, CM_INLINE))
+    if (!NodePrev(node) && !NodePrev(NodeParent(node)) && !TY_(nodeHasCM)(NodeParent(NodeParent(node)), CM_INLINE))
         return yes;
 
     return no;
@@ -597,33 +770,35 @@ static Bool CleanLeadingWhitespace(TidyDocImpl* ARG_UNUSED(doc), Node* node)
 
 static void CleanSpaces(TidyDocImpl* doc, Node* node)
 {
-    Node* next;
+    Node *parent = node ? NodeParent(node) : NULL;
+    Node *next;
 
-    while (node)
+    for ( ; node; node = next)
     {
-        next = node->next;
 
         if (TY_(nodeIsText)(node) && CleanLeadingWhitespace(doc, node))
-            while (node->start < node->end && TY_(IsWhite)(doc->lexer->lexbuf[node->start]))
-                ++(node->start);
+        {
+            ctmbstr text = NodeText(doc->lexer, node);
+            while (node->start < node->end && TY_(IsWhite)(*text))
+                ++text, ++(node->start);
+        }
 
         if (TY_(nodeIsText)(node) && CleanTrailingWhitespace(doc, node))
-            while (node->end > node->start && TY_(IsWhite)(doc->lexer->lexbuf[node->end - 1]))
+        {
+            ctmbstr text = NodeText(doc->lexer, node);
+            while (node->end > node->start &&
+                   TY_(IsWhite)(text[NodeTextLen(node) - 1]))
                 --(node->end);
+        }
+
+        /* text has no content, so it can go once past it */
+        next = TY_(NextPreOrder)(node, parent);
 
         if (TY_(nodeIsText)(node) && !(node->start < node->end))
         {
             TY_(RemoveNode)(node);
             TY_(FreeNode)(doc, node);
-            node = next;
-
-            continue;
         }
-
-        if (node->content)
-            CleanSpaces(doc, node->content);
-
-        node = next;
     }
 }
 
@@ -641,28 +816,48 @@ static void CleanSpaces(TidyDocImpl* doc, Node* node)
 */
 static void TrimSpaces( TidyDocImpl* doc, Node *element)
 {
-    Node* text = element->content;
+    Node* text = NodeContent(element);
 
-    if (nodeIsPRE(element) || IsPreDescendant(element))
+    if (nodeIsPRE(element) || IsPreDescendant(doc, element))
         return;
 
     if (TY_(nodeIsText)(text))
         TrimInitialSpace(doc, element, text);
 
-    text = element->last;
+    text = NodeLast(element);
 
     if (TY_(nodeIsText)(text))
         TrimTrailingSpace(doc, element, text);
 }
 
-static Bool DescendantOf( Node *element, TidyTagId tid )
+static Bool DescendantOf( TidyDocImpl* doc, Node *element, TidyTagId tid )
+{
+    Bool result;
+
+    CountAncestors( doc, NodeParent(element) );
+    result = ( doc->lexer->ancestors[tid] > 0 );
+#if defined(_DEBUG)
+    assert( result == WalkDescendantOf(element, tid, no) );
+#endif
+    return result;
+}
+
+/* as DescendantOf(), but unknown tags are told apart */
+static Bool DescendantOfTag( TidyDocImpl* doc, Node *element, const Dict* tag )
 {
     Node *parent;
-    for ( parent = element->parent;
+
+    if ( tag && !DescendantOf(doc, element, tag->id) )
+        return no;
+
+    if ( tag && tag->id != TidyTag_UNKNOWN )
+        return yes;
+
+    for ( parent = NodeParent(element);
           parent != NULL;
-          parent = parent->parent )
+          parent = NodeParent(parent) )
     {
-        if ( TagIsId(parent, tid) )
+        if ( NodeTag(parent) == tag )
             return yes;
     }
     return no;
@@ -685,9 +880,9 @@ static Bool InsertMisc(Node *element, Node *node)
     if ( node->type == XmlDecl )
     {
         Node* root = element;
-        while ( root && root->parent )
-            root = root->parent;
-        if ( root && !(root->content && root->content->type == XmlDecl))
+        while ( root && NodeParent(root) )
+            root = NodeParent(root);
+        if ( root && !(NodeContent(root) && NodeContent(root)->type == XmlDecl))
         {
           TY_(InsertNodeAtStart)( root, node );
           return yes;
@@ -698,10 +893,10 @@ static Bool InsertMisc(Node *element, Node *node)
     ** the cracks.  This is an experiment to figure out
     ** a decent place to pick them up.
     */
-    if ( node->tag &&
+    if ( NodeTag(node) &&
          TY_(nodeIsElement)(node) &&
          TY_(nodeCMIsEmpty)(node) && TagId(node) == TidyTag_UNKNOWN &&
-         (node->tag->versions & VERS_PROPRIETARY) != 0 )
+         (NodeTag(node)->versions & VERS_PROPRIETARY) != 0 )
     {
         TY_(InsertNodeAtEnd)(element, node);
         return yes;
@@ -711,29 +906,130 @@ static Bool InsertMisc(Node *element, Node *node)
 }
 
 
-static void ParseTag( TidyDocImpl* doc, Node *node, GetTokenMode mode )
+/* the parser for node's content, NULL if there is none to parse */
+static Parser* TagParser( TidyDocImpl* doc, Node *node )
 {
     Lexer* lexer = doc->lexer;
     /*
-       Fix by GLP 2000-12-21.  Need to reset insertspace if this 
+       Fix by GLP 2000-12-21.  Need to reset insertspace if this
        is both a non-inline and empty tag (base, link, meta, isindex, hr, area).
     */
-    if (node->tag->model & CM_EMPTY)
+    if (NodeTag(node)->model & CM_EMPTY)
     {
         lexer->waswhite = no;
-        if (node->tag->parser == NULL)
-            return;
+        if (NodeTag(node)->parser == NULL)
+            return NULL;
     }
-    else if (!(node->tag->model & CM_INLINE))
+    else if (!(NodeTag(node)->model & CM_INLINE))
         lexer->insertspace = no;
 
-    if (node->tag->parser == NULL)
-        return;
+    if (NodeTag(node)->parser == NULL)
+        return NULL;
 
     if (node->type == StartEndTag)
-        return;
+        return NULL;
+
+    return NodeTag(node)->parser;
+}
+
+static void PushFrame( TidyDocImpl* doc, Parser* parser, Node *element,
+                       GetTokenMode mode )
+{
+    Lexer* lexer = doc->lexer;
+    ParseFrame* frame;
+
+    if (lexer->nframes == lexer->frameslength)
+    {
+        lexer->frameslength = lexer->frameslength ? 2 * lexer->frameslength : 16;
+        lexer->frames = (ParseFrame*) TidyRealloc( lexer->allocator, lexer->frames,
+                                        sizeof(ParseFrame) * lexer->frameslength );
+    }
+
+    frame = &lexer->frames[ lexer->nframes++ ];
+    TidyClearMemory( frame, sizeof(ParseFrame) );
+    frame->parser = parser;
+    frame->element = element;
+    frame->mode = mode;
+    frame->state = ParseStart;
+}
+
+/*
+ runs the parser in each frame above base until it returns
+ NULL.  A parser returning a child gets a frame for it above
+ its own, so nothing here recurses.  Returns no, keeping the
+ frames, if the input given to tidyParseChunk() ran out; the
+ frames then carry on from there when called again.
+*/
+static Bool RunFrames( TidyDocImpl* doc, uint base )
+{
+    Lexer* lexer = doc->lexer;
+    ParseFrame* frame;
+    Parser* parser;
+    Node *child;
+
+    while (lexer->nframes > base)
+    {
+        frame = &lexer->frames[ lexer->nframes - 1 ];
+        child = (*frame->parser)( doc, frame );
+
+        if (child == NULL)
+        {
+            if (lexer->suspended)
+                return no;
+            --lexer->nframes;
+        }
+        else if (frame->childparser)
+            PushFrame( doc, frame->childparser, child, frame->childmode );
+        else if ((parser = TagParser(doc, child)) != NULL)
+            PushFrame( doc, parser, child, frame->childmode );
+    }
+    return yes;
+}
+
+/*
+ parses the content of element with parser, and that of
+ the elements in it, as RunFrames()
+*/
+static Bool ParseElement( TidyDocImpl* doc, Parser* parser, Node *element,
+                          GetTokenMode mode )
+{
+    uint base = doc->lexer->nframes;
+    PushFrame( doc, parser, element, mode );
+    return RunFrames( doc, base );
+}
 
-    (*node->tag->parser)( doc, node, mode );
+/*
+ the input given to tidyParseChunk() has run out before the
+ next token, so the parser is to carry on at state when
+ called again with more
+*/
+static Node* Suspend( ParseFrame* frame, ParseState state )
+{
+    frame->state = state;
+    return NULL;
+}
+
+/*
+ returns child for its content to be parsed next, and the
+ parser to be called again at state when that is done
+*/
+static Node* ParseChild( ParseFrame* frame, Node *child, GetTokenMode mode,
+                         ParseState state )
+{
+    frame->child = child;
+    frame->childparser = NULL;
+    frame->childmode = mode;
+    frame->state = state;
+    return child;
+}
+
+/* as ParseChild() but with the given parser, whatever child's tag */
+static Node* ParseChildWith( ParseFrame* frame, Parser* parser, Node *child,
+                             GetTokenMode mode, ParseState state )
+{
+    ParseChild( frame, child, mode, state );
+    frame->childparser = parser;
+    return child;
 }
 
 /*
@@ -752,19 +1048,23 @@ static void InsertDocType( TidyDocImpl* doc, Node *element, Node *doctype )
     {
         TY_(ReportError)(doc, element, doctype, DOCTYPE_AFTER_TAGS );
         while ( !nodeIsHTML(element) )
-            element = element->parent;
+            element = NodeParent(element);
         TY_(InsertNodeBeforeElement)( element, doctype );
     }
 }
 
 /*
  move node to the head, where element is used as starting
- point in hunt for head. normally called during parsing
+ point in hunt for head. normally called during parsing.
+ returns yes if node's content is then to be parsed
 */
-static void MoveToHead( TidyDocImpl* doc, Node *element, Node *node )
+static Bool MoveToHead( TidyDocImpl* doc, Node *element, Node *node )
 {
     Node *head;
 
+    if ( node->counted )
+        TY_(ResetAncestors)( doc );
+
     TY_(RemoveNode)( node );  /* make sure that node is isolated */
 
     if ( TY_(nodeIsElement)(node) )
@@ -776,14 +1076,12 @@ static void MoveToHead( TidyDocImpl* doc, Node *element, Node *node )
 
         TY_(InsertNodeAtEnd)(head, node);
 
-        if ( node->tag->parser )
-            ParseTag( doc, node, IgnoreWhitespace );
-    }
-    else
-    {
-        TY_(ReportError)(doc, element, node, DISCARDING_UNEXPECTED);
-        TY_(FreeNode)( doc, node );
+        return ( NodeTag(node)->parser != NULL );
     }
+
+    TY_(ReportError)(doc, element, node, DISCARDING_UNEXPECTED);
+    TY_(FreeNode)( doc, node );
+    return no;
 }
 
 /* moves given node to end of body element */
@@ -815,61 +1113,64 @@ static void AddClassNoIndent( TidyDocImpl* doc, Node *node )
    upon seeing the start tag, or by the
    parser when the start tag is inferred
 */
-void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
+Node* TY_(ParseBlock)( TidyDocImpl* doc, ParseFrame* frame )
 {
     Lexer* lexer = doc->lexer;
+    Node *element = frame->element;
     Node *node;
-    Bool checkstack = yes;
-    uint istackbase = 0;
 
-    if ( element->tag->model & CM_EMPTY )
-        return;
+    if ( frame->state == ParseStart )
+    {
+        if ( NodeTag(element)->model & CM_EMPTY )
+            return NULL;
 
-    if ( nodeIsFORM(element) && 
-         DescendantOf(element, TidyTag_FORM) )
-        TY_(ReportError)(doc, element, NULL, ILLEGAL_NESTING );
+        if ( nodeIsFORM(element) && 
+             DescendantOf(doc, element, TidyTag_FORM) )
+            TY_(ReportError)(doc, element, NULL, ILLEGAL_NESTING );
 
-    /*
-     InlineDup() asks the lexer to insert inline emphasis tags
-     currently pushed on the istack, but take care to avoid
-     propagating inline emphasis inside OBJECT or APPLET.
-     For these elements a fresh inline stack context is created
-     and disposed of upon reaching the end of the element.
-     They thus behave like table cells in this respect.
-    */
-    if (element->tag->model & CM_OBJECT)
-    {
-        istackbase = lexer->istackbase;
-        lexer->istackbase = lexer->istacksize;
-    }
+        /*
+         InlineDup() asks the lexer to insert inline emphasis tags
+         currently pushed on the istack, but take care to avoid
+         propagating inline emphasis inside OBJECT or APPLET.
+         For these elements a fresh inline stack context is created
+         and disposed of upon reaching the end of the element.
+         They thus behave like table cells in this respect.
+        */
+        if (NodeTag(element)->model & CM_OBJECT)
+        {
+            frame->istackbase = lexer->istackbase;
+            lexer->istackbase = lexer->istacksize;
+        }
 
-    if (!(element->tag->model & CM_MIXED))
-        TY_(InlineDup)( doc, NULL );
+        if (!(NodeTag(element)->model & CM_MIXED))
+            TY_(InlineDup)( doc, NULL );
 
-    mode = IgnoreWhitespace;
+        frame->mode = IgnoreWhitespace;
+        frame->checkstack = yes;
+    }
 
-    while ((node = TY_(GetToken)(doc, mode /*MixedContent*/)) != NULL)
+    while ((node = TY_(GetToken)(doc, frame->mode /*MixedContent*/)) != NULL)
     {
         /* end tag for this element */
-        if (node->type == EndTag && node->tag &&
-            (node->tag == element->tag || element->was == node->tag))
+        if (node->type == EndTag && NodeTag(node) &&
+            (NodeTag(node) == NodeTag(element) || NodeWas(element) == NodeTag(node)))
         {
             TY_(FreeNode)( doc, node );
 
-            if (element->tag->model & CM_OBJECT)
+            if (NodeTag(element)->model & CM_OBJECT)
             {
                 /* pop inline stack */
                 while (lexer->istacksize > lexer->istackbase)
                     TY_(PopInline)( doc, NULL );
-                lexer->istackbase = istackbase;
+                lexer->istackbase = frame->istackbase;
             }
 
             element->closed = yes;
             TrimSpaces( doc, element );
-            return;
+            return NULL;
         }
 
-        if ( nodeIsBODY( node ) && DescendantOf( element, TidyTag_HEAD ))
+        if ( nodeIsBODY( node ) && DescendantOf( doc, element, TidyTag_HEAD ))
         {
             /*  If we're in the HEAD, close it before proceeding.
                 This is an extremely rare occurance, but has been observed.
@@ -889,7 +1190,7 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
 
         if (node->type == EndTag)
         {
-            if (node->tag == NULL)
+            if (NodeTag(node) == NULL)
             {
                 TY_(ReportError)(doc, element, node, DISCARDING_UNEXPECTED );
                 TY_(FreeNode)( doc, node );
@@ -914,7 +1215,7 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
                 node = InferredTag(doc, TidyTag_BR);
 #endif
             }
-            else if (DescendantOf( element, node->tag->id ))
+            else if (DescendantOf( doc, element, NodeTag(node)->id ))
             {
                 /* 
                   if this is the end tag for an ancestor element
@@ -924,27 +1225,27 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
                 break;
 #if OBSOLETE
                 Node *parent;
-                for ( parent = element->parent;
+                for ( parent = NodeParent(element);
                       parent != NULL; 
-                      parent = parent->parent )
+                      parent = NodeParent(parent) )
                 {
-                    if (node->tag == parent->tag)
+                    if (NodeTag(node) == NodeTag(parent))
                     {
-                        if (!(element->tag->model & CM_OPT))
+                        if (!(NodeTag(element)->model & CM_OPT))
                             TY_(ReportError)(doc, element, node, MISSING_ENDTAG_BEFORE );
 
                         TY_(UngetToken)( doc );
 
-                        if (element->tag->model & CM_OBJECT)
+                        if (NodeTag(element)->model & CM_OBJECT)
                         {
                             /* pop inline stack */
                             while (lexer->istacksize > lexer->istackbase)
                                 TY_(PopInline)( doc, NULL );
-                            lexer->istackbase = istackbase;
+                            lexer->istackbase = frame->istackbase;
                         }
 
                         TrimSpaces( doc, element );
-                        return;
+                        return NULL;
                     }
                 }
 #endif
@@ -957,7 +1258,7 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
                 {
                     TY_(UngetToken)( doc );
                     TrimSpaces( doc, element );
-                    return;
+                    return NULL;
                 }
             }
         }
@@ -965,10 +1266,10 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
         /* mixed content model permits text */
         if (TY_(nodeIsText)(node))
         {
-            if ( checkstack )
+            if ( frame->checkstack )
             {
-                checkstack = no;
-                if (!(element->tag->model & CM_MIXED))
+                frame->checkstack = no;
+                if (!(NodeTag(element)->model & CM_MIXED))
                 {
                     if ( TY_(InlineDup)(doc, node) > 0 )
                         continue;
@@ -976,7 +1277,7 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
             }
 
             TY_(InsertNodeAtEnd)(element, node);
-            mode = MixedContent;
+            frame->mode = MixedContent;
 
             /*
               HTML4 strict doesn't allow mixed content for
@@ -1029,7 +1330,7 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
         }
 
         /* ignore unknown start/end tags */
-        if ( node->tag == NULL )
+        if ( NodeTag(node) == NULL )
         {
             TY_(ReportError)(doc, element, node, DISCARDING_UNEXPECTED );
             TY_(FreeNode)( doc, node );
@@ -1094,7 +1395,9 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
 
                 if ( TY_(nodeHasCM)(node, CM_HEAD) )
                 {
-                    MoveToHead( doc, element, node );
+                    if ( MoveToHead(doc, element, node) )
+                        return ParseChild( frame, node, IgnoreWhitespace,
+                                           ParseContent );
                     continue;
                 }
 
@@ -1117,7 +1420,7 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
                 {
                     TY_(UngetToken)( doc );
                     TrimSpaces( doc, element );
-                    return;
+                    return NULL;
                 }
             }
             else if ( TY_(nodeHasCM)(node, CM_BLOCK) )
@@ -1130,17 +1433,19 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
                     TY_(UngetToken)( doc );
 
                     if ( TY_(nodeHasCM)(element, CM_OBJECT) )
-                        lexer->istackbase = istackbase;
+                        lexer->istackbase = frame->istackbase;
 
                     TrimSpaces( doc, element );
-                    return;
+                    return NULL;
                 }
             }
             else /* things like list items */
             {
-                if (node->tag->model & CM_HEAD)
+                if (NodeTag(node)->model & CM_HEAD)
                 {
-                    MoveToHead( doc, element, node );
+                    if ( MoveToHead(doc, element, node) )
+                        return ParseChild( frame, node, IgnoreWhitespace,
+                                           ParseContent );
                     continue;
                 }
 
@@ -1150,8 +1455,8 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
                 */
 
                 if ( nodeIsFORM(element) &&
-                     nodeIsTD(element->parent) &&
-                     element->parent->implicit )
+                     nodeIsTD(NodeParent(element)) &&
+                     NodeParent(element)->implicit )
                 {
                     if ( nodeIsTD(node) )
                     {
@@ -1164,10 +1469,11 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
                     {
                         TY_(ReportError)(doc, element, node, DISCARDING_UNEXPECTED );
                         TY_(FreeNode)( doc, node );
-                        node = element->parent;
-                        TidyDocFree(doc, node->element);
-                        node->element = TY_(tmbstrdup)(doc->allocator, "th");
-                        node->tag = TY_(LookupTagDef)( TidyTag_TH );
+                        node = NodeParent(element);
+                        if ( node->counted )
+                            TY_(ResetAncestors)( doc );
+                        SetNodeTag(node, TY_(LookupTagDef)( TidyTag_TH ));
+                        SetNodeElement(node, NodeTag(node)->name);
                         continue;
                     }
                 }
@@ -1179,11 +1485,11 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
 
                 if ( TY_(nodeHasCM)(node, CM_LIST) )
                 {
-                    if ( element->parent && element->parent->tag &&
-                         element->parent->tag->parser == TY_(ParseList) )
+                    if ( NodeParent(element) && NodeTag(NodeParent(element)) &&
+                         NodeTag(NodeParent(element))->parser == TY_(ParseList) )
                     {
                         TrimSpaces( doc, element );
-                        return;
+                        return NULL;
                     }
 
                     node = TY_(InferredTag)(doc, TidyTag_UL);
@@ -1191,10 +1497,10 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
                 }
                 else if ( TY_(nodeHasCM)(node, CM_DEFLIST) )
                 {
-                    if ( nodeIsDL(element->parent) )
+                    if ( nodeIsDL(NodeParent(element)) )
                     {
                         TrimSpaces( doc, element );
-                        return;
+                        return NULL;
                     }
 
                     node = TY_(InferredTag)(doc, TidyTag_DL);
@@ -1205,7 +1511,7 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
                     /* In exiled mode, return so table processing can 
                        continue. */
                     if (lexer->exiled)
-                        return;
+                        return NULL;
                     node = TY_(InferredTag)(doc, TidyTag_TABLE);
                 }
                 else if ( TY_(nodeHasCM)(element, CM_OBJECT) )
@@ -1213,15 +1519,15 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
                     /* pop inline stack */
                     while ( lexer->istacksize > lexer->istackbase )
                         TY_(PopInline)( doc, NULL );
-                    lexer->istackbase = istackbase;
+                    lexer->istackbase = frame->istackbase;
                     TrimSpaces( doc, element );
-                    return;
+                    return NULL;
 
                 }
                 else
                 {
                     TrimSpaces( doc, element );
-                    return;
+                    return NULL;
                 }
             }
         }
@@ -1229,25 +1535,25 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
         /* parse known element */
         if (TY_(nodeIsElement)(node))
         {
-            if (node->tag->model & CM_INLINE)
+            if (NodeTag(node)->model & CM_INLINE)
             {
-                if (checkstack && !node->implicit)
+                if (frame->checkstack && !node->implicit)
                 {
-                    checkstack = no;
+                    frame->checkstack = no;
 
-                    if (!(element->tag->model & CM_MIXED)) /* #431731 - fix by Randy Waki 25 Dec 00 */
+                    if (!(NodeTag(element)->model & CM_MIXED)) /* #431731 - fix by Randy Waki 25 Dec 00 */
                     {
                         if ( TY_(InlineDup)(doc, node) > 0 )
                             continue;
                     }
                 }
 
-                mode = MixedContent;
+                frame->mode = MixedContent;
             }
             else
             {
-                checkstack = yes;
-                mode = IgnoreWhitespace;
+                frame->checkstack = yes;
+                frame->mode = IgnoreWhitespace;
             }
 
             /* trim white space before <br> */
@@ -1259,8 +1565,8 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
             if (node->implicit)
                 TY_(ReportError)(doc, element, node, INSERTING_TAG );
 
-            ParseTag( doc, node, IgnoreWhitespace /*MixedContent*/ );
-            continue;
+            return ParseChild( frame, node, IgnoreWhitespace /*MixedContent*/,
+                               ParseContent );
         }
 
         /* discard unexpected tags */
@@ -1272,65 +1578,74 @@ void TY_(ParseBlock)( TidyDocImpl* doc, Node *element, GetTokenMode mode)
         continue;
     }
 
-    if (!(element->tag->model & CM_OPT))
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
+    if (!(NodeTag(element)->model & CM_OPT))
         TY_(ReportError)(doc, element, node, MISSING_ENDTAG_FOR);
 
-    if (element->tag->model & CM_OBJECT)
+    if (NodeTag(element)->model & CM_OBJECT)
     {
         /* pop inline stack */
         while ( lexer->istacksize > lexer->istackbase )
             TY_(PopInline)( doc, NULL );
-        lexer->istackbase = istackbase;
+        lexer->istackbase = frame->istackbase;
     }
 
     TrimSpaces( doc, element );
+    return NULL;
 }
 
-void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
+Node* TY_(ParseInline)( TidyDocImpl* doc, ParseFrame* frame )
 {
     Lexer* lexer = doc->lexer;
-    Node *node, *parent;
-
-    if (element->tag->model & CM_EMPTY)
-        return;
-
-    /*
-     ParseInline is used for some block level elements like H1 to H6
-     For such elements we need to insert inline emphasis tags currently
-     on the inline stack. For Inline elements, we normally push them
-     onto the inline stack provided they aren't implicit or OBJECT/APPLET.
-     This test is carried out in PushInline and PopInline, see istack.c
+    Node *element = frame->element;
+    GetTokenMode mode = frame->mode;
+    Node *node;
 
-     InlineDup(...) is not called for elements with a CM_MIXED (inline and
-     block) content model, e.g. <del> or <ins>, otherwise constructs like 
+    if ( frame->state == ParseStart )
+    {
+        if (NodeTag(element)->model & CM_EMPTY)
+            return NULL;
 
-       <p>111<a name='foo'>222<del>333</del>444</a>555</p>
-       <p>111<span>222<del>333</del>444</span>555</p>
-       <p>111<em>222<del>333</del>444</em>555</p>
+        /*
+         ParseInline is used for some block level elements like H1 to H6
+         For such elements we need to insert inline emphasis tags currently
+         on the inline stack. For Inline elements, we normally push them
+         onto the inline stack provided they aren't implicit or OBJECT/APPLET.
+         This test is carried out in PushInline and PopInline, see istack.c
 
-     will get corrupted.
-    */
-    if ((TY_(nodeHasCM)(element, CM_BLOCK) || nodeIsDT(element)) &&
-        !TY_(nodeHasCM)(element, CM_MIXED))
-        TY_(InlineDup)(doc, NULL);
-    else if (TY_(nodeHasCM)(element, CM_INLINE))
-        TY_(PushInline)(doc, element);
+         InlineDup(...) is not called for elements with a CM_MIXED (inline and
+         block) content model, e.g. <del> or <ins>, otherwise constructs like 
 
-    if ( nodeIsNOBR(element) )
-        doc->badLayout |= USING_NOBR;
-    else if ( nodeIsFONT(element) )
-        doc->badLayout |= USING_FONT;
+           <p>111<a name='foo'>222<del>333</del>444</a>555</p>
+           <p>111<span>222<del>333</del>444</span>555</p>
+           <p>111<em>222<del>333</del>444</em>555</p>
 
-    /* Inline elements may or may not be within a preformatted element */
-    if (mode != Preformatted)
-        mode = MixedContent;
+         will get corrupted.
+        */
+        if ((TY_(nodeHasCM)(element, CM_BLOCK) || nodeIsDT(element)) &&
+            !TY_(nodeHasCM)(element, CM_MIXED))
+            TY_(InlineDup)(doc, NULL);
+        else if (TY_(nodeHasCM)(element, CM_INLINE))
+            TY_(PushInline)(doc, element);
+
+        if ( nodeIsNOBR(element) )
+            doc->badLayout |= USING_NOBR;
+        else if ( nodeIsFONT(element) )
+            doc->badLayout |= USING_FONT;
+
+        /* Inline elements may or may not be within a preformatted element */
+        if (mode != Preformatted)
+            mode = frame->mode = MixedContent;
+    }
 
     while ((node = TY_(GetToken)(doc, mode)) != NULL)
     {
         /* end tag for current element */
-        if (node->tag == element->tag && node->type == EndTag)
+        if (NodeTag(node) == NodeTag(element) && node->type == EndTag)
         {
-            if (element->tag->model & CM_INLINE)
+            if (NodeTag(element)->model & CM_INLINE)
                 TY_(PopInline)( doc, node );
 
             TY_(FreeNode)( doc, node );
@@ -1344,23 +1659,26 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
              otherwise it won't alter the anchor text color
             */
             if ( nodeIsFONT(element) && 
-                 element->content && element->content == element->last )
+                 NodeContent(element) && NodeContent(element) == NodeLast(element) )
             {
-                Node *child = element->content;
+                Node *child = NodeContent(element);
 
                 if ( nodeIsA(child) )
                 {
-                    child->parent = element->parent;
-                    child->next = element->next;
-                    child->prev = element->prev;
+                    if (element->counted)
+                        TY_(ResetAncestors)(doc);
+
+                    SetNodeParent(child, NodeParent(element));
+                    SetNodeNext(child, NodeNext(element));
+                    SetNodePrev(child, NodePrev(element));
 
-                    element->next = NULL;
-                    element->prev = NULL;
-                    element->parent = child;
+                    SetNodeNext(element, NULL);
+                    SetNodePrev(element, NULL);
+                    SetNodeParent(element, child);
 
-                    element->content = child->content;
-                    element->last = child->last;
-                    child->content = element;
+                    SetNodeContent(element, NodeContent(child));
+                    SetNodeLast(element, NodeLast(child));
+                    SetNodeContent(child, element);
 
                     TY_(FixNodeLinks)(child);
                     TY_(FixNodeLinks)(element);
@@ -1369,7 +1687,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
 
             element->closed = yes;
             TrimSpaces( doc, element );
-            return;
+            return NULL;
         }
 
         /* <u>...<u>  map 2nd <u> to </u> if 1st is explicit */
@@ -1377,11 +1695,11 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
         /* otherwise emphasis nesting is probably unintentional */
         /* big, small, sub, sup have cumulative effect to leave them alone */
         if ( node->type == StartTag
-             && node->tag == element->tag
+             && NodeTag(node) == NodeTag(element)
              && TY_(IsPushed)( doc, node )
              && !node->implicit
              && !element->implicit
-             && node->tag && (node->tag->model & CM_INLINE)
+             && NodeTag(node) && (NodeTag(node)->model & CM_INLINE)
              && !nodeIsA(node)
              && !nodeIsFONT(node)
              && !nodeIsBIG(node)
@@ -1394,9 +1712,9 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
         {
             /* proceeds only if "node" does not have any attribute and
                follows a text node not finishing with a space */
-            if (element->content != NULL && node->attributes == NULL
-                && TY_(nodeIsText)(element->last)
-                && !TY_(TextNodeEndWithSpace)(doc->lexer, element->last) )
+            if (NodeContent(element) != NULL && NodeAttrs(node) == NULL
+                && TY_(nodeIsText)(NodeLast(element))
+                && !TY_(TextNodeEndWithSpace)(doc->lexer, NodeLast(element)) )
             {
                 TY_(ReportWarning)(doc, element, node, COERCE_TO_ENDTAG_WARN);
                 node->type = EndTag;
@@ -1404,7 +1722,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
                 continue;
             }
 
-            if (node->attributes == NULL || element->attributes == NULL)
+            if (NodeAttrs(node) == NULL || NodeAttrs(element) == NULL)
                 TY_(ReportWarning)(doc, element, node, NESTED_EMPHASIS);
         }
         else if ( TY_(IsPushed)(doc, node) && node->type == StartTag && 
@@ -1416,7 +1734,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
         if ( TY_(nodeIsText)(node) )
         {
             /* only called for 1st child */
-            if ( element->content == NULL && !(mode & Preformatted) )
+            if ( NodeContent(element) == NULL && !(mode & Preformatted) )
                 TrimSpaces( doc, element );
 
             if ( node->start >= node->end )
@@ -1449,7 +1767,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
             if (!(mode & Preformatted))
                 TrimSpaces(doc, element);
 
-            return;
+            return NULL;
         }
 
         /* within <dt> or <pre> map <p> to <br> */
@@ -1457,13 +1775,12 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
              node->type == StartTag &&
              ( (mode & Preformatted) ||
                nodeIsDT(element) || 
-               DescendantOf(element, TidyTag_DT )
+               DescendantOf(doc, element, TidyTag_DT )
              )
            )
         {
-            node->tag = TY_(LookupTagDef)( TidyTag_BR );
-            TidyDocFree(doc, node->element);
-            node->element = TY_(tmbstrdup)(doc->allocator, "br");
+            SetNodeTag(node, TY_(LookupTagDef)( TidyTag_BR ));
+            SetNodeElement(node, NodeTag(node)->name);
             TrimSpaces(doc, element);
             TY_(InsertNodeAtEnd)(element, node);
             continue;
@@ -1476,12 +1793,12 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
         {
             TY_(ConstrainVersion)( doc, ~VERS_HTML40_STRICT );
             TY_(InsertNodeAtEnd)(element, node);
-            (*node->tag->parser)( doc, node, mode );
-            continue;
+            return ParseChildWith( frame, NodeTag(node)->parser, node, mode,
+                                   ParseContent );
         }
 
         /* ignore unknown and PARAM tags */
-        if ( node->tag == NULL || nodeIsPARAM(node) )
+        if ( NodeTag(node) == NULL || nodeIsPARAM(node) )
         {
             TY_(ReportError)(doc, element, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)( doc, node );
@@ -1499,7 +1816,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
            else if ( nodeIsP(node) )
            {
                /* coerce unmatched </p> to <br><br> */
-                if ( !DescendantOf(element, TidyTag_P) )
+                if ( !DescendantOf(doc, element, TidyTag_P) )
                 {
                     TY_(CoerceNode)(doc, node, TidyTag_BR, no, no);
                     TrimSpaces( doc, element );
@@ -1522,7 +1839,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
                    where it gets tokens from the inline stack rather than
                    from the input stream. Check if the scenerio fits. */
                 if ( !nodeIsA(element)
-                     && (node->tag != element->tag)
+                     && (NodeTag(node) != NodeTag(element))
                      && TY_(IsPushed)( doc, node )
                      && TY_(IsPushed)( doc, element ) )
                 {
@@ -1535,14 +1852,14 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
                         TY_(InlineDup1)( doc, NULL, element ); /* dupe the <i>, after </b> */
                         if (!(mode & Preformatted))
                             TrimSpaces( doc, element );
-                        return; /* close <i>, but will re-open it, after </b> */
+                        return NULL; /* close <i>, but will re-open it, after </b> */
                     }
                 }
                 TY_(PopInline)( doc, element );
 
                 if ( !nodeIsA(element) )
                 {
-                    if ( nodeIsA(node) && node->tag != element->tag )
+                    if ( nodeIsA(node) && NodeTag(node) != NodeTag(element) )
                     {
                        TY_(ReportError)(doc, element, node, MISSING_ENDTAG_BEFORE );
                        TY_(UngetToken)( doc );
@@ -1556,7 +1873,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
                     if (!(mode & Preformatted))
                         TrimSpaces(doc, element);
 
-                    return;
+                    return NULL;
                 }
 
                 /* if parent is <a> then discard unexpected inline end tag */
@@ -1569,7 +1886,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
             {
                 TY_(UngetToken)( doc );
                 TrimSpaces(doc, element);
-                return;
+                return NULL;
             }
         }
 
@@ -1577,7 +1894,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
         if ( TY_(nodeHasCM)(node, CM_HEADING) && TY_(nodeHasCM)(element, CM_HEADING) )
         {
 
-            if ( node->tag == element->tag )
+            if ( NodeTag(node) == NodeTag(element) )
             {
                 TY_(ReportError)(doc, element, node, NON_MATCHING_ENDTAG );
                 TY_(FreeNode)( doc, node);
@@ -1591,7 +1908,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
             if (!(mode & Preformatted))
                 TrimSpaces(doc, element);
 
-            return;
+            return NULL;
         }
 
         /*
@@ -1601,13 +1918,13 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
         /* #427827 - fix by Randy Waki and Bjoern Hoehrmann 23 Aug 00 */
         /* if (node->tag == doc->tags.tag_a && !node->implicit && TY_(IsPushed)(doc, node)) */
         if ( nodeIsA(node) && !node->implicit && 
-             (nodeIsA(element) || DescendantOf(element, TidyTag_A)) )
+             (nodeIsA(element) || DescendantOf(doc, element, TidyTag_A)) )
         {
             /* coerce <a> to </a> unless it has some attributes */
             /* #427827 - fix by Randy Waki and Bjoern Hoehrmann 23 Aug 00 */
             /* other fixes by Dave Raggett */
             /* if (node->attributes == NULL) */
-            if (node->type != EndTag && node->attributes == NULL)
+            if (node->type != EndTag && NodeAttrs(node) == NULL)
             {
                 node->type = EndTag;
                 TY_(ReportError)(doc, element, node, COERCE_TO_ENDTAG);
@@ -1623,10 +1940,10 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
             if (!(mode & Preformatted))
                 TrimSpaces(doc, element);
 
-            return;
+            return NULL;
         }
 
-        if (element->tag->model & CM_HEADING)
+        if (NodeTag(element)->model & CM_HEADING)
         {
             if ( nodeIsCENTER(node) || nodeIsDIV(node) )
             {
@@ -1640,9 +1957,9 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
                 TY_(ReportError)(doc, element, node, TAG_NOT_ALLOWED_IN);
 
                 /* insert center as parent if heading is empty */
-                if (element->content == NULL)
+                if (NodeContent(element) == NULL)
                 {
-                    InsertNodeAsParent(element, node);
+                    InsertNodeAsParent(doc, element, node);
                     continue;
                 }
 
@@ -1652,7 +1969,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
                 if (!(mode & Preformatted))
                     TrimSpaces(doc, element);
 
-                element = TY_(CloneNode)( doc, element );
+                element = frame->element = TY_(CloneNode)( doc, element );
                 TY_(InsertNodeAtEnd)(node, element);
                 continue;
             }
@@ -1669,7 +1986,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
                 TY_(ReportError)(doc, element, node, TAG_NOT_ALLOWED_IN);
 
                 /* insert hr before heading if heading is empty */
-                if (element->content == NULL)
+                if (NodeContent(element) == NULL)
                 {
                     TY_(InsertNodeBeforeElement)(element, node);
                     continue;
@@ -1681,7 +1998,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
                 if (!(mode & Preformatted))
                     TrimSpaces(doc, element);
 
-                element = TY_(CloneNode)( doc, element );
+                element = frame->element = TY_(CloneNode)( doc, element );
                 TY_(InsertNodeAfterElement)(node, element);
                 continue;
             }
@@ -1703,7 +2020,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
                 dd = TY_(InferredTag)(doc, TidyTag_DD);
 
                 /* insert hr within dd before dt if dt is empty */
-                if (element->content == NULL)
+                if (NodeContent(element) == NULL)
                 {
                     TY_(InsertNodeBeforeElement)(element, dd);
                     TY_(InsertNodeAtEnd)(dd, node);
@@ -1717,7 +2034,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
                 if (!(mode & Preformatted))
                     TrimSpaces(doc, element);
 
-                element = TY_(CloneNode)( doc, element );
+                element = frame->element = TY_(CloneNode)( doc, element );
                 TY_(InsertNodeAfterElement)(dd, element);
                 continue;
             }
@@ -1728,31 +2045,24 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
           if this is the end tag for an ancestor element
           then infer end tag for this element
         */
-        if (node->type == EndTag)
+        if ( node->type == EndTag && DescendantOfTag(doc, element, NodeTag(node)) )
         {
-            for (parent = element->parent;
-                    parent != NULL; parent = parent->parent)
-            {
-                if (node->tag == parent->tag)
-                {
-                    if (!(element->tag->model & CM_OPT) && !element->implicit)
-                        TY_(ReportError)(doc, element, node, MISSING_ENDTAG_BEFORE);
+            if (!(NodeTag(element)->model & CM_OPT) && !element->implicit)
+                TY_(ReportError)(doc, element, node, MISSING_ENDTAG_BEFORE);
 
-                    if( TY_(IsPushedLast)( doc, element, node ) ) 
-                        TY_(PopInline)( doc, element );
-                    TY_(UngetToken)( doc );
+            if( TY_(IsPushedLast)( doc, element, node ) ) 
+                TY_(PopInline)( doc, element );
+            TY_(UngetToken)( doc );
 
-                    if (!(mode & Preformatted))
-                        TrimSpaces(doc, element);
+            if (!(mode & Preformatted))
+                TrimSpaces(doc, element);
 
-                    return;
-                }
-            }
+            return NULL;
         }
 
         /* block level tags end this element */
-        if (!(node->tag->model & CM_INLINE) &&
-            !(element->tag->model & CM_MIXED))
+        if (!(NodeTag(node)->model & CM_INLINE) &&
+            !(NodeTag(element)->model & CM_MIXED))
         {
             if ( !TY_(nodeIsElement)(node) )
             {
@@ -1761,12 +2071,14 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
                 continue;
             }
 
-            if (!(element->tag->model & CM_OPT))
+            if (!(NodeTag(element)->model & CM_OPT))
                 TY_(ReportError)(doc, element, node, MISSING_ENDTAG_BEFORE);
 
-            if (node->tag->model & CM_HEAD && !(node->tag->model & CM_BLOCK))
+            if (NodeTag(node)->model & CM_HEAD && !(NodeTag(node)->model & CM_BLOCK))
             {
-                MoveToHead(doc, element, node);
+                if ( MoveToHead(doc, element, node) )
+                    return ParseChild( frame, node, IgnoreWhitespace,
+                                       ParseContent );
                 continue;
             }
 
@@ -1776,13 +2088,13 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
             */
             if ( nodeIsA(element) )
             {
-                if (node->tag && !(node->tag->model & CM_HEADING))
+                if (NodeTag(node) && !(NodeTag(node)->model & CM_HEADING))
                     TY_(PopInline)( doc, element );
-                else if (!(element->content))
+                else if (!(NodeContent(element)))
                 {
                     TY_(DiscardElement)( doc, element );
                     TY_(UngetToken)( doc );
-                    return;
+                    return NULL;
                 }
             }
 
@@ -1791,7 +2103,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
             if (!(mode & Preformatted))
                 TrimSpaces(doc, element);
 
-            return;
+            return NULL;
         }
 
         /* parse inline element */
@@ -1805,8 +2117,7 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
                 TrimSpaces(doc, element);
             
             TY_(InsertNodeAtEnd)(element, node);
-            ParseTag(doc, node, mode);
-            continue;
+            return ParseChild( frame, node, mode, ParseContent );
         }
 
         /* discard unexpected tags */
@@ -1815,20 +2126,27 @@ void TY_(ParseInline)( TidyDocImpl* doc, Node *element, GetTokenMode mode )
         continue;
     }
 
-    if (!(element->tag->model & CM_OPT))
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
+    if (!(NodeTag(element)->model & CM_OPT))
         TY_(ReportError)(doc, element, node, MISSING_ENDTAG_FOR);
 
+    return NULL;
 }
 
-void TY_(ParseEmpty)(TidyDocImpl* doc, Node *element, GetTokenMode mode)
+Node* TY_(ParseEmpty)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
+    Node *element = frame->element;
     if ( lexer->isvoyager )
     {
-        Node *node = TY_(GetToken)( doc, mode);
+        Node *node = TY_(GetToken)( doc, frame->mode);
+        if ( lexer->suspended )
+            return Suspend( frame, ParseStart );
         if ( node )
         {
-            if ( !(node->type == EndTag && node->tag == element->tag) )
+            if ( !(node->type == EndTag && NodeTag(node) == NodeTag(element)) )
             {
                 TY_(ReportError)(doc, element, node, ELEMENT_NOT_EMPTY);
                 TY_(UngetToken)( doc );
@@ -1839,25 +2157,45 @@ void TY_(ParseEmpty)(TidyDocImpl* doc, Node *element, GetTokenMode mode)
             }
         }
     }
+    return NULL;
 }
 
-void TY_(ParseDefList)(TidyDocImpl* doc, Node *list, GetTokenMode mode)
+Node* TY_(ParseDefList)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
+    Node *list = frame->element;
     Node *node, *parent;
 
-    if (list->tag->model & CM_EMPTY)
-        return;
+    if ( frame->state == ParseStart )
+    {
+        if (NodeTag(list)->model & CM_EMPTY)
+            return NULL;
 
-    lexer->insert = NULL;  /* defer implicit inline start tags */
+        lexer->insert = NULL;  /* defer implicit inline start tags */
+    }
+    else if ( frame->state == ParseCenter )
+    {
+        node = frame->child;
+        lexer->excludeBlocks = yes;
+
+        /* now create a new dl element,
+         * unless node has been blown away because the
+         * center was empty, as above.
+         */
+        if (NodeLast(frame->parent) == node)
+        {
+            list = frame->element = TY_(InferredTag)(doc, TidyTag_DL);
+            TY_(InsertNodeAfterElement)(node, list);
+        }
+    }
 
     while ((node = TY_(GetToken)( doc, IgnoreWhitespace)) != NULL)
     {
-        if (node->tag == list->tag && node->type == EndTag)
+        if (NodeTag(node) == NodeTag(list) && node->type == EndTag)
         {
             TY_(FreeNode)( doc, node);
             list->closed = yes;
-            return;
+            return NULL;
         }
 
         /* deal with comments etc. */
@@ -1871,7 +2209,7 @@ void TY_(ParseDefList)(TidyDocImpl* doc, Node *list, GetTokenMode mode)
             TY_(ReportError)(doc, list, node, MISSING_STARTTAG);
         }
 
-        if (node->tag == NULL)
+        if (NodeTag(node) == NULL)
         {
             TY_(ReportError)(doc, list, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)( doc, node);
@@ -1893,8 +2231,8 @@ void TY_(ParseDefList)(TidyDocImpl* doc, Node *list, GetTokenMode mode)
                 continue;
             }
 
-            for (parent = list->parent;
-                    parent != NULL; parent = parent->parent)
+            for (parent = NodeParent(list);
+                    parent != NULL; parent = NodeParent(parent))
             {
                /* Do not match across BODY to avoid infinite loop
                   between ParseBody and this parser,
@@ -1904,12 +2242,12 @@ void TY_(ParseDefList)(TidyDocImpl* doc, Node *list, GetTokenMode mode)
                     discardIt = yes;
                     break;
                 }
-                if (node->tag == parent->tag)
+                if (NodeTag(node) == NodeTag(parent))
                 {
                     TY_(ReportError)(doc, list, node, MISSING_ENDTAG_BEFORE);
 
                     TY_(UngetToken)( doc );
-                    return;
+                    return NULL;
                 }
             }
             if (discardIt)
@@ -1923,7 +2261,7 @@ void TY_(ParseDefList)(TidyDocImpl* doc, Node *list, GetTokenMode mode)
         /* center in a dt or a dl breaks the dl list in two */
         if ( nodeIsCENTER(node) )
         {
-            if (list->content)
+            if (NodeContent(list))
                 TY_(InsertNodeAfterElement)(list, node);
             else /* trim empty dl list */
             {
@@ -1937,43 +2275,31 @@ void TY_(ParseDefList)(TidyDocImpl* doc, Node *list, GetTokenMode mode)
 
             /* #426885 - fix by Glenn Carroll 19 Apr 00, and
                          Gary Dechaines 11 Aug 00 */
-            /* ParseTag can destroy node, if it finds that
+            /* Parsing can destroy node, if it finds that
              * this <center> is followed immediately by </center>.
              * It's awkward but necessary to determine if this
              * has happened.
              */
-            parent = node->parent;
+            frame->parent = NodeParent(node);
 
             /* and parse contents of center */
             lexer->excludeBlocks = no;
-            ParseTag( doc, node, mode);
-            lexer->excludeBlocks = yes;
-
-            /* now create a new dl element,
-             * unless node has been blown away because the
-             * center was empty, as above.
-             */
-            if (parent->last == node)
-            {
-                list = TY_(InferredTag)(doc, TidyTag_DL);
-                TY_(InsertNodeAfterElement)(node, list);
-            }
-            continue;
+            return ParseChild( frame, node, frame->mode, ParseCenter );
         }
 
         if ( !(nodeIsDT(node) || nodeIsDD(node)) )
         {
             TY_(UngetToken)( doc );
 
-            if (!(node->tag->model & (CM_BLOCK | CM_INLINE)))
+            if (!(NodeTag(node)->model & (CM_BLOCK | CM_INLINE)))
             {
                 TY_(ReportError)(doc, list, node, TAG_NOT_ALLOWED_IN);
-                return;
+                return NULL;
             }
 
             /* if DD appeared directly in BODY then exclude blocks */
-            if (!(node->tag->model & CM_INLINE) && lexer->excludeBlocks)
-                return;
+            if (!(NodeTag(node)->model & CM_INLINE) && lexer->excludeBlocks)
+                return NULL;
 
             node = TY_(InferredTag)(doc, TidyTag_DD);
             TY_(ReportError)(doc, list, node, MISSING_STARTTAG);
@@ -1988,10 +2314,14 @@ void TY_(ParseDefList)(TidyDocImpl* doc, Node *list, GetTokenMode mode)
         
         /* node should be <DT> or <DD>*/
         TY_(InsertNodeAtEnd)(list, node);
-        ParseTag( doc, node, IgnoreWhitespace);
+        return ParseChild( frame, node, IgnoreWhitespace, ParseContent );
     }
 
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
     TY_(ReportError)(doc, list, node, MISSING_ENDTAG_FOR);
+    return NULL;
 }
 
 static Bool FindLastLI( Node *list, Node **lastli )
@@ -1999,37 +2329,41 @@ static Bool FindLastLI( Node *list, Node **lastli )
     Node *node;
 
     *lastli = NULL;
-    for ( node = list->content; node ; node = node->next )
+    for ( node = NodeContent(list); node ; node = NodeNext(node) )
         if ( nodeIsLI(node) && node->type == StartTag )
             *lastli=node;
     return *lastli ? yes:no;
 }
 
-void TY_(ParseList)(TidyDocImpl* doc, Node *list, GetTokenMode ARG_UNUSED(mode))
+Node* TY_(ParseList)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
+    Node *list = frame->element;
     Node *node, *parent, *lastli;
     Bool wasblock;
 
-    if (list->tag->model & CM_EMPTY)
-        return;
+    if ( frame->state == ParseStart )
+    {
+        if (NodeTag(list)->model & CM_EMPTY)
+            return NULL;
 
-    lexer->insert = NULL;  /* defer implicit inline start tags */
+        lexer->insert = NULL;  /* defer implicit inline start tags */
+    }
 
     while ((node = TY_(GetToken)( doc, IgnoreWhitespace)) != NULL)
     {
-        if (node->tag == list->tag && node->type == EndTag)
+        if (NodeTag(node) == NodeTag(list) && node->type == EndTag)
         {
             TY_(FreeNode)( doc, node);
             list->closed = yes;
-            return;
+            return NULL;
         }
 
         /* deal with comments etc. */
         if (InsertMisc(list, node))
             continue;
 
-        if (node->type != TextNode && node->tag == NULL)
+        if (node->type != TextNode && NodeTag(node) == NULL)
         {
             TY_(ReportError)(doc, list, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)( doc, node);
@@ -2058,19 +2392,19 @@ void TY_(ParseList)(TidyDocImpl* doc, Node *list, GetTokenMode ARG_UNUSED(mode))
                 continue;
             }
 
-            for ( parent = list->parent;
-                  parent != NULL; parent = parent->parent )
+            for ( parent = NodeParent(list);
+                  parent != NULL; parent = NodeParent(parent) )
             {
                /* Do not match across BODY to avoid infinite loop
                   between ParseBody and this parser,
                   See http://tidy.sf.net/bug/1053626. */
                 if (nodeIsBODY(parent))
                     break;
-                if (node->tag == parent->tag)
+                if (NodeTag(node) == NodeTag(parent))
                 {
                     TY_(ReportError)(doc, list, node, MISSING_ENDTAG_BEFORE);
                     TY_(UngetToken)( doc );
-                    return;
+                    return NULL;
                 }
             }
 
@@ -2086,14 +2420,14 @@ void TY_(ParseList)(TidyDocImpl* doc, Node *list, GetTokenMode ARG_UNUSED(mode))
             if (TY_(nodeHasCM)(node,CM_BLOCK) && lexer->excludeBlocks)
             {
                 TY_(ReportError)(doc, list, node, MISSING_ENDTAG_BEFORE);
-                return;
+                return NULL;
             }
             /* http://tidy.sf.net/issue/1316307 */
             /* In exiled mode, return so table processing can continue. */
             else if ( lexer->exiled
                       && (TY_(nodeHasCM)(node, CM_TABLE|CM_ROWGRP|CM_ROW)
                           || nodeIsTABLE(node)) )
-                return;
+                return NULL;
 
             /* http://tidy.sf.net/issue/836462
                If "list" is an unordered list, insert the next tag within 
@@ -2127,10 +2461,14 @@ void TY_(ParseList)(TidyDocImpl* doc, Node *list, GetTokenMode ARG_UNUSED(mode))
             /* node is <LI> */
             TY_(InsertNodeAtEnd)(list,node);
 
-        ParseTag( doc, node, IgnoreWhitespace);
+        return ParseChild( frame, node, IgnoreWhitespace, ParseContent );
     }
 
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
     TY_(ReportError)(doc, list, node, MISSING_ENDTAG_FOR);
+    return NULL;
 }
 
 /*
@@ -2144,7 +2482,7 @@ static void MoveBeforeTable( TidyDocImpl* ARG_UNUSED(doc), Node *row,
     Node *table;
 
     /* first find the table element */
-    for (table = row->parent; table; table = table->parent)
+    for (table = NodeParent(row); table; table = NodeParent(table))
     {
         if ( nodeIsTABLE(table) )
         {
@@ -2153,7 +2491,7 @@ static void MoveBeforeTable( TidyDocImpl* ARG_UNUSED(doc), Node *row,
         }
     }
     /* No table element */
-    TY_(InsertNodeBeforeElement)( row->parent, node );
+    TY_(InsertNodeBeforeElement)( NodeParent(row), node );
 }
 
 /*
@@ -2165,7 +2503,7 @@ static void FixEmptyRow(TidyDocImpl* doc, Node *row)
 {
     Node *cell;
 
-    if (row->content == NULL)
+    if (NodeContent(row) == NULL)
     {
         cell = TY_(InferredTag)(doc, TidyTag_TD);
         TY_(InsertNodeAtEnd)(row, cell);
@@ -2173,31 +2511,48 @@ static void FixEmptyRow(TidyDocImpl* doc, Node *row)
     }
 }
 
-void TY_(ParseRow)(TidyDocImpl* doc, Node *row, GetTokenMode ARG_UNUSED(mode))
+Node* TY_(ParseRow)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
+    Node *row = frame->element;
     Node *node;
-    Bool exclude_state;
-
-    if (row->tag->model & CM_EMPTY)
-        return;
 
-    while ((node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL)
+    if ( frame->state == ParseStart )
     {
-        if (node->tag == row->tag)
-        {
-            if (node->type == EndTag)
-            {
-                TY_(FreeNode)( doc, node);
+        if (NodeTag(row)->model & CM_EMPTY)
+            return NULL;
+    }
+    else if ( frame->state == ParseExiled )
+    {
+        lexer->exiled = no;
+        lexer->excludeBlocks = frame->saved;
+    }
+    else if ( frame->state == ParseCell )
+    {
+        lexer->excludeBlocks = frame->saved;
+
+        /* pop inline stack */
+
+        while ( lexer->istacksize > lexer->istackbase )
+            TY_(PopInline)( doc, NULL );
+    }
+
+    while ((node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL)
+    {
+        if (NodeTag(node) == NodeTag(row))
+        {
+            if (node->type == EndTag)
+            {
+                TY_(FreeNode)( doc, node);
                 row->closed = yes;
                 FixEmptyRow( doc, row);
-                return;
+                return NULL;
             }
 
             /* New row start implies end of current row */
             TY_(UngetToken)( doc );
             FixEmptyRow( doc, row);
-            return;
+            return NULL;
         }
 
         /* 
@@ -2207,10 +2562,10 @@ void TY_(ParseRow)(TidyDocImpl* doc, Node *row, GetTokenMode ARG_UNUSED(mode))
         if ( node->type == EndTag )
         {
             if ( (TY_(nodeHasCM)(node, CM_HTML|CM_TABLE) || nodeIsTABLE(node))
-                 && DescendantOf(row, TagId(node)) )
+                 && DescendantOf(doc, row, TagId(node)) )
             {
                 TY_(UngetToken)( doc );
-                return;
+                return NULL;
             }
 
             if ( nodeIsFORM(node) || TY_(nodeHasCM)(node, CM_BLOCK|CM_INLINE) )
@@ -2236,7 +2591,7 @@ void TY_(ParseRow)(TidyDocImpl* doc, Node *row, GetTokenMode ARG_UNUSED(mode))
             continue;
 
         /* discard unknown tags */
-        if (node->tag == NULL && node->type != TextNode)
+        if (NodeTag(node) == NULL && node->type != TextNode)
         {
             TY_(ReportError)(doc, row, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)( doc, node);
@@ -2255,7 +2610,7 @@ void TY_(ParseRow)(TidyDocImpl* doc, Node *row, GetTokenMode ARG_UNUSED(mode))
         if ( TY_(nodeHasCM)(node, CM_ROWGRP) )
         {
             TY_(UngetToken)( doc );
-            return;
+            return NULL;
         }
 
         if (node->type == EndTag)
@@ -2284,20 +2639,23 @@ void TY_(ParseRow)(TidyDocImpl* doc, Node *row, GetTokenMode ARG_UNUSED(mode))
                 MoveBeforeTable( doc, row, node );
                 TY_(ReportError)(doc, row, node, TAG_NOT_ALLOWED_IN);
                 lexer->exiled = yes;
-                exclude_state = lexer->excludeBlocks;
+                frame->saved = lexer->excludeBlocks;
                 lexer->excludeBlocks = no;
 
                 if (node->type != TextNode)
-                    ParseTag( doc, node, IgnoreWhitespace);
+                    return ParseChild( frame, node, IgnoreWhitespace,
+                                       ParseExiled );
 
                 lexer->exiled = no;
-                lexer->excludeBlocks = exclude_state;
+                lexer->excludeBlocks = frame->saved;
                 continue;
             }
-            else if (node->tag->model & CM_HEAD)
+            else if (NodeTag(node)->model & CM_HEAD)
             {
                 TY_(ReportError)(doc, row, node, TAG_NOT_ALLOWED_IN);
-                MoveToHead( doc, row, node);
+                if ( MoveToHead(doc, row, node) )
+                    return ParseChild( frame, node, IgnoreWhitespace,
+                                       ParseContent );
                 continue;
             }
         }
@@ -2311,47 +2669,51 @@ void TY_(ParseRow)(TidyDocImpl* doc, Node *row, GetTokenMode ARG_UNUSED(mode))
         
         /* node should be <TD> or <TH> */
         TY_(InsertNodeAtEnd)(row, node);
-        exclude_state = lexer->excludeBlocks;
+        frame->saved = lexer->excludeBlocks;
         lexer->excludeBlocks = no;
-        ParseTag( doc, node, IgnoreWhitespace);
-        lexer->excludeBlocks = exclude_state;
-
-        /* pop inline stack */
-
-        while ( lexer->istacksize > lexer->istackbase )
-            TY_(PopInline)( doc, NULL );
+        return ParseChild( frame, node, IgnoreWhitespace, ParseCell );
     }
 
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
+    return NULL;
 }
 
-void TY_(ParseRowGroup)(TidyDocImpl* doc, Node *rowgroup, GetTokenMode ARG_UNUSED(mode))
+Node* TY_(ParseRowGroup)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
-    Node *node, *parent;
+    Node *rowgroup = frame->element;
+    Node *node;
 
-    if (rowgroup->tag->model & CM_EMPTY)
-        return;
+    if ( frame->state == ParseStart )
+    {
+        if (NodeTag(rowgroup)->model & CM_EMPTY)
+            return NULL;
+    }
+    else if ( frame->state == ParseExiled )
+        lexer->exiled = no;
 
     while ((node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL)
     {
-        if (node->tag == rowgroup->tag)
+        if (NodeTag(node) == NodeTag(rowgroup))
         {
             if (node->type == EndTag)
             {
                 rowgroup->closed = yes;
                 TY_(FreeNode)( doc, node);
-                return;
+                return NULL;
             }
 
             TY_(UngetToken)( doc );
-            return;
+            return NULL;
         }
 
         /* if </table> infer end tag */
         if ( nodeIsTABLE(node) && node->type == EndTag )
         {
             TY_(UngetToken)( doc );
-            return;
+            return NULL;
         }
 
         /* deal with comments etc. */
@@ -2359,7 +2721,7 @@ void TY_(ParseRowGroup)(TidyDocImpl* doc, Node *rowgroup, GetTokenMode ARG_UNUSE
             continue;
 
         /* discard unknown tags */
-        if (node->tag == NULL && node->type != TextNode)
+        if (NodeTag(node) == NULL && node->type != TextNode)
         {
             TY_(ReportError)(doc, rowgroup, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)( doc, node);
@@ -2388,15 +2750,18 @@ void TY_(ParseRowGroup)(TidyDocImpl* doc, Node *rowgroup, GetTokenMode ARG_UNUSE
                 lexer->exiled = yes;
 
                 if (node->type != TextNode)
-                    ParseTag(doc, node, IgnoreWhitespace);
+                    return ParseChild( frame, node, IgnoreWhitespace,
+                                       ParseExiled );
 
                 lexer->exiled = no;
                 continue;
             }
-            else if (node->tag->model & CM_HEAD)
+            else if (NodeTag(node)->model & CM_HEAD)
             {
                 TY_(ReportError)(doc, rowgroup, node, TAG_NOT_ALLOWED_IN);
-                MoveToHead(doc, rowgroup, node);
+                if ( MoveToHead(doc, rowgroup, node) )
+                    return ParseChild( frame, node, IgnoreWhitespace,
+                                       ParseContent );
                 continue;
             }
         }
@@ -2424,15 +2789,10 @@ void TY_(ParseRowGroup)(TidyDocImpl* doc, Node *rowgroup, GetTokenMode ARG_UNUSE
                 continue;
             }
 
-            for ( parent = rowgroup->parent;
-                  parent != NULL;
-                  parent = parent->parent )
+            if ( DescendantOfTag(doc, rowgroup, NodeTag(node)) )
             {
-                if (node->tag == parent->tag)
-                {
-                    TY_(UngetToken)( doc );
-                    return;
-                }
+                TY_(UngetToken)( doc );
+                return NULL;
             }
         }
 
@@ -2440,12 +2800,12 @@ void TY_(ParseRowGroup)(TidyDocImpl* doc, Node *rowgroup, GetTokenMode ARG_UNUSE
           if THEAD, TFOOT or TBODY then implied end tag
 
         */
-        if (node->tag->model & CM_ROWGRP)
+        if (NodeTag(node)->model & CM_ROWGRP)
         {
             if (node->type != EndTag)
             {
                 TY_(UngetToken)( doc );
-                return;
+                return NULL;
             }
         }
 
@@ -2465,25 +2825,30 @@ void TY_(ParseRowGroup)(TidyDocImpl* doc, Node *rowgroup, GetTokenMode ARG_UNUSE
 
        /* node should be <TR> */
         TY_(InsertNodeAtEnd)(rowgroup, node);
-        ParseTag(doc, node, IgnoreWhitespace);
+        return ParseChild( frame, node, IgnoreWhitespace, ParseContent );
     }
 
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
+    return NULL;
 }
 
-void TY_(ParseColGroup)(TidyDocImpl* doc, Node *colgroup, GetTokenMode ARG_UNUSED(mode))
+Node* TY_(ParseColGroup)(TidyDocImpl* doc, ParseFrame* frame)
 {
-    Node *node, *parent;
+    Node *colgroup = frame->element;
+    Node *node;
 
-    if (colgroup->tag->model & CM_EMPTY)
-        return;
+    if (frame->state == ParseStart && (NodeTag(colgroup)->model & CM_EMPTY))
+        return NULL;
 
     while ((node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL)
     {
-        if (node->tag == colgroup->tag && node->type == EndTag)
+        if (NodeTag(node) == NodeTag(colgroup) && node->type == EndTag)
         {
             TY_(FreeNode)( doc, node);
             colgroup->closed = yes;
-            return;
+            return NULL;
         }
 
         /* 
@@ -2500,22 +2865,17 @@ void TY_(ParseColGroup)(TidyDocImpl* doc, Node *colgroup, GetTokenMode ARG_UNUSE
                 continue;
             }
 
-            for ( parent = colgroup->parent;
-                  parent != NULL;
-                  parent = parent->parent )
+            if ( DescendantOfTag(doc, colgroup, NodeTag(node)) )
             {
-                if (node->tag == parent->tag)
-                {
-                    TY_(UngetToken)( doc );
-                    return;
-                }
+                TY_(UngetToken)( doc );
+                return NULL;
             }
         }
 
         if (TY_(nodeIsText)(node))
         {
             TY_(UngetToken)( doc );
-            return;
+            return NULL;
         }
 
         /* deal with comments etc. */
@@ -2523,7 +2883,7 @@ void TY_(ParseColGroup)(TidyDocImpl* doc, Node *colgroup, GetTokenMode ARG_UNUSE
             continue;
 
         /* discard unknown tags */
-        if (node->tag == NULL)
+        if (NodeTag(node) == NULL)
         {
             TY_(ReportError)(doc, colgroup, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)( doc, node);
@@ -2533,7 +2893,7 @@ void TY_(ParseColGroup)(TidyDocImpl* doc, Node *colgroup, GetTokenMode ARG_UNUSE
         if ( !nodeIsCOL(node) )
         {
             TY_(UngetToken)( doc );
-            return;
+            return NULL;
         }
 
         if (node->type == EndTag)
@@ -2545,28 +2905,38 @@ void TY_(ParseColGroup)(TidyDocImpl* doc, Node *colgroup, GetTokenMode ARG_UNUSE
         
         /* node should be <COL> */
         TY_(InsertNodeAtEnd)(colgroup, node);
-        ParseTag(doc, node, IgnoreWhitespace);
+        return ParseChild( frame, node, IgnoreWhitespace, ParseContent );
     }
+
+    if (doc->lexer->suspended)
+        return Suspend( frame, ParseContent );
+
+    return NULL;
 }
 
-void TY_(ParseTableTag)(TidyDocImpl* doc, Node *table, GetTokenMode ARG_UNUSED(mode))
+Node* TY_(ParseTableTag)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
-    Node *node, *parent;
-    uint istackbase;
+    Node *table = frame->element;
+    Node *node;
+
+    if ( frame->state == ParseStart )
+    {
+        TY_(DeferDup)( doc );
+        frame->istackbase = lexer->istackbase;
+        lexer->istackbase = lexer->istacksize;
+    }
+    else if ( frame->state == ParseExiled )
+        lexer->exiled = no;
 
-    TY_(DeferDup)( doc );
-    istackbase = lexer->istackbase;
-    lexer->istackbase = lexer->istacksize;
-    
     while ((node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL)
     {
-        if (node->tag == table->tag && node->type == EndTag)
+        if (NodeTag(node) == NodeTag(table) && node->type == EndTag)
         {
             TY_(FreeNode)( doc, node);
-            lexer->istackbase = istackbase;
+            lexer->istackbase = frame->istackbase;
             table->closed = yes;
-            return;
+            return NULL;
         }
 
         /* deal with comments etc. */
@@ -2574,7 +2944,7 @@ void TY_(ParseTableTag)(TidyDocImpl* doc, Node *table, GetTokenMode ARG_UNUSED(m
             continue;
 
         /* discard unknown tags */
-        if (node->tag == NULL && node->type != TextNode)
+        if (NodeTag(node) == NULL && node->type != TextNode)
         {
             TY_(ReportError)(doc, table, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)( doc, node);
@@ -2598,14 +2968,17 @@ void TY_(ParseTableTag)(TidyDocImpl* doc, Node *table, GetTokenMode ARG_UNUSED(m
                 lexer->exiled = yes;
 
                 if (node->type != TextNode) 
-                    ParseTag(doc, node, IgnoreWhitespace);
+                    return ParseChild( frame, node, IgnoreWhitespace,
+                                       ParseExiled );
 
                 lexer->exiled = no;
                 continue;
             }
-            else if (node->tag->model & CM_HEAD)
+            else if (NodeTag(node)->model & CM_HEAD)
             {
-                MoveToHead(doc, table, node);
+                if ( MoveToHead(doc, table, node) )
+                    return ParseChild( frame, node, IgnoreWhitespace,
+                                       ParseContent );
                 continue;
             }
         }
@@ -2633,33 +3006,27 @@ void TY_(ParseTableTag)(TidyDocImpl* doc, Node *table, GetTokenMode ARG_UNUSED(m
                 continue;
             }
 
-            for ( parent = table->parent;
-                  parent != NULL;
-                  parent = parent->parent )
+            if ( DescendantOfTag(doc, table, NodeTag(node)) )
             {
-                if (node->tag == parent->tag)
-                {
-                    TY_(ReportError)(doc, table, node, MISSING_ENDTAG_BEFORE );
-                    TY_(UngetToken)( doc );
-                    lexer->istackbase = istackbase;
-                    return;
-                }
+                TY_(ReportError)(doc, table, node, MISSING_ENDTAG_BEFORE );
+                TY_(UngetToken)( doc );
+                lexer->istackbase = frame->istackbase;
+                return NULL;
             }
         }
 
-        if (!(node->tag->model & CM_TABLE))
+        if (!(NodeTag(node)->model & CM_TABLE))
         {
             TY_(UngetToken)( doc );
             TY_(ReportError)(doc, table, node, TAG_NOT_ALLOWED_IN);
-            lexer->istackbase = istackbase;
-            return;
+            lexer->istackbase = frame->istackbase;
+            return NULL;
         }
 
         if (TY_(nodeIsElement)(node))
         {
             TY_(InsertNodeAtEnd)(table, node);
-            ParseTag(doc, node, IgnoreWhitespace);
-            continue;
+            return ParseChild( frame, node, IgnoreWhitespace, ParseContent );
         }
 
         /* discard unexpected text nodes and end tags */
@@ -2667,8 +3034,12 @@ void TY_(ParseTableTag)(TidyDocImpl* doc, Node *table, GetTokenMode ARG_UNUSED(m
         TY_(FreeNode)( doc, node);
     }
 
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
     TY_(ReportError)(doc, table, node, MISSING_ENDTAG_FOR);
-    lexer->istackbase = istackbase;
+    lexer->istackbase = frame->istackbase;
+    return NULL;
 }
 
 /* acceptable content for pre elements */
@@ -2678,7 +3049,7 @@ static Bool PreContent( TidyDocImpl* ARG_UNUSED(doc), Node* node )
     if ( nodeIsP(node) || TY_(nodeIsText)(node) )
         return yes;
 
-    if ( node->tag == NULL ||
+    if ( NodeTag(node) == NULL ||
          nodeIsPARAM(node) ||
          !TY_(nodeHasCM)(node, CM_INLINE|CM_NEW) )
         return no;
@@ -2686,19 +3057,30 @@ static Bool PreContent( TidyDocImpl* ARG_UNUSED(doc), Node* node )
     return yes;
 }
 
-void TY_(ParsePre)( TidyDocImpl* doc, Node *pre, GetTokenMode ARG_UNUSED(mode) )
+Node* TY_(ParsePre)( TidyDocImpl* doc, ParseFrame* frame )
 {
+    Node *pre = frame->element;
     Node *node;
 
-    if (pre->tag->model & CM_EMPTY)
-        return;
+    if ( frame->state == ParseStart )
+    {
+        if (NodeTag(pre)->model & CM_EMPTY)
+            return NULL;
 
-    TY_(InlineDup)( doc, NULL ); /* tell lexer to insert inlines if needed */
+        TY_(InlineDup)( doc, NULL ); /* tell lexer to insert inlines if needed */
+    }
+    else if ( frame->state == ParseSplit )
+    {
+        Node *newnode = TY_(InferredTag)(doc, TidyTag_PRE);
+        TY_(ReportError)(doc, pre, newnode, INSERTING_TAG);
+        pre = frame->element = newnode;
+        TY_(InsertNodeAfterElement)(frame->child, pre);
+    }
 
     while ((node = TY_(GetToken)(doc, Preformatted)) != NULL)
     {
         if ( node->type == EndTag && 
-             (node->tag == pre->tag || DescendantOf(pre, TagId(node))) )
+             (NodeTag(node) == NodeTag(pre) || DescendantOf(doc, pre, TagId(node))) )
         {
             if (nodeIsBODY(node) || nodeIsHTML(node))
             {
@@ -2706,7 +3088,7 @@ void TY_(ParsePre)( TidyDocImpl* doc, Node *pre, GetTokenMode ARG_UNUSED(mode) )
                 TY_(FreeNode)(doc, node);
                 continue;
             }
-            if (node->tag == pre->tag)
+            if (NodeTag(node) == NodeTag(pre))
             {
                 TY_(FreeNode)(doc, node);
             }
@@ -2717,7 +3099,7 @@ void TY_(ParsePre)( TidyDocImpl* doc, Node *pre, GetTokenMode ARG_UNUSED(mode) )
             }
             pre->closed = yes;
             TrimSpaces(doc, pre);
-            return;
+            return NULL;
         }
 
         if (TY_(nodeIsText)(node))
@@ -2730,7 +3112,7 @@ void TY_(ParsePre)( TidyDocImpl* doc, Node *pre, GetTokenMode ARG_UNUSED(mode) )
         if (InsertMisc(pre, node))
             continue;
 
-        if (node->tag == NULL)
+        if (NodeTag(node) == NULL)
         {
             TY_(ReportError)(doc, pre, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)(doc, node);
@@ -2740,8 +3122,6 @@ void TY_(ParsePre)( TidyDocImpl* doc, Node *pre, GetTokenMode ARG_UNUSED(mode) )
         /* strip unexpected tags */
         if ( !PreContent(doc, node) )
         {
-            Node *newnode;
-
             /* fix for http://tidy.sf.net/bug/772205 */
             if (node->type == EndTag)
             {
@@ -2751,7 +3131,7 @@ void TY_(ParsePre)( TidyDocImpl* doc, Node *pre, GetTokenMode ARG_UNUSED(mode) )
                {
                   TY_(UngetToken)(doc);
                   TrimSpaces(doc, pre);
-                  return;
+                  return NULL;
                }
 
                TY_(ReportError)(doc, pre, node, DISCARDING_UNEXPECTED);
@@ -2767,7 +3147,7 @@ void TY_(ParsePre)( TidyDocImpl* doc, Node *pre, GetTokenMode ARG_UNUSED(mode) )
                     TY_(ReportError)(doc, pre, node, MISSING_ENDTAG_BEFORE);
 
                 TY_(UngetToken)(doc);
-                return;
+                return NULL;
             }
 
             /*
@@ -2809,14 +3189,7 @@ void TY_(ParsePre)( TidyDocImpl* doc, Node *pre, GetTokenMode ARG_UNUSED(mode) )
             */
             TY_(InsertNodeAfterElement)(pre, node);
             TY_(ReportError)(doc, pre, node, MISSING_ENDTAG_BEFORE);
-            ParseTag(doc, node, IgnoreWhitespace);
-
-            newnode = TY_(InferredTag)(doc, TidyTag_PRE);
-            TY_(ReportError)(doc, pre, newnode, INSERTING_TAG);
-            pre = newnode;
-            TY_(InsertNodeAfterElement)(node, pre);
-
-            continue;
+            return ParseChild( frame, node, IgnoreWhitespace, ParseSplit );
         }
 
         if ( nodeIsP(node) )
@@ -2848,8 +3221,7 @@ void TY_(ParsePre)( TidyDocImpl* doc, Node *pre, GetTokenMode ARG_UNUSED(mode) )
                 TrimSpaces(doc, pre);
             
             TY_(InsertNodeAtEnd)(pre, node);
-            ParseTag(doc, node, Preformatted);
-            continue;
+            return ParseChild( frame, node, Preformatted, ParseContent );
         }
 
         /* discard unexpected tags */
@@ -2857,24 +3229,30 @@ void TY_(ParsePre)( TidyDocImpl* doc, Node *pre, GetTokenMode ARG_UNUSED(mode) )
         TY_(FreeNode)( doc, node);
     }
 
+    if (doc->lexer->suspended)
+        return Suspend( frame, ParseContent );
+
     TY_(ReportError)(doc, pre, node, MISSING_ENDTAG_FOR);
+    return NULL;
 }
 
-void TY_(ParseOptGroup)(TidyDocImpl* doc, Node *field, GetTokenMode ARG_UNUSED(mode))
+Node* TY_(ParseOptGroup)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
+    Node *field = frame->element;
     Node *node;
 
-    lexer->insert = NULL;  /* defer implicit inline start tags */
+    if ( frame->state == ParseStart )
+        lexer->insert = NULL;  /* defer implicit inline start tags */
 
     while ((node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL)
     {
-        if (node->tag == field->tag && node->type == EndTag)
+        if (NodeTag(node) == NodeTag(field) && node->type == EndTag)
         {
             TY_(FreeNode)( doc, node);
             field->closed = yes;
             TrimSpaces(doc, field);
-            return;
+            return NULL;
         }
 
         /* deal with comments etc. */
@@ -2888,32 +3266,38 @@ void TY_(ParseOptGroup)(TidyDocImpl* doc, Node *field, GetTokenMode ARG_UNUSED(m
                 TY_(ReportError)(doc, field, node, CANT_BE_NESTED);
 
             TY_(InsertNodeAtEnd)(field, node);
-            ParseTag(doc, node, MixedContent);
-            continue;
+            return ParseChild( frame, node, MixedContent, ParseContent );
         }
 
         /* discard unexpected tags */
         TY_(ReportError)(doc, field, node, DISCARDING_UNEXPECTED );
         TY_(FreeNode)( doc, node);
     }
+
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
+    return NULL;
 }
 
 
-void TY_(ParseSelect)(TidyDocImpl* doc, Node *field, GetTokenMode ARG_UNUSED(mode))
+Node* TY_(ParseSelect)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
+    Node *field = frame->element;
     Node *node;
 
-    lexer->insert = NULL;  /* defer implicit inline start tags */
+    if ( frame->state == ParseStart )
+        lexer->insert = NULL;  /* defer implicit inline start tags */
 
     while ((node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL)
     {
-        if (node->tag == field->tag && node->type == EndTag)
+        if (NodeTag(node) == NodeTag(field) && node->type == EndTag)
         {
             TY_(FreeNode)( doc, node);
             field->closed = yes;
             TrimSpaces(doc, field);
-            return;
+            return NULL;
         }
 
         /* deal with comments etc. */
@@ -2927,8 +3311,7 @@ void TY_(ParseSelect)(TidyDocImpl* doc, Node *field, GetTokenMode ARG_UNUSED(mod
            )
         {
             TY_(InsertNodeAtEnd)(field, node);
-            ParseTag(doc, node, IgnoreWhitespace);
-            continue;
+            return ParseChild( frame, node, IgnoreWhitespace, ParseContent );
         }
 
         /* discard unexpected tags */
@@ -2936,12 +3319,18 @@ void TY_(ParseSelect)(TidyDocImpl* doc, Node *field, GetTokenMode ARG_UNUSED(mod
         TY_(FreeNode)( doc, node);
     }
 
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
     TY_(ReportError)(doc, field, node, MISSING_ENDTAG_FOR);
+    return NULL;
 }
 
-void TY_(ParseText)(TidyDocImpl* doc, Node *field, GetTokenMode mode)
+Node* TY_(ParseText)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
+    Node *field = frame->element;
+    GetTokenMode mode;
     Node *node;
 
     lexer->insert = NULL;  /* defer implicit inline start tags */
@@ -2953,12 +3342,12 @@ void TY_(ParseText)(TidyDocImpl* doc, Node *field, GetTokenMode mode)
 
     while ((node = TY_(GetToken)(doc, mode)) != NULL)
     {
-        if (node->tag == field->tag && node->type == EndTag)
+        if (NodeTag(node) == NodeTag(field) && node->type == EndTag)
         {
             TY_(FreeNode)( doc, node);
             field->closed = yes;
             TrimSpaces(doc, field);
-            return;
+            return NULL;
         }
 
         /* deal with comments etc. */
@@ -2968,7 +3357,7 @@ void TY_(ParseText)(TidyDocImpl* doc, Node *field, GetTokenMode mode)
         if (TY_(nodeIsText)(node))
         {
             /* only called for 1st child */
-            if (field->content == NULL && !(mode & Preformatted))
+            if (NodeContent(field) == NULL && !(mode & Preformatted))
                 TrimSpaces(doc, field);
 
             if (node->start >= node->end)
@@ -2984,9 +3373,9 @@ void TY_(ParseText)(TidyDocImpl* doc, Node *field, GetTokenMode mode)
         /* for textarea should all cases of < and & be escaped? */
 
         /* discard inline tags e.g. font */
-        if (   node->tag 
-            && node->tag->model & CM_INLINE
-            && !(node->tag->model & CM_FIELD)) /* #487283 - fix by Lee Passey 25 Jan 02 */
+        if (   NodeTag(node) 
+            && NodeTag(node)->model & CM_INLINE
+            && !(NodeTag(node)->model & CM_FIELD)) /* #487283 - fix by Lee Passey 25 Jan 02 */
         {
             TY_(ReportError)(doc, field, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)( doc, node);
@@ -2994,43 +3383,48 @@ void TY_(ParseText)(TidyDocImpl* doc, Node *field, GetTokenMode mode)
         }
 
         /* terminate element on other tags */
-        if (!(field->tag->model & CM_OPT))
+        if (!(NodeTag(field)->model & CM_OPT))
             TY_(ReportError)(doc, field, node, MISSING_ENDTAG_BEFORE);
 
         TY_(UngetToken)( doc );
         TrimSpaces(doc, field);
-        return;
+        return NULL;
     }
 
-    if (!(field->tag->model & CM_OPT))
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
+    if (!(NodeTag(field)->model & CM_OPT))
         TY_(ReportError)(doc, field, node, MISSING_ENDTAG_FOR);
+    return NULL;
 }
 
 
-void TY_(ParseTitle)(TidyDocImpl* doc, Node *title, GetTokenMode ARG_UNUSED(mode))
+Node* TY_(ParseTitle)(TidyDocImpl* doc, ParseFrame* frame)
 {
+    Node *title = frame->element;
     Node *node;
     while ((node = TY_(GetToken)(doc, MixedContent)) != NULL)
     {
-        if (node->tag == title->tag && node->type == StartTag)
+        if (NodeTag(node) == NodeTag(title) && node->type == StartTag)
         {
             TY_(ReportError)(doc, title, node, COERCE_TO_ENDTAG);
             node->type = EndTag;
             TY_(UngetToken)( doc );
             continue;
         }
-        else if (node->tag == title->tag && node->type == EndTag)
+        else if (NodeTag(node) == NodeTag(title) && node->type == EndTag)
         {
             TY_(FreeNode)( doc, node);
             title->closed = yes;
             TrimSpaces(doc, title);
-            return;
+            return NULL;
         }
 
         if (TY_(nodeIsText)(node))
         {
             /* only called for 1st child */
-            if (title->content == NULL)
+            if (NodeContent(title) == NULL)
                 TrimInitialSpace(doc, title, node);
 
             if (node->start >= node->end)
@@ -3048,7 +3442,7 @@ void TY_(ParseTitle)(TidyDocImpl* doc, Node *title, GetTokenMode ARG_UNUSED(mode
             continue;
 
         /* discard unknown tags */
-        if (node->tag == NULL)
+        if (NodeTag(node) == NULL)
         {
             TY_(ReportError)(doc, title, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)( doc, node);
@@ -3059,10 +3453,14 @@ void TY_(ParseTitle)(TidyDocImpl* doc, Node *title, GetTokenMode ARG_UNUSED(mode
         TY_(ReportError)(doc, title, node, MISSING_ENDTAG_BEFORE);
         TY_(UngetToken)( doc );
         TrimSpaces(doc, title);
-        return;
+        return NULL;
     }
 
+    if (doc->lexer->suspended)
+        return Suspend( frame, ParseContent );
+
     TY_(ReportError)(doc, title, node, MISSING_ENDTAG_FOR);
+    return NULL;
 }
 
 /*
@@ -3072,29 +3470,40 @@ void TY_(ParseTitle)(TidyDocImpl* doc, Node *title, GetTokenMode ARG_UNUSED(mode
   < + letter,  < + !, < + ?  or  < + / + letter
 */
 
-void TY_(ParseScript)(TidyDocImpl* doc, Node *script, GetTokenMode ARG_UNUSED(mode))
+Node* TY_(ParseScript)(TidyDocImpl* doc, ParseFrame* frame)
 {
+    Lexer* lexer = doc->lexer;
+    Node *script = frame->element;
     Node *node;
     
-    doc->lexer->parent = script;
-    node = TY_(GetToken)(doc, CdataContent);
-    doc->lexer->parent = NULL;
-
-    if (node)
+    if ( frame->state == ParseStart )
     {
-        TY_(InsertNodeAtEnd)(script, node);
-    }
-    else
-    {
-        /* handle e.g. a document like "<script>" */
-        TY_(ReportError)(doc, script, NULL, MISSING_ENDTAG_FOR);
-        return;
+        lexer->parent = script;
+        node = TY_(GetToken)(doc, CdataContent);
+        lexer->parent = NULL;
+
+        if (lexer->suspended)
+            return Suspend( frame, ParseStart );
+
+        if (node)
+        {
+            TY_(InsertNodeAtEnd)(script, node);
+        }
+        else
+        {
+            /* handle e.g. a document like "<script>" */
+            TY_(ReportError)(doc, script, NULL, MISSING_ENDTAG_FOR);
+            return NULL;
+        }
     }
 
     node = TY_(GetToken)(doc, IgnoreWhitespace);
 
-    if (!(node && node->type == EndTag && node->tag &&
-        node->tag->id == script->tag->id))
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
+    if (!(node && node->type == EndTag && NodeTag(node) &&
+        NodeTag(node)->id == NodeTag(script)->id))
     {
         TY_(ReportError)(doc, script, node, MISSING_ENDTAG_FOR);
 
@@ -3105,6 +3514,8 @@ void TY_(ParseScript)(TidyDocImpl* doc, Node *script, GetTokenMode ARG_UNUSED(mo
     {
         TY_(FreeNode)(doc, node);
     }
+
+    return NULL;
 }
 
 Bool TY_(IsJavaScript)(Node *node)
@@ -3112,10 +3523,10 @@ Bool TY_(IsJavaScript)(Node *node)
     Bool result = no;
     AttVal *attr;
 
-    if (node->attributes == NULL)
+    if (NodeAttrs(node) == NULL)
         return yes;
 
-    for (attr = node->attributes; attr; attr = attr->next)
+    for (attr = NodeAttrs(node); attr; attr = attr->next)
     {
         if ( (attrIsLANGUAGE(attr) || attrIsTYPE(attr))
              && AttrContains(attr, "javascript") )
@@ -3128,16 +3539,15 @@ Bool TY_(IsJavaScript)(Node *node)
     return result;
 }
 
-void TY_(ParseHead)(TidyDocImpl* doc, Node *head, GetTokenMode ARG_UNUSED(mode))
+Node* TY_(ParseHead)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
+    Node *head = frame->element;
     Node *node;
-    int HasTitle = 0;
-    int HasBase = 0;
 
     while ((node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL)
     {
-        if (node->tag == head->tag && node->type == EndTag)
+        if (NodeTag(node) == NodeTag(head) && node->type == EndTag)
         {
             TY_(FreeNode)( doc, node);
             head->closed = yes;
@@ -3146,7 +3556,7 @@ void TY_(ParseHead)(TidyDocImpl* doc, Node *head, GetTokenMode ARG_UNUSED(mode))
 
         /* find and discard multiple <head> elements */
         /* find and discard <html> in <head> elements */
-        if ((node->tag == head->tag || nodeIsHTML(node)) && node->type == StartTag)
+        if ((NodeTag(node) == NodeTag(head) || nodeIsHTML(node)) && node->type == StartTag)
         {
             TY_(ReportError)(doc, head, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)(doc, node);
@@ -3160,8 +3570,8 @@ void TY_(ParseHead)(TidyDocImpl* doc, Node *head, GetTokenMode ARG_UNUSED(mode))
             break;
         }
 
-        if (node->type == ProcInsTag && node->element &&
-            TY_(tmbstrcmp)(node->element, "xml-stylesheet") == 0)
+        if (node->type == ProcInsTag && NodeElement(node) &&
+            TY_(tmbstrcmp)(NodeElement(node), "xml-stylesheet") == 0)
         {
             TY_(ReportError)(doc, head, node, TAG_NOT_ALLOWED_IN);
             TY_(InsertNodeBeforeElement)(TY_(FindHTML)(doc), node);
@@ -3179,7 +3589,7 @@ void TY_(ParseHead)(TidyDocImpl* doc, Node *head, GetTokenMode ARG_UNUSED(mode))
         }
 
         /* discard unknown tags */
-        if (node->tag == NULL)
+        if (NodeTag(node) == NULL)
         {
             TY_(ReportError)(doc, head, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)( doc, node);
@@ -3191,7 +3601,7 @@ void TY_(ParseHead)(TidyDocImpl* doc, Node *head, GetTokenMode ARG_UNUSED(mode))
          treat as implicit end of head and deal
          with as part of the body
         */
-        if (!(node->tag->model & CM_HEAD))
+        if (!(NodeTag(node)->model & CM_HEAD))
         {
             /* #545067 Implicit closing of head broken - warn only for XHTML input */
             if ( lexer->isvoyager )
@@ -3204,18 +3614,18 @@ void TY_(ParseHead)(TidyDocImpl* doc, Node *head, GetTokenMode ARG_UNUSED(mode))
         {
             if ( nodeIsTITLE(node) )
             {
-                ++HasTitle;
+                ++frame->titles;
 
-                if (HasTitle > 1)
+                if (frame->titles > 1)
                     TY_(ReportError)(doc, head, node,
                                      head ?
                                      TOO_MANY_ELEMENTS_IN : TOO_MANY_ELEMENTS);
             }
             else if ( nodeIsBASE(node) )
             {
-                ++HasBase;
+                ++frame->bases;
 
-                if (HasBase > 1)
+                if (frame->bases > 1)
                     TY_(ReportError)(doc, head, node,
                                      head ?
                                      TOO_MANY_ELEMENTS_IN : TOO_MANY_ELEMENTS);
@@ -3269,31 +3679,39 @@ void TY_(ParseHead)(TidyDocImpl* doc, Node *head, GetTokenMode ARG_UNUSED(mode))
 #endif /* AUTO_INPUT_ENCODING */
 
             TY_(InsertNodeAtEnd)(head, node);
-            ParseTag(doc, node, IgnoreWhitespace);
-            continue;
+            return ParseChild( frame, node, IgnoreWhitespace, ParseContent );
         }
 
         /* discard unexpected text nodes and end tags */
         TY_(ReportError)(doc, head, node, DISCARDING_UNEXPECTED);
         TY_(FreeNode)( doc, node);
     }
+
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
+    return NULL;
 }
 
-void TY_(ParseBody)(TidyDocImpl* doc, Node *body, GetTokenMode mode)
+Node* TY_(ParseBody)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
+    Node *body = frame->element;
     Node *node;
-    Bool checkstack, iswhitenode;
+    Bool iswhitenode;
 
-    mode = IgnoreWhitespace;
-    checkstack = yes;
+    if ( frame->state == ParseStart )
+    {
+        frame->mode = IgnoreWhitespace;
+        frame->checkstack = yes;
 
-    TY_(BumpObject)( doc, body->parent );
+        TY_(BumpObject)( doc, NodeParent(body) );
+    }
 
-    while ((node = TY_(GetToken)(doc, mode)) != NULL)
+    while ((node = TY_(GetToken)(doc, frame->mode)) != NULL)
     {
         /* find and discard multiple <body> elements */
-        if (node->tag == body->tag && node->type == StartTag)
+        if (NodeTag(node) == NodeTag(body) && node->type == StartTag)
         {
             TY_(ReportError)(doc, body, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)(doc, node);
@@ -3320,15 +3738,15 @@ void TY_(ParseBody)(TidyDocImpl* doc, Node *body, GetTokenMode mode)
             TY_(ReportError)(doc, body, node, CONTENT_AFTER_BODY );
         }
 
-        if ( node->tag == body->tag && node->type == EndTag )
+        if ( NodeTag(node) == NodeTag(body) && node->type == EndTag )
         {
             body->closed = yes;
             TrimSpaces(doc, body);
             TY_(FreeNode)( doc, node);
             lexer->seenEndBody = 1;
-            mode = IgnoreWhitespace;
+            frame->mode = IgnoreWhitespace;
 
-            if ( nodeIsNOFRAMES(body->parent) )
+            if ( nodeIsNOFRAMES(NodeParent(body)) )
                 break;
 
             continue;
@@ -3339,11 +3757,11 @@ void TY_(ParseBody)(TidyDocImpl* doc, Node *body, GetTokenMode mode)
             if (node->type == StartTag)
             {
                 TY_(InsertNodeAtEnd)(body, node);
-                TY_(ParseBlock)(doc, node, mode);
-                continue;
+                return ParseChildWith( frame, TY_(ParseBlock), node, frame->mode,
+                                       ParseContent );
             }
 
-            if (node->type == EndTag && nodeIsNOFRAMES(body->parent) )
+            if (node->type == EndTag && nodeIsNOFRAMES(NodeParent(body)) )
             {
                 TrimSpaces(doc, body);
                 TY_(UngetToken)( doc );
@@ -3352,7 +3770,7 @@ void TY_(ParseBody)(TidyDocImpl* doc, Node *body, GetTokenMode mode)
         }
 
         if ( (nodeIsFRAME(node) || nodeIsFRAMESET(node))
-             && nodeIsNOFRAMES(body->parent) )
+             && nodeIsNOFRAMES(NodeParent(body)) )
         {
             TrimSpaces(doc, body);
             TY_(UngetToken)( doc );
@@ -3363,7 +3781,7 @@ void TY_(ParseBody)(TidyDocImpl* doc, Node *body, GetTokenMode mode)
 
         if ( TY_(nodeIsText)(node) &&
              node->end <= node->start + 1 &&
-             lexer->lexbuf[node->start] == ' ' )
+             NodeText(lexer, node)[0] == ' ' )
             iswhitenode = yes;
 
         /* deal with comments etc. */
@@ -3382,7 +3800,7 @@ void TY_(ParseBody)(TidyDocImpl* doc, Node *body, GetTokenMode mode)
         /* mixed content model permits text */
         if (TY_(nodeIsText)(node))
         {
-            if (iswhitenode && mode == IgnoreWhitespace)
+            if (iswhitenode && frame->mode == IgnoreWhitespace)
             {
                 TY_(FreeNode)( doc, node);
                 continue;
@@ -3391,16 +3809,16 @@ void TY_(ParseBody)(TidyDocImpl* doc, Node *body, GetTokenMode mode)
             /* HTML 2 and HTML4 strict don't allow text here */
             TY_(ConstrainVersion)(doc, ~(VERS_HTML40_STRICT | VERS_HTML20));
 
-            if (checkstack)
+            if (frame->checkstack)
             {
-                checkstack = no;
+                frame->checkstack = no;
 
                 if ( TY_(InlineDup)(doc, node) > 0 )
                     continue;
             }
 
             TY_(InsertNodeAtEnd)(body, node);
-            mode = MixedContent;
+            frame->mode = MixedContent;
             continue;
         }
 
@@ -3410,7 +3828,7 @@ void TY_(ParseBody)(TidyDocImpl* doc, Node *body, GetTokenMode mode)
             continue;
         }
         /* discard unknown  and PARAM tags */
-        if ( node->tag == NULL || nodeIsPARAM(node) )
+        if ( NodeTag(node) == NULL || nodeIsPARAM(node) )
         {
             TY_(ReportError)(doc, body, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)( doc, node);
@@ -3430,43 +3848,45 @@ void TY_(ParseBody)(TidyDocImpl* doc, Node *body, GetTokenMode mode)
            )
         {
             /* avoid this error message being issued twice */
-            if (!(node->tag->model & CM_HEAD))
+            if (!(NodeTag(node)->model & CM_HEAD))
                 TY_(ReportError)(doc, body, node, TAG_NOT_ALLOWED_IN);
 
-            if (node->tag->model & CM_HTML)
+            if (NodeTag(node)->model & CM_HTML)
             {
                 /* copy body attributes if current body was inferred */
                 if ( nodeIsBODY(node) && body->implicit 
-                     && body->attributes == NULL )
+                     && NodeAttrs(body) == NULL )
                 {
-                    body->attributes = node->attributes;
-                    node->attributes = NULL;
+                    SetNodeAttrs(body, NodeAttrs(node));
+                    SetNodeAttrs(node, NULL);
                 }
 
                 TY_(FreeNode)( doc, node);
                 continue;
             }
 
-            if (node->tag->model & CM_HEAD)
+            if (NodeTag(node)->model & CM_HEAD)
             {
-                MoveToHead(doc, body, node);
+                if ( MoveToHead(doc, body, node) )
+                    return ParseChild( frame, node, IgnoreWhitespace,
+                                       ParseContent );
                 continue;
             }
 
-            if (node->tag->model & CM_LIST)
+            if (NodeTag(node)->model & CM_LIST)
             {
                 TY_(UngetToken)( doc );
                 node = TY_(InferredTag)(doc, TidyTag_UL);
                 AddClassNoIndent(doc, node);
                 lexer->excludeBlocks = yes;
             }
-            else if (node->tag->model & CM_DEFLIST)
+            else if (NodeTag(node)->model & CM_DEFLIST)
             {
                 TY_(UngetToken)( doc );
                 node = TY_(InferredTag)(doc, TidyTag_DL);
                 lexer->excludeBlocks = yes;
             }
-            else if (node->tag->model & (CM_TABLE | CM_ROWGRP | CM_ROW))
+            else if (NodeTag(node)->model & (CM_TABLE | CM_ROWGRP | CM_ROW))
             {
                 /* http://tidy.sf.net/issue/2855621 */
                 if (node->type != EndTag) {
@@ -3486,7 +3906,7 @@ void TY_(ParseBody)(TidyDocImpl* doc, Node *body, GetTokenMode mode)
                 if ( !TY_(nodeHasCM)(node, CM_ROW | CM_FIELD) )
                 {
                     TY_(UngetToken)( doc );
-                    return;
+                    return NULL;
                 }
 
                 /* ignore </td> </th> <option> etc. */
@@ -3525,55 +3945,73 @@ void TY_(ParseBody)(TidyDocImpl* doc, Node *body, GetTokenMode mode)
                 else
                     TY_(ConstrainVersion)(doc, ~(VERS_HTML40_STRICT|VERS_HTML20));
 
-                if (checkstack && !node->implicit)
+                if (frame->checkstack && !node->implicit)
                 {
-                    checkstack = no;
+                    frame->checkstack = no;
 
                     if ( TY_(InlineDup)(doc, node) > 0 )
                         continue;
                 }
 
-                mode = MixedContent;
+                frame->mode = MixedContent;
             }
             else
             {
-                checkstack = yes;
-                mode = IgnoreWhitespace;
+                frame->checkstack = yes;
+                frame->mode = IgnoreWhitespace;
             }
 
             if (node->implicit)
                 TY_(ReportError)(doc, body, node, INSERTING_TAG);
 
             TY_(InsertNodeAtEnd)(body, node);
-            ParseTag(doc, node, mode);
-            continue;
+            return ParseChild( frame, node, frame->mode, ParseContent );
         }
 
         /* discard unexpected tags */
         TY_(ReportError)(doc, body, node, DISCARDING_UNEXPECTED);
         TY_(FreeNode)( doc, node);
     }
+
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
+    return NULL;
 }
 
-void TY_(ParseNoFrames)(TidyDocImpl* doc, Node *noframes, GetTokenMode mode)
+Node* TY_(ParseNoFrames)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
+    Node *noframes = frame->element;
     Node *node;
 
-    if ( cfg(doc, TidyAccessibilityCheckLevel) == 0 )
+    if ( frame->state == ParseStart )
     {
-        doc->badAccess |=  BA_USING_NOFRAMES;
+        if ( cfg(doc, TidyAccessibilityCheckLevel) == 0 )
+        {
+            doc->badAccess |=  BA_USING_NOFRAMES;
+        }
+    }
+    else if ( frame->state == ParseNoFramesBody )
+    {
+        node = frame->child;
+
+        /* fix for bug http://tidy.sf.net/bug/887259 */
+        if (frame->saved && TY_(FindBody)(doc) != node)
+        {
+            TY_(CoerceNode)(doc, node, TidyTag_DIV, no, no);
+            MoveNodeToBody(doc, node);
+        }
     }
-    mode = IgnoreWhitespace;
 
-    while ( (node = TY_(GetToken)(doc, mode)) != NULL )
+    while ( (node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL )
     {
-        if ( node->tag == noframes->tag && node->type == EndTag )
+        if ( NodeTag(node) == NodeTag(noframes) && node->type == EndTag )
         {
             TY_(FreeNode)( doc, node);
             noframes->closed = yes;
             TrimSpaces(doc, noframes);
-            return;
+            return NULL;
         }
 
         if ( nodeIsFRAME(node) || nodeIsFRAMESET(node) )
@@ -3589,7 +4027,7 @@ void TY_(ParseNoFrames)(TidyDocImpl* doc, Node *noframes, GetTokenMode mode)
                 TY_(ReportError)(doc, noframes, node, MISSING_ENDTAG_BEFORE);
                 TY_(UngetToken)( doc );
             }
-            return;
+            return NULL;
         }
 
         if ( nodeIsHTML(node) )
@@ -3607,21 +4045,14 @@ void TY_(ParseNoFrames)(TidyDocImpl* doc, Node *noframes, GetTokenMode mode)
 
         if ( nodeIsBODY(node) && node->type == StartTag )
         {
-            Bool seen_body = lexer->seenEndBody;
+            frame->saved = lexer->seenEndBody;
             TY_(InsertNodeAtEnd)(noframes, node);
-            ParseTag(doc, node, IgnoreWhitespace /*MixedContent*/);
-
-            /* fix for bug http://tidy.sf.net/bug/887259 */
-            if (seen_body && TY_(FindBody)(doc) != node)
-            {
-                TY_(CoerceNode)(doc, node, TidyTag_DIV, no, no);
-                MoveNodeToBody(doc, node);
-            }
-            continue;
+            return ParseChild( frame, node, IgnoreWhitespace /*MixedContent*/,
+                               ParseNoFramesBody );
         }
 
         /* implicit body element inferred */
-        if (TY_(nodeIsText)(node) || (node->tag && node->type != EndTag))
+        if (TY_(nodeIsText)(node) || (NodeTag(node) && node->type != EndTag))
         {
             Node *body = TY_(FindBody)( doc );
             if ( body || lexer->seenEndBody )
@@ -3649,8 +4080,8 @@ void TY_(ParseNoFrames)(TidyDocImpl* doc, Node *noframes, GetTokenMode mode)
                 TY_(InsertNodeAtEnd)( noframes, node );
             }
 
-            ParseTag( doc, node, IgnoreWhitespace /*MixedContent*/ );
-            continue;
+            return ParseChild( frame, node, IgnoreWhitespace /*MixedContent*/,
+                               ParseContent );
         }
 
         /* discard unexpected end tags */
@@ -3658,34 +4089,40 @@ void TY_(ParseNoFrames)(TidyDocImpl* doc, Node *noframes, GetTokenMode mode)
         TY_(FreeNode)( doc, node);
     }
 
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
     TY_(ReportError)(doc, noframes, node, MISSING_ENDTAG_FOR);
+    return NULL;
 }
 
-void TY_(ParseFrameSet)(TidyDocImpl* doc, Node *frameset, GetTokenMode ARG_UNUSED(mode))
+Node* TY_(ParseFrameSet)(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
+    Node *frameset = frame->element;
     Node *node;
 
-    if ( cfg(doc, TidyAccessibilityCheckLevel) == 0 )
+    if ( frame->state == ParseStart &&
+         cfg(doc, TidyAccessibilityCheckLevel) == 0 )
     {
         doc->badAccess |= BA_USING_FRAMES;
     }
-    
+
     while ((node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL)
     {
-        if (node->tag == frameset->tag && node->type == EndTag)
+        if (NodeTag(node) == NodeTag(frameset) && node->type == EndTag)
         {
             TY_(FreeNode)( doc, node);
             frameset->closed = yes;
             TrimSpaces(doc, frameset);
-            return;
+            return NULL;
         }
 
         /* deal with comments etc. */
         if (InsertMisc(frameset, node))
             continue;
 
-        if (node->tag == NULL)
+        if (NodeTag(node) == NULL)
         {
             TY_(ReportError)(doc, frameset, node, DISCARDING_UNEXPECTED);
             TY_(FreeNode)( doc, node);
@@ -3694,9 +4131,11 @@ void TY_(ParseFrameSet)(TidyDocImpl* doc, Node *frameset, GetTokenMode ARG_UNUSE
 
         if (TY_(nodeIsElement)(node))
         {
-            if (node->tag && node->tag->model & CM_HEAD)
+            if (NodeTag(node) && NodeTag(node)->model & CM_HEAD)
             {
-                MoveToHead(doc, frameset, node);
+                if ( MoveToHead(doc, frameset, node) )
+                    return ParseChild( frame, node, IgnoreWhitespace,
+                                       ParseContent );
                 continue;
             }
         }
@@ -3708,14 +4147,13 @@ void TY_(ParseFrameSet)(TidyDocImpl* doc, Node *frameset, GetTokenMode ARG_UNUSE
             TY_(ReportError)(doc, frameset, node, INSERTING_TAG);
         }
 
-        if (node->type == StartTag && (node->tag->model & CM_FRAMES))
+        if (node->type == StartTag && (NodeTag(node)->model & CM_FRAMES))
         {
             TY_(InsertNodeAtEnd)(frameset, node);
             lexer->excludeBlocks = no;
-            ParseTag(doc, node, MixedContent);
-            continue;
+            return ParseChild( frame, node, MixedContent, ParseContent );
         }
-        else if (node->type == StartEndTag && (node->tag->model & CM_FRAMES))
+        else if (node->type == StartEndTag && (NodeTag(node)->model & CM_FRAMES))
         {
             TY_(InsertNodeAtEnd)(frameset, node);
             continue;
@@ -3732,78 +4170,109 @@ void TY_(ParseFrameSet)(TidyDocImpl* doc, Node *frameset, GetTokenMode ARG_UNUSE
         TY_(FreeNode)( doc, node);
     }
 
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
     TY_(ReportError)(doc, frameset, node, MISSING_ENDTAG_FOR);
+    return NULL;
 }
 
-void TY_(ParseHTML)(TidyDocImpl* doc, Node *html, GetTokenMode mode)
+Node* TY_(ParseHTML)(TidyDocImpl* doc, ParseFrame* frame)
 {
+    Node *html = frame->element;
     Node *node, *head;
-    Node *frameset = NULL;
-    Node *noframes = NULL;
 
-    TY_(SetOptionBool)( doc, TidyXmlTags, no );
+    if ( frame->state == ParseDone )
+        return NULL;
 
-    for (;;)
+    if ( frame->state == ParseFramesetDone )
     {
-        node = TY_(GetToken)(doc, IgnoreWhitespace);
+        /*
+          see if it includes a noframes element so
+          that we can merge subsequent noframes elements
+        */
 
-        if (node == NULL)
+        for (node = NodeContent(frame->frameset); node; node = NodeNext(node))
         {
-            node = TY_(InferredTag)(doc, TidyTag_HEAD);
-            break;
+            if ( nodeIsNOFRAMES(node) )
+                frame->noframes = node;
         }
+    }
 
-        if ( nodeIsHEAD(node) )
-            break;
+    if ( frame->state == ParseStart )
+    {
+        TY_(SetOptionBool)( doc, TidyXmlTags, no );
 
-        if (node->tag == html->tag && node->type == EndTag)
+        for (;;)
         {
-            TY_(ReportError)(doc, html, node, DISCARDING_UNEXPECTED);
-            TY_(FreeNode)( doc, node);
-            continue;
-        }
+            node = TY_(GetToken)(doc, IgnoreWhitespace);
 
-        /* find and discard multiple <html> elements */
-        if (node->tag == html->tag && node->type == StartTag)
-        {
-            TY_(ReportError)(doc, html, node, DISCARDING_UNEXPECTED);
-            TY_(FreeNode)(doc, node);
-            continue;
-        }
+            if (doc->lexer->suspended)
+                return Suspend( frame, ParseStart );
 
-        /* deal with comments etc. */
-        if (InsertMisc(html, node))
-            continue;
+            if (node == NULL)
+            {
+                node = TY_(InferredTag)(doc, TidyTag_HEAD);
+                break;
+            }
 
-        TY_(UngetToken)( doc );
-        node = TY_(InferredTag)(doc, TidyTag_HEAD);
-        break;
-    }
+            if ( nodeIsHEAD(node) )
+                break;
+
+            if (NodeTag(node) == NodeTag(html) && node->type == EndTag)
+            {
+                TY_(ReportError)(doc, html, node, DISCARDING_UNEXPECTED);
+                TY_(FreeNode)( doc, node);
+                continue;
+            }
 
-    head = node;
-    TY_(InsertNodeAtEnd)(html, head);
-    TY_(ParseHead)(doc, head, mode);
+            /* find and discard multiple <html> elements */
+            if (NodeTag(node) == NodeTag(html) && node->type == StartTag)
+            {
+                TY_(ReportError)(doc, html, node, DISCARDING_UNEXPECTED);
+                TY_(FreeNode)(doc, node);
+                continue;
+            }
+
+            /* deal with comments etc. */
+            if (InsertMisc(html, node))
+                continue;
+
+            TY_(UngetToken)( doc );
+            node = TY_(InferredTag)(doc, TidyTag_HEAD);
+            break;
+        }
+
+        head = node;
+        TY_(InsertNodeAtEnd)(html, head);
+        return ParseChildWith( frame, TY_(ParseHead), head, frame->mode,
+                               ParseBodyStart );
+    }
 
     for (;;)
     {
         node = TY_(GetToken)(doc, IgnoreWhitespace);
 
+        if (doc->lexer->suspended)
+            return Suspend( frame, ParseContent );
+
         if (node == NULL)
         {
-            if (frameset == NULL) /* implied body */
+            if (frame->frameset == NULL) /* implied body */
             {
                 node = TY_(InferredTag)(doc, TidyTag_BODY);
                 TY_(InsertNodeAtEnd)(html, node);
-                TY_(ParseBody)(doc, node, mode);
+                return ParseChildWith( frame, TY_(ParseBody), node, frame->mode,
+                                       ParseDone );
             }
 
-            return;
+            return NULL;
         }
 
         /* robustly handle html tags */
-        if (node->tag == html->tag)
+        if (NodeTag(node) == NodeTag(html))
         {
-            if (node->type != StartTag && frameset == NULL)
+            if (node->type != StartTag && frame->frameset == NULL)
                 TY_(ReportError)(doc, html, node, DISCARDING_UNEXPECTED);
 
             TY_(FreeNode)( doc, node);
@@ -3826,24 +4295,24 @@ void TY_(ParseHTML)(TidyDocImpl* doc, Node *html, GetTokenMode mode)
 
             if ( cfg(doc, TidyAccessibilityCheckLevel) == 0 )
             {
-                if (frameset != NULL)
+                if (frame->frameset != NULL)
                 {
                     TY_(UngetToken)( doc );
 
-                    if (noframes == NULL)
+                    if (frame->noframes == NULL)
                     {
-                        noframes = TY_(InferredTag)(doc, TidyTag_NOFRAMES);
-                        TY_(InsertNodeAtEnd)(frameset, noframes);
-                        TY_(ReportError)(doc, html, noframes, INSERTING_TAG);
+                        frame->noframes = TY_(InferredTag)(doc, TidyTag_NOFRAMES);
+                        TY_(InsertNodeAtEnd)(frame->frameset, frame->noframes);
+                        TY_(ReportError)(doc, html, frame->noframes, INSERTING_TAG);
                     }
                     else
                     {
-                        if (noframes->type == StartEndTag)
-                            noframes->type = StartTag;
+                        if (frame->noframes->type == StartEndTag)
+                            frame->noframes->type = StartTag;
                     }
 
-                    ParseTag(doc, noframes, mode);
-                    continue;
+                    return ParseChild( frame, frame->noframes, frame->mode,
+                                       ParseContent );
                 }
             }
 
@@ -3861,25 +4330,13 @@ void TY_(ParseHTML)(TidyDocImpl* doc, Node *html, GetTokenMode mode)
                 continue;
             }
 
-            if (frameset != NULL)
+            if (frame->frameset != NULL)
                 TY_(ReportFatal)(doc, html, node, DUPLICATE_FRAMESET);
             else
-                frameset = node;
+                frame->frameset = node;
 
             TY_(InsertNodeAtEnd)(html, node);
-            ParseTag(doc, node, mode);
-
-            /*
-              see if it includes a noframes element so
-              that we can merge subsequent noframes elements
-            */
-
-            for (node = frameset->content; node; node = node->next)
-            {
-                if ( nodeIsNOFRAMES(node) )
-                    noframes = node;
-            }
-            continue;
+            return ParseChild( frame, node, frame->mode, ParseFramesetDone );
         }
 
         /* if not a frameset document coerce <noframes> to <body> */
@@ -3892,7 +4349,7 @@ void TY_(ParseHTML)(TidyDocImpl* doc, Node *html, GetTokenMode mode)
                 continue;
             }
 
-            if (frameset == NULL)
+            if (frame->frameset == NULL)
             {
                 TY_(ReportError)(doc, html, node, DISCARDING_UNEXPECTED);
                 TY_(FreeNode)( doc, node);
@@ -3900,28 +4357,29 @@ void TY_(ParseHTML)(TidyDocImpl* doc, Node *html, GetTokenMode mode)
                 break;
             }
 
-            if (noframes == NULL)
+            if (frame->noframes == NULL)
             {
-                noframes = node;
-                TY_(InsertNodeAtEnd)(frameset, noframes);
+                frame->noframes = node;
+                TY_(InsertNodeAtEnd)(frame->frameset, frame->noframes);
             }
             else
                 TY_(FreeNode)( doc, node);
 
-            ParseTag(doc, noframes, mode);
-            continue;
+            return ParseChild( frame, frame->noframes, frame->mode, ParseContent );
         }
 
         if (TY_(nodeIsElement)(node))
         {
-            if (node->tag && node->tag->model & CM_HEAD)
+            if (NodeTag(node) && NodeTag(node)->model & CM_HEAD)
             {
-                MoveToHead(doc, html, node);
+                if ( MoveToHead(doc, html, node) )
+                    return ParseChild( frame, node, IgnoreWhitespace,
+                                       ParseContent );
                 continue;
             }
 
             /* discard illegal frame element following a frameset */
-            if ( frameset != NULL && nodeIsFRAME(node) )
+            if ( frame->frameset != NULL && nodeIsFRAME(node) )
             {
                 TY_(ReportError)(doc, html, node, DISCARDING_UNEXPECTED);
                 TY_(FreeNode)(doc, node);
@@ -3933,23 +4391,22 @@ void TY_(ParseHTML)(TidyDocImpl* doc, Node *html, GetTokenMode mode)
 
         /* insert other content into noframes element */
 
-        if (frameset)
+        if (frame->frameset)
         {
-            if (noframes == NULL)
+            if (frame->noframes == NULL)
             {
-                noframes = TY_(InferredTag)(doc, TidyTag_NOFRAMES);
-                TY_(InsertNodeAtEnd)(frameset, noframes);
+                frame->noframes = TY_(InferredTag)(doc, TidyTag_NOFRAMES);
+                TY_(InsertNodeAtEnd)(frame->frameset, frame->noframes);
             }
             else
             {
                 TY_(ReportError)(doc, html, node, NOFRAMES_CONTENT);
-                if (noframes->type == StartEndTag)
-                    noframes->type = StartTag;
+                if (frame->noframes->type == StartEndTag)
+                    frame->noframes->type = StartTag;
             }
 
             TY_(ConstrainVersion)(doc, VERS_FRAMESET);
-            ParseTag(doc, noframes, mode);
-            continue;
+            return ParseChild( frame, frame->noframes, frame->mode, ParseContent );
         }
 
         node = TY_(InferredTag)(doc, TidyTag_BODY);
@@ -3961,7 +4418,7 @@ void TY_(ParseHTML)(TidyDocImpl* doc, Node *html, GetTokenMode mode)
     /* node must be body */
 
     TY_(InsertNodeAtEnd)(html, node);
-    ParseTag(doc, node, mode);
+    return ParseChild( frame, node, frame->mode, ParseDone );
 }
 
 static Bool nodeCMIsOnlyInline( Node* node )
@@ -3977,7 +4434,7 @@ static void EncloseBodyText(TidyDocImpl* doc)
     if (!body)
         return;
 
-    node = body->content;
+    node = NodeContent(body);
 
     while (node)
     {
@@ -3988,7 +4445,7 @@ static void EncloseBodyText(TidyDocImpl* doc)
             TY_(InsertNodeBeforeElement)(node, p);
             while (node && (!TY_(nodeIsElement)(node) || nodeCMIsOnlyInline(node)))
             {
-                Node* next = node->next;
+                Node* next = NodeNext(node);
                 TY_(RemoveNode)(node);
                 TY_(InsertNodeAtEnd)(p, node);
                 node = next;
@@ -3996,7 +4453,7 @@ static void EncloseBodyText(TidyDocImpl* doc)
             TrimSpaces(doc, p);
             continue;
         }
-        node = node->next;
+        node = NodeNext(node);
     }
 }
 
@@ -4005,25 +4462,24 @@ static void EncloseBodyText(TidyDocImpl* doc)
   When requested, text nodes in these elements are wrapped in <p>. */
 static void EncloseBlockText(TidyDocImpl* doc, Node* node)
 {
-    Node *next;
+    Node *parent, *next;
     Node *block;
 
-    while (node)
-    {
-        next = node->next;
+    if (node == NULL)
+        return;
+
+    parent = NodeParent(node);
 
-        if (node->content)
-            EncloseBlockText(doc, node->content);
+    for (node = TY_(FirstLeaf)(node); node; node = next)
+    {
+        next = TY_(NextPostOrder)(node, parent);
 
         if (!(nodeIsFORM(node) || nodeIsNOSCRIPT(node) ||
               nodeIsBLOCKQUOTE(node))
-            || !node->content)
-        {
-            node = next;
+            || !NodeContent(node))
             continue;
-        }
 
-        block = node->content;
+        block = NodeContent(node);
 
         if ((TY_(nodeIsText)(block) && !TY_(IsBlank)(doc->lexer, block)) ||
             (TY_(nodeIsElement)(block) && nodeCMIsOnlyInline(block)))
@@ -4033,77 +4489,70 @@ static void EncloseBlockText(TidyDocImpl* doc, Node* node)
             while (block &&
                    (!TY_(nodeIsElement)(block) || nodeCMIsOnlyInline(block)))
             {
-                Node* tempNext = block->next;
+                Node* tempNext = NodeNext(block);
                 TY_(RemoveNode)(block);
                 TY_(InsertNodeAtEnd)(p, block);
                 block = tempNext;
             }
             TrimSpaces(doc, p);
-            continue;
         }
-
-        node = next;
     }
 }
 
 static void ReplaceObsoleteElements(TidyDocImpl* doc, Node* node)
 {
-    Node *next;
+    Node *parent = node ? NodeParent(node) : NULL;
 
-    while (node)
+    for ( ; node; node = TY_(NextPreOrder)(node, parent))
     {
-        next = node->next;
-
         if (nodeIsDIR(node) || nodeIsMENU(node))
             TY_(CoerceNode)(doc, node, TidyTag_UL, yes, yes);
 
         if (nodeIsXMP(node) || nodeIsLISTING(node) ||
-            (node->tag && node->tag->id == TidyTag_PLAINTEXT))
+            (NodeTag(node) && NodeTag(node)->id == TidyTag_PLAINTEXT))
             TY_(CoerceNode)(doc, node, TidyTag_PRE, yes, yes);
-
-        if (node->content)
-            ReplaceObsoleteElements(doc, node->content);
-
-        node = next;
     }
 }
 
 static void AttributeChecks(TidyDocImpl* doc, Node* node)
 {
+    Node *parent = node ? NodeParent(node) : NULL;
     Node *next;
 
-    while (node)
+    for ( ; node; node = next)
     {
-        next = node->next;
-
         if (TY_(nodeIsElement)(node))
         {
-            if (node->tag->chkattrs)
-                node->tag->chkattrs(doc, node);
+            if (NodeTag(node)->chkattrs)
+                NodeTag(node)->chkattrs(doc, node);
             else
                 TY_(CheckAttributes)(doc, node);
         }
 
-        if (node->content)
-            AttributeChecks(doc, node->content);
-
+        next = TY_(NextPreOrder)(node, parent);
         assert( next != node ); /* http://tidy.sf.net/issue/1603538 */
-        node = next;
     }
 }
 
 /*
-  HTML is the top level element
+  HTML is the top level element.  Returns no if the input given
+  to tidyParseChunk() ran out, to carry on when called again.
 */
-void TY_(ParseDocument)(TidyDocImpl* doc)
+Bool TY_(ParseDocument)(TidyDocImpl* doc)
 {
-    Node *node, *html, *doctype = NULL;
+    Lexer* lexer = doc->lexer;
+    Node *node, *html, *doctype = TY_(FindDocType)(doc);
+    Bool resumed = ( lexer->nframes > 0 );
 
-    while ((node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL)
+    /* carry on with the html element */
+    if (resumed && !RunFrames(doc, 0))
+        return no;
+
+    while (!resumed && (node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL)
     {
         if (node->type == XmlDecl)
         {
-            if (TY_(FindXmlDecl)(doc) && doc->root.content)
+            if (TY_(FindXmlDecl)(doc) && NodeContent(&doc->root))
             {
                 TY_(ReportError)(doc, &doc->root, node, DISCARDING_UNEXPECTED);
                 TY_(FreeNode)(doc, node);
@@ -4191,10 +4640,14 @@ void TY_(ParseDocument)(TidyDocImpl* doc)
             TY_(ReportError)(doc, NULL, NULL, MISSING_DOCTYPE);
 
         TY_(InsertNodeAtEnd)( &doc->root, html);
-        TY_(ParseHTML)( doc, html, IgnoreWhitespace );
+        if ( !ParseElement(doc, TY_(ParseHTML), html, IgnoreWhitespace) )
+            return no;
         break;
     }
 
+    if (lexer->suspended)
+        return no;
+
 #if SUPPORT_ACCESSIBILITY_CHECKS
     /* do this before any more document fixes */
     if ( cfg( doc, TidyAccessibilityCheckLevel ) > 0 )
@@ -4206,7 +4659,7 @@ void TY_(ParseDocument)(TidyDocImpl* doc)
         /* a later check should complain if <body> is empty */
         html = TY_(InferredTag)(doc, TidyTag_HTML);
         TY_(InsertNodeAtEnd)( &doc->root, html);
-        TY_(ParseHTML)(doc, html, IgnoreWhitespace);
+        ParseElement( doc, TY_(ParseHTML), html, IgnoreWhitespace );
     }
 
     if (!TY_(FindTITLE)(doc))
@@ -4216,15 +4669,376 @@ void TY_(ParseDocument)(TidyDocImpl* doc)
         TY_(InsertNodeAtEnd)(head, TY_(InferredTag)(doc, TidyTag_TITLE));
     }
 
+    /* the passes below move elements without telling */
+    TY_(ResetAncestors)(doc);
+
     AttributeChecks(doc, &doc->root);
     ReplaceObsoleteElements(doc, &doc->root);
     TY_(DropEmptyElements)(doc, &doc->root);
     CleanSpaces(doc, &doc->root);
+    TY_(ResetAncestors)(doc);
 
     if (cfgBool(doc, TidyEncloseBodyText))
         EncloseBodyText(doc);
     if (cfgBool(doc, TidyEncloseBlockText))
         EncloseBlockText(doc, &doc->root);
+    return yes;
+}
+
+/*
+  Scanning passes each token to the application's callback as it
+  is read, instead of building a tree.  When tags are inferred, the
+  open elements are kept on a stack to supply the start and end
+  tags the markup leaves out, so memory grows with the depth of
+  nesting rather than the size of the document.
+*/
+struct _ScanState
+{
+    Node**  open;       /* open elements, outermost first */
+    uint    nopen;
+    uint    size;
+    Node*   cdata;      /* script or style waiting for its content,
+                           also open when inferring */
+    Bool    infer;
+    uint    pre;        /* depth of preformatted elements */
+    Bool    seenHead;
+    Bool    seenBody;
+    Bool    stop;       /* the callback has asked to stop */
+};
+
+#define ScanTop(st) ((st)->nopen > 0 ? (st)->open[(st)->nopen - 1] : NULL)
+
+/* Passes node to the callback, freeing it unless keep is set */
+static void ScanEmit( TidyDocImpl* doc, ScanState* st, Node* node, Bool keep )
+{
+    if ( !st->stop &&
+         !doc->tokenCallback(tidyImplToDoc(doc), tidyImplToNode(node)) )
+        st->stop = yes;
+
+    if ( NodeTag(node) && NodeTag(node)->parser == TY_(ParsePre) )
+    {
+        if ( node->type == StartTag )
+            ++st->pre;
+        else if ( node->type == EndTag && st->pre > 0 )
+            --st->pre;
+    }
+
+    if ( !keep )
+        TY_(FreeNode)( doc, node );
+}
+
+static void ScanPush( TidyDocImpl* doc, ScanState* st, Node* node )
+{
+    if ( st->nopen == st->size )
+    {
+        st->size = st->size ? 2 * st->size : 16;
+        st->open = (Node**) TidyDocRealloc( doc, st->open,
+                                            st->size * sizeof(Node*) );
+    }
+    st->open[st->nopen++] = node;
+}
+
+static void ScanPushInferred( TidyDocImpl* doc, ScanState* st, TidyTagId id )
+{
+    Node* node = TY_(InferredTag)( doc, id );
+    ScanEmit( doc, st, node, yes );
+    ScanPush( doc, st, node );
+}
+
+/* Closes the innermost open element with an inferred end tag */
+static void ScanPopInferred( TidyDocImpl* doc, ScanState* st )
+{
+    Node* element = st->open[--st->nopen];
+    Node* node = TY_(NewNode)( doc, doc->lexer );
+
+    node->type = EndTag;
+    node->implicit = yes;
+    SetNodeElement(node, NodeElement(element));
+    SetNodeTag(node, NodeTag(element));
+
+    ScanEmit( doc, st, node, no );
+    TY_(FreeNode)( doc, element );
+}
+
+/* Does node end element, whose end tag may be omitted?  Text and
+** unknown elements count as inline content.
+*/
+static Bool ScanEndsElement( Node* element, Node* node )
+{
+    uint model = NodeTag(node) ? NodeTag(node)->model : CM_INLINE;
+
+    switch ( TagId(element) )
+    {
+    case TidyTag_P:
+        return !(model & CM_INLINE);
+    case TidyTag_LI:
+        return nodeIsLI(node);
+    case TidyTag_DT:
+    case TidyTag_DD:
+        return (model & CM_DEFLIST) != 0;
+    case TidyTag_TD:
+    case TidyTag_TH:
+        return (model & (CM_ROW|CM_TABLE)) != 0;
+    case TidyTag_TR:
+        return nodeIsTR(node) || (model & CM_ROWGRP) != 0;
+    case TidyTag_THEAD:
+    case TidyTag_TBODY:
+    case TidyTag_TFOOT:
+        return (model & CM_ROWGRP) != 0;
+    case TidyTag_OPTION:
+        return nodeIsOPTION(node) || nodeIsOPTGROUP(node);
+    case TidyTag_COLGROUP:
+        return !nodeIsCOL(node);
+    case TidyTag_HEAD:
+        return !(model & CM_HEAD);
+    default:
+        break;
+    }
+    return no;
+}
+
+/* Is element inline, which ends when the element it is in does?
+** Unknown elements count as inline.
+*/
+static Bool ScanIsInline( Node* element )
+{
+    return NodeTag(element) == NULL || (NodeTag(element)->model & CM_INLINE) != 0;
+}
+
+/* Closes the open elements above the first depth ones before node */
+static void ScanCloseTo( TidyDocImpl* doc, ScanState* st, uint depth,
+                         Node* node )
+{
+    while ( st->nopen > depth )
+    {
+        Node* top = ScanTop( st );
+        if ( !(NodeTag(top) && (NodeTag(top)->model & CM_OPT)) )
+            TY_(ReportError)( doc, top, node, MISSING_ENDTAG_BEFORE );
+        ScanPopInferred( doc, st );
+    }
+}
+
+/* Mode to read the next token in, as the parser for the innermost
+** open element would.
+*/
+static GetTokenMode ScanMode( ScanState* st, Bool infer )
+{
+    Node* top = ScanTop( st );
+    Parser* parser;
+
+    if ( st->pre > 0 )
+        return Preformatted;
+    if ( !infer )
+        return MixedContent;
+    if ( top == NULL )
+        return IgnoreWhitespace;
+    if ( NodeTag(top) == NULL )
+        return MixedContent;
+
+    parser = NodeTag(top)->parser;
+    if ( parser == TY_(ParseHTML) || parser == TY_(ParseHead) ||
+         parser == TY_(ParseList) || parser == TY_(ParseDefList) ||
+         parser == TY_(ParseTableTag) || parser == TY_(ParseColGroup) ||
+         parser == TY_(ParseRowGroup) || parser == TY_(ParseRow) ||
+         parser == TY_(ParseSelect) || parser == TY_(ParseOptGroup) ||
+         parser == TY_(ParseFrameSet) )
+        return IgnoreWhitespace;
+    return MixedContent;
+}
+
+/* Start tags and text: end elements they can't be in, and supply
+** the html, head and body start tags if missing.
+*/
+static void ScanContent( TidyDocImpl* doc, ScanState* st, Node* node )
+{
+    uint model = NodeTag(node) ? NodeTag(node)->model : CM_INLINE;
+    Node* top;
+
+    if ( (nodeIsHTML(node) && st->nopen > 0) ||
+         (nodeIsHEAD(node) && (st->seenHead || st->seenBody)) ||
+         (nodeIsBODY(node) && st->seenBody) )
+    {
+        TY_(ReportError)( doc, ScanTop(st), node, DISCARDING_UNEXPECTED );
+        TY_(FreeNode)( doc, node );
+        return;
+    }
+
+    /* a token ending the element that open inline elements are in
+       ends them too, as ParseInline returns to its parent */
+    if ( !(model & CM_INLINE) )
+    {
+        uint i = st->nopen;
+        while ( i > 0 && ScanIsInline(st->open[i-1]) )
+            --i;
+        if ( i > 0 && i < st->nopen && ScanEndsElement(st->open[i-1], node) )
+            ScanCloseTo( doc, st, i, node );
+    }
+
+    while ( (top = ScanTop(st)) != NULL && ScanEndsElement(top, node) )
+        ScanPopInferred( doc, st );
+
+    if ( top == NULL && !nodeIsHTML(node) )
+    {
+        ScanPushInferred( doc, st, TidyTag_HTML );
+        top = ScanTop( st );
+    }
+
+    if ( nodeIsHTML(top) &&
+         !(nodeIsHEAD(node) || nodeIsBODY(node) || nodeIsFRAMESET(node)) )
+    {
+        if ( node->type != TextNode && (model & CM_HEAD) &&
+             !st->seenHead && !st->seenBody )
+        {
+            ScanPushInferred( doc, st, TidyTag_HEAD );
+            st->seenHead = yes;
+        }
+        else if ( !st->seenBody )
+        {
+            ScanPushInferred( doc, st, TidyTag_BODY );
+            st->seenBody = yes;
+        }
+    }
+
+    if ( nodeIsHEAD(node) )
+        st->seenHead = yes;
+    else if ( nodeIsBODY(node) )
+        st->seenBody = yes;
+
+    if ( node->type == StartTag && !(NodeTag(node) && (NodeTag(node)->model & CM_EMPTY)) )
+    {
+        ScanEmit( doc, st, node, yes );
+        ScanPush( doc, st, node );
+        if ( NodeTag(node) && NodeTag(node)->parser == TY_(ParseScript) )
+            st->cdata = node;
+    }
+    else
+        ScanEmit( doc, st, node, no );
+}
+
+/* End tags close the matching open element and any inside it.  The
+** body and html end tags are left for the end of the document.
+*/
+static void ScanEndTag( TidyDocImpl* doc, ScanState* st, Node* node )
+{
+    uint i;
+
+    if ( nodeIsBODY(node) || nodeIsHTML(node) )
+    {
+        TY_(FreeNode)( doc, node );
+        return;
+    }
+
+    for ( i = st->nopen; i > 0; --i )
+    {
+        if ( NodeElement(st->open[i-1]) == NodeElement(node) )
+            break;
+    }
+
+    if ( i == 0 )
+    {
+        TY_(ReportError)( doc, ScanTop(st), node, DISCARDING_UNEXPECTED );
+        TY_(FreeNode)( doc, node );
+        return;
+    }
+
+    ScanCloseTo( doc, st, i, node );
+
+    ScanEmit( doc, st, node, no );
+    TY_(FreeNode)( doc, st->open[--st->nopen] );
+}
+
+Bool TY_(ScanDocument)( TidyDocImpl* doc )
+{
+    Lexer* lexer = doc->lexer;
+    Bool xmlIn = cfgBool( doc, TidyXmlTags );
+    Bool infer = doc->inferTags && !xmlIn;
+    ScanState* st = lexer->scan;
+    Node* node;
+
+    /* kept in the lexer while suspended */
+    if ( st == NULL )
+    {
+        st = lexer->scan = (ScanState*) TidyDocAlloc( doc, sizeof(ScanState) );
+        TidyClearMemory( st, sizeof(ScanState) );
+        st->infer = infer;
+    }
+
+    while ( !st->stop )
+    {
+        if ( st->cdata )
+        {
+            lexer->parent = st->cdata;
+            node = TY_(GetToken)( doc, CdataContent );
+            lexer->parent = NULL;
+
+            if ( lexer->suspended )
+                return no;
+
+            /* when inferring, the element stays open for its end tag */
+            if ( !infer )
+                TY_(FreeNode)( doc, st->cdata );
+            st->cdata = NULL;
+
+            if ( node && node->start == node->end )
+            {
+                TY_(FreeNode)( doc, node );
+                continue;
+            }
+        }
+        else
+            node = TY_(GetToken)( doc, ScanMode(st, infer) );
+
+        if ( lexer->suspended )
+            return no;
+
+        if ( node == NULL )
+            break;
+
+        if ( !infer )
+        {
+            Bool cdata = ( !xmlIn && node->type == StartTag && NodeTag(node) &&
+                           NodeTag(node)->parser == TY_(ParseScript) );
+            ScanEmit( doc, st, node, cdata );
+            if ( cdata )
+                st->cdata = node;
+        }
+        else if ( node->type == StartTag || node->type == StartEndTag ||
+                  node->type == TextNode )
+            ScanContent( doc, st, node );
+        else if ( node->type == EndTag )
+            ScanEndTag( doc, st, node );
+        else
+            ScanEmit( doc, st, node, no );
+
+        /* no token refers to the lexer's buffer now, so reuse it,
+           and only the open elements still refer to their names */
+        TY_(ClearLexerText)( lexer );
+        if ( st->cdata == NULL )
+            TY_(TrimNames)( doc, st->open, st->nopen );
+    }
+
+    while ( st->nopen > 0 )
+        ScanPopInferred( doc, st );
+
+    TY_(AbandonScan)( doc );
+    return yes;
+}
+
+void TY_(AbandonScan)( TidyDocImpl* doc )
+{
+    Lexer* lexer = doc->lexer;
+    ScanState* st = lexer ? lexer->scan : NULL;
+
+    if ( st == NULL )
+        return;
+
+    while ( st->nopen > 0 )
+        TY_(FreeNode)( doc, st->open[--st->nopen] );
+    if ( st->cdata && !st->infer )
+        TY_(FreeNode)( doc, st->cdata );
+    TidyDocFree( doc, st->open );
+    TidyDocFree( doc, st );
+    lexer->scan = NULL;
 }
 
 Bool TY_(XMLPreserveWhiteSpace)( TidyDocImpl* doc, Node *element)
@@ -4232,7 +5046,7 @@ Bool TY_(XMLPreserveWhiteSpace)( TidyDocImpl* doc, Node *element)
     AttVal *attribute;
 
     /* search attributes for xml:space */
-    for (attribute = element->attributes; attribute; attribute = attribute->next)
+    for (attribute = NodeAttrs(element); attribute; attribute = attribute->next)
     {
         if (attrIsXML_SPACE(attribute))
         {
@@ -4243,7 +5057,7 @@ Bool TY_(XMLPreserveWhiteSpace)( TidyDocImpl* doc, Node *element)
         }
     }
 
-    if (element->element == NULL)
+    if (NodeElement(element) == NULL)
         return no;
         
     /* kludge for html docs without explicit xml:space attribute */
@@ -4254,7 +5068,7 @@ Bool TY_(XMLPreserveWhiteSpace)( TidyDocImpl* doc, Node *element)
         return yes;
 
     /* kludge for XSL docs */
-    if ( TY_(tmbstrcasecmp)(element->element, "xsl:text") == 0 )
+    if ( TY_(tmbstrcasecmp)(NodeElement(element), "xsl:text") == 0 )
         return yes;
 
     return no;
@@ -4263,21 +5077,25 @@ Bool TY_(XMLPreserveWhiteSpace)( TidyDocImpl* doc, Node *element)
 /*
   XML documents
 */
-static void ParseXMLElement(TidyDocImpl* doc, Node *element, GetTokenMode mode)
+static Node* ParseXMLElement(TidyDocImpl* doc, ParseFrame* frame)
 {
     Lexer* lexer = doc->lexer;
+    Node *element = frame->element;
+    GetTokenMode mode;
     Node *node;
 
     /* if node is pre or has xml:space="preserve" then do so */
 
-    if ( TY_(XMLPreserveWhiteSpace)(doc, element) )
-        mode = Preformatted;
+    if ( frame->state == ParseStart &&
+         TY_(XMLPreserveWhiteSpace)(doc, element) )
+        frame->mode = Preformatted;
+
+    mode = frame->mode;
 
     while ((node = TY_(GetToken)(doc, mode)) != NULL)
     {
         if (node->type == EndTag &&
-           node->element && element->element &&
-           TY_(tmbstrcmp)(node->element, element->element) == 0)
+           NodeElement(node) && NodeElement(node) == NodeElement(element))
         {
             TY_(FreeNode)( doc, node);
             element->closed = yes;
@@ -4296,23 +5114,27 @@ static void ParseXMLElement(TidyDocImpl* doc, Node *element, GetTokenMode mode)
             continue;
         }
 
+        TY_(InsertNodeAtEnd)(element, node);
+
         /* parse content on seeing start tag */
         if (node->type == StartTag)
-            ParseXMLElement( doc, node, mode );
-
-        TY_(InsertNodeAtEnd)(element, node);
+            return ParseChildWith( frame, ParseXMLElement, node, mode,
+                                   ParseContent );
     }
 
+    if (lexer->suspended)
+        return Suspend( frame, ParseContent );
+
     /*
      if first child is text then trim initial space and
      delete text node if it is empty.
     */
 
-    node = element->content;
+    node = NodeContent(element);
 
     if (TY_(nodeIsText)(node) && mode != Preformatted)
     {
-        if ( lexer->lexbuf[node->start] == ' ' )
+        if ( NodeText(lexer, node)[0] == ' ' )
         {
             node->start++;
 
@@ -4326,11 +5148,12 @@ static void ParseXMLElement(TidyDocImpl* doc, Node *element, GetTokenMode mode)
      delete the text node if it is empty
     */
 
-    node = element->last;
+    node = NodeLast(element);
 
     if (TY_(nodeIsText)(node) && mode != Preformatted)
     {
-        if ( lexer->lexbuf[node->end - 1] == ' ' )
+        if ( node->end > node->start &&
+             NodeText(lexer, node)[NodeTextLen(node) - 1] == ' ' )
         {
             node->end--;
 
@@ -4338,14 +5161,21 @@ static void ParseXMLElement(TidyDocImpl* doc, Node *element, GetTokenMode mode)
                 TY_(DiscardElement)( doc, node );
         }
     }
+
+    return NULL;
 }
 
-void TY_(ParseXMLDocument)(TidyDocImpl* doc)
+Bool TY_(ParseXMLDocument)(TidyDocImpl* doc)
 {
-    Node *node, *doctype = NULL;
+    Lexer* lexer = doc->lexer;
+    Node *node, *doctype = TY_(FindDocType)(doc);
 
     TY_(SetOptionBool)( doc, TidyXmlTags, yes );
 
+    /* carry on with the element being parsed */
+    if (lexer->nframes > 0 && !RunFrames(doc, 0))
+        return no;
+
     while ((node = TY_(GetToken)(doc, IgnoreWhitespace)) != NULL)
     {
         /* discard unexpected end tags */
@@ -4385,7 +5215,8 @@ void TY_(ParseXMLDocument)(TidyDocImpl* doc)
         if (node->type == StartTag)
         {
             TY_(InsertNodeAtEnd)( &doc->root, node );
-            ParseXMLElement( doc, node, IgnoreWhitespace );
+            if ( !ParseElement(doc, ParseXMLElement, node, IgnoreWhitespace) )
+                return no;
             continue;
         }
 
@@ -4393,9 +5224,13 @@ void TY_(ParseXMLDocument)(TidyDocImpl* doc)
         TY_(FreeNode)( doc, node);
     }
 
+    if (lexer->suspended)
+        return no;
+
     /* ensure presence of initial <?xml version="1.0"?> */
     if ( cfgBool(doc, TidyXmlDecl) )
         TY_(FixXmlDecl)( doc );
+    return yes;
 }
 
 /*
@@ -51,6 +51,19 @@ void TY_(InsertNodeBeforeElement)(Node *element, Node *node);
 void TY_(InsertNodeAfterElement)(Node *element, Node *node);
 
 Node *TY_(TrimEmptyElement)( TidyDocImpl* doc, Node *element );
+
+/*
+  walk node, its following siblings and their content without
+  recursion, stopping at parent, which is node's parent
+*/
+Node* TY_(NextPreOrder)( Node *node, Node *parent );
+Node* TY_(NextPastContent)( Node *node, Node *parent );
+Node* TY_(FirstLeaf)( Node *node );
+Node* TY_(NextPostOrder)( Node *node, Node *parent );
+
+/* forget the elements counted as ancestors, see DescendantOf() */
+void TY_(ResetAncestors)( TidyDocImpl* doc );
+
 Node* TY_(DropEmptyElements)(TidyDocImpl* doc, Node* node);
 
 
@@ -60,9 +73,20 @@ Bool TY_(IsBlank)(Lexer *lexer, Node *node);
 Bool TY_(IsJavaScript)(Node *node);
 
 /*
-  HTML is the top level element
+  HTML is the top level element.  These return no if the input
+  given to tidyParseChunk() runs out, and carry on from there
+  when called again.
 */
-void TY_(ParseDocument)( TidyDocImpl* doc );
+Bool TY_(ParseDocument)( TidyDocImpl* doc );
+
+/*
+  Passes tokens to the document's token callback without
+  building a tree, inferring omitted tags if asked to
+*/
+Bool TY_(ScanDocument)( TidyDocImpl* doc );
+
+/* drops what a suspended ScanDocument() keeps */
+void TY_(AbandonScan)( TidyDocImpl* doc );
 
 
 
@@ -71,6 +95,6 @@ void TY_(ParseDocument)( TidyDocImpl* doc );
 */
 Bool TY_(XMLPreserveWhiteSpace)( TidyDocImpl* doc, Node *element );
 
-void TY_(ParseXMLDocument)( TidyDocImpl* doc );
+Bool TY_(ParseXMLDocument)( TidyDocImpl* doc );
 
 #endif /* __PARSER_H__ */
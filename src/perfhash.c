@@ -0,0 +1,185 @@
+/* perfhash.c -- perfect hashing of the built-in name tables
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+  The hash is FNV-1a with the seed mixed into the offset basis and
+  a final avalanche so that the low bits, used by the modulus, depend
+  on every byte.  Tables are built with the "hash and displace" method:
+  buckets are placed largest first, each trying seeds until all of its
+  names land in distinct free slots.
+
+*/
+
+#include "perfhash.h"
+#include "lexer.h"
+
+#if defined(_DEBUG)
+#include <stdio.h>
+#endif
+
+static uint Hash( ctmbstr s, uint seed, Bool caseless )
+{
+    uint h = 2166136261u ^ (seed * 0x9E3779B9u);
+    uint c;
+
+    while ( (c = (byte) *s++) != 0 )
+    {
+        if ( caseless )
+            c = TY_(ToLower)( c );
+        h ^= c;
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+uint TY_(PerfectHashIndex)( const PerfectHash* ph, ctmbstr s )
+{
+    uint seed;
+
+    if ( s == NULL )
+        return 0;
+    seed = ph->seeds[ Hash(s, 0, ph->caseless) % ph->nseeds ];
+    return ph->slots[ Hash(s, seed, ph->caseless) % ph->nslots ];
+}
+
+#if defined(_DEBUG)
+
+/* Builds a table with nseeds buckets and nslots slots for the names,
+** returning no if some bucket can't be placed.
+*/
+static Bool BuildPerfectHash( PerfectHashName* name, uint count,
+                              Bool caseless, uint* bucket,
+                              unsigned short* seeds, uint nseeds,
+                              unsigned short* slots, uint nslots )
+{
+    uint i, b, size, maxsize = 0, seed;
+
+    for ( b = 0; b < nseeds; ++b )
+        seeds[b] = 0;
+    for ( i = 0; i < nslots; ++i )
+        slots[i] = 0;
+
+    for ( i = 1; i < count; ++i )
+    {
+        if ( name(i) )
+            bucket[i] = Hash( name(i), 0, caseless ) % nseeds;
+    }
+
+    for ( b = 0; b < nseeds; ++b )
+    {
+        size = 0;
+        for ( i = 1; i < count; ++i )
+            if ( name(i) && bucket[i] == b )
+                ++size;
+        if ( size > maxsize )
+            maxsize = size;
+    }
+
+    for ( size = maxsize; size > 0; --size )
+    {
+        for ( b = 0; b < nseeds; ++b )
+        {
+            uint n = 0;
+            for ( i = 1; i < count; ++i )
+                if ( name(i) && bucket[i] == b )
+                    ++n;
+            if ( n != size )
+                continue;
+
+            for ( seed = 1; seed <= 0xFFFF; ++seed )
+            {
+                Bool fits = yes;
+                for ( i = 1; fits && i < count; ++i )
+                {
+                    uint slot;
+                    if ( !name(i) || bucket[i] != b )
+                        continue;
+                    slot = Hash( name(i), seed, caseless ) % nslots;
+                    if ( slots[slot] != 0 )
+                        fits = no;
+                    else
+                        slots[slot] = (unsigned short) i;
+                }
+                if ( fits )
+                    break;
+
+                /* undo this try */
+                for ( i = 1; i < count; ++i )
+                    if ( name(i) && bucket[i] == b &&
+                         slots[Hash(name(i), seed, caseless) % nslots] == i )
+                        slots[Hash(name(i), seed, caseless) % nslots] = 0;
+            }
+            if ( seed > 0xFFFF )
+                return no;
+            seeds[b] = (unsigned short) seed;
+        }
+    }
+    return yes;
+}
+
+static void PrintArray( ctmbstr prefix, ctmbstr what,
+                        const unsigned short* a, uint n )
+{
+    uint i;
+
+    fprintf( stderr, "static const unsigned short %s%s[] =\n{", prefix, what );
+    for ( i = 0; i < n; ++i )
+        fprintf( stderr, "%s%u%s", i % 12 ? " " : "\n    ", a[i],
+                 i + 1 < n ? "," : "\n" );
+    fprintf( stderr, "};\n" );
+}
+
+Bool TY_(CheckPerfectHash)( const PerfectHash* ph, PerfectHashName* name,
+                            uint count, ctmbstr prefix )
+{
+    TidyAllocator* allocator = &TY_(g_default_allocator);
+    uint i, n = 0, nseeds, nslots, *bucket;
+    unsigned short *seeds, *slots;
+    Bool ok = yes;
+
+    for ( i = 1; ok && i < count; ++i )
+        ok = ( name(i) == NULL || TY_(PerfectHashIndex)(ph, name(i)) == i );
+    if ( ok )
+        return yes;
+
+    for ( i = 1; i < count; ++i )
+        if ( name(i) )
+            ++n;
+
+    bucket = (uint*) TidyAlloc( allocator, count * sizeof(uint) );
+    for ( nslots = n + n/4 + 1; ; nslots += n/8 + 1 )
+    {
+        nseeds = n/2 + 1;
+        seeds = (unsigned short*) TidyAlloc( allocator, nseeds * sizeof(*seeds) );
+        slots = (unsigned short*) TidyAlloc( allocator, nslots * sizeof(*slots) );
+        if ( BuildPerfectHash(name, count, ph->caseless, bucket,
+                              seeds, nseeds, slots, nslots) )
+            break;
+        TidyFree( allocator, seeds );
+        TidyFree( allocator, slots );
+    }
+
+    fprintf( stderr, "%s perfect hash is out of date, use:\n", prefix );
+    PrintArray( prefix, "Seeds", seeds, nseeds );
+    PrintArray( prefix, "Slots", slots, nslots );
+
+    TidyFree( allocator, bucket );
+    TidyFree( allocator, seeds );
+    TidyFree( allocator, slots );
+    return no;
+}
+
+#endif /* _DEBUG */
+
+/*
+ * local variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * eval: (c-set-offset 'substatement-open 0)
+ * end:
+ */
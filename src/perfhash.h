@@ -0,0 +1,59 @@
+#ifndef __PERFHASH_H__
+#define __PERFHASH_H__
+
+/* perfhash.h -- perfect hashing of the built-in name tables
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+  The tables of names Tidy knows (tags, attributes, ...) are fixed
+  at compile time, so each gets a collision-free hash generated once
+  and kept next to it as two constant arrays.  A lookup is then one
+  hash and one string compare, with no set up per document, and the
+  arrays are shared read-only by all documents.
+
+  A name is hashed once to pick a bucket, and hashed again with the
+  bucket's seed to pick its slot.  A slot holds the index of its
+  name in the table, 0 if it is unused: index 0 is never a name.
+
+*/
+
+#include "forward.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+struct _PerfectHash
+{
+    const unsigned short* seeds;    /* per bucket */
+    uint                  nseeds;
+    const unsigned short* slots;    /* table index, or 0 */
+    uint                  nslots;
+    Bool                  caseless; /* fold ASCII case when hashing */
+};
+
+typedef struct _PerfectHash PerfectHash;
+
+/* Returns the table index of the one name s may be, or 0.  The caller
+** compares s with that name, since other strings hash somewhere too.
+*/
+uint TY_(PerfectHashIndex)( const PerfectHash* ph, ctmbstr s );
+
+#if defined(_DEBUG)
+/* Returns the name at index ix of the table, NULL if none */
+typedef ctmbstr (PerfectHashName)( uint ix );
+
+/* Checks ph finds all names at indexes 1 to count-1.  If it doesn't,
+** e.g. after adding a name, prints arrays that do to stderr, as
+** "<prefix>Seeds" and "<prefix>Slots", and returns no.
+*/
+Bool TY_(CheckPerfectHash)( const PerfectHash* ph, PerfectHashName* name,
+                            uint count, ctmbstr prefix );
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __PERFHASH_H__ */
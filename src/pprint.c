@@ -38,7 +38,7 @@ static void PPrintAsp( TidyDocImpl* doc, uint indent, Node* node );
 static void PPrintJste( TidyDocImpl* doc, uint indent, Node* node );
 static void PPrintPhp( TidyDocImpl* doc, uint indent, Node* node );
 static int  TextEndsWithNewline( Lexer *lexer, Node *node, uint mode );
-static int  TextStartsWithWhitespace( Lexer *lexer, Node *node, uint start, uint mode );
+static int  TextStartsWithWhitespace( Lexer *lexer, Node *node, size_t start, uint mode );
 static Bool InsideHead( TidyDocImpl* doc, Node *node );
 static Bool ShouldIndent( TidyDocImpl* doc, Node *node );
 
@@ -296,7 +296,7 @@ void TY_(InitPrintBuf)( TidyDocImpl* doc )
     TidyClearMemory( &doc->pprint, sizeof(TidyPrintImpl) );
     InitIndent( &doc->pprint.indent[0] );
     InitIndent( &doc->pprint.indent[1] );
-    doc->pprint.allocator = doc->allocator;
+    doc->pprint.allocator = TidyDocAllocator( doc, TidyMemPrint );
 }
 
 void TY_(FreePrintBuf)( TidyDocImpl* doc )
@@ -362,7 +362,7 @@ static Bool HasMixedContent (Node *element)
     if (!element)
         return no;
 
-    for (node = element->content; node; node = node->next)
+    for (node = NodeContent(element); node; node = NodeNext(node))
         if ( TY_(nodeIsText)(node) )
              return yes;
 
@@ -923,11 +923,11 @@ static void PPrintChar( TidyDocImpl* doc, uint c, uint mode )
     AddChar( pprint, c );
 }
 
-static uint IncrWS( uint start, uint end, uint indent, int ixWS )
+static size_t IncrWS( size_t start, size_t end, uint indent, int ixWS )
 {
   if ( ixWS > 0 )
   {
-    uint st = start + MIN( (uint)ixWS, indent );
+    size_t st = start + MIN( (uint)ixWS, indent );
     start = MIN( st, end );
   }
   return start;
@@ -941,9 +941,11 @@ static uint IncrWS( uint start, uint end, uint indent, int ixWS )
 static void PPrintText( TidyDocImpl* doc, uint mode, uint indent,
                         Node* node  )
 {
-    uint start = node->start;
-    uint end = node->end;
-    uint ix, c = 0;
+    ctmbstr text = NodeText( doc->lexer, node );
+    size_t start = 0;
+    size_t end = NodeTextLen(node);
+    size_t ix;
+    uint c = 0;
     int  ixNL = TextEndsWithNewline( doc->lexer, node, mode );
     int  ixWS = TextStartsWithWhitespace( doc->lexer, node, start, mode );
     if ( ixNL > 0 )
@@ -960,11 +962,11 @@ static void PPrintText( TidyDocImpl* doc, uint mode, uint indent,
             ix = IncrWS( ix, end, indent, ixWS );
         }
         */
-        c = (byte) doc->lexer->lexbuf[ix];
+        c = (byte) text[ix];
 
         /* look for UTF-8 multibyte character */
         if ( c > 0x7F )
-             ix += TY_(GetUTF8)( doc->lexer->lexbuf + ix, &c );
+             ix += TY_(GetUTF8)( text + ix, &c );
 
         if ( c == '\n' )
         {
@@ -1100,21 +1102,21 @@ static uint AttrIndent( TidyDocImpl* doc, Node* node, AttVal* ARG_UNUSED(attr) )
 {
   uint spaces = cfg( doc, TidyIndentSpaces );
   uint xtra = 2;  /* 1 for the '<', another for the ' ' */
-  if ( node->element == NULL )
+  if ( NodeElement(node) == NULL )
     return spaces;
 
   if ( !TY_(nodeHasCM)(node, CM_INLINE) ||
-       !ShouldIndent(doc, node->parent ? node->parent: node) )
-    return xtra + TY_(tmbstrlen)( node->element );
+       !ShouldIndent(doc, NodeParent(node) ? NodeParent(node): node) )
+    return xtra + TY_(tmbstrlen)( NodeElement(node) );
 
   if ( NULL != (node = TY_(FindContainer)(node)) )
-    return xtra + TY_(tmbstrlen)( node->element );
+    return xtra + TY_(tmbstrlen)( NodeElement(node) );
   return spaces;
 }
 
 static Bool AttrNoIndentFirst( /*TidyDocImpl* doc,*/ Node* node, AttVal* attr )
 {
-  return ( attr==node->attributes );
+  return ( attr==NodeAttrs(node) );
   
   /*&& 
            ( InsideHead(doc, node) ||
@@ -1133,7 +1135,7 @@ static void PPrintAttribute( TidyDocImpl* doc, uint indent,
     Bool indAttrs  = cfgBool( doc, TidyIndentAttributes );
     uint xtra      = AttrIndent( doc, node, attr );
     Bool first     = AttrNoIndentFirst( /*doc,*/ node, attr );
-    tmbstr name    = attr->attribute;
+    ctmbstr name   = attr->attribute;
     Bool wrappable = no;
     tchar c;
 
@@ -1228,7 +1230,7 @@ static void PPrintAttrs( TidyDocImpl* doc, uint indent, Node *node )
         TY_(AddAttribute)( doc, node, "xml:space", "preserve" );
     }
 
-    for ( av = node->attributes; av; av = av->next )
+    for ( av = NodeAttrs(node); av; av = av->next )
     {
         if ( av->attribute != NULL )
         {
@@ -1251,12 +1253,14 @@ Bool TY_(TextNodeEndWithSpace)( Lexer *lexer, Node *node )
 {
     if (TY_(nodeIsText)(node) && node->end > node->start)
     {
-        uint i, c = '\0'; /* initialised to avoid warnings */
-        for (i = node->start; i < node->end; ++i)
+        ctmbstr text = NodeText( lexer, node );
+        size_t i;
+        uint c = '\0'; /* initialised to avoid warnings */
+        for (i = 0; i < NodeTextLen(node); ++i)
         {
-            c = (byte) lexer->lexbuf[i];
+            c = (byte) text[i];
             if ( c > 0x7F )
-                i += TY_(GetUTF8)( lexer->lexbuf + i, &c );
+                i += TY_(GetUTF8)( text + i, &c );
         }
 
         if ( c == ' ' || c == '\n' )
@@ -1283,24 +1287,24 @@ static Bool AfterSpaceImp(Lexer *lexer, Node *node, Bool isEmpty)
 {
     Node *prev;
 
-    if ( !TY_(nodeCMIsInline)(node) )
-        return yes;
-
-    prev = node->prev;
-    if (prev)
+    for ( ; TY_(nodeCMIsInline)(node); node = NodeParent(node) )
     {
-        if (TY_(nodeIsText)(prev))
-            return TY_(TextNodeEndWithSpace)( lexer, prev );
-        else if (nodeIsBR(prev))
-            return yes;
+        prev = NodePrev(node);
+        if (prev)
+        {
+            if (TY_(nodeIsText)(prev))
+                return TY_(TextNodeEndWithSpace)( lexer, prev );
+            else if (nodeIsBR(prev))
+                return yes;
 
-        return no;
-    }
+            return no;
+        }
 
-    if ( isEmpty && !TY_(nodeCMIsInline)(node->parent) )
-        return no;
+        if ( isEmpty && !TY_(nodeCMIsInline)(NodeParent(node)) )
+            return no;
+    }
 
-    return AfterSpaceImp(lexer, node->parent, isEmpty);
+    return yes;
 }
 
 static Bool AfterSpace(Lexer *lexer, Node *node)
@@ -1316,7 +1320,7 @@ static void PPrintTag( TidyDocImpl* doc,
     Bool xhtmlOut = cfgBool( doc, TidyXhtmlOut );
     Bool xmlOut = cfgBool( doc, TidyXmlOut );
     tchar c;
-    tmbstr s = node->element;
+    ctmbstr s = NodeElement(node);
 
     AddChar( pprint, '<' );
 
@@ -1384,7 +1388,7 @@ static void PPrintEndTag( TidyDocImpl* doc, uint ARG_UNUSED(mode),
 {
     TidyPrintImpl* pprint = &doc->pprint;
     Bool uc = cfgBool( doc, TidyUpperCaseTags );
-    tmbstr s = node->element;
+    ctmbstr s = NodeElement(node);
     tchar c;
 
    /*
@@ -1439,7 +1443,7 @@ static void PPrintComment( TidyDocImpl* doc, uint indent, Node* node )
 
     AddString(pprint, "--");
     AddChar( pprint, '>' );
-    if ( node->linebreak && node->next )
+    if ( node->linebreak && NodeNext(node) )
         TY_(PFlushLine)( doc, indent );
 }
 
@@ -1458,9 +1462,9 @@ static void PPrintDocType( TidyDocImpl* doc, uint indent, Node *node )
 
     AddString( pprint, "<!DOCTYPE " );
     SetWrap( doc, indent );
-    if (node->element)
+    if (NodeElement(node))
     {
-        AddString(pprint, node->element);
+        AddString(pprint, NodeElement(node));
     }
 
     if (fpi && fpi->value)
@@ -1493,11 +1497,11 @@ static void PPrintDocType( TidyDocImpl* doc, uint indent, Node *node )
         AddChar(pprint, sys->delim);
     }
 
-    if (node->content)
+    if (NodeContent(node))
     {
         PCondFlushLine(doc, indent);
         AddChar(pprint, '[');
-        PPrintText(doc, CDATA, 0, node->content);
+        PPrintText(doc, CDATA, 0, NodeContent(node));
         AddChar(pprint, ']');
     }
 
@@ -1510,12 +1514,12 @@ static void PPrintPI( TidyDocImpl* doc, uint indent, Node *node )
 {
     TidyPrintImpl* pprint = &doc->pprint;
     tchar c;
-    tmbstr s;
+    ctmbstr s;
 
     SetWrap( doc, indent );
     AddString( pprint, "<?" );
 
-    s = node->element;
+    s = NodeElement(node);
 
     while (s && *s)
     {
@@ -1564,7 +1568,8 @@ static void PPrintXmlDecl( TidyDocImpl* doc, uint indent, Node *node )
     /* restore old config value */
     TY_(SetOptionBool)(doc, TidyUpperCaseAttrs, ucAttrs);
 
-    if ( node->end <= 0 || doc->lexer->lexbuf[node->end - 1] != '?' )
+    if ( node->end <= node->start ||
+         NodeText(doc->lexer, node)[NodeTextLen(node) - 1] != '?' )
         AddChar( pprint, '?' );
     AddChar( pprint, '>' );
     WrapOn( doc, saveWrap );
@@ -1697,14 +1702,13 @@ static ctmbstr CSS_COMMENT_END       = "*/";
 static ctmbstr DEFAULT_COMMENT_START = "";
 static ctmbstr DEFAULT_COMMENT_END   = "";
 
-static Bool InsideHead( TidyDocImpl* doc, Node *node )
+static Bool InsideHead( TidyDocImpl* ARG_UNUSED(doc), Node *node )
 {
-  if ( nodeIsHEAD(node) )
-    return yes;
-
-  if ( node->parent != NULL )
-    return InsideHead( doc, node->parent );
-
+  for ( ; node != NULL; node = NodeParent(node) )
+  {
+    if ( nodeIsHEAD(node) )
+      return yes;
+  }
   return no;
 }
 
@@ -1718,31 +1722,36 @@ static int TextEndsWithNewline(Lexer *lexer, Node *node, uint mode )
 {
     if ( (mode & (CDATA|COMMENT)) && TY_(nodeIsText)(node) && node->end > node->start )
     {
-        uint ch, ix = node->end - 1;
+        ctmbstr text = NodeText( lexer, node );
+        size_t ix = NodeTextLen(node);
+        uint ch;
         /* Skip non-newline whitespace. */
-        while ( ix >= node->start && (ch = (lexer->lexbuf[ix] & 0xff))
+        while ( ix > 0 && (ch = (text[ix - 1] & 0xff))
                 && ( ch == ' ' || ch == '\t' || ch == '\r' ) )
             --ix;
 
-        if ( lexer->lexbuf[ ix ] == '\n' )
-          return node->end - ix - 1; /* #543262 tidy eats all memory */
+        if ( ix > 0 && text[ ix - 1 ] == '\n' )
+          return (int)(NodeTextLen(node) - ix); /* #543262 tidy eats all memory */
     }
     return -1;
 }
 
-static int TextStartsWithWhitespace( Lexer *lexer, Node *node, uint start, uint mode )
+/* start is relative to the node's text */
+static int TextStartsWithWhitespace( Lexer *lexer, Node *node, size_t start, uint mode )
 {
     assert( node != NULL );
-    if ( (mode & (CDATA|COMMENT)) && TY_(nodeIsText)(node) && node->end > node->start && start >= node->start )
+    if ( (mode & (CDATA|COMMENT)) && TY_(nodeIsText)(node) && node->end > node->start )
     {
-        uint ch, ix = start;
+        ctmbstr text = NodeText( lexer, node );
+        size_t ix = start;
+        uint ch;
         /* Skip whitespace. */
-        while ( ix < node->end && (ch = (lexer->lexbuf[ix] & 0xff))
+        while ( ix < NodeTextLen(node) && (ch = (text[ix] & 0xff))
                 && ( ch==' ' || ch=='\t' || ch=='\r' ) )
             ++ix;
 
         if ( ix > start )
-          return ix - start;
+          return (int)(ix - start);
     }
     return -1;
 }
@@ -1752,8 +1761,8 @@ static Bool HasCDATA( Lexer* lexer, Node* node )
     /* Scan forward through the textarray. Since the characters we're
     ** looking for are < 0x7f, we don't have to do any UTF-8 decoding.
     */
-    ctmbstr start = lexer->lexbuf + node->start;
-    int len = node->end - node->start + 1;
+    ctmbstr start = NodeText( lexer, node );
+    int len = (int)(NodeTextLen(node) + 1);
 
     if ( node->type != TextNode )
         return no;
@@ -1762,75 +1771,181 @@ static Bool HasCDATA( Lexer* lexer, Node* node )
 }
 
 
+/*
+  The tree is printed without recursion, with a frame on a stack for
+  each element whose content is being printed.  Opening a frame
+  prints what comes before the element's content and closing it what
+  comes after, which keeps the printer's stack use the same however
+  deeply the document is nested.
+*/
+typedef enum
+{
+    PrintContent,       /* the content alone, as for the root */
+    PrintPre,           /* pre or textarea */
+    PrintScriptStyle,
+    PrintInline,
+    PrintInlineIndent,  /* inline with its content indented */
+    PrintBlock,         /* other tags */
+    PrintXML            /* element, for PPrintXMLTree() */
+} PrintKind;
+
+typedef struct _PrintFrame PrintFrame;
+
+struct _PrintFrame
+{
+    PrintKind kind;
+    Node* node;
+    uint  mode;
+    uint  indent;
+    uint  cmode;            /* mode and indent for the content */
+    uint  cindent;
+    Node* next;             /* the next child to print */
+    Node* last;             /* the child printed last */
+    Bool  flushText;        /* new line between text and a block */
+    Bool  mixed;            /* XML element with text in it */
+    Bool  hasCData;         /* for script and style */
+    ctmbstr commentStart;
+    ctmbstr commentEnd;
+};
+
+/* prints up to frame's content, no if the node is done with */
+typedef Bool (PrintOpen)( TidyDocImpl* doc, PrintFrame* frame );
+typedef void (PrintClose)( TidyDocImpl* doc, PrintFrame* frame );
+
+static void PPrintWalk( TidyDocImpl* doc, uint mode, uint indent, Node *node,
+                        PrintOpen* open, PrintClose* close )
+{
+    TidyPrintImpl* pprint = &doc->pprint;
+    PrintFrame *frames = NULL, *frame;
+    uint nframes = 0, size = 0;
+
+    while ( node )
+    {
+        if ( nframes == size )
+        {
+            size = size ? 2 * size : 16;
+            frames = (PrintFrame*) TidyRealloc( pprint->allocator, frames,
+                                                sizeof(PrintFrame) * size );
+        }
+
+        frame = &frames[ nframes ];
+        TidyClearMemory( frame, sizeof(PrintFrame) );
+        frame->node = node;
+        frame->mode = mode;
+        frame->indent = indent;
+
+        if ( (*open)(doc, frame) )
+        {
+            frame->next = NodeContent(node);
+            ++nframes;
+        }
+
+        for ( node = NULL; nframes > 0; --nframes )
+        {
+            frame = &frames[ nframes - 1 ];
+
+            if ( frame->next )
+            {
+                node = frame->next;
+                frame->next = NodeNext(node);
+
+                /* kludge for naked text before block level tag */
+                if ( frame->flushText && frame->last &&
+                     TY_(nodeIsText)(frame->last) &&
+                     NodeTag(node) && !TY_(nodeHasCM)(node, CM_INLINE) )
+                {
+                    TY_(PFlushLine)( doc, frame->cindent );
+                }
+
+                frame->last = node;
+                mode = frame->cmode;
+                indent = frame->cindent;
+                break;
+            }
+
+            (*close)( doc, frame );
+        }
+    }
+
+    TidyFree( pprint->allocator, frames );
+}
+
 static
-void PPrintScriptStyle( TidyDocImpl* doc, uint mode, uint indent, Node *node )
+Bool PPrintScriptStyleOpen( TidyDocImpl* doc, PrintFrame* frame )
 {
     TidyPrintImpl* pprint = &doc->pprint;
-    Node*   content;
-    ctmbstr commentStart = DEFAULT_COMMENT_START;
-    ctmbstr commentEnd = DEFAULT_COMMENT_END;
-    Bool    hasCData = no;
-    int     contentIndent = -1;
+    Node*   node = frame->node;
+    uint    indent = frame->indent;
     Bool    xhtmlOut = cfgBool( doc, TidyXhtmlOut );
 
+    frame->kind = PrintScriptStyle;
+    frame->commentStart = DEFAULT_COMMENT_START;
+    frame->commentEnd = DEFAULT_COMMENT_END;
+
     if ( InsideHead(doc, node) )
       TY_(PFlushLine)( doc, indent );
 
-    PPrintTag( doc, mode, indent, node );
+    PPrintTag( doc, frame->mode, indent, node );
 
     /* use zero indent here, see http://tidy.sf.net/bug/729972 */
     TY_(PFlushLine)(doc, 0);
 
-    if ( xhtmlOut && node->content != NULL )
+    if ( xhtmlOut && NodeContent(node) != NULL )
     {
         AttVal* type = attrGetTYPE(node);
 
         if (AttrValueIs(type, "text/javascript"))
         {
-            commentStart = JS_COMMENT_START;
-            commentEnd = JS_COMMENT_END;
+            frame->commentStart = JS_COMMENT_START;
+            frame->commentEnd = JS_COMMENT_END;
         }
         else if (AttrValueIs(type, "text/css"))
         {
-            commentStart = CSS_COMMENT_START;
-            commentEnd = CSS_COMMENT_END;
+            frame->commentStart = CSS_COMMENT_START;
+            frame->commentEnd = CSS_COMMENT_END;
         }
         else if (AttrValueIs(type, "text/vbscript"))
         {
-            commentStart = VB_COMMENT_START;
-            commentEnd = VB_COMMENT_END;
+            frame->commentStart = VB_COMMENT_START;
+            frame->commentEnd = VB_COMMENT_END;
         }
 
-        hasCData = HasCDATA(doc->lexer, node->content);
+        frame->hasCData = HasCDATA(doc->lexer, NodeContent(node));
 
-        if (!hasCData)
+        if (!frame->hasCData)
         {
             uint saveWrap = WrapOff( doc );
 
-            AddString( pprint, commentStart );
+            AddString( pprint, frame->commentStart );
             AddString( pprint, CDATA_START );
-            AddString( pprint, commentEnd );
+            AddString( pprint, frame->commentEnd );
             PCondFlushLine( doc, indent );
 
             WrapOn( doc, saveWrap );
         }
     }
 
-    for ( content = node->content;
-          content != NULL;
-          content = content->next )
-    {
-        /*
-          This is a bit odd, with the current code there can only
-          be one child and the only caller of this function defines
-          all these modes already...
-        */
-        TY_(PPrintTree)( doc, (mode | PREFORMATTED | NOWRAP | CDATA), 
-                         indent, content );
+    /*
+      This is a bit odd, with the current code there can only
+      be one child and the only caller of this function defines
+      all these modes already...
+    */
+    frame->cmode = frame->mode | PREFORMATTED | NOWRAP | CDATA;
+    frame->cindent = indent;
+    return yes;
+}
 
-        if ( content == node->last )
-            contentIndent = TextEndsWithNewline( doc->lexer, content, CDATA );
-    }
+static
+void PPrintScriptStyleClose( TidyDocImpl* doc, PrintFrame* frame )
+{
+    TidyPrintImpl* pprint = &doc->pprint;
+    Node*   node = frame->node;
+    uint    indent = frame->indent;
+    int     contentIndent = -1;
+    Bool    xhtmlOut = cfgBool( doc, TidyXhtmlOut );
+
+    if ( NodeLast(node) )
+        contentIndent = TextEndsWithNewline( doc->lexer, NodeLast(node), CDATA );
 
     if ( contentIndent < 0 )
     {
@@ -1838,28 +1953,28 @@ void PPrintScriptStyle( TidyDocImpl* doc, uint mode, uint indent, Node *node )
         contentIndent = 0;
     }
 
-    if ( xhtmlOut && node->content != NULL )
+    if ( xhtmlOut && NodeContent(node) != NULL )
     {
-        if ( ! hasCData )
+        if ( ! frame->hasCData )
         {
             uint saveWrap = WrapOff( doc );
 
-            AddString( pprint, commentStart );
+            AddString( pprint, frame->commentStart );
             AddString( pprint, CDATA_END );
-            AddString( pprint, commentEnd );
+            AddString( pprint, frame->commentEnd );
 
             WrapOn( doc, saveWrap );
             PCondFlushLine( doc, indent );
         }
     }
 
-    if ( node->content && pprint->indent[ 0 ].spaces != (int)indent )
+    if ( NodeContent(node) && pprint->indent[ 0 ].spaces != (int)indent )
     {
         pprint->indent[ 0 ].spaces = indent;
     }
-    PPrintEndTag( doc, mode, indent, node );
+    PPrintEndTag( doc, frame->mode, indent, node );
     if ( cfgAutoBool(doc, TidyIndentContent) == TidyNoState
-         && node->next != NULL &&
+         && NodeNext(node) != NULL &&
          !( TY_(nodeHasCM)(node, CM_INLINE) || TY_(nodeIsText)(node) ) )
         TY_(PFlushLine)( doc, indent );
 }
@@ -1877,9 +1992,9 @@ static Bool ShouldIndent( TidyDocImpl* doc, Node *node )
 
     if ( indentContent == TidyAutoState )
     {
-        if ( node->content && TY_(nodeHasCM)(node, CM_NO_INDENT) )
+        if ( NodeContent(node) && TY_(nodeHasCM)(node, CM_NO_INDENT) )
         {
-            for ( node = node->content; node; node = node->next )
+            for ( node = NodeContent(node); node; node = NodeNext(node) )
                 if ( TY_(nodeHasCM)(node, CM_BLOCK) )
                     return yes;
             return no;
@@ -1899,7 +2014,7 @@ static Bool ShouldIndent( TidyDocImpl* doc, Node *node )
 
         /* http://tidy.sf.net/issue/1610888
            Indenting <div><img /></div> produces spurious lines with IE 6.x */
-        if ( nodeIsDIV(node) && node->last && nodeIsIMG(node->last) )
+        if ( nodeIsDIV(node) && NodeLast(node) && nodeIsIMG(NodeLast(node)) )
             return no;
     }
 
@@ -1909,36 +2024,19 @@ static Bool ShouldIndent( TidyDocImpl* doc, Node *node )
     if ( nodeIsMAP(node) )
         return yes;
 
-    return ( !TY_(nodeHasCM)( node, CM_INLINE ) && node->content );
+    return ( !TY_(nodeHasCM)( node, CM_INLINE ) && NodeContent(node) );
 }
 
-/*
- Feature request #434940 - fix by Dave Raggett/Ignacio Vazquez-Abrams 21 Jun 01
- print just the content of the body element.
- useful when you want to reuse material from
- other documents.
-
- -- Sebastiano Vigna <vigna@dsi.unimi.it>
-*/
-void TY_(PrintBody)( TidyDocImpl* doc )
+static Bool PPrintOpen( TidyDocImpl* doc, PrintFrame* frame )
 {
-    Node *node = TY_(FindBody)( doc );
-
-    if ( node )
-    {
-        for ( node = node->content; node != NULL; node = node->next )
-            TY_(PPrintTree)( doc, NORMAL, 0, node );
-    }
-}
-
-void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
-{
-    Node *content, *last;
+    Node *node = frame->node;
+    uint mode = frame->mode;
+    uint indent = frame->indent;
     uint spaces = cfg( doc, TidyIndentSpaces );
     Bool xhtml = cfgBool( doc, TidyXhtmlOut );
 
-    if ( node == NULL )
-        return;
+    frame->cmode = mode;
+    frame->cindent = indent;
 
     if (node->type == TextNode)
     {
@@ -1950,8 +2048,8 @@ void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
     }
     else if ( node->type == RootNode )
     {
-        for ( content = node->content; content; content = content->next )
-           TY_(PPrintTree)( doc, mode, indent, content );
+        frame->kind = PrintContent;
+        return yes;
     }
     else if ( node->type == DocTypeTag )
         PPrintDocType( doc, indent, node );
@@ -1975,8 +2073,8 @@ void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
         if ( ! TY_(nodeHasCM)(node, CM_INLINE) )
             PCondFlushLine( doc, indent );
 
-        if ( nodeIsBR(node) && node->prev &&
-             !(nodeIsBR(node->prev) || (mode & PREFORMATTED)) &&
+        if ( nodeIsBR(node) && NodePrev(node) &&
+             !(nodeIsBR(NodePrev(node)) || (mode & PREFORMATTED)) &&
              cfgBool(doc, TidyBreakBeforeBR) )
             TY_(PFlushLine)( doc, indent );
 
@@ -1984,7 +2082,7 @@ void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
         {
             /* insert extra newline for classic formatting */
             Bool classic = cfgBool( doc, TidyVertSpace );
-            if (classic && node->parent && node->parent->content != node)
+            if (classic && NodeParent(node) && NodeContent(NodeParent(node)) != node)
             {
                 TY_(PFlushLine)( doc, indent );
             }
@@ -1992,7 +2090,7 @@ void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
 
         PPrintTag( doc, mode, indent, node );
 
-        if (node->next)
+        if (NodeNext(node))
         {
           if (nodeIsPARAM(node) || nodeIsAREA(node))
               PCondFlushLine(doc, indent);
@@ -2006,42 +2104,32 @@ void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
         if ( node->type == StartEndTag )
             node->type = StartTag;
 
-        if ( node->tag && 
-             (node->tag->parser == TY_(ParsePre) || nodeIsTEXTAREA(node)) )
+        if ( NodeTag(node) && 
+             (NodeTag(node)->parser == TY_(ParsePre) || nodeIsTEXTAREA(node)) )
         {
             Bool classic  = cfgBool( doc, TidyVertSpace );
-            uint indprev = indent;
             PCondFlushLine( doc, indent );
 
             PCondFlushLine( doc, indent );
 
             /* insert extra newline for classic formatting */
-            if (classic && node->parent && node->parent->content != node)
+            if (classic && NodeParent(node) && NodeContent(NodeParent(node)) != node)
             {
                 TY_(PFlushLine)( doc, indent );
             }
             PPrintTag( doc, mode, indent, node );
 
-            indent = 0;
-            TY_(PFlushLine)( doc, indent );
-
-            for ( content = node->content; content; content = content->next )
-            {
-                TY_(PPrintTree)( doc, (mode | PREFORMATTED | NOWRAP),
-                                 indent, content );
-            }
-            PCondFlushLine( doc, indent );
-            indent = indprev;
-            PPrintEndTag( doc, mode, indent, node );
+            TY_(PFlushLine)( doc, 0 );
 
-            if ( cfgAutoBool(doc, TidyIndentContent) == TidyNoState
-                 && node->next != NULL )
-                TY_(PFlushLine)( doc, indent );
+            frame->kind = PrintPre;
+            frame->cmode = mode | PREFORMATTED | NOWRAP;
+            frame->cindent = 0;
+            return yes;
         }
         else if ( nodeIsSTYLE(node) || nodeIsSCRIPT(node) )
         {
-            PPrintScriptStyle( doc, (mode | PREFORMATTED | NOWRAP | CDATA),
-                               indent, node );
+            frame->mode = mode | PREFORMATTED | NOWRAP | CDATA;
+            return PPrintScriptStyleOpen( doc, frame );
         }
         else if ( TY_(nodeCMIsInline)(node) )
         {
@@ -2050,11 +2138,9 @@ void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
                 /* replace <nobr>...</nobr> by &nbsp; or &#160; etc. */
                 if ( nodeIsNOBR(node) )
                 {
-                    for ( content = node->content;
-                          content != NULL;
-                          content = content->next)
-                        TY_(PPrintTree)( doc, mode|NOWRAP, indent, content );
-                    return;
+                    frame->kind = PrintContent;
+                    frame->cmode = mode | NOWRAP;
+                    return yes;
                 }
             }
 
@@ -2062,28 +2148,14 @@ void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
             PPrintTag( doc, mode, indent, node );
 
             /* indent content for SELECT, TEXTAREA, MAP, OBJECT and APPLET */
+            frame->kind = PrintInline;
             if ( ShouldIndent(doc, node) )
             {
-                indent += spaces;
-                PCondFlushLine( doc, indent );
-
-                for ( content = node->content;
-                      content != NULL;
-                      content = content->next )
-                    TY_(PPrintTree)( doc, mode, indent, content );
-
-                indent -= spaces;
-                PCondFlushLine( doc, indent );
-                /* PCondFlushLine( doc, indent ); */
-            }
-            else
-            {
-                for ( content = node->content;
-                      content != NULL;
-                      content = content->next )
-                    TY_(PPrintTree)( doc, mode, indent, content );
+                frame->kind = PrintInlineIndent;
+                frame->cindent = indent + spaces;
+                PCondFlushLine( doc, frame->cindent );
             }
-            PPrintEndTag( doc, mode, indent, node );
+            return yes;
         }
         else /* other tags */
         {
@@ -2094,7 +2166,7 @@ void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
             uint contentIndent = indent;
 
             /* insert extra newline for classic formatting */
-            if (classic && node->parent && node->parent->content != node && !nodeIsHTML(node))
+            if (classic && NodeParent(node) && NodeContent(NodeParent(node)) != node && !nodeIsHTML(node))
             {
                 TY_(PFlushLine)( doc, indent );
             }
@@ -2103,12 +2175,12 @@ void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
                 contentIndent += spaces;
 
             PCondFlushLine( doc, indent );
-            if ( indsmart && node->prev != NULL )
+            if ( indsmart && NodePrev(node) != NULL )
                 TY_(PFlushLine)( doc, indent );
 
             /* do not omit elements with attributes */
             if ( !hideend || !TY_(nodeHasCM)(node, CM_OMITST) ||
-                 node->attributes != NULL )
+                 NodeAttrs(node) != NULL )
             {
                 PPrintTag( doc, mode, indent, node );
 
@@ -2116,7 +2188,7 @@ void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
                 {
                     /* fix for bug 530791, don't wrap after */
                     /* <li> if first child is text node     */
-                    if (!(nodeIsLI(node) && TY_(nodeIsText)(node->content)))
+                    if (!(nodeIsLI(node) && TY_(nodeIsText)(NodeContent(node))))
                         PCondFlushLine( doc, contentIndent );
                 }
                 else if ( TY_(nodeHasCM)(node, CM_HTML) || nodeIsNOFRAMES(node) ||
@@ -2124,20 +2196,51 @@ void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
                     TY_(PFlushLine)( doc, contentIndent );
             }
 
-            last = NULL;
-            for ( content = node->content; content; content = content->next )
-            {
-                /* kludge for naked text before block level tag */
-                if ( last && !indcont && TY_(nodeIsText)(last) &&
-                     content->tag && !TY_(nodeHasCM)(content, CM_INLINE) )
-                {
-                    /* TY_(PFlushLine)(fout, indent); */
-                    TY_(PFlushLine)( doc, contentIndent );
-                }
+            frame->kind = PrintBlock;
+            frame->cindent = contentIndent;
+            frame->flushText = !indcont;
+            return yes;
+        }
+    }
+    return no;
+}
 
-                TY_(PPrintTree)( doc, mode, contentIndent, content );
-                last = content;
-            }
+static void PPrintClose( TidyDocImpl* doc, PrintFrame* frame )
+{
+    Node *node = frame->node;
+    uint mode = frame->mode;
+    uint indent = frame->indent;
+
+    switch ( frame->kind )
+    {
+    case PrintPre:
+        PCondFlushLine( doc, 0 );
+        PPrintEndTag( doc, mode, indent, node );
+
+        if ( cfgAutoBool(doc, TidyIndentContent) == TidyNoState
+             && NodeNext(node) != NULL )
+            TY_(PFlushLine)( doc, indent );
+        break;
+
+    case PrintScriptStyle:
+        PPrintScriptStyleClose( doc, frame );
+        break;
+
+    case PrintInlineIndent:
+        PCondFlushLine( doc, indent );
+        /* PCondFlushLine( doc, indent ); */
+        PPrintEndTag( doc, mode, indent, node );
+        break;
+
+    case PrintInline:
+        PPrintEndTag( doc, mode, indent, node );
+        break;
+
+    case PrintBlock:
+        {
+            Bool indcont  = ( cfgAutoBool(doc, TidyIndentContent) != TidyNoState );
+            Bool hideend  = cfgBool( doc, TidyHideEndTags );
+            Bool classic  = cfgBool( doc, TidyVertSpace );
 
             /* don't flush line for td and th */
             if ( ShouldIndent(doc, node) ||
@@ -2169,17 +2272,49 @@ void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
 
             if (!indcont && !hideend && !nodeIsHTML(node) && !classic)
                 TY_(PFlushLine)( doc, indent );
-            else if (classic && node->next != NULL && TY_(nodeHasCM)(node, CM_LIST|CM_DEFLIST|CM_TABLE|CM_BLOCK/*|CM_HEADING*/))
+            else if (classic && NodeNext(node) != NULL && TY_(nodeHasCM)(node, CM_LIST|CM_DEFLIST|CM_TABLE|CM_BLOCK/*|CM_HEADING*/))
                 TY_(PFlushLine)( doc, indent );
         }
+        break;
+
+    default:
+        break;
     }
 }
 
-void TY_(PPrintXMLTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
+/*
+ Feature request #434940 - fix by Dave Raggett/Ignacio Vazquez-Abrams 21 Jun 01
+ print just the content of the body element.
+ useful when you want to reuse material from
+ other documents.
+
+ -- Sebastiano Vigna <vigna@dsi.unimi.it>
+*/
+void TY_(PrintBody)( TidyDocImpl* doc )
+{
+    Node *node = TY_(FindBody)( doc );
+
+    if ( node )
+    {
+        for ( node = NodeContent(node); node != NULL; node = NodeNext(node) )
+            TY_(PPrintTree)( doc, NORMAL, 0, node );
+    }
+}
+
+void TY_(PPrintTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
+{
+    PPrintWalk( doc, mode, indent, node, PPrintOpen, PPrintClose );
+}
+
+static Bool PPrintXMLOpen( TidyDocImpl* doc, PrintFrame* frame )
 {
+    Node *node = frame->node;
+    uint mode = frame->mode;
+    uint indent = frame->indent;
     Bool xhtmlOut = cfgBool( doc, TidyXhtmlOut );
-    if (node == NULL)
-        return;
+
+    frame->cmode = mode;
+    frame->cindent = indent;
 
     if ( node->type == TextNode)
     {
@@ -2193,11 +2328,8 @@ void TY_(PPrintXMLTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
     }
     else if ( node->type == RootNode )
     {
-        Node *content;
-        for ( content = node->content;
-              content != NULL;
-              content = content->next )
-           TY_(PPrintXMLTree)( doc, mode, indent, content );
+        frame->kind = PrintContent;
+        return yes;
     }
     else if ( node->type == DocTypeTag )
         PPrintDocType( doc, indent, node );
@@ -2229,7 +2361,7 @@ void TY_(PPrintXMLTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
         Bool mixed = no;
         uint cindent;
 
-        for ( content = node->content; content; content = content->next )
+        for ( content = NodeContent(node); content; content = NodeNext(content) )
         {
             if ( TY_(nodeIsText)(content) )
             {
@@ -2252,18 +2384,35 @@ void TY_(PPrintXMLTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
             cindent = indent + spaces;
 
         PPrintTag( doc, mode, indent, node );
-        if ( !mixed && node->content )
+        if ( !mixed && NodeContent(node) )
             TY_(PFlushLine)( doc, cindent );
- 
-        for ( content = node->content; content; content = content->next )
-            TY_(PPrintXMLTree)( doc, mode, cindent, content );
-
-        if ( !mixed && node->content )
-            PCondFlushLine( doc, indent );
 
-        PPrintEndTag( doc, mode, indent, node );
-        /* PCondFlushLine( doc, indent ); */
+        frame->kind = PrintXML;
+        frame->indent = indent;
+        frame->cindent = cindent;
+        frame->mixed = mixed;
+        return yes;
     }
+    return no;
+}
+
+static void PPrintXMLClose( TidyDocImpl* doc, PrintFrame* frame )
+{
+    Node *node = frame->node;
+
+    if ( frame->kind != PrintXML )
+        return;
+
+    if ( !frame->mixed && NodeContent(node) )
+        PCondFlushLine( doc, frame->indent );
+
+    PPrintEndTag( doc, frame->mode, frame->indent, node );
+    /* PCondFlushLine( doc, indent ); */
+}
+
+void TY_(PPrintXMLTree)( TidyDocImpl* doc, uint mode, uint indent, Node *node )
+{
+    PPrintWalk( doc, mode, indent, node, PPrintXMLOpen, PPrintXMLClose );
 }
 
 /*
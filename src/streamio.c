@@ -25,6 +25,7 @@
 #include "message.h"
 #include "utf8.h"
 #include "tmbstr.h"
+#include "textscan.h"
 
 #ifdef TIDY_WIN32_MLANG_SUPPORT
 #include "win32tc.h"
@@ -38,6 +39,9 @@ static uint ReadCharFromStream( StreamIn* in );
 
 static uint ReadByte( StreamIn* in );
 static void UngetByte( StreamIn* in, uint byteValue );
+static const byte* bytesrc_getBlock( TidyInputSource* source, byte* buf,
+                                     uint maxlen, uint* len );
+static int DecodeUTF8FromStream( StreamIn* in, uint firstByte, uint* c, int* count );
 
 static void PutByte( uint byteValue, StreamOut* out );
 
@@ -51,56 +55,14 @@ static uint DecodeLatin0(uint c);
 
 static uint PopChar( StreamIn *in );
 
-/******************************
-** Static (duration) Globals
-******************************/
-
-static StreamOut stderrStreamOut = 
-{
-    ASCII,
-    FSM_ASCII,
-    DEFAULT_NL_CONFIG,
-#ifdef TIDY_WIN32_MLANG_SUPPORT
-    NULL,
-#endif
-    FileIO,
-    { 0, TY_(filesink_putByte) }
-};
-
-static StreamOut stdoutStreamOut = 
-{
-    ASCII,
-    FSM_ASCII,
-    DEFAULT_NL_CONFIG,
-#ifdef TIDY_WIN32_MLANG_SUPPORT
-    NULL,
-#endif
-    FileIO,
-    { 0, TY_(filesink_putByte) }
-};
-
-StreamOut* TY_(StdErrOutput)(void)
-{
-  if ( stderrStreamOut.sink.sinkData == 0 )
-      stderrStreamOut.sink.sinkData = stderr;
-  return &stderrStreamOut;
-}
-
-#if 0
-StreamOut* TY_(StdOutOutput)(void)
-{
-  if ( stdoutStreamOut.sink.sinkData == 0 )
-      stdoutStreamOut.sink.sinkData = stdout;
-  return &stdoutStreamOut;
-}
-#endif
 
 void  TY_(ReleaseStreamOut)( TidyDocImpl *doc,  StreamOut* out )
 {
-    if ( out && out != &stderrStreamOut && out != &stdoutStreamOut )
+    if ( out )
     {
-        if ( out->iotype == FileIO )
-            fclose( (FILE*) out->sink.sinkData );
+        FILE* fp = (FILE*) out->sink.sinkData;
+        if ( out->iotype == FileIO && fp != stderr && fp != stdout )
+            fclose( fp );
         TidyDocFree( doc, out );
     }
 }
@@ -124,6 +86,7 @@ StreamIn* TY_(initStreamIn)( TidyDocImpl* doc, int encoding )
     in->bufsize = CHARBUF_SIZE;
     in->allocator = doc->allocator;
     in->charbuf = (tchar*)TidyDocAlloc(doc, sizeof(tchar) * in->bufsize);
+    in->getBlock = bytesrc_getBlock;
     InitLastPos( in );
 #ifdef TIDY_STORE_ORIGINAL_TEXT
     in->otextbuf = NULL;
@@ -139,7 +102,9 @@ void TY_(freeStreamIn)(StreamIn* in)
     if (in->otextbuf)
         TidyFree(in->allocator, in->otextbuf);
 #endif
+    TidyFree(in->allocator, in->blockbuf);
     TidyFree(in->allocator, in->charbuf);
+    TidyFree(in->allocator, in->mark.charbuf);
     TidyFree(in->allocator, in);
 }
 
@@ -151,14 +116,31 @@ StreamIn* TY_(FileInput)( TidyDocImpl* doc, FILE *fp, int encoding )
         TY_(freeStreamIn)( in );
         return NULL;
     }
+    in->getBlock = TY_(fileSourceBlockFunc)( &in->source );
+    in->mapbase = TY_(fileSourceMapping)( &in->source, &in->mapsize );
     in->iotype = FileIO;
     return in;
 }
 
+/* Hand out the unread part of the buffer in one block */
+static const byte* bufsrc_getBlock( TidyInputSource* source, byte* ARG_UNUSED(buf),
+                                    uint ARG_UNUSED(maxlen), uint* len )
+{
+    TidyBuffer* inbuf = (TidyBuffer*) source->sourceData;
+    const byte* block = inbuf->bp + inbuf->next;
+    *len = 0;
+    if ( tidyBufEndOfInput(inbuf) )
+        return NULL;
+    *len = inbuf->size - inbuf->next;
+    inbuf->next = inbuf->size;
+    return block;
+}
+
 StreamIn* TY_(BufferInput)( TidyDocImpl* doc, TidyBuffer* buf, int encoding )
 {
     StreamIn *in = TY_(initStreamIn)( doc, encoding );
     tidyInitInputBuffer( &in->source, buf );
+    in->getBlock = bufsrc_getBlock;
     in->iotype = BufferIO;
     return in;
 }
@@ -171,6 +153,74 @@ StreamIn* TY_(UserInput)( TidyDocImpl* doc, TidyInputSource* source, int encodin
     return in;
 }
 
+/* Reads chunks as they are appended to the buffer, see
+** tidyParseChunk().  The caller clears "partial" once the
+** last one is in.
+*/
+StreamIn* TY_(ChunkInput)( TidyDocImpl* doc, TidyBuffer* chunks, int encoding )
+{
+    StreamIn *in = TY_(BufferInput)( doc, chunks, encoding );
+    in->partial = yes;
+    return in;
+}
+
+/* Notes where the next char is read from chunk input */
+void TY_(MarkStreamIn)( StreamIn* in )
+{
+    TidyBuffer* chunks = (TidyBuffer*) in->source.sourceData;
+    StreamMark* mark = &in->mark;
+
+    mark->offset = chunks->next - (in->blocklen - in->blockpos) - in->restlen;
+    mark->state = in->state;
+    mark->pushed = in->pushed;
+    mark->bufpos = in->bufpos;
+    if ( mark->charbuflen < in->bufpos )
+    {
+        mark->charbuflen = in->bufsize;
+        mark->charbuf = (tchar*) TidyRealloc( in->allocator, mark->charbuf,
+                                              sizeof(tchar) * mark->charbuflen );
+    }
+    if ( in->bufpos > 0 )
+        memcpy( mark->charbuf, in->charbuf, sizeof(tchar) * in->bufpos );
+    mark->tabs = in->tabs;
+    memcpy( mark->lastcols, in->lastcols, sizeof(mark->lastcols) );
+    mark->curlastpos = in->curlastpos;
+    mark->firstlastpos = in->firstlastpos;
+    mark->curcol = in->curcol;
+    mark->curline = in->curline;
+    memcpy( mark->rawunget, in->rawunget, sizeof(mark->rawunget) );
+    mark->rawungetlen = in->rawungetlen;
+}
+
+/* Goes back to the mark, to read from there again.  The window
+** is emptied, so the buffer may be moved before the next read.
+*/
+void TY_(ResetStreamIn)( StreamIn* in )
+{
+    TidyBuffer* chunks = (TidyBuffer*) in->source.sourceData;
+    StreamMark* mark = &in->mark;
+
+    chunks->next = mark->offset;
+    in->block = in->rest = NULL;
+    in->blockpos = in->blocklen = in->restlen = 0;
+    in->starved = no;
+
+    in->state = mark->state;
+    in->pushed = mark->pushed;
+    /* charbuf only grows, so it still has room */
+    in->bufpos = mark->bufpos;
+    if ( mark->bufpos > 0 )
+        memcpy( in->charbuf, mark->charbuf, sizeof(tchar) * mark->bufpos );
+    in->tabs = mark->tabs;
+    memcpy( in->lastcols, mark->lastcols, sizeof(in->lastcols) );
+    in->curlastpos = mark->curlastpos;
+    in->firstlastpos = mark->firstlastpos;
+    in->curcol = mark->curcol;
+    in->curline = mark->curline;
+    memcpy( in->rawunget, mark->rawunget, sizeof(in->rawunget) );
+    in->rawungetlen = mark->rawungetlen;
+}
+
 int TY_(ReadBOMEncoding)(StreamIn *in)
 {
     uint c, c1;
@@ -512,6 +562,118 @@ uint TY_(ReadChar)( StreamIn *in )
     return c;
 }
 
+/* Plain ASCII text is passed through unchanged by these encodings */
+static Bool IsTextRunEncoding( StreamIn* in )
+{
+    switch ( in->encoding )
+    {
+    case RAW:
+    case ASCII:
+    case LATIN0:
+    case LATIN1:
+    case UTF8:
+    case MACROMAN:
+    case WIN1252:
+    case IBM858:
+#if SUPPORT_ASIAN_ENCODINGS
+    case BIG5:
+    case SHIFTJIS:
+#endif
+        return yes;
+#ifndef NO_NATIVE_ISO2022_SUPPORT
+    case ISO2022:
+        return in->state == FSM_ASCII;
+#endif
+    }
+    return no;
+}
+
+/* Consumes a run of plain text (see TY_(ScanPlainText)) from the
+** input window and sets *run to point at it.  For UTF-8 input the
+** run may hold any valid non-ASCII chars as well, ending before
+** U+00A0 if stopAtNbsp is set.  Has the same effect on line and
+** column positions as reading it char by char.  Returns the run
+** length in bytes, 0 if the next char needs the full ReadChar().
+*/
+uint TY_(ReadTextRun)( StreamIn* in, ctmbstr* run, Bool stopAtNbsp )
+{
+#ifdef TIDY_STORE_ORIGINAL_TEXT
+    return 0;
+#else
+    const byte* buf;
+    uint i, n, chars;
+    int col;
+
+    if ( in->pushed || in->tabs > 0 || in->rawungetlen > 0
+         || !IsTextRunEncoding(in) )
+        return 0;
+
+    buf = in->block + in->blockpos;
+    n = TY_(ScanPlainText)( buf, in->blocklen - in->blockpos,
+                            in->encoding == UTF8 );
+    chars = n;
+    if ( n > 0 && in->encoding == UTF8 )
+        n = TY_(ScanValidUTF8)( buf, n, stopAtNbsp, &chars );
+    if ( n == 0 )
+        return 0;
+
+    *run = (ctmbstr) buf;
+    in->blockpos += n;
+
+    /* only the last LASTPOS_SIZE columns can be restored by UngetChar */
+    col = in->curcol;
+    i = ( chars > LASTPOS_SIZE ? chars - LASTPOS_SIZE : 0 );
+    for ( ; i < chars; ++i )
+    {
+        PopLastPos( in );
+        in->lastcols[in->curlastpos] = col + (int) i;
+    }
+    in->curcol = col + (int) chars;
+    return n;
+#endif
+}
+
+/* Where the next char to be read starts in the memory mapped input,
+** or NULL if the input isn't mapped.  Pushed back chars are taken
+** to be the bytes just before the read position: one byte for ASCII
+** and their UTF-8 length otherwise, so non-ASCII only for UTF-8 input.
+** The position is only a hint: callers must check the bytes there
+** before relying on them.
+*/
+const byte* TY_(MappedInputPos)( StreamIn* in )
+{
+    const byte* pos;
+    uint i, n = 0;
+
+    if ( in->mapbase == NULL || in->block == NULL
+         || in->tabs > 0 || in->rawungetlen > 0 )
+        return NULL;
+#if SUPPORT_UTF16_ENCODINGS
+    if ( in->encoding == UTF16 || in->encoding == UTF16LE
+         || in->encoding == UTF16BE )
+        return NULL;
+#endif
+
+    pos = in->block + in->blockpos;
+    for ( i = 0; in->pushed && i < in->bufpos; ++i )
+    {
+        tchar c = in->charbuf[i];
+        if ( c < 0x80 )
+            n += 1;
+        else if ( in->encoding != UTF8 )
+            return NULL;
+        else if ( c < 0x800 )
+            n += 2;
+        else if ( c < 0x10000 )
+            n += 3;
+        else
+            n += 4;
+    }
+    if ( n > (uint)(pos - in->mapbase) )
+        return NULL;
+    return pos - n;
+}
+
 static uint PopChar( StreamIn *in )
 {
     uint c = EndOfStream;
@@ -579,6 +741,14 @@ StreamOut* TY_(FileOutput)( TidyDocImpl *doc, FILE* fp, int encoding, uint nl )
     out->iotype = FileIO;
     return out;
 }
+/* Each document gets its own stderr stream so that the encoder
+** state is never shared between documents on different threads.
+*/
+StreamOut* TY_(StdErrOutput)( TidyDocImpl *doc )
+{
+    return TY_(FileOutput)( doc, stderr, ASCII, DEFAULT_NL_CONFIG );
+}
+
 StreamOut* TY_(BufferOutput)( TidyDocImpl *doc, TidyBuffer* buf, int encoding, uint nl )
 {
     StreamOut* out = initStreamOut( doc, encoding, nl );
@@ -1081,17 +1251,136 @@ void TIDY_CALL tidyPutByte( TidyOutputSink* sink, uint ch )
     sink->putByte( sink->sinkData, (byte) ch );
 }
 
+/* Adapter for sources that only deliver a byte at a time,
+** such as user supplied ones
+*/
+static const byte* bytesrc_getBlock( TidyInputSource* source, byte* buf,
+                                     uint maxlen, uint* len )
+{
+    uint n = 0;
+    while ( n < maxlen && !source->eof(source->sourceData) )
+    {
+        int bv = source->getByte( source->sourceData );
+        if ( bv == EOF )
+            break;
+        buf[n++] = (byte) bv;
+    }
+    *len = n;
+    return n > 0 ? buf : NULL;
+}
+
+/* Move the window on to the next block of raw input.
+** Returns no at end of input.
+*/
+static Bool FillBlock( StreamIn* in )
+{
+    uint len = 0;
+
+    /* past the memory limit the rest is ignored, see DocParseStream().
+    ** Windows the size of blockbuf keep a token from taking much more
+    ** than the limit, and from stopping anywhere else, even if source
+    ** memory holds all of the input.
+    */
+    if ( in->blockeof || in->doc->arena.exceeded )
+        return no;
+
+    if ( in->restlen == 0 )
+    {
+        if ( in->blockbuf == NULL )
+            in->blockbuf = (byte*) TidyAlloc( in->allocator, BLOCKBUF_SIZE );
+
+        in->rest = in->getBlock( &in->source, in->blockbuf, BLOCKBUF_SIZE, &len );
+        if ( in->rest == NULL || len == 0 )
+        {
+            if ( in->partial )
+                in->starved = yes;
+            else
+                in->blockeof = yes;
+            return no;
+        }
+        in->restlen = len;
+    }
+
+    len = ( in->restlen > BLOCKBUF_SIZE ? BLOCKBUF_SIZE : in->restlen );
+    in->block = in->rest;
+    in->blockpos = 0;
+    in->blocklen = len;
+    in->rest += len;
+    in->restlen -= len;
+    return yes;
+}
+
 static uint ReadByte( StreamIn* in )
 {
-    return tidyGetByte( &in->source );
+    if ( in->rawungetlen > 0 )
+        return in->rawunget[ --in->rawungetlen ];
+    if ( in->blockpos < in->blocklen || FillBlock(in) )
+        return in->block[ in->blockpos++ ];
+    return EndOfStream;
+}
+
+uint TY_(ReadRawByte)( StreamIn* in )
+{
+    return ReadByte( in );
 }
+
 Bool TY_(IsEOF)( StreamIn* in )
 {
-    return tidyIsEOF( &in->source );
+    if ( in->rawungetlen > 0 || in->blockpos < in->blocklen )
+        return no;
+    return !FillBlock( in );
 }
+
 static void UngetByte( StreamIn* in, uint byteValue )
 {
-    tidyUngetByte( &in->source, byteValue );
+    if ( in->rawungetlen == 0 && in->blockpos > 0 )
+    {
+        --in->blockpos;
+        assert( in->block[in->blockpos] == (byte) byteValue );
+    }
+    else
+    {
+        assert( in->rawungetlen < RAWUNGET_SIZE );
+        in->rawunget[ in->rawungetlen++ ] = (byte) byteValue;
+    }
+}
+
+/* Decode a UTF-8 sequence whose first byte has already been read.
+** Successor bytes are taken straight from the window when it holds
+** enough of them, otherwise they are gathered a byte at a time and
+** any not used by the sequence are put back.
+*/
+static int DecodeUTF8FromStream( StreamIn* in, uint firstByte, uint* c, int* count )
+{
+    enum { kMaxSuccessors = 5 };
+    tmbchar succ[kMaxSuccessors + 1];
+    uint i, avail = 0;
+    int err;
+
+    if ( in->rawungetlen == 0 && in->blocklen - in->blockpos >= kMaxSuccessors )
+    {
+        err = TY_(DecodeUTF8BytesToChar)( c, firstByte,
+                                          (ctmbstr) in->block + in->blockpos,
+                                          NULL, count );
+        in->blockpos += *count - 1;
+        return err;
+    }
+
+    while ( avail < kMaxSuccessors )
+    {
+        uint b = ReadByte( in );
+        if ( b == EndOfStream )
+            break;
+        succ[avail++] = (tmbchar) b;
+    }
+    for ( i = avail; i <= kMaxSuccessors; ++i )
+        succ[i] = 0;
+
+    err = TY_(DecodeUTF8BytesToChar)( c, firstByte, succ, NULL, count );
+
+    for ( i = avail; i > (uint)(*count - 1); --i )
+        UngetByte( in, (byte) succ[i-1] );
+    return err;
 }
 static void PutByte( uint byteValue, StreamOut* out )
 {
@@ -1154,9 +1443,6 @@ static uint ReadCharFromStream( StreamIn* in )
     uint bytesRead = 0;
 #endif
 
-    if ( TY_(IsEOF)(in) )
-        return EndOfStream;
-    
     c = ReadByte( in );
 
     if (c == EndOfStream)
@@ -1255,7 +1541,7 @@ static uint ReadCharFromStream( StreamIn* in )
         int err, count = 0;
         
         /* first byte "c" is passed in separately */
-        err = TY_(DecodeUTF8BytesToChar)( &n, c, NULL, &in->source, &count );
+        err = DecodeUTF8FromStream( in, c, &n, &count );
         if (!err && (n == (uint)EndOfStream) && (count == 1)) /* EOF */
             return EndOfStream;
         else if (err)
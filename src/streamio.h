@@ -62,9 +62,32 @@ typedef enum
 enum
 {
     CHARBUF_SIZE=5,
-    LASTPOS_SIZE=64
+    LASTPOS_SIZE=64,
+    BLOCKBUF_SIZE=8192,
+    RAWUNGET_SIZE=8
 };
 
+/* Where a token began in input that may be followed by more,
+** see MarkStreamIn()
+*/
+typedef struct _StreamMark
+{
+    uint   offset;              /* into the source buffer */
+    ISO2022State state;
+    Bool   pushed;
+    tchar* charbuf;
+    uint   bufpos;
+    uint   charbuflen;          /* allocated */
+    int    tabs;
+    int    lastcols[LASTPOS_SIZE];
+    unsigned short curlastpos;
+    unsigned short firstlastpos;
+    int    curcol;
+    int    curline;
+    byte   rawunget[RAWUNGET_SIZE];
+    uint   rawungetlen;
+} StreamMark;
+
 /* non-raw input is cleaned up*/
 struct _StreamIn
 {
@@ -85,6 +108,36 @@ struct _StreamIn
 
     TidyInputSource source;
 
+    /* Raw bytes are read a block at a time.  "block" is the current
+    ** window, either in "blockbuf" or directly in source memory.
+    ** Bytes ungotten past the start of the window go to "rawunget".
+    ** A source block may be the whole input, so the window moves over
+    ** it BLOCKBUF_SIZE bytes at a time, the rest waiting in "rest".
+    */
+    TidyGetBlockFunc getBlock;
+    const byte* block;
+    uint   blockpos;
+    uint   blocklen;
+    const byte* rest;
+    uint   restlen;
+    byte*  blockbuf;
+    Bool   blockeof;
+    byte   rawunget[RAWUNGET_SIZE];
+    uint   rawungetlen;
+
+    /* Memory mapped file input: the whole mapping */
+    const byte* mapbase;
+    size_t mapsize;
+
+    /* Input given so far to tidyParseChunk(), with more to come
+    ** while "partial" is set.  Running out of it then sets "starved"
+    ** rather than "blockeof", so the lexer can go back to the mark
+    ** at the start of the token and read it again with more input.
+    */
+    Bool   partial;
+    Bool   starved;
+    StreamMark mark;
+
 #ifdef TIDY_WIN32_MLANG_SUPPORT
     void* mlang;
 #endif
@@ -105,9 +158,16 @@ void TY_(freeStreamIn)(StreamIn* in);
 StreamIn* TY_(FileInput)( TidyDocImpl* doc, FILE* fp, int encoding );
 StreamIn* TY_(BufferInput)( TidyDocImpl* doc, TidyBuffer* content, int encoding );
 StreamIn* TY_(UserInput)( TidyDocImpl* doc, TidyInputSource* source, int encoding );
+StreamIn* TY_(ChunkInput)( TidyDocImpl* doc, TidyBuffer* chunks, int encoding );
+
+void      TY_(MarkStreamIn)( StreamIn* in );
+void      TY_(ResetStreamIn)( StreamIn* in );
 
 int       TY_(ReadBOMEncoding)(StreamIn *in);
+uint      TY_(ReadRawByte)( StreamIn* in );
 uint      TY_(ReadChar)( StreamIn* in );
+uint      TY_(ReadTextRun)( StreamIn* in, ctmbstr* run, Bool stopAtNbsp );
+const byte* TY_(MappedInputPos)( StreamIn* in );
 void      TY_(UngetChar)( uint c, StreamIn* in );
 Bool      TY_(IsEOF)( StreamIn* in );
 
@@ -134,8 +194,7 @@ StreamOut* TY_(FileOutput)( TidyDocImpl *doc, FILE* fp, int encoding, uint newln
 StreamOut* TY_(BufferOutput)( TidyDocImpl *doc, TidyBuffer* buf, int encoding, uint newln );
 StreamOut* TY_(UserOutput)( TidyDocImpl *doc, TidyOutputSink* sink, int encoding, uint newln );
 
-StreamOut* TY_(StdErrOutput)(void);
-/* StreamOut* StdOutOutput(void); */
+StreamOut* TY_(StdErrOutput)( TidyDocImpl *doc );
 void       TY_(ReleaseStreamOut)( TidyDocImpl *doc, StreamOut* out );
 
 void TY_(WriteChar)( uint c, StreamOut* out );
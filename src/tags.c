@@ -16,6 +16,7 @@
 #include "tidy-int.h"
 #include "message.h"
 #include "tmbstr.h"
+#include "perfhash.h"
 
 /* Attribute checking methods */
 static CheckAttribs CheckIMG;
@@ -262,6 +263,48 @@ static const Dict tag_defs[] =
   { (TidyTagId)0,        NULL,         0,                    NULL,                       (0),                                           NULL,          NULL           }
 };
 
+/* Perfect hash of tag_defs, see perfhash.h.  Debug builds check it
+   in InitTags() and print new arrays if the table has changed. */
+static const unsigned short tagHashSeeds[] =
+{
+    1, 13, 7, 3, 3, 0, 2, 3, 5, 3, 1, 1,
+    1, 1, 2, 1, 5, 1, 1, 1, 2, 4, 4, 5,
+    1, 4, 11, 5, 1, 6, 3, 16, 3, 1, 5, 2,
+    7, 5, 8, 6, 1, 2, 4, 4, 5, 2, 0, 10,
+    7, 6, 1, 0, 1, 0, 4, 0, 0, 8, 13, 0
+};
+static const unsigned short tagHashSlots[] =
+{
+    64, 119, 70, 91, 50, 0, 0, 4, 82, 15, 42, 113,
+    0, 103, 33, 30, 44, 9, 68, 25, 19, 95, 38, 32,
+    78, 10, 22, 66, 104, 16, 69, 87, 116, 5, 0, 1,
+    61, 72, 0, 100, 39, 0, 0, 89, 105, 48, 36, 77,
+    0, 18, 0, 28, 92, 73, 90, 88, 0, 62, 55, 94,
+    60, 0, 0, 0, 11, 53, 102, 115, 21, 20, 106, 111,
+    109, 74, 0, 107, 0, 81, 0, 84, 52, 96, 75, 49,
+    37, 0, 114, 47, 76, 23, 3, 14, 80, 0, 0, 83,
+    0, 54, 0, 27, 57, 8, 93, 24, 12, 117, 97, 13,
+    65, 2, 63, 43, 41, 0, 35, 0, 56, 71, 51, 98,
+    0, 79, 67, 118, 40, 7, 85, 0, 0, 6, 110, 0,
+    46, 31, 45, 0, 59, 17, 86, 99, 0, 112, 0, 29,
+    108, 26, 58, 34, 101
+};
+
+static const PerfectHash tagHash =
+{
+    tagHashSeeds, sizeof(tagHashSeeds)/sizeof(tagHashSeeds[0]),
+    tagHashSlots, sizeof(tagHashSlots)/sizeof(tagHashSlots[0]),
+    no
+};
+
+#if defined(_DEBUG)
+static ctmbstr tagDefName( uint ix )
+{
+    return tag_defs[ix].name;
+}
+#endif
+
+/* Declared tags are hashed per document, as they are defined */
 #if ELEMENT_HASH_LOOKUP
 static uint tagsHash(ctmbstr s)
 {
@@ -273,22 +316,17 @@ static uint tagsHash(ctmbstr s)
     return hashval % ELEMENT_HASH_SIZE;
 }
 
-static const Dict *tagsInstall(TidyDocImpl* doc, TidyTagImpl* tags, const Dict* old)
+static void tagsInstall(TidyDocImpl* doc, TidyTagImpl* tags, const Dict* old)
 {
     DictHash *np;
     uint hashval;
 
-    if (old)
-    {
-        np = (DictHash *)TidyDocAlloc(doc, sizeof(*np));
-        np->tag = old;
-
-        hashval = tagsHash(old->name);
-        np->next = tags->hashtab[hashval];
-        tags->hashtab[hashval] = np;
-    }
+    np = (DictHash *)TidyDocAlloc(doc, sizeof(*np));
+    np->tag = old;
 
-    return old;
+    hashval = tagsHash(old->name);
+    np->next = tags->hashtab[hashval];
+    tags->hashtab[hashval] = np;
 }
 
 static void tagsRemoveFromHash( TidyDocImpl* doc, TidyTagImpl* tags, ctmbstr s )
@@ -333,43 +371,30 @@ static void tagsEmptyHash( TidyDocImpl* doc, TidyTagImpl* tags )
 }
 #endif /* ELEMENT_HASH_LOOKUP */
 
-static const Dict* tagsLookup( TidyDocImpl* doc, TidyTagImpl* tags, ctmbstr s )
+static const Dict* tagsLookup( TidyDocImpl* ARG_UNUSED(doc), TidyTagImpl* tags, ctmbstr s )
 {
-    const Dict *np;
+    uint ix;
 #if ELEMENT_HASH_LOOKUP
     const DictHash* p;
+#else
+    const Dict *np;
 #endif
 
     if (!s)
         return NULL;
 
+    ix = TY_(PerfectHashIndex)( &tagHash, s );
+    if ( ix && TY_(tmbstrcmp)(s, tag_defs[ix].name) == 0 )
+        return tag_defs + ix;
+
 #if ELEMENT_HASH_LOOKUP
-    /* this breaks if declared elements get changed between two   */
-    /* parser runs since Tidy would use the cached version rather */
-    /* than the new one.                                          */
-    /* However, as FreeDeclaredTags() correctly cleans the hash   */
-    /* this should not be true anymore.                           */
     for (p = tags->hashtab[tagsHash(s)]; p && p->tag; p = p->next)
         if (TY_(tmbstrcmp)(s, p->tag->name) == 0)
             return p->tag;
-
-    for (np = tag_defs + 1; np < tag_defs + N_TIDY_TAGS; ++np)
-        if (TY_(tmbstrcmp)(s, np->name) == 0)
-            return tagsInstall(doc, tags, np);
-
-    for (np = tags->declared_tag_list; np; np = np->next)
-        if (TY_(tmbstrcmp)(s, np->name) == 0)
-            return tagsInstall(doc, tags, np);
 #else
-
-    for (np = tag_defs + 1; np < tag_defs + N_TIDY_TAGS; ++np)
-        if (TY_(tmbstrcmp)(s, np->name) == 0)
-            return np;
-
     for (np = tags->declared_tag_list; np; np = np->next)
         if (TY_(tmbstrcmp)(s, np->name) == 0)
             return np;
-
 #endif /* ELEMENT_HASH_LOOKUP */
 
     return NULL;
@@ -408,6 +433,9 @@ static void declare( TidyDocImpl* doc, TidyTagImpl* tags,
             np = NewDict( doc, name );
             np->next = tags->declared_tag_list;
             tags->declared_tag_list = np;
+#if ELEMENT_HASH_LOOKUP
+            tagsInstall( doc, tags, np );
+#endif
         }
 
         /* Make sure we are not over-writing predefined tags */
@@ -428,19 +456,28 @@ Bool TY_(FindTag)( TidyDocImpl* doc, Node *node )
     const Dict *np = NULL;
     if ( cfgBool(doc, TidyXmlTags) )
     {
-        node->tag = doc->tags.xml_tags;
+        SetNodeTag(node, doc->tags.xml_tags);
         return yes;
     }
 
-    if ( node->element && (np = tagsLookup(doc, &doc->tags, node->element)) )
+    if ( NodeElement(node) && (np = tagsLookup(doc, &doc->tags, NodeElement(node))) )
     {
-        node->tag = np;
+        SetNodeTag(node, np);
         return yes;
     }
     
     return no;
 }
 
+ctmbstr TY_(KnownTagName)( ctmbstr s )
+{
+    uint ix = TY_(PerfectHashIndex)( &tagHash, s );
+
+    if ( ix && TY_(tmbstrcmp)(s, tag_defs[ix].name) == 0 )
+        return tag_defs[ix].name;
+    return NULL;
+}
+
 const Dict* TY_(LookupTagDef)( TidyTagId tid )
 {
     const Dict *np;
@@ -454,7 +491,7 @@ const Dict* TY_(LookupTagDef)( TidyTagId tid )
 
 Parser* TY_(FindParser)( TidyDocImpl* doc, Node *node )
 {
-    const Dict* np = tagsLookup( doc, &doc->tags, node->element );
+    const Dict* np = tagsLookup( doc, &doc->tags, NodeElement(node) );
     if ( np )
         return np->parser;
     return NULL;
@@ -546,6 +583,14 @@ void TY_(InitTags)( TidyDocImpl* doc )
 
     TidyClearMemory( tags, sizeof(TidyTagImpl) );
 
+#if defined(_DEBUG)
+    {
+        Bool ok = TY_(CheckPerfectHash)( &tagHash, tagDefName,
+                                         N_TIDY_TAGS, "tagHash" );
+        assert( ok );
+    }
+#endif
+
     /* create dummy entry for all xml tags */
     xml =  NewDict( doc, NULL );
     xml->versions = VERS_XML;
@@ -626,7 +671,7 @@ void TY_(FreeTags)( TidyDocImpl* doc )
 /* default method for checking an element's attributes */
 void TY_(CheckAttributes)( TidyDocImpl* doc, Node *node )
 {
-    AttVal *next, *attval = node->attributes;
+    AttVal *next, *attval = NodeAttrs(node);
     while (attval)
     {
         next = attval->next;
@@ -736,7 +781,10 @@ void CheckTABLE( TidyDocImpl* doc, Node *node )
     if ( cfgBool(doc, TidyXmlOut) && (attval = TY_(AttrGetById)(node, TidyAttr_BORDER)) )
     {
         if (attval->value == NULL)
+        {
+            attval = TY_(OwnAttr)(doc, node, attval);
             attval->value = TY_(tmbstrdup)(doc->allocator, "1");
+        }
     }
 }
 
@@ -858,12 +906,12 @@ Bool TY_(nodeHasText)( TidyDocImpl* doc, Node* node )
 {
   if ( doc && node )
   {
-    uint ix;
-    Lexer* lexer = doc->lexer;
-    for ( ix = node->start; ix < node->end; ++ix )
+    size_t ix;
+    ctmbstr text = NodeText( doc->lexer, node );
+    for ( ix = 0; ix < NodeTextLen(node); ++ix )
     {
         /* whitespace */
-        if ( !TY_(IsWhite)( lexer->lexbuf[ix] ) )
+        if ( !TY_(IsWhite)( text[ix] ) )
             return yes;
     }
   }
@@ -891,8 +939,8 @@ Bool nodeMatchCM( Node* node, uint contentModel )
 */
 Bool TY_(nodeHasCM)( Node* node, uint contentModel )
 {
-  return ( node && node->tag && 
-           (node->tag->model & contentModel) != 0 );
+  return ( node && NodeTag(node) && 
+           (NodeTag(node)->model & contentModel) != 0 );
 }
 
 Bool TY_(nodeCMIsBlock)( Node* node )
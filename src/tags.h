@@ -20,9 +20,54 @@
 #include "forward.h"
 #include "attrdict.h"
 
-typedef void (Parser)( TidyDocImpl* doc, Node *node, GetTokenMode mode );
+/*
+ A parser reads the content of frame->element.  Instead of parsing
+ an element it meets itself, it returns it, and is called again with
+ the same frame once that element's content has been parsed; it
+ returns NULL when frame->element is done.  So the elements open at
+ any point are on the lexer's stack of frames, not the C stack.
+*/
+typedef Node* (Parser)( TidyDocImpl* doc, ParseFrame* frame );
 typedef void (CheckAttribs)( TidyDocImpl* doc, Node *node );
 
+/* where a parser carries on from when called again */
+typedef enum
+{
+    ParseStart,         /* first call for the element */
+    ParseContent,       /* the next token */
+    ParseExiled,        /* after content moved before a table */
+    ParseCell,          /* after a table cell */
+    ParseCenter,        /* after a center that broke a list */
+    ParseSplit,         /* after an element that split a pre */
+    ParseNoFramesBody,  /* after a body in noframes */
+    ParseBodyStart,     /* after the head, see ParseHTML */
+    ParseFramesetDone,  /* after a frameset */
+    ParseDone           /* after the last child */
+} ParseState;
+
+struct _ParseFrame
+{
+    Parser*      parser;
+    Node*        element;
+    GetTokenMode mode;
+    ParseState   state;
+
+    /* the element to parse next, as returned */
+    Node*        child;
+    Parser*      childparser;   /* if not its tag's parser */
+    GetTokenMode childmode;
+
+    /* what the parsers keep while child is parsed */
+    Bool         checkstack;
+    Bool         saved;         /* a lexer flag to restore */
+    uint         istackbase;
+    uint         titles;        /* ParseHead */
+    uint         bases;
+    Node*        parent;        /* ParseDefList */
+    Node*        frameset;      /* ParseHTML */
+    Node*        noframes;
+};
+
 /*
  Tag dictionary node
 */
@@ -81,6 +126,9 @@ typedef struct _TidyTagImpl TidyTagImpl;
 
 /* interface for finding tag by name */
 const Dict* TY_(LookupTagDef)( TidyTagId tid );
+
+/* The name of the built-in tag called s, NULL if none */
+ctmbstr TY_(KnownTagName)( ctmbstr s );
 Bool    TY_(FindTag)( TidyDocImpl* doc, Node *node );
 Parser* TY_(FindParser)( TidyDocImpl* doc, Node *node );
 void    TY_(DefineTag)( TidyDocImpl* doc, UserTagType tagType, ctmbstr name );
@@ -120,8 +168,8 @@ Parser TY_(ParseText);
 CheckAttribs TY_(CheckAttributes);
 
 /* 0 == TidyTag_UNKNOWN */
-#define TagId(node)        ((node) && (node)->tag ? (node)->tag->id : TidyTag_UNKNOWN)
-#define TagIsId(node, tid) ((node) && (node)->tag && (node)->tag->id == tid)
+#define TagId(node)        ((node) && NodeTag(node) ? NodeTag(node)->id : TidyTag_UNKNOWN)
+#define TagIsId(node, tid) ((node) && NodeTag(node) && NodeTag(node)->id == tid)
 
 Bool TY_(nodeIsText)( Node* node );
 Bool TY_(nodeIsElement)( Node* node );
@@ -0,0 +1,440 @@
+/* textscan.c -- fast scanning of raw input text
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+  The lexer spends most of its time on ordinary text, where every
+  character is simply copied.  These scanners find where such a
+  run ends so it can be copied in one go, and check that UTF-8
+  input in the run is valid so it need not be decoded.
+
+  The SSE2 versions are used whenever the target guarantees SSE2
+  (all x86-64 targets).  With gcc and clang AVX2 versions are also
+  built and picked at run time if the processor supports them.
+
+*/
+
+#include "forward.h"
+#include "textscan.h"
+
+#if SUPPORT_SIMD_SCAN && ( defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) \
+                           || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) )
+#define TIDY_SCAN_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__) && ( __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) \
+                           || defined(__clang__) )
+#define TIDY_SCAN_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+#define IsUTF8Trail(b)  ( ((b) & 0xC0) == 0x80 )
+
+/* Scalar version, also used for the tail of a buffer */
+static uint ScanPlainTextBytes( const byte* buf, uint len, Bool highBytes,
+                                Bool prevSpace )
+{
+    uint i;
+    for ( i = 0; i < len; ++i )
+    {
+        byte c = buf[i];
+        if ( c == ' ' )
+        {
+            if ( prevSpace )
+                break;
+            prevSpace = yes;
+            continue;
+        }
+        if ( c >= 0x80 && highBytes )
+        {
+            prevSpace = no;
+            continue;
+        }
+        if ( c <= ' ' || c >= 0x7F || c == '<' || c == '&' )
+            break;
+        prevSpace = no;
+    }
+    return i;
+}
+
+/* Checks UTF-8 the way DecodeUTF8BytesToChar() does: shortest form
+** only, at most U+10FFFF, U+FFFE and U+FFFF rejected, surrogates
+** allowed.  Returns the length of the valid prefix of buf, which
+** ends on a character boundary, and adds the number of characters
+** in it to *chars.
+*/
+static uint ScanValidUTF8Bytes( const byte* buf, uint len, Bool stopAtNbsp,
+                                uint* chars )
+{
+    uint i = 0, n = 0;
+
+    while ( i < len )
+    {
+        byte c = buf[i];
+        byte lo = 0x80, hi = 0xBF;
+        uint need;
+
+        if ( c < 0x80 )
+        {
+            ++i;
+            ++n;
+            continue;
+        }
+
+        if ( c >= 0xC2 && c <= 0xDF )
+            need = 2;
+        else if ( c >= 0xE0 && c <= 0xEF )
+        {
+            need = 3;
+            if ( c == 0xE0 )
+                lo = 0xA0;
+        }
+        else if ( c >= 0xF0 && c <= 0xF4 )
+        {
+            need = 4;
+            if ( c == 0xF0 )
+                lo = 0x90;
+            else if ( c == 0xF4 )
+                hi = 0x8F;
+        }
+        else
+            break;
+
+        if ( i + need > len || buf[i+1] < lo || buf[i+1] > hi )
+            break;
+        if ( need > 2 && !IsUTF8Trail(buf[i+2]) )
+            break;
+        if ( need > 3 && !IsUTF8Trail(buf[i+3]) )
+            break;
+
+        /* U+FFFE and U+FFFF */
+        if ( c == 0xEF && buf[i+1] == 0xBF && (buf[i+2] & 0xFE) == 0xBE )
+            break;
+        /* U+00A0 */
+        if ( stopAtNbsp && c == 0xC2 && buf[i+1] == 0xA0 )
+            break;
+
+        i += need;
+        ++n;
+    }
+
+    *chars += n;
+    return i;
+}
+
+/* Trailing zero count of a non-zero mask */
+static uint LowestBit( uint mask )
+{
+#if defined(__GNUC__)
+    return (uint) __builtin_ctz( mask );
+#else
+    uint n = 0;
+    while ( !(mask & 1) )
+    {
+        mask >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+#ifdef TIDY_SCAN_SSE2
+static uint ScanPlainTextSSE2( const byte* buf, uint len, Bool highBytes )
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i high  = highBytes ? _mm_set1_epi8( -1 ) : zero;
+    const __m128i space = _mm_set1_epi8( 0x20 );
+    const __m128i del   = _mm_set1_epi8( 0x7F );
+    const __m128i lt    = _mm_set1_epi8( '<' );
+    const __m128i amp   = _mm_set1_epi8( '&' );
+    uint i = 0, carry = 0;
+
+    for ( ; i + 16 <= len; i += 16 )
+    {
+        __m128i v, ok;
+        uint okMask, spMask, dblSp, bad;
+
+        /* signed compares, so bytes >= 0x80 are less than zero */
+        v  = _mm_loadu_si128( (const __m128i*)(buf + i) );
+        ok = _mm_andnot_si128( _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8(v, del),
+                                                           _mm_cmpeq_epi8(v, lt) ),
+                                             _mm_cmpeq_epi8(v, amp) ),
+                               _mm_cmpgt_epi8(v, space) );
+        ok = _mm_or_si128( ok, _mm_and_si128(high, _mm_cmplt_epi8(v, zero)) );
+
+        okMask = (uint) _mm_movemask_epi8( ok );
+        spMask = (uint) _mm_movemask_epi8( _mm_cmpeq_epi8(v, space) );
+        dblSp  = spMask & ( (spMask << 1) | carry );
+        bad    = ~( okMask | (spMask & ~dblSp) ) & 0xFFFF;
+
+        if ( bad )
+            return i + LowestBit( bad );
+        carry = (spMask >> 15) & 1;
+    }
+    return i + ScanPlainTextBytes( buf + i, len - i, highBytes,
+                                   i > 0 && buf[i-1] == ' ' );
+}
+
+/* Without a byte shuffle SSE2 can only skip over ASCII quickly,
+** other chunks are checked a character at a time.
+*/
+static uint ScanValidUTF8SSE2( const byte* buf, uint len, Bool stopAtNbsp,
+                               uint* chars )
+{
+    uint i = 0;
+
+    while ( i + 16 <= len )
+    {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(buf + i) );
+
+        if ( _mm_movemask_epi8(v) == 0 )
+        {
+            i += 16;
+            *chars += 16;
+        }
+        else
+        {
+            /* room for a sequence starting at the end of the chunk */
+            uint lim = ( len - i < 19 ? len - i : 19 );
+            uint m = ScanValidUTF8Bytes( buf + i, lim, stopAtNbsp, chars );
+            i += m;
+            if ( m < 16 )
+                return i;
+        }
+    }
+    return i + ScanValidUTF8Bytes( buf + i, len - i, stopAtNbsp, chars );
+}
+#endif
+
+#ifdef TIDY_SCAN_AVX2
+__attribute__((target("avx2")))
+static uint ScanPlainTextAVX2( const byte* buf, uint len, Bool highBytes )
+{
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i high  = highBytes ? _mm256_set1_epi8( -1 ) : zero;
+    const __m256i space = _mm256_set1_epi8( 0x20 );
+    const __m256i del   = _mm256_set1_epi8( 0x7F );
+    const __m256i lt    = _mm256_set1_epi8( '<' );
+    const __m256i amp   = _mm256_set1_epi8( '&' );
+    uint i = 0, carry = 0;
+
+    for ( ; i + 32 <= len; i += 32 )
+    {
+        __m256i v, ok;
+        uint okMask, spMask, dblSp, bad;
+
+        v  = _mm256_loadu_si256( (const __m256i*)(buf + i) );
+        ok = _mm256_andnot_si256( _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8(v, del),
+                                                                    _mm256_cmpeq_epi8(v, lt) ),
+                                                   _mm256_cmpeq_epi8(v, amp) ),
+                                  _mm256_cmpgt_epi8(v, space) );
+        ok = _mm256_or_si256( ok, _mm256_and_si256(high, _mm256_cmpgt_epi8(zero, v)) );
+
+        okMask = (uint) _mm256_movemask_epi8( ok );
+        spMask = (uint) _mm256_movemask_epi8( _mm256_cmpeq_epi8(v, space) );
+        dblSp  = spMask & ( (spMask << 1) | carry );
+        bad    = ~( okMask | (spMask & ~dblSp) );
+
+        if ( bad )
+            return i + LowestBit( bad );
+        carry = spMask >> 31;
+    }
+    return i + ScanPlainTextBytes( buf + i, len - i, highBytes,
+                                   i > 0 && buf[i-1] == ' ' );
+}
+
+/* UTF-8 validation by table lookup on the nibbles of each byte and
+** the one before it, after Keiser and Lemire, "Validating UTF-8 In
+** Less Than One Instruction Per Byte" (2021).  Tidy accepts encoded
+** surrogates, so the row of the first byte table that would reject
+** them (ED A0..BF) leaves that bit out.
+*/
+#define U8_TOO_SHORT      (1<<0)
+#define U8_TOO_LONG       (1<<1)
+#define U8_OVERLONG_3     (1<<2)
+#define U8_TOO_LARGE      (1<<3)
+#define U8_SURROGATE      (1<<4)
+#define U8_OVERLONG_2     (1<<5)
+#define U8_TOO_LARGE_1000 (1<<6)
+#define U8_OVERLONG_4     (1<<6)
+#define U8_TWO_CONTS      (1<<7)
+#define U8_CARRY          (U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS)
+
+#define LUT8(a,b,c,d,e,f,g,h) \
+    (char)(a),(char)(b),(char)(c),(char)(d),(char)(e),(char)(f),(char)(g),(char)(h)
+
+#define Lookup16(v, t0,t1,t2,t3,t4,t5,t6,t7,t8,t9,t10,t11,t12,t13,t14,t15) \
+    _mm256_shuffle_epi8( _mm256_setr_epi8( \
+        LUT8(t0,t1,t2,t3,t4,t5,t6,t7), LUT8(t8,t9,t10,t11,t12,t13,t14,t15), \
+        LUT8(t0,t1,t2,t3,t4,t5,t6,t7), LUT8(t8,t9,t10,t11,t12,t13,t14,t15) ), (v) )
+
+/* "cur" moved up by n bytes, the last n bytes of "prev" filling in */
+#define PrevBytes(cur, prev, n) \
+    _mm256_alignr_epi8( (cur), _mm256_permute2x128_si256((prev), (cur), 0x21), 16 - (n) )
+
+__attribute__((target("avx2")))
+static int UTF8ChunkHasErrors( __m256i input, __m256i prev_input, Bool stopAtNbsp )
+{
+    const __m256i nibble = _mm256_set1_epi8( 0x0F );
+    __m256i prev1, prev2, prev3, b1hi, b1lo, b2hi, special;
+    __m256i third, fourth, must23, err;
+
+    prev1 = PrevBytes( input, prev_input, 1 );
+    prev2 = PrevBytes( input, prev_input, 2 );
+    prev3 = PrevBytes( input, prev_input, 3 );
+
+    b1hi = Lookup16( _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble),
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS,
+        U8_TOO_SHORT | U8_OVERLONG_2,
+        U8_TOO_SHORT,
+        U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,
+        U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4 );
+
+    b1lo = Lookup16( _mm256_and_si256(prev1, nibble),
+        U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4,
+        U8_CARRY | U8_OVERLONG_2,
+        U8_CARRY,
+        U8_CARRY,
+        U8_CARRY | U8_TOO_LARGE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 );
+
+    b2hi = Lookup16( _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble),
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3
+            | U8_TOO_LARGE_1000 | U8_OVERLONG_4,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT );
+
+    special = _mm256_and_si256( _mm256_and_si256(b1hi, b1lo), b2hi );
+
+    /* third and fourth bytes of longer sequences must be trail bytes */
+    third  = _mm256_subs_epu8( prev2, _mm256_set1_epi8( (char)(0xE0 - 1) ) );
+    fourth = _mm256_subs_epu8( prev3, _mm256_set1_epi8( (char)(0xF0 - 1) ) );
+    must23 = _mm256_cmpgt_epi8( _mm256_or_si256(third, fourth), _mm256_setzero_si256() );
+    err = _mm256_xor_si256( _mm256_and_si256(must23, _mm256_set1_epi8((char)0x80)),
+                            special );
+
+    /* U+FFFE and U+FFFF */
+    err = _mm256_or_si256( err, _mm256_and_si256( _mm256_and_si256(
+              _mm256_cmpeq_epi8( prev2, _mm256_set1_epi8((char)0xEF) ),
+              _mm256_cmpeq_epi8( prev1, _mm256_set1_epi8((char)0xBF) ) ),
+              _mm256_cmpeq_epi8( _mm256_or_si256(input, _mm256_set1_epi8(1)),
+                                 _mm256_set1_epi8((char)0xBF) ) ) );
+
+    /* U+00A0 */
+    if ( stopAtNbsp )
+        err = _mm256_or_si256( err, _mm256_and_si256(
+                  _mm256_cmpeq_epi8( prev1, _mm256_set1_epi8((char)0xC2) ),
+                  _mm256_cmpeq_epi8( input, _mm256_set1_epi8((char)0xA0) ) ) );
+
+    return !_mm256_testz_si256( err, err );
+}
+
+__attribute__((target("avx2")))
+static uint ScanValidUTF8AVX2( const byte* buf, uint len, Bool stopAtNbsp,
+                               uint* chars )
+{
+    /* as a signed byte, anything above this starts a character */
+    const __m256i trailMax = _mm256_set1_epi8( (char) 0xBF );
+    __m256i prev = _mm256_setzero_si256();
+    uint i = 0, n = 0, k;
+
+    for ( ; i + 32 <= len; i += 32 )
+    {
+        __m256i v = _mm256_loadu_si256( (const __m256i*)(buf + i) );
+        if ( UTF8ChunkHasErrors(v, prev, stopAtNbsp) )
+            break;
+        n += (uint) __builtin_popcount( _mm256_movemask_epi8(
+                                            _mm256_cmpgt_epi8(v, trailMax) ) );
+        prev = v;
+    }
+
+    /* A sequence may still be open at the end of the last good chunk:
+       back up to its first byte and let the byte loop take it from there */
+    for ( k = 1; k <= 3 && k <= i; ++k )
+    {
+        byte b = buf[i-k];
+        if ( !IsUTF8Trail(b) )
+        {
+            uint seqlen = ( b >= 0xF0 ? 4 : b >= 0xE0 ? 3 : b >= 0xC0 ? 2 : 1 );
+            if ( seqlen > k )
+            {
+                i -= k;
+                --n;
+            }
+            break;
+        }
+    }
+
+    *chars += n;
+    return i + ScanValidUTF8Bytes( buf + i, len - i, stopAtNbsp, chars );
+}
+
+/* 0 = not yet checked, 1 = no AVX2, 2 = AVX2.  Threads that check
+** at once all store the same answer.
+*/
+static int avx2State = 0;
+
+static Bool HasAVX2( void )
+{
+    int state = __atomic_load_n( &avx2State, __ATOMIC_RELAXED );
+    if ( state == 0 )
+    {
+        __builtin_cpu_init();
+        state = __builtin_cpu_supports( "avx2" ) ? 2 : 1;
+        __atomic_store_n( &avx2State, state, __ATOMIC_RELAXED );
+    }
+    return state == 2;
+}
+#endif
+
+uint TY_(ScanPlainText)( const byte* buf, uint len, Bool highBytes )
+{
+#ifdef TIDY_SCAN_AVX2
+    if ( len >= 32 && HasAVX2() )
+        return ScanPlainTextAVX2( buf, len, highBytes );
+#endif
+#ifdef TIDY_SCAN_SSE2
+    if ( len >= 16 )
+        return ScanPlainTextSSE2( buf, len, highBytes );
+#endif
+    return ScanPlainTextBytes( buf, len, highBytes, no );
+}
+
+uint TY_(ScanValidUTF8)( const byte* buf, uint len, Bool stopAtNbsp, uint* chars )
+{
+    *chars = 0;
+#ifdef TIDY_SCAN_AVX2
+    if ( len >= 32 && HasAVX2() )
+        return ScanValidUTF8AVX2( buf, len, stopAtNbsp, chars );
+#endif
+#ifdef TIDY_SCAN_SSE2
+    if ( len >= 16 )
+        return ScanValidUTF8SSE2( buf, len, stopAtNbsp, chars );
+#endif
+    return ScanValidUTF8Bytes( buf, len, stopAtNbsp, chars );
+}
+
+/*
+ * local variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * eval: (c-set-offset 'substatement-open 0)
+ * end:
+ */
@@ -0,0 +1,42 @@
+#ifndef __TEXTSCAN_H__
+#define __TEXTSCAN_H__
+
+/* textscan.h -- fast scanning of raw input text
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+  Byte scanners used by the lexer to skip over runs of input
+  that need no per-character processing.  Vectorized with SSE2,
+  and AVX2 when the processor supports it, falling back to plain
+  byte loops elsewhere.
+
+*/
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Returns the length of the run of plain text at the start of buf:
+** printable ASCII other than '<' and '&', plus single spaces.  The
+** run stops before a second consecutive space.  The byte before buf
+** is assumed not to be a space.  If highBytes is set, bytes >= 0x80
+** are part of the run too.
+*/
+uint TY_(ScanPlainText)( const byte* buf, uint len, Bool highBytes );
+
+/* Returns the length of the valid UTF-8 at the start of buf, which
+** always ends on a character boundary, and sets *chars to the number
+** of characters in it.  Valid means what DecodeUTF8BytesToChar()
+** accepts.  If stopAtNbsp is set, U+00A0 also ends it.
+*/
+uint TY_(ScanValidUTF8)( const byte* buf, uint len, Bool stopAtNbsp,
+                         uint* chars );
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __TEXTSCAN_H__ */
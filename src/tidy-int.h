@@ -21,6 +21,9 @@
 #include "attrs.h"
 #include "pprint.h"
 #include "access.h"
+#include "arena.h"
+#include "intern.h"
+#include "nodes.h"
 
 #ifndef MAX
 #define MAX(a,b) (((a) > (b))?(a):(b))
@@ -40,6 +43,8 @@ struct _TidyDocImpl
     TidyConfigImpl      config;
     TidyTagImpl         tags;
     TidyAttribImpl      attribs;
+    NameTable           tagNames;   /* element names in the tree */
+    NameTable           attrNames;  /* attribute names in the tree */
 
 #if SUPPORT_ACCESSIBILITY_CHECKS
     /* Accessibility Checks state */
@@ -55,6 +60,17 @@ struct _TidyDocImpl
     StreamOut*          errout;
     TidyReportFilter    mssgFilt;
     TidyOptCallback     pOptCallback;
+    TidyBuffer          heldMessages; /* see HoldMessages() */
+    Bool                holdMessages;
+
+    /* tidyParseChunk() */
+    TidyBuffer          chunks;     /* input not yet read */
+    StreamIn*           chunkIn;    /* reading it, until the final chunk */
+    uint                chunkWant;  /* unread bytes to wait for */
+    Bool                chunksDone; /* parsed before the final chunk */
+
+    TidyTokenCallback   tokenCallback; /* scan, not parse, if set */
+    Bool                inferTags;  /* scan with inferred tags */
 
     /* Parse + Repair Results */
     uint                optionErrors;
@@ -72,6 +88,10 @@ struct _TidyDocImpl
 
     /* Memory allocator */
     TidyAllocator*      allocator;
+    TidyArena           arena;      /* allocator is a view of it */
+#if SUPPORT_COMPACT_NODES
+    NodeTable           nodes;      /* all but root, see nodes.h */
+#endif
 
     /* Miscellaneous */
     void*               appData;
@@ -124,6 +144,9 @@ TidyOption   tidyImplToOption( const TidyOptionImpl* option );
 #define TidyDocFree(doc, block) TidyFree((doc)->allocator, block)
 #define TidyDocPanic(doc, msg) TidyPanic((doc)->allocator, msg)
 
+/* The document's allocator, charging what it allocates to kind */
+#define TidyDocAllocator(doc, kind) ArenaAllocator(&(doc)->arena, kind)
+
 int          TY_(DocParseStream)( TidyDocImpl* impl, StreamIn* in );
 
 #endif /* __TIDY_INT_H__ */
@@ -44,6 +44,7 @@
 /* Create/Destroy a Tidy "document" object */
 static TidyDocImpl* tidyDocCreate( TidyAllocator *allocator );
 static void         tidyDocRelease( TidyDocImpl* impl );
+static void         FreeDocTree( TidyDocImpl* impl );
 
 static int          tidyDocStatus( TidyDocImpl* impl );
 
@@ -52,7 +53,13 @@ static int          tidyDocParseFile( TidyDocImpl* impl, ctmbstr htmlfil );
 static int          tidyDocParseStdin( TidyDocImpl* impl );
 static int          tidyDocParseString( TidyDocImpl* impl, ctmbstr content );
 static int          tidyDocParseBuffer( TidyDocImpl* impl, TidyBuffer* inbuf );
+static int          tidyDocParseChunk( TidyDocImpl* impl, const byte* bytes,
+                                       uint len, Bool isFinal );
 static int          tidyDocParseSource( TidyDocImpl* impl, TidyInputSource* docIn );
+static void         StartParse( TidyDocImpl* impl, StreamIn* in );
+static Bool         RunParse( TidyDocImpl* impl );
+static int          EndParse( TidyDocImpl* impl );
+static void         AbandonChunks( TidyDocImpl* impl );
 
 
 /* Execute post-parse diagnostics and cleanup.
@@ -142,9 +149,17 @@ TidyDocImpl* tidyDocCreate( TidyAllocator *allocator )
 {
     TidyDocImpl* doc = (TidyDocImpl*)TidyAlloc( allocator, sizeof(TidyDocImpl) );
     TidyClearMemory( doc, sizeof(*doc) );
-    doc->allocator = allocator;
+    TY_(InitArena)( &doc->arena, allocator );
+    doc->allocator = TidyDocAllocator( doc, TidyMemOther );
+#if SUPPORT_COMPACT_NODES
+    TY_(InitNodeTable)( doc );
+#endif
+    tidyBufInitWithAllocator( &doc->heldMessages,
+                              TidyDocAllocator(doc, TidyMemMessages) );
+    tidyBufInitWithAllocator( &doc->chunks,
+                              TidyDocAllocator(doc, TidyMemLexer) );
 
-    TY_(InitMap)();
+    TY_(InitEntities)();
     TY_(InitTags)( doc );
     TY_(InitAttrs)( doc );
     TY_(InitConfig)( doc );
@@ -156,7 +171,7 @@ TidyDocImpl* tidyDocCreate( TidyAllocator *allocator )
     ** Config input will be set by config parsing routines.
     ** But we need to start off with a way to report errors.
     */
-    doc->errout = TY_(StdErrOutput)();
+    doc->errout = TY_(StdErrOutput)( doc );
     return doc;
 }
 
@@ -168,13 +183,25 @@ void          tidyDocRelease( TidyDocImpl* doc )
         assert( doc->docIn == NULL );
         assert( doc->docOut == NULL );
 
+        AbandonChunks( doc );
         TY_(ReleaseStreamOut)( doc, doc->errout );
         doc->errout = NULL;
+        tidyBufFree( &doc->heldMessages );
+        tidyBufFree( &doc->chunks );
 
         TY_(FreePrintBuf)( doc );
         TY_(FreeLexer)( doc );
+#if SUPPORT_DOC_ARENA
+        /* the tree, config, tags etc. go with the arena */
+        TY_(FreeArena)( &doc->arena );
+        TidyFree( doc->arena.allocator, doc );
+#else
         TY_(FreeNode)(doc, &doc->root);
         TidyClearMemory(&doc->root, sizeof(Node));
+#if SUPPORT_COMPACT_NODES
+        TY_(FreeNodeTable)( doc );
+#endif
+        TY_(FreeNames)( doc );
 
         if (doc->givenDoctype)
             TidyDocFree(doc, doc->givenDoctype);
@@ -182,10 +209,37 @@ void          tidyDocRelease( TidyDocImpl* doc )
         TY_(FreeConfig)( doc );
         TY_(FreeAttrTable)( doc );
         TY_(FreeTags)( doc );
-        TidyDocFree( doc, doc );
+        TidyFree( doc->arena.allocator, doc );
+#endif
     }
 }
 
+int TIDY_CALL          tidyDocReset( TidyDoc tdoc )
+{
+    TidyDocImpl* doc = tidyDocToImpl( tdoc );
+    if ( doc == NULL )
+        return -EINVAL;
+    assert( doc->docIn == NULL );
+    assert( doc->docOut == NULL );
+
+    AbandonChunks( doc );
+    FreeDocTree( doc );
+
+    doc->errors = 0;
+    doc->warnings = 0;
+    doc->accessErrors = 0;
+    doc->infoMessages = 0;
+    doc->docErrors = 0;
+    doc->parseStatus = 0;
+    doc->badAccess = 0;
+    doc->badLayout = 0;
+    doc->badChars = 0;
+    doc->badForm = 0;
+    doc->nClassId = 0;
+    doc->inputHadBOM = no;
+    return 0;
+}
+
 /* Let application store a chunk of data w/ each Tidy tdocance.
 ** Useful for callbacks.
 */
@@ -654,6 +708,19 @@ Bool TIDY_CALL        tidySetReportFilter( TidyDoc tdoc, TidyReportFilter filt )
   return no;
 }
 
+Bool TIDY_CALL        tidySetTokenCallback( TidyDoc tdoc, TidyTokenCallback tokCallback,
+                                            Bool inferTags )
+{
+  TidyDocImpl* impl = tidyDocToImpl( tdoc );
+  if ( impl )
+  {
+    impl->tokenCallback = tokCallback;
+    impl->inferTags = inferTags;
+    return yes;
+  }
+  return no;
+}
+
 #if 0   /* Not yet */
 int         tidySetContentOutputSink( TidyDoc tdoc, TidyOutputSink* outp )
 {
@@ -796,6 +863,22 @@ uint TIDY_CALL       tidyConfigErrorCount( TidyDoc tdoc )
         count = impl->optionErrors;
     return count;
 }
+size_t TIDY_CALL     tidyMemoryUsed( TidyDoc tdoc, TidyMemKind kind )
+{
+    TidyDocImpl* impl = tidyDocToImpl( tdoc );
+    size_t bytes = 0;
+    if ( impl && (uint) kind <= TidyMemTotal )
+        bytes = impl->arena.used[ kind ];
+    return bytes;
+}
+size_t TIDY_CALL     tidyMemoryPeak( TidyDoc tdoc, TidyMemKind kind )
+{
+    TidyDocImpl* impl = tidyDocToImpl( tdoc );
+    size_t bytes = 0;
+    if ( impl && (uint) kind <= TidyMemTotal )
+        bytes = impl->arena.peak[ kind ];
+    return bytes;
+}
 
 
 /* Error reporting functions 
@@ -849,6 +932,12 @@ int TIDY_CALL  tidyParseSource( TidyDoc tdoc, TidyInputSource* source )
     TidyDocImpl* doc = tidyDocToImpl( tdoc );
     return tidyDocParseSource( doc, source );
 }
+int TIDY_CALL  tidyParseChunk( TidyDoc tdoc, const byte* bytes,
+                               uint len, Bool isFinal )
+{
+    TidyDocImpl* doc = tidyDocToImpl( tdoc );
+    return tidyDocParseChunk( doc, bytes, len, isFinal );
+}
 
 
 int   tidyDocParseFile( TidyDocImpl* doc, ctmbstr filnam )
@@ -909,6 +998,113 @@ int   tidyDocParseBuffer( TidyDocImpl* doc, TidyBuffer* inbuf )
     return status;
 }
 
+/* Drops what has been read of doc->chunks, as the parse keeps only
+** text it has copied, and adds bytes.
+*/
+static void AppendChunk( TidyDocImpl* doc, const byte* bytes, uint len )
+{
+    TidyBuffer* chunks = &doc->chunks;
+
+    if ( chunks->next > 0 )
+    {
+        memmove( chunks->bp, chunks->bp + chunks->next,
+                 chunks->size - chunks->next );
+        chunks->size -= chunks->next;
+        chunks->next = 0;
+    }
+    tidyBufAppend( chunks, (void*) bytes, len );
+}
+
+/* Drops a parse left waiting for more chunks */
+static void AbandonChunks( TidyDocImpl* doc )
+{
+    if ( doc->chunkIn )
+    {
+#ifdef TIDY_WIN32_MLANG_SUPPORT
+        TY_(Win32MLangUninitInputTranscoder)(doc->chunkIn);
+#endif /* TIDY_WIN32_MLANG_SUPPORT */
+        TY_(freeStreamIn)( doc->chunkIn );
+        doc->chunkIn = NULL;
+        TY_(AbandonScan)( doc );
+        doc->lexer->nframes = 0;
+        TY_(SetArenaBudget)( &doc->arena, 0 );
+    }
+    doc->chunksDone = no;
+    tidyBufClear( &doc->chunks );
+}
+
+/* Each chunk is parsed as far as it goes.  When the lexer runs out of
+** input before the end of a token, the parsers return, leaving their
+** frames in the lexer, and carry on with the token when the next
+** chunk comes.  A token is read again only once the input after its
+** start has doubled, so a long one is read a few times at most.
+*/
+int   tidyDocParseChunk( TidyDocImpl* doc, const byte* bytes,
+                         uint len, Bool isFinal )
+{
+    TidyBuffer* chunks;
+    StreamIn* in = NULL;
+    int status = 0;
+
+    if ( doc == NULL || (bytes == NULL && len > 0) )
+        return -EINVAL;
+    chunks = &doc->chunks;
+
+    /* the parse has ended early, at the memory limit or as the
+       token callback asked, so the rest of the input is ignored */
+    if ( doc->chunksDone )
+    {
+        if ( !isFinal )
+            return 0;
+        doc->chunksDone = no;
+        return doc->parseStatus;
+    }
+
+    if ( len > 0 )
+        AppendChunk( doc, bytes, len );
+
+    if ( doc->chunkIn == NULL )
+    {
+        /* enough to tell a byte order mark */
+        if ( chunks->size < 3 && !isFinal )
+            return 0;
+
+        in = TY_(ChunkInput)( doc, chunks, cfg( doc, TidyInCharEncoding ));
+        in->partial = !isFinal;
+        StartParse( doc, in );
+        doc->chunkIn = in;
+    }
+    else
+    {
+        in = doc->chunkIn;
+        if ( !isFinal && chunks->size - chunks->next < doc->chunkWant )
+            return 0;
+
+        in->partial = !isFinal;
+        doc->docIn = in;
+    }
+
+    if ( !RunParse(doc) )
+    {
+        doc->chunkWant = 2 * (chunks->size - chunks->next);
+        doc->docIn = NULL;
+        return 0;
+    }
+
+    status = EndParse( doc );
+    TY_(freeStreamIn)( in );
+    doc->chunkIn = NULL;
+    tidyBufClear( chunks );
+
+    if ( !isFinal )
+    {
+        doc->chunksDone = yes;
+        doc->parseStatus = status;
+        status = 0;
+    }
+    return status;
+}
+
 int   tidyDocParseString( TidyDocImpl* doc, ctmbstr content )
 {
     int status = -EINVAL;
@@ -974,8 +1170,15 @@ int         tidyDocSaveFile( TidyDocImpl* doc, ctmbstr filnam )
     if ( doc->errors > 0 &&
          cfgBool(doc, TidyWriteBack) && !cfgBool(doc, TidyForceOutput) )
         status = tidyDocStatus( doc );
-    else 
+    else
+    {
+        /* Text may still be read from the mapped input file,
+           which is about to be overwritten */
+        if ( doc->lexer && doc->lexer->mapping
+             && TY_(isMappedFile)( doc->lexer->mapping, filnam ) )
+            TY_(UnmapText)( doc );
         fout = fopen( filnam, "wb" );
+    }
 
     if ( fout )
     {
@@ -1150,11 +1353,32 @@ int TIDY_CALL        tidyRunDiagnostics( TidyDoc tdoc )
 ** Emit likewise requires that document sink and all
 ** pretty printing options have been set.
 */
+/* Frees the tree and everything else that belongs to the
+** last document parsed, keeping the lexer's buffers.
+*/
+static void FreeDocTree( TidyDocImpl* doc )
+{
+    if ( doc->lexer )
+        TY_(ResetLexer)( doc );
+    TY_(FreeAnchors)( doc );
+
+    TY_(FreeNode)(doc, &doc->root);
+    TidyClearMemory(&doc->root, sizeof(Node));
+    TY_(FreeNames)( doc );
+
+    if (doc->givenDoctype)
+        TidyDocFree(doc, doc->givenDoctype);
+
+    doc->givenDoctype = NULL;
+}
+
 static ctmbstr integrity = "\nPanic - tree has lost its integrity\n";
 
-int         TY_(DocParseStream)( TidyDocImpl* doc, StreamIn* in )
+/* Sets up to parse from in, see DocParseStream() */
+static void StartParse( TidyDocImpl* doc, StreamIn* in )
 {
     Bool xmlIn = cfgBool( doc, TidyXmlTags );
+    size_t budget = 1024 * (size_t) cfg( doc, TidyMemoryLimit );
     int bomEnc;
 
     assert( doc != NULL && in != NULL );
@@ -1162,18 +1386,16 @@ int         TY_(DocParseStream)( TidyDocImpl* doc, StreamIn* in )
     doc->docIn = in;
 
     TY_(TakeConfigSnapshot)( doc );    /* Save config state */
-    TY_(FreeLexer)( doc );
-    TY_(FreeAnchors)( doc );
-
-    TY_(FreeNode)(doc, &doc->root);
-    TidyClearMemory(&doc->root, sizeof(Node));
-
-    if (doc->givenDoctype)
-        TidyDocFree(doc, doc->givenDoctype);
-
-    doc->givenDoctype = NULL;
+    FreeDocTree( doc );
+    TY_(ResetArenaPeak)( &doc->arena );
+#if SUPPORT_COMPACT_NODES
+    if ( budget == 0 || budget > NODE_SPAN_LIMIT )
+        budget = NODE_SPAN_LIMIT;
+#endif
+    TY_(SetArenaBudget)( &doc->arena, budget );
 
-    doc->lexer = TY_(NewLexer)( doc );
+    if ( doc->lexer == NULL )
+        doc->lexer = TY_(NewLexer)( doc );
     /* doc->lexer->root = &doc->root; */
     doc->root.line = doc->lexer->lines;
     doc->root.column = doc->lexer->columns;
@@ -1192,29 +1414,52 @@ int         TY_(DocParseStream)( TidyDocImpl* doc, StreamIn* in )
         TY_(Win32MLangInitInputTranscoder)(in, in->encoding);
 #endif /* TIDY_WIN32_MLANG_SUPPORT */
 
-    /* Tidy doesn't alter the doctype for generic XML docs */
-    if ( xmlIn )
-    {
-        TY_(ParseXMLDocument)( doc );
-        if ( !TY_(CheckNodeIntegrity)( &doc->root ) )
-            TidyPanic( doc->allocator, integrity );
-    }
-    else
-    {
+    if ( doc->tokenCallback || !xmlIn )
         doc->warnings = 0;
-        TY_(ParseDocument)( doc );
-        if ( !TY_(CheckNodeIntegrity)( &doc->root ) )
-            TidyPanic( doc->allocator, integrity );
-    }
+}
+
+/* Returns no if the input given to tidyParseChunk() ran out first */
+static Bool RunParse( TidyDocImpl* doc )
+{
+    Bool xmlIn = cfgBool( doc, TidyXmlTags );
+
+    if ( doc->tokenCallback )
+        return TY_(ScanDocument)( doc );
+
+    /* Tidy doesn't alter the doctype for generic XML docs */
+    if ( xmlIn ? !TY_(ParseXMLDocument)( doc ) : !TY_(ParseDocument)( doc ) )
+        return no;
+
+    if ( !TY_(CheckNodeIntegrity)( &doc->root ) )
+        TidyPanic( doc->allocator, integrity );
+    return yes;
+}
 
+static int EndParse( TidyDocImpl* doc )
+{
 #ifdef TIDY_WIN32_MLANG_SUPPORT
-    TY_(Win32MLangUninitInputTranscoder)(in);
+    TY_(Win32MLangUninitInputTranscoder)(doc->docIn);
 #endif /* TIDY_WIN32_MLANG_SUPPORT */
 
     doc->docIn = NULL;
+    if ( doc->arena.exceeded )
+    {
+        TY_(ReportMemoryLimit)( doc, (ulong) (doc->arena.budget / 1024) );
+        TY_(SetArenaBudget)( &doc->arena, 0 );
+        return -ENOMEM;
+    }
+    TY_(SetArenaBudget)( &doc->arena, 0 );
     return tidyDocStatus( doc );
 }
 
+int         TY_(DocParseStream)( TidyDocImpl* doc, StreamIn* in )
+{
+    AbandonChunks( doc );
+    StartParse( doc, in );
+    RunParse( doc );
+    return EndParse( doc );
+}
+
 int         tidyDocRunDiagnostics( TidyDocImpl* doc )
 {
     Bool quiet = cfgBool( doc, TidyQuiet );
@@ -1251,16 +1496,10 @@ int         tidyDocCleanAndRepair( TidyDocImpl* doc )
     if (tidyXmlTags)
        return tidyDocStatus( doc );
 
-    /* simplifies <b><b> ... </b> ...</b> etc. */
-    TY_(NestedEmphasis)( doc, &doc->root );
-
-    /* cleans up <dir>indented text</dir> etc. */
-    TY_(List2BQ)( doc, &doc->root );
-    TY_(BQ2Div)( doc, &doc->root );
-
-    /* replaces i by em and b by strong */
-    if ( logical )
-        TY_(EmFromI)( doc, &doc->root );
+    /* simplifies <b><b> ... </b> ...</b> etc., cleans up
+       <dir>indented text</dir> etc. and, for logical emphasis,
+       replaces i by em and b by strong */
+    TY_(CleanEmphasisAndLists)( doc, logical );
 
     if ( word2K && TY_(IsWord2000)(doc) )
     {
@@ -1308,7 +1547,7 @@ int         tidyDocCleanAndRepair( TidyDocImpl* doc )
         }
     }
 
-    if ( doc->root.content )
+    if ( NodeContent(&doc->root) )
     {
         /* If we had XHTML input but want HTML output */
         if ( htmlOut && doc->lexer->isvoyager )
@@ -1322,16 +1561,16 @@ int         tidyDocCleanAndRepair( TidyDocImpl* doc )
         if (xhtmlOut && !htmlOut)
         {
             TY_(SetXHTMLDocType)(doc);
-            TY_(FixAnchors)(doc, &doc->root, wantNameAttr, yes);
             TY_(FixXhtmlNamespace)(doc, yes);
-            TY_(FixLanguageInformation)(doc, &doc->root, yes, yes);
+            TY_(FixAnchorsAndLanguage)(doc, &doc->root, wantNameAttr, yes,
+                                       yes, yes);
         }
         else
         {
             TY_(FixDocType)(doc);
-            TY_(FixAnchors)(doc, &doc->root, wantNameAttr, yes);
             TY_(FixXhtmlNamespace)(doc, no);
-            TY_(FixLanguageInformation)(doc, &doc->root, no, yes);
+            TY_(FixAnchorsAndLanguage)(doc, &doc->root, wantNameAttr, yes,
+                                       no, yes);
         }
 
         if (tidyMark )
@@ -1408,7 +1647,7 @@ int         tidyDocSaveStream( TidyDocImpl* doc, StreamOut* out )
         TY_(ReplacePreformattedSpaces)(doc, &doc->root);
 
     if ( sortAttrStrat != TidySortAttrNone )
-        TY_(SortAttributes)(&doc->root, sortAttrStrat);
+        TY_(SortAttributes)(doc, &doc->root, sortAttrStrat);
 
     if ( showMarkup && (doc->errors == 0 || forceOutput) )
     {
@@ -1491,24 +1730,24 @@ TidyNode TIDY_CALL    tidyGetBody( TidyDoc tdoc )
 TidyNode TIDY_CALL    tidyGetParent( TidyNode tnod )
 {
   Node* nimp = tidyNodeToImpl( tnod );
-  return tidyImplToNode( nimp->parent );
+  return tidyImplToNode( NodeParent(nimp) );
 }
 TidyNode TIDY_CALL    tidyGetChild( TidyNode tnod )
 {
   Node* nimp = tidyNodeToImpl( tnod );
-  return tidyImplToNode( nimp->content );
+  return tidyImplToNode( NodeContent(nimp) );
 }
 
 /* siblings */
 TidyNode TIDY_CALL    tidyGetNext( TidyNode tnod )
 {
   Node* nimp = tidyNodeToImpl( tnod );
-  return tidyImplToNode( nimp->next );
+  return tidyImplToNode( NodeNext(nimp) );
 }
 TidyNode TIDY_CALL    tidyGetPrev( TidyNode tnod )
 {
   Node* nimp = tidyNodeToImpl( tnod );
-  return tidyImplToNode( nimp->prev );
+  return tidyImplToNode( NodePrev(nimp) );
 }
 
 /* Node info */
@@ -1543,7 +1782,7 @@ ctmbstr TIDY_CALL        tidyNodeGetName( TidyNode tnod )
   Node* nimp = tidyNodeToImpl( tnod );
   ctmbstr nnam = NULL;
   if ( nimp )
-    nnam = nimp->element;
+    nnam = NodeElement(nimp);
   return nnam;
 }
 
@@ -1602,8 +1841,8 @@ Bool TIDY_CALL tidyNodeGetValue( TidyDoc tdoc, TidyNode tnod, TidyBuffer* buf )
     case PhpTag:
     {
         tidyBufClear( buf );
-        tidyBufAppend( buf, doc->lexer->lexbuf + node->start,
-                       node->end - node->start );
+        tidyBufAppend( buf, (void*) NodeText(doc->lexer, node),
+                       (uint)(node->end - node->start) );
         break;
     }
     default:
@@ -1642,8 +1881,8 @@ Bool TIDY_CALL tidyNodeIsProp( TidyDoc ARG_UNUSED(tdoc), TidyNode tnod )
     case StartTag:
     case EndTag:
     case StartEndTag:
-        isProprietary = ( nimp->tag
-                          ? (nimp->tag->versions&VERS_PROPRIETARY)!=0
+        isProprietary = ( NodeTag(nimp)
+                          ? (NodeTag(nimp)->versions&VERS_PROPRIETARY)!=0
                           : yes );
         break;
     }
@@ -1656,8 +1895,8 @@ TidyTagId TIDY_CALL tidyNodeGetId(TidyNode tnod)
     Node* nimp = tidyNodeToImpl(tnod);
 
     TidyTagId tagId = TidyTag_UNKNOWN;
-    if (nimp && nimp->tag)
-        tagId = nimp->tag->id;
+    if (nimp && NodeTag(nimp))
+        tagId = NodeTag(nimp)->id;
 
     return tagId;
 }
@@ -1681,7 +1920,7 @@ TidyAttr TIDY_CALL   tidyAttrFirst( TidyNode tnod )
   Node* nimp = tidyNodeToImpl( tnod );
   AttVal* attval = NULL;
   if ( nimp )
-    attval = nimp->attributes;
+    attval = NodeAttrs(nimp);
   return tidyImplToAttr( attval );
 }
 TidyAttr TIDY_CALL    tidyAttrNext( TidyAttr tattr )
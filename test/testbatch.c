@@ -0,0 +1,155 @@
+/*
+  testbatch.c - check that tidyProcessBatch() delivers its items in
+                order, with the same markup, messages and status as
+                tidying each input on its own
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+  Usage: testbatch threads config input ...
+
+  Built and run by testbatch.sh, with -fsanitize=thread by default
+  so that the pool's locking is checked as well.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tidy.h"
+#include "buffio.h"
+
+typedef struct _BatchCheck
+{
+    uint next;      /* index the next callback should have */
+    uint bad;
+} BatchCheck;
+
+static void TIDY_CALL itemDone( TidyBatchItem* item, uint index,
+                                void* appData )
+{
+    BatchCheck* check = (BatchCheck*) appData;
+
+    if ( index != check->next || item->appData != (void*) item )
+    {
+        printf( "item %u delivered in place of %u\n", index, check->next );
+        check->bad++;
+    }
+    check->next = index + 1;
+}
+
+/* tidy input on its own, as tidyProcessBatch() does each item */
+static int tidyOne( TidyDoc config, ctmbstr input,
+                    TidyBuffer* output, TidyBuffer* messages )
+{
+    TidyDoc tdoc = tidyCreate();
+    int status;
+
+    tidyOptCopyConfig( tdoc, config );
+    tidySetErrorBuffer( tdoc, messages );
+
+    status = tidyParseFile( tdoc, input );
+    if ( status >= 0 )
+        status = tidyCleanAndRepair( tdoc );
+    if ( status >= 0 )
+        status = tidyRunDiagnostics( tdoc );
+    if ( status > 1 )
+        status = ( tidyOptGetBool(tdoc, TidyForceOutput) ? status : -1 );
+    if ( status >= 0 && tidyOptGetBool(tdoc, TidyShowMarkup) )
+        status = tidySaveBuffer( tdoc, output );
+
+    tidyRelease( tdoc );
+    return status;
+}
+
+static Bool sameBuffer( TidyBuffer* a, TidyBuffer* b )
+{
+    return a->size == b->size &&
+           ( a->size == 0 || memcmp(a->bp, b->bp, a->size) == 0 );
+}
+
+int main( int argc, char** argv )
+{
+    TidyDoc config;
+    TidyBatchItem* items;
+    TidyBuffer *outputs, *messages, summary;
+    BatchCheck check = { 0, 0 };
+    uint threads, count, i;
+
+    if ( argc < 4 )
+    {
+        fprintf( stderr, "Usage: %s threads config input ...\n", argv[0] );
+        return 2;
+    }
+
+    threads = (uint) atoi( argv[1] );
+    count = (uint) (argc - 3);
+
+    config = tidyCreate();
+    if ( tidyLoadConfig(config, argv[2]) < 0 )
+    {
+        fprintf( stderr, "%s: can't read %s\n", argv[0], argv[2] );
+        return 2;
+    }
+    tidyOptSetBool( config, TidyQuiet, yes );
+    tidyOptSetBool( config, TidyForceOutput, yes );
+    tidyOptSetBool( config, TidyMark, no );
+
+    /* items' messages are encoded as config's error output */
+    tidyBufInit( &summary );
+    tidySetErrorBuffer( config, &summary );
+
+    items = (TidyBatchItem*) calloc( count, sizeof(TidyBatchItem) );
+    outputs = (TidyBuffer*) calloc( count, sizeof(TidyBuffer) );
+    messages = (TidyBuffer*) calloc( count, sizeof(TidyBuffer) );
+
+    for ( i = 0; i < count; ++i )
+    {
+        tidyBufInit( &outputs[i] );
+        tidyBufInit( &messages[i] );
+        items[i].file = argv[ i + 3 ];
+        items[i].output = &outputs[i];
+        items[i].messages = &messages[i];
+        items[i].appData = &items[i];
+    }
+
+    tidyProcessBatch( config, items, count, threads, itemDone, &check );
+
+    if ( check.next != count )
+    {
+        printf( "%u of %u items delivered\n", check.next, count );
+        check.bad++;
+    }
+
+    for ( i = 0; i < count; ++i )
+    {
+        TidyBuffer output, errors;
+        int status;
+
+        tidyBufInit( &output );
+        tidyBufInit( &errors );
+        status = tidyOne( config, items[i].file, &output, &errors );
+
+        if ( status != items[i].status ||
+             !sameBuffer(&output, &outputs[i]) ||
+             !sameBuffer(&errors, &messages[i]) )
+        {
+            printf( "%s differs from tidying it on its own\n", items[i].file );
+            check.bad++;
+        }
+
+        tidyBufFree( &output );
+        tidyBufFree( &errors );
+        tidyBufFree( &outputs[i] );
+        tidyBufFree( &messages[i] );
+    }
+
+    free( items );
+    free( outputs );
+    free( messages );
+    tidyRelease( config );
+    tidyBufFree( &summary );
+
+    printf( "%u items on %u threads: %s\n", count, threads,
+            check.bad ? "FAILED" : "same output, messages and order" );
+    return check.bad ? 1 : 0;
+}
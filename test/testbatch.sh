@@ -0,0 +1,50 @@
+#! /bin/sh
+
+#
+# testbatch.sh - build testbatch.c with the library sources and check
+#                tidyProcessBatch() on the testcase inputs
+#
+# (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+# See tidy.c for the copyright notice.
+#
+# <URL:http://tidy.sourceforge.net/>
+#
+# Usage: testbatch.sh [threads]
+#
+# The driver is built with -fsanitize=thread unless CFLAGS says
+# otherwise, e.g. CFLAGS=-O2 where the thread sanitizer is missing.
+#
+# set -x
+
+VERSION='$Id'
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--g -O1 -fsanitize=thread}
+CFGFILE=./input/cfg_default.txt
+THREADS=${1:-4}
+TESTBATCH=./tmp/testbatch
+
+# Make sure output directory exists.
+if [ ! -d ./tmp ]
+then
+  mkdir ./tmp
+fi
+
+$CC $CFLAGS -I../include -o $TESTBATCH testbatch.c ../src/*.c -lpthread \
+  || exit 1
+
+INFILES=`cut -d ' ' -f 1 testcases.txt | while read bugNo
+do
+  for INFILE in ./input/in_${bugNo}.*ml
+  do
+    if [ -r $INFILE ]
+    then
+      echo $INFILE
+      break
+    fi
+  done
+done`
+
+unset HTML_TIDY
+
+$TESTBATCH $THREADS $CFGFILE $INFILES
@@ -0,0 +1,202 @@
+/*
+  testchunk.c - check that tidyParseChunk() gives the same markup,
+                messages and status as tidyParseBuffer() on the whole
+                input, however it is cut into chunks, and the same
+                tokens when scanning
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+  Usage: testchunk config input ...
+
+  Built and run by testchunk.sh.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tidy.h"
+#include "buffio.h"
+
+/* chunk sizes to cut each input into, 0 for all of it at once */
+static const uint chunkSizes[] = { 1, 2, 7, 64, 1000, 0 };
+
+static Bool readFile( ctmbstr name, TidyBuffer* buf )
+{
+    FILE* fin = fopen( name, "rb" );
+    byte block[ 4096 ];
+    size_t n;
+
+    if ( fin == NULL )
+        return no;
+    while ( (n = fread(block, 1, sizeof(block), fin)) > 0 )
+        tidyBufAppend( buf, block, (uint) n );
+    fclose( fin );
+    return yes;
+}
+
+/* notes each token scanned, with its position */
+static Bool TIDY_CALL tokenRead( TidyDoc tdoc, TidyNode tok )
+{
+    TidyBuffer* tokens = (TidyBuffer*) tidyGetAppData( tdoc );
+    ctmbstr name = tidyNodeGetName( tok );
+    char line[ 256 ];
+
+    sprintf( line, "%d %.200s %u:%u\n", (int) tidyNodeGetType(tok),
+             name ? name : "", tidyNodeLine(tok), tidyNodeColumn(tok) );
+    tidyBufAppend( tokens, line, (uint) strlen(line) );
+    return yes;
+}
+
+/* tidy input, given in chunks of chunkSize bytes unless it is 0.
+   With tokens, it is scanned into them instead, along with the
+   messages.
+*/
+static int tidyOne( TidyDoc config, TidyBuffer* input, uint chunkSize,
+                    TidyBuffer* output, TidyBuffer* messages,
+                    TidyBuffer* tokens )
+{
+    TidyDoc tdoc = tidyCreate();
+    int status = 0;
+
+    tidyOptCopyConfig( tdoc, config );
+    tidySetErrorBuffer( tdoc, tokens ? tokens : messages );
+    if ( tokens )
+    {
+        tidySetAppData( tdoc, tokens );
+        tidySetTokenCallback( tdoc, tokenRead, yes );
+    }
+
+    if ( chunkSize == 0 )
+    {
+        input->next = 0;
+        status = tidyParseBuffer( tdoc, input );
+    }
+    else
+    {
+        uint pos = 0;
+        do
+        {
+            uint len = input->size - pos;
+            if ( len > chunkSize )
+                len = chunkSize;
+            status = tidyParseChunk( tdoc, input->bp + pos, len,
+                                     pos + len == input->size );
+            pos += len;
+        } while ( pos < input->size && status == 0 );
+
+        if ( input->size == 0 )
+            status = tidyParseChunk( tdoc, NULL, 0, yes );
+    }
+
+    if ( tokens )
+    {
+        tidyRelease( tdoc );
+        return status;
+    }
+
+    if ( status >= 0 )
+        status = tidyCleanAndRepair( tdoc );
+    if ( status >= 0 )
+        status = tidyRunDiagnostics( tdoc );
+    if ( status > 1 )
+        status = ( tidyOptGetBool(tdoc, TidyForceOutput) ? status : -1 );
+    if ( status >= 0 && tidyOptGetBool(tdoc, TidyShowMarkup) )
+        status = tidySaveBuffer( tdoc, output );
+
+    tidyRelease( tdoc );
+    return status;
+}
+
+static Bool sameBuffer( TidyBuffer* a, TidyBuffer* b )
+{
+    return a->size == b->size &&
+           ( a->size == 0 || memcmp(a->bp, b->bp, a->size) == 0 );
+}
+
+int main( int argc, char** argv )
+{
+    TidyDoc config;
+    uint bad = 0, count, i, j;
+
+    if ( argc < 3 )
+    {
+        fprintf( stderr, "Usage: %s config input ...\n", argv[0] );
+        return 2;
+    }
+
+    count = (uint) (argc - 2);
+
+    config = tidyCreate();
+    if ( tidyLoadConfig(config, argv[1]) < 0 )
+    {
+        fprintf( stderr, "%s: can't read %s\n", argv[0], argv[1] );
+        return 2;
+    }
+    tidyOptSetBool( config, TidyQuiet, yes );
+    tidyOptSetBool( config, TidyForceOutput, yes );
+    tidyOptSetBool( config, TidyMark, no );
+
+    for ( i = 0; i < count; ++i )
+    {
+        ctmbstr name = argv[ i + 2 ];
+        TidyBuffer input, output, errors, tokens;
+        int status;
+
+        tidyBufInit( &input );
+        tidyBufInit( &output );
+        tidyBufInit( &errors );
+        tidyBufInit( &tokens );
+        if ( !readFile(name, &input) )
+        {
+            printf( "can't read %s\n", name );
+            bad++;
+            continue;
+        }
+        status = tidyOne( config, &input, 0, &output, &errors, NULL );
+        tidyOne( config, &input, 0, NULL, NULL, &tokens );
+
+        for ( j = 0; chunkSizes[j] != 0; ++j )
+        {
+            TidyBuffer chunkOutput, chunkErrors, chunkTokens;
+            int chunkStatus;
+
+            tidyBufInit( &chunkOutput );
+            tidyBufInit( &chunkErrors );
+            tidyBufInit( &chunkTokens );
+            chunkStatus = tidyOne( config, &input, chunkSizes[j],
+                                   &chunkOutput, &chunkErrors, NULL );
+            tidyOne( config, &input, chunkSizes[j], NULL, NULL, &chunkTokens );
+
+            if ( chunkStatus != status ||
+                 !sameBuffer(&chunkOutput, &output) ||
+                 !sameBuffer(&chunkErrors, &errors) )
+            {
+                printf( "%s differs in chunks of %u bytes\n",
+                        name, chunkSizes[j] );
+                bad++;
+            }
+            if ( !sameBuffer(&chunkTokens, &tokens) )
+            {
+                printf( "%s scans differently in chunks of %u bytes\n",
+                        name, chunkSizes[j] );
+                bad++;
+            }
+
+            tidyBufFree( &chunkOutput );
+            tidyBufFree( &chunkErrors );
+            tidyBufFree( &chunkTokens );
+        }
+
+        tidyBufFree( &input );
+        tidyBufFree( &output );
+        tidyBufFree( &errors );
+        tidyBufFree( &tokens );
+    }
+
+    tidyRelease( config );
+
+    printf( "%u inputs in chunks: %s\n", count,
+            bad ? "FAILED" : "same output, messages, status and tokens" );
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,46 @@
+#! /bin/sh
+
+#
+# testchunk.sh - build testchunk.c with the library sources and check
+#                tidyParseChunk() on the testcase inputs
+#
+# (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+# See tidy.c for the copyright notice.
+#
+# <URL:http://tidy.sourceforge.net/>
+#
+# Usage: testchunk.sh
+#
+# set -x
+
+VERSION='$Id'
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--g -O1}
+CFGFILE=./input/cfg_default.txt
+TESTCHUNK=./tmp/testchunk
+
+# Make sure output directory exists.
+if [ ! -d ./tmp ]
+then
+  mkdir ./tmp
+fi
+
+$CC $CFLAGS -I../include -o $TESTCHUNK testchunk.c ../src/*.c -lpthread \
+  || exit 1
+
+INFILES=`cut -d ' ' -f 1 testcases.txt | while read bugNo
+do
+  for INFILE in ./input/in_${bugNo}.*ml
+  do
+    if [ -r $INFILE ]
+    then
+      echo $INFILE
+      break
+    fi
+  done
+done`
+
+unset HTML_TIDY
+
+$TESTCHUNK $CFGFILE $INFILES
@@ -0,0 +1,85 @@
+#! /bin/sh
+
+#
+# testjobs.sh - check that -jobs gives the same output and messages
+#               as tidying each testcase input on its own
+#
+# (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+# See tidy.c for the copyright notice.
+#
+# <URL:http://tidy.sourceforge.net/>
+#
+# Usage: testjobs.sh [jobs [tidy options]]
+#
+# set -x
+
+VERSION='$Id'
+
+TIDY=../bin/tidy
+CFGFILE=./input/cfg_default.txt
+JOBS=${1:-0}
+
+if [ $# -gt 0 ]
+then
+  shift
+fi
+
+# Make sure output directory exists.
+if [ ! -d ./tmp ]
+then
+  mkdir ./tmp
+fi
+
+INFILES=`cut -d ' ' -f 1 testcases.txt | while read bugNo
+do
+  for INFILE in ./input/in_${bugNo}.*ml
+  do
+    if [ -r $INFILE ]
+    then
+      echo $INFILE
+      break
+    fi
+  done
+done`
+
+unset HTML_TIDY
+
+rm -f ./tmp/jobs_one.html ./tmp/jobs_one.txt
+for INFILE in $INFILES
+do
+  $TIDY -q -config $CFGFILE "$@" --tidy-mark no --force-output yes $INFILE \
+    >> ./tmp/jobs_one.html 2>> ./tmp/jobs_one.txt
+done
+
+$TIDY -jobs $JOBS -q -config $CFGFILE "$@" --tidy-mark no --force-output yes \
+  $INFILES > ./tmp/jobs_all.html 2> ./tmp/jobs_all.txt
+
+STATUS=0
+if cmp -s ./tmp/jobs_one.html ./tmp/jobs_all.html &&
+   cmp -s ./tmp/jobs_one.txt ./tmp/jobs_all.txt
+then
+  echo "-jobs $JOBS: same output and messages"
+else
+  echo "== -jobs $JOBS failed: see ./tmp/jobs_one.* and ./tmp/jobs_all.*"
+  STATUS=1
+fi
+
+# A file name that starts with digits is a file, not a thread count.
+set -- $INFILES
+cp $1 ./tmp/2019-jobs.html
+for INFILE in ./tmp/2019-jobs.html $2
+do
+  $TIDY -q --tidy-mark no --force-output yes $INFILE
+done > ./tmp/jobs_one.html 2> /dev/null
+(cd ./tmp && ../$TIDY -q --tidy-mark no --force-output yes \
+  -jobs 2019-jobs.html ../$2 > ./jobs_all.html 2> /dev/null)
+
+if cmp -s ./tmp/jobs_one.html ./tmp/jobs_all.html
+then
+  echo "-jobs 2019-jobs.html: taken as a file name"
+else
+  echo "== -jobs 2019-jobs.html failed: see ./tmp/jobs_one.html and ./tmp/jobs_all.html"
+  STATUS=1
+fi
+
+exit $STATUS
@@ -30,6 +30,8 @@ CFGFILE=./input/cfg_${TESTNO}.txt
 
 TIDYFILE=./tmp/out_${TESTNO}.html
 MSGFILE=./tmp/msg_${TESTNO}.txt
+PIPEFILE=./tmp/pipe_${TESTNO}.html
+PIPEMSGFILE=./tmp/pipemsg_${TESTNO}.txt
 
 unset HTML_TIDY
 
@@ -37,7 +39,7 @@ shift
 shift
 
 # Remove any pre-exising test outputs
-for INFIL in $MSGFILE $TIDYFILE
+for INFIL in $MSGFILE $TIDYFILE $PIPEFILE $PIPEMSGFILE
 do
   if [ -f $INFIL ]
   then
@@ -54,9 +56,11 @@ do
 done
 
 # If no test specific config file, use default.
+DEFAULTCFG=no
 if [ ! -f $CFGFILE ]
 then
   CFGFILE=./input/cfg_default.txt
+  DEFAULTCFG=yes
 fi
 
 # Make sure output directory exists.
@@ -75,5 +79,37 @@ then
   exit 1
 fi
 
+# Where a testcase gives the messages expected, they must match.
+EXPECTEDMSG=./output/msg_${TESTNO}.txt
+if [ -f $EXPECTEDMSG ] && ! cmp -s $EXPECTEDMSG $MSGFILE
+then
+  echo "== $TESTNO failed (messages differ from $EXPECTEDMSG)"
+  diff $EXPECTEDMSG $MSGFILE
+  exit 1
+fi
+
+# A file is read through a mapping where it can be, a pipe never
+# is, and both must give the same document.  Test specific config
+# files may name the input in messages or write back to it.
+if [ $DEFAULTCFG = yes ]
+then
+  cat $INFILE | $TIDY -f $PIPEMSGFILE -config $CFGFILE "$@" --tidy-mark no \
+    -o $PIPEFILE
+
+  SAME=yes
+  if [ -f $TIDYFILE ] || [ -f $PIPEFILE ]
+  then
+    cmp -s $TIDYFILE $PIPEFILE || SAME=no
+  fi
+  cmp -s $MSGFILE $PIPEMSGFILE || SAME=no
+
+  if [ $SAME = no ]
+  then
+    echo "== $TESTNO failed (input piped in differs from the file)"
+    diff $MSGFILE $PIPEMSGFILE
+    exit 1
+  fi
+fi
+
 exit 0
 
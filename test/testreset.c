@@ -0,0 +1,181 @@
+/*
+  testreset.c - check that one TidyDoc reused through tidyDocReset()
+                gives each input the same markup, messages and status
+                as a TidyDoc created for it, and allocates less
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+  Usage: testreset config input ...
+
+  Built and run by testreset.sh.  The inputs are taken twice by the
+  reused document, and the second time round it should allocate
+  fewer blocks than fresh documents do for the same inputs.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tidy.h"
+#include "buffio.h"
+
+typedef struct _CountingAllocator
+{
+    TidyAllocator base;
+    ulong allocs;       /* blocks allocated, or grown by realloc */
+} CountingAllocator;
+
+static void* TIDY_CALL countAlloc( TidyAllocator* self, size_t nBytes )
+{
+    ((CountingAllocator*) self)->allocs++;
+    return malloc( nBytes );
+}
+
+static void* TIDY_CALL countRealloc( TidyAllocator* self, void* block,
+                                     size_t nBytes )
+{
+    ((CountingAllocator*) self)->allocs++;
+    return realloc( block, nBytes );
+}
+
+static void TIDY_CALL countFree( TidyAllocator* ARG_UNUSED(self), void* block )
+{
+    free( block );
+}
+
+static void TIDY_CALL countPanic( TidyAllocator* ARG_UNUSED(self), ctmbstr msg )
+{
+    fprintf( stderr, "panic: %s\n", msg );
+    exit( 2 );
+}
+
+static const TidyAllocatorVtbl countVtbl =
+{
+    countAlloc, countRealloc, countFree, countPanic
+};
+
+/* tidy input with tdoc, as the console program does */
+static int tidyWith( TidyDoc tdoc, ctmbstr input,
+                     TidyBuffer* output, TidyBuffer* messages )
+{
+    int status;
+
+    tidySetErrorBuffer( tdoc, messages );
+
+    status = tidyParseFile( tdoc, input );
+    if ( status >= 0 )
+        status = tidyCleanAndRepair( tdoc );
+    if ( status >= 0 )
+        status = tidyRunDiagnostics( tdoc );
+    if ( status > 1 )
+        status = ( tidyOptGetBool(tdoc, TidyForceOutput) ? status : -1 );
+    if ( status >= 0 && tidyOptGetBool(tdoc, TidyShowMarkup) )
+        status = tidySaveBuffer( tdoc, output );
+    return status;
+}
+
+/* tidy input with a TidyDoc of its own */
+static int tidyOne( TidyDoc config, TidyAllocator* allocator, ctmbstr input,
+                    TidyBuffer* output, TidyBuffer* messages )
+{
+    TidyDoc tdoc = tidyCreateWithAllocator( allocator );
+    int status;
+
+    tidyOptCopyConfig( tdoc, config );
+    status = tidyWith( tdoc, input, output, messages );
+    tidyRelease( tdoc );
+    return status;
+}
+
+static Bool sameBuffer( TidyBuffer* a, TidyBuffer* b )
+{
+    return a->size == b->size &&
+           ( a->size == 0 || memcmp(a->bp, b->bp, a->size) == 0 );
+}
+
+int main( int argc, char** argv )
+{
+    CountingAllocator fresh = { { &countVtbl }, 0 };
+    CountingAllocator reused = { { &countVtbl }, 0 };
+    TidyDoc config, tdoc;
+    ulong warm = 0, freshWarm = 0;
+    uint count, i, pass, bad = 0;
+
+    if ( argc < 3 )
+    {
+        fprintf( stderr, "Usage: %s config input ...\n", argv[0] );
+        return 2;
+    }
+
+    count = (uint) (argc - 2);
+
+    config = tidyCreate();
+    if ( tidyLoadConfig(config, argv[1]) < 0 )
+    {
+        fprintf( stderr, "%s: can't read %s\n", argv[0], argv[1] );
+        return 2;
+    }
+    tidyOptSetBool( config, TidyQuiet, yes );
+    tidyOptSetBool( config, TidyForceOutput, yes );
+    tidyOptSetBool( config, TidyMark, no );
+
+    tdoc = tidyCreateWithAllocator( &reused.base );
+    tidyOptCopyConfig( tdoc, config );
+
+    for ( pass = 0; pass < 2; ++pass )
+    {
+        /* the first pass warms the buffers up */
+        if ( pass == 1 )
+        {
+            warm = reused.allocs;
+            freshWarm = fresh.allocs;
+        }
+
+        for ( i = 0; i < count; ++i )
+        {
+            ctmbstr input = argv[ i + 2 ];
+            TidyBuffer output, errors, freshOutput, freshErrors;
+            int status, freshStatus;
+
+            tidyBufInit( &output );
+            tidyBufInit( &errors );
+            tidyBufInit( &freshOutput );
+            tidyBufInit( &freshErrors );
+
+            tidyDocReset( tdoc );
+            status = tidyWith( tdoc, input, &output, &errors );
+
+            freshStatus = tidyOne( config, &fresh.base, input,
+                                   &freshOutput, &freshErrors );
+
+            if ( status != freshStatus ||
+                 !sameBuffer(&output, &freshOutput) ||
+                 !sameBuffer(&errors, &freshErrors) )
+            {
+                printf( "%s differs from tidying it with a new TidyDoc\n",
+                        input );
+                bad++;
+            }
+
+            tidyBufFree( &output );
+            tidyBufFree( &errors );
+            tidyBufFree( &freshOutput );
+            tidyBufFree( &freshErrors );
+        }
+    }
+
+    tidyRelease( tdoc );
+    tidyRelease( config );
+
+    if ( reused.allocs - warm >= fresh.allocs - freshWarm )
+    {
+        printf( "a reused TidyDoc made %lu allocations for %lu by new ones\n",
+                reused.allocs - warm, fresh.allocs - freshWarm );
+        bad++;
+    }
+
+    printf( "%u inputs on one reset TidyDoc: %s\n", count,
+            bad ? "FAILED" : "same output, messages and status, "
+                             "fewer allocations" );
+    return bad ? 1 : 0;
+}
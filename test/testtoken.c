@@ -0,0 +1,213 @@
+/*
+  testtoken.c - check the tokens tidySetTokenCallback() passes for a
+                few inputs, with and without inferred tags, that the
+                callback can stop a scan, and that a scan's memory
+                does not grow with the input
+
+  (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+  See tidy.h for the copyright notice.
+
+  Usage: testtoken
+
+  Built and run by testtoken.sh.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tidy.h"
+#include "buffio.h"
+
+typedef struct _TokenCase
+{
+    ctmbstr input;
+    Bool infer;
+    ctmbstr expected;   /* tokens as tokenRead() writes them */
+} TokenCase;
+
+static const TokenCase cases[] =
+{
+    { "<p>a<p>b<ul><li>x<li>y</ul>", no,
+      "<p> 'a' <p> 'b' <ul> <li> 'x' <li> 'y' </ul>" },
+    { "<p>a<p>b<ul><li>x<li>y</ul>", yes,
+      "<html> <body> <p> 'a' </p> <p> 'b' </p> <ul> <li> 'x' </li>"
+      " <li> 'y' </li> </ul> </body> </html>" },
+    { "<title>t</title><!-- c --><br>text", no,
+      "<title> 't' </title> <!--> <br> 'text'" },
+    { "<title>t</title><!-- c --><br>text", yes,
+      "<html> <head> <title> 't' </title> <!--> </head> <body> <br>"
+      " 'text' </body> </html>" },
+    { "<table><tr><td>1<td>2</table>", no,
+      "<table> <tr> <td> '1' <td> '2' </table>" },
+    { "<table><tr><td>1<td>2</table>", yes,
+      "<html> <body> <table> <tr> <td> '1' </td> <td> '2' </td> </tr>"
+      " </table> </body> </html>" },
+    { "<ul><li><b>x<li>y</ul>", yes,
+      "<html> <body> <ul> <li> <b> 'x' </b> </li> <li> 'y' </li> </ul>"
+      " </body> </html>" },
+    { "<p><b>x<div>y</div>", yes,
+      "<html> <body> <p> <b> 'x' </b> </p> <div> 'y' </div> </body>"
+      " </html>" },
+    { "<table><tr><td><i>a<td>b", yes,
+      "<html> <body> <table> <tr> <td> <i> 'a' </i> </td> <td> 'b' </td>"
+      " </tr> </table> </body> </html>" },
+    { NULL, no, NULL }
+};
+
+typedef struct _TokenCheck
+{
+    TidyBuffer tokens;  /* as read, unless only counted */
+    Bool counted;
+    uint count;
+    uint stopAt;        /* tokens to take before stopping, or 0 */
+} TokenCheck;
+
+static Bool TIDY_CALL tokenRead( TidyDoc tdoc, TidyNode tok )
+{
+    TokenCheck* check = (TokenCheck*) tidyGetAppData( tdoc );
+    ctmbstr name = tidyNodeGetName( tok );
+    TidyBuffer value;
+    char line[ 256 ];
+
+    ++check->count;
+    if ( check->counted )
+        return yes;
+
+    switch ( tidyNodeGetType(tok) )
+    {
+    case TidyNode_Start:
+        sprintf( line, "<%.200s>", name );
+        break;
+    case TidyNode_End:
+        sprintf( line, "</%.200s>", name );
+        break;
+    case TidyNode_StartEnd:
+        sprintf( line, "<%.200s/>", name );
+        break;
+    case TidyNode_Comment:
+        strcpy( line, "<!-->" );
+        break;
+    case TidyNode_Text:
+        tidyBufInit( &value );
+        tidyNodeGetValue( tdoc, tok, &value );
+        sprintf( line, "'%.*s'", (int) (value.size < 200 ? value.size : 200),
+                 value.bp ? (char*) value.bp : "" );
+        tidyBufFree( &value );
+        break;
+    default:
+        sprintf( line, "#%d", (int) tidyNodeGetType(tok) );
+        break;
+    }
+
+    if ( check->tokens.size > 0 )
+        tidyBufAppend( &check->tokens, " ", 1 );
+    tidyBufAppend( &check->tokens, line, (uint) strlen(line) );
+
+    return ( check->stopAt == 0 || check->count < check->stopAt );
+}
+
+/* scan input, returning the parse status and the peak memory */
+static int scanOne( TidyBuffer* input, Bool infer, TokenCheck* check,
+                    size_t* peak )
+{
+    TidyDoc tdoc = tidyCreate();
+    TidyBuffer errors;
+    int status;
+
+    tidyBufInit( &errors );
+    tidySetErrorBuffer( tdoc, &errors );
+    tidySetAppData( tdoc, check );
+    tidySetTokenCallback( tdoc, tokenRead, infer );
+
+    status = tidyParseBuffer( tdoc, input );
+    if ( peak )
+        *peak = tidyMemoryPeak( tdoc, TidyMemTotal );
+
+    tidyRelease( tdoc );
+    tidyBufFree( &errors );
+    return status;
+}
+
+static void setString( TidyBuffer* input, ctmbstr str )
+{
+    tidyBufClear( input );
+    tidyBufAppend( input, (void*) str, (uint) strlen(str) );
+}
+
+static Bool sameTokens( TokenCheck* check, ctmbstr expected )
+{
+    return check->tokens.size == strlen( expected ) &&
+           ( check->tokens.size == 0 ||
+             memcmp(check->tokens.bp, expected, check->tokens.size) == 0 );
+}
+
+int main( void )
+{
+    ctmbstr row = "<p>some text <b>bold</b> <a href=\"x.html\">link</a>\n";
+    TidyBuffer input;
+    TokenCheck check;
+    size_t peak, firstPeak = 0;
+    uint i, ncases, rows, bad = 0;
+
+    tidyBufInit( &input );
+
+    for ( i = 0; cases[i].input; ++i )
+    {
+        setString( &input, cases[i].input );
+        memset( &check, 0, sizeof(check) );
+        tidyBufInit( &check.tokens );
+
+        scanOne( &input, cases[i].infer, &check, NULL );
+        if ( !sameTokens(&check, cases[i].expected) )
+        {
+            tidyBufAppend( &check.tokens, "", 1 );
+            printf( "%s%s gave\n  %s\nnot\n  %s\n", cases[i].input,
+                    cases[i].infer ? " with inferred tags" : "",
+                    (char*) check.tokens.bp, cases[i].expected );
+            bad++;
+        }
+        tidyBufFree( &check.tokens );
+    }
+    ncases = i;
+
+    /* the callback stops the scan after the third token */
+    setString( &input, cases[1].input );
+    memset( &check, 0, sizeof(check) );
+    tidyBufInit( &check.tokens );
+    check.stopAt = 3;
+
+    if ( scanOne(&input, yes, &check, NULL) < 0 ||
+         !sameTokens(&check, "<html> <body> <p>") )
+    {
+        printf( "scan did not stop after three tokens\n" );
+        bad++;
+    }
+    tidyBufFree( &check.tokens );
+
+    /* a hundred times the input needs no more memory to scan */
+    for ( rows = 1000; rows <= 100000; rows *= 10 )
+    {
+        tidyBufClear( &input );
+        for ( i = 0; i < rows; ++i )
+            tidyBufAppend( &input, (void*) row, (uint) strlen(row) );
+
+        memset( &check, 0, sizeof(check) );
+        check.counted = yes;
+
+        scanOne( &input, yes, &check, &peak );
+        if ( firstPeak == 0 )
+            firstPeak = peak;
+        else if ( peak > firstPeak + firstPeak / 4 )
+        {
+            printf( "scanning %u rows took %lu bytes, %u rows %lu\n",
+                    rows, (ulong) peak, 1000, (ulong) firstPeak );
+            bad++;
+        }
+    }
+
+    tidyBufFree( &input );
+
+    printf( "%u token sequences, an early stop and memory for %u rows: %s\n",
+            ncases, rows / 10, bad ? "FAILED" : "as expected" );
+    return bad ? 1 : 0;
+}
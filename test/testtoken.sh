@@ -0,0 +1,33 @@
+#! /bin/sh
+
+#
+# testtoken.sh - build testtoken.c with the library sources and check
+#                the tokens tidySetTokenCallback() passes
+#
+# (c) 1998-2008 (W3C) MIT, ERCIM, Keio University
+# See tidy.c for the copyright notice.
+#
+# <URL:http://tidy.sourceforge.net/>
+#
+# Usage: testtoken.sh
+#
+# set -x
+
+VERSION='$Id'
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--g -O1}
+TESTTOKEN=./tmp/testtoken
+
+# Make sure output directory exists.
+if [ ! -d ./tmp ]
+then
+  mkdir ./tmp
+fi
+
+$CC $CFLAGS -I../include -o $TESTTOKEN testtoken.c ../src/*.c -lpthread \
+  || exit 1
+
+unset HTML_TIDY
+
+$TESTTOKEN